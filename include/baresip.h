@@ -76,7 +76,8 @@ enum sipansbeep {
 enum jbuf_type {
 	JBUF_OFF,
 	JBUF_FIXED,
-	JBUF_ADAPTIVE
+	JBUF_ADAPTIVE,
+	JBUF_FRAME      /**< Frame-aware, video only */
 };
 
 /** Defines the incoming out-of-dialog request mode */
@@ -234,6 +235,7 @@ bool call_refresh_allowed(const struct call *call);
 bool call_ack_pending(const struct call *call);
 int  call_transfer(struct call *call, const char *uri);
 int  call_replace_transfer(struct call *target_call, struct call *source_call);
+int  call_relay(struct call *call, struct call *peer, bool enable);
 int  call_status(struct re_printf *pf, const struct call *call);
 int  call_debug(struct re_printf *pf, const struct call *call);
 int  call_notify_sipfrag(struct call *call, uint16_t scode,
@@ -392,8 +394,11 @@ struct config_audio {
 	int dec_fmt;            /**< Audio decoder sample format    */
 	struct range buffer;    /**< Audio receive buffer in [ms]   */
 	bool adaptive;          /**< Enable adaptive audio buffer   */
+	bool stretch;           /**< Adapt by time-stretching       */
 	double silence;         /**< Silence volume in [dB]         */
 	uint32_t telev_pt;      /**< Payload type for tel.-event    */
+	bool txshare;           /**< Share encoder between calls    */
+	bool red;               /**< Send redundant audio (RFC 2198)*/
 };
 
 /** Video */
@@ -409,6 +414,12 @@ struct config_video {
 	double fps;             /**< Video framerate                */
 	bool fullscreen;        /**< Enable fullscreen display      */
 	int enc_fmt;            /**< Encoder pixelfmt (enum vidfmt) */
+	bool bwe;               /**< Congestion controlled bitrate  */
+	bool txshare;           /**< Share encoder between calls    */
+	uint32_t simulcast;     /**< Number of simulcast layers     */
+	bool fec;               /**< Send FEC stream (RFC 5109)     */
+	bool adaptive;          /**< Skip static frames and blocks  */
+	uint32_t enc_threads;   /**< Encoder threads of all calls   */
 };
 
 /** Audio/Video Transport */
@@ -430,6 +441,7 @@ struct config_avt {
 	uint32_t rtp_timeout;   /**< RTP Timeout in seconds (0=off) */
 	bool bundle;            /**< Media Multiplexing (BUNDLE)    */
 	enum rtp_receive_mode rxmode;   /**< RTP RX processing mode */
+	bool lattrace;          /**< Per-frame latency tracing      */
 };
 
 /** Network Configuration */
@@ -634,6 +646,45 @@ int auplay_alloc(struct auplay_st **stp, struct list *auplayl,
 		 auplay_write_h *wh, void *arg);
 
 
+/*
+ * Audio sample format conversion
+ */
+
+int  aufmt_convert(int dst_fmt, void *dstv, int src_fmt, const void *srcv,
+		   size_t sampc);
+void aufmt_interleave(float *dstv, float * const *srcv, uint8_t ch,
+		      size_t frames);
+void aufmt_deinterleave(float * const *dstv, const float *srcv, uint8_t ch,
+			size_t frames);
+
+
+/*
+ * Polyphase audio resampler
+ */
+
+struct aupoly;
+
+int    aupoly_alloc(struct aupoly **rsp, uint32_t irate, uint8_t ich,
+		    uint32_t orate, uint8_t och);
+int    aupoly_process(struct aupoly *rs, void *outv, size_t *outc,
+		      const void *inv, size_t inc, int fmt);
+size_t aupoly_outc(const struct aupoly *rs, size_t inc);
+void   aupoly_reset(struct aupoly *rs);
+
+
+/*
+ * Audio frame arena
+ */
+
+struct auarena;
+
+int      auarena_alloc(struct auarena **arp, size_t slotsz, unsigned slotc);
+void     auarena_reset(struct auarena *ar);
+void    *auarena_get(struct auarena *ar, size_t sz);
+uint64_t auarena_misses(const struct auarena *ar);
+size_t   auarena_slotsz(const struct auarena *ar);
+
+
 /*
  * Audio Filter
  */
@@ -656,6 +707,7 @@ struct aufilt_prm {
 	uint32_t srate;       /**< Sampling rate in [Hz]        */
 	uint8_t  ch;          /**< Number of channels           */
 	int      fmt;         /**< Sample format (enum aufmt)   */
+	struct auarena *arena; /**< Frame arena, or NULL        */
 };
 
 typedef int (aufilt_encupd_h)(struct aufilt_enc_st **stp, void **ctx,
@@ -670,6 +722,9 @@ typedef int (aufilt_decupd_h)(struct aufilt_dec_st **stp, void **ctx,
 typedef int (aufilt_decode_h)(struct aufilt_dec_st *st,
 			      struct auframe *af);
 
+/** Sample format bit for the native formats of an Audio Filter */
+#define AUFILT_FMT(fmt) (1u << (fmt))
+
 struct aufilt {
 	struct le le;
 	const char *name;
@@ -677,6 +732,7 @@ struct aufilt {
 	aufilt_encode_h *ench;
 	aufilt_decupd_h *decupdh;
 	aufilt_decode_h *dech;
+	uint32_t fmts;        /**< Native sample formats, 0 for any */
 };
 
 void aufilt_register(struct list *aufiltl, struct aufilt *af);
@@ -1131,6 +1187,7 @@ int vidsrc_alloc(struct vidsrc_st **stp, struct list *vidsrcl,
 
 struct vidisp;
 struct vidisp_st;
+struct vidframe_hw;
 
 /** Video Display parameters */
 struct vidisp_prm {
@@ -1147,6 +1204,9 @@ typedef int  (vidisp_update_h)(struct vidisp_st *st, bool fullscreen,
 			       int orient, const struct vidrect *window);
 typedef int  (vidisp_disp_h)(struct vidisp_st *st, const char *title,
 			     const struct vidframe *frame, uint64_t timestamp);
+typedef int  (vidisp_disphw_h)(struct vidisp_st *st, const char *title,
+			       const struct vidframe_hw *hw,
+			       uint64_t timestamp);
 typedef void (vidisp_hide_h)(struct vidisp_st *st);
 
 /** Defines a Video display */
@@ -1157,6 +1217,7 @@ struct vidisp {
 	vidisp_update_h *updateh;
 	vidisp_disp_h   *disph;
 	vidisp_hide_h   *hideh;
+	vidisp_disphw_h *disphwh;  /**< Display hardware frame (optional) */
 };
 
 int vidisp_register(struct vidisp **vp, struct list *vidispl, const char *name,
@@ -1245,6 +1306,22 @@ struct viddec_packet {
 	const struct rtp_header *hdr; /**< RTP Header                        */
 	uint64_t timestamp;	      /**< Timestamp in VIDEO_TIMEBASE units */
 	struct mbuf *mb;	      /**< RTP Buffer memory                 */
+	struct vidframe_hw *hw;       /**< Hardware frame, NULL=not accepted */
+};
+
+typedef int (vidframe_hw_download_h)(struct vidframe *dst,
+				     const struct vidframe_hw *hw);
+
+/**
+ * Decoded frame in a hardware surface. The surface is owned by the
+ * decoder and is valid until the next call to its decode handler.
+ */
+struct vidframe_hw {
+	const char *type;             /**< Surface type, e.g. "vaapi"       */
+	void *surface;                /**< Surface reference, NULL=none     */
+	struct vidsz size;            /**< Picture size                     */
+	enum vidfmt fmt;              /**< Pixel format in system memory    */
+	vidframe_hw_download_h *downloadh; /**< Download to system memory  */
 };
 
 typedef int (videnc_packet_h)(bool marker, uint64_t rtp_ts,
@@ -1264,6 +1341,19 @@ typedef int (videnc_encode_h)(struct videnc_state *ves, bool update,
 typedef int (videnc_packetize_h)(struct videnc_state *ves,
 				 const struct vidpacket *packet);
 
+/** Changed blocks of a frame, in macroblocks of 16 x 16 pixels */
+struct vidactmap {
+	const uint8_t *map;  /**< One byte per block, 0=static, NULL=all   */
+	unsigned cols;       /**< Number of block columns                  */
+	unsigned rows;       /**< Number of block rows                     */
+};
+
+typedef int (videnc_actmap_h)(struct videnc_state *ves,
+			      const struct vidactmap *map);
+
+typedef int (videnc_debug_h)(struct re_printf *pf,
+			     const struct videnc_state *ves);
+
 typedef int(viddec_update_h)(struct viddec_state **vdsp,
 			     const struct vidcodec *vc, const char *fmtp,
 			     const struct video *vid);
@@ -1284,6 +1374,8 @@ struct vidcodec {
 	sdp_fmtp_enc_h *fmtp_ench;
 	sdp_fmtp_cmp_h *fmtp_cmph;
 	videnc_packetize_h *packetizeh;
+	videnc_actmap_h *actmaph;  /**< Skip static blocks (optional) */
+	videnc_debug_h *encdebugh; /**< Encoder debug (optional)      */
 };
 
 void vidcodec_register(struct list *vidcodecl, struct vidcodec *vc);
@@ -1294,6 +1386,8 @@ const struct vidcodec *vidcodec_find_encoder(const struct list *vidcodecl,
 					     const char *name);
 const struct vidcodec *vidcodec_find_decoder(const struct list *vidcodecl,
 					     const char *name);
+unsigned videnc_threads_alloc(unsigned want);
+void     videnc_threads_free(unsigned n);
 
 
 /*
@@ -1334,6 +1428,9 @@ typedef int (vidfilt_decupd_h)(struct vidfilt_dec_st **stp, void **ctx,
 			       const struct video *vid);
 typedef int (vidfilt_decode_h)(struct vidfilt_dec_st *st,
 			       struct vidframe *frame, uint64_t *timestamp);
+typedef int (vidfilt_dechw_h)(struct vidfilt_dec_st *st,
+			      const struct vidframe_hw *hw,
+			      uint64_t *timestamp);
 
 struct vidfilt {
 	struct le le;
@@ -1342,6 +1439,7 @@ struct vidfilt {
 	vidfilt_encode_h *ench;
 	vidfilt_decupd_h *decupdh;
 	vidfilt_decode_h *dech;
+	vidfilt_dechw_h *dechwh;  /**< Accepts hardware frames (optional) */
 };
 
 void vidfilt_register(struct list *vidfiltl, struct vidfilt *vf);
@@ -1363,6 +1461,15 @@ struct stream_param;
 struct mnat;
 struct mnat_sess;
 
+/** Audio stream statistics */
+struct audio_stat {
+	uint64_t tx_overrun;    /**< Source buffer overruns           */
+	uint64_t tx_underrun;   /**< Source buffer underruns          */
+	uint64_t rx_discard;    /**< Discarded incoming packets       */
+	uint64_t rx_latency;    /**< Playout buffer latency in [ms]   */
+	int32_t rx_jitter;      /**< Auframe push jitter in [us]      */
+};
+
 typedef void (audio_event_h)(int key, bool end, void *arg);
 typedef void (audio_level_h)(bool tx, double lvl, void *arg);
 typedef void (audio_err_h)(int err, const char *str, void *arg);
@@ -1384,6 +1491,7 @@ int  audio_set_player(struct audio *au, const char *mod, const char *device);
 void audio_level_put(const struct audio *au, bool tx, double lvl);
 int  audio_level_get(const struct audio *au, double *level);
 int  audio_debug(struct re_printf *pf, const struct audio *a);
+int  audio_stats(const struct audio *a, struct audio_stat *st);
 struct stream *audio_strm(const struct audio *au);
 uint64_t audio_jb_current_value(const struct audio *au);
 int  audio_set_bitrate(struct audio *au, uint32_t bitrate);
@@ -1446,6 +1554,8 @@ double video_calc_seconds(uint64_t rtp_ts);
 double video_timestamp_to_seconds(uint64_t timestamp);
 uint64_t video_calc_rtp_timestamp_fix(uint64_t timestamp);
 uint64_t video_calc_timebase_timestamp(uint64_t rtp_ts);
+int vidframe_hw_download(struct vidframe **framep,
+			 const struct vidframe_hw *hw);
 
 
 /*
@@ -1504,7 +1614,11 @@ const char *stream_cname(const struct stream *strm);
 const char *stream_peer(const struct stream *strm);
 int  stream_bundle_init(struct stream *strm, bool offerer);
 int  stream_debug(struct re_printf *pf, const struct stream *s);
+int  stream_latency_debug(struct re_printf *pf, const struct stream *s);
+void stream_latency_reset(struct stream *s);
 void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms);
+int  stream_relay_start(struct stream *src, struct stream *dst);
+void stream_relay_stop(struct stream *src);
 
 
 /**
@@ -1527,8 +1641,12 @@ struct jbuf_stat {
 };
 
 
+/** Defines the jitter buffer clock handler, returns the time in [ms] */
+typedef uint64_t (jbuf_clock_h)(void *arg);
+
 int  jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max);
 int  jbuf_set_type(struct jbuf *jb, enum jbuf_type jbtype);
+void jbuf_set_clock(struct jbuf *jb, jbuf_clock_h *clockh, void *arg);
 int  jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem);
 int  jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem);
 int  jbuf_drain(struct jbuf *jb, struct rtp_header *hdr, void **mem);
@@ -1539,6 +1657,16 @@ uint32_t jbuf_frames(const struct jbuf *jb);
 uint32_t jbuf_packets(const struct jbuf *jb);
 
 
+/*
+ * OpenMetrics
+ */
+
+struct openmetrics;
+
+int openmetrics_alloc(struct openmetrics **omp);
+int openmetrics_encode(struct openmetrics *om, struct mbuf *mb);
+
+
 /*
  * STUN URI
  */
@@ -23,6 +23,18 @@
   audio_player            aubridge,pseudo0
   audio_source            aubridge,pseudo0
  \endverbatim
+ *
+ * With the device prefix "bus:" any number of players and sources can be
+ * attached to a named conference bus. A player and a source with the same
+ * member key "bus:<name>/<key>" form one leg: the source receives the mix
+ * of all players except its own (mix-minus), e.g. with the account
+ * parameters:
+ *
+ \verbatim
+  ;audio_player=aubridge,bus:conf1/alice;audio_source=aubridge,bus:conf1/alice
+ \endverbatim
+ *
+ * A source without a key receives the mix of all players.
  */
 
 
@@ -30,13 +42,15 @@ static struct ausrc *ausrc;
 static struct auplay *auplay;
 
 struct hash *aubridge_ht_device;
+struct hash *aubridge_ht_bus;
 
 
 static int module_init(void)
 {
 	int err;
 
-	err = hash_alloc(&aubridge_ht_device, 32);
+	err  = hash_alloc(&aubridge_ht_device, 32);
+	err |= hash_alloc(&aubridge_ht_bus, 32);
 	if (err)
 		return err;
 
@@ -55,6 +69,7 @@ static int module_close(void)
 	auplay = mem_deref(auplay);
 
 	aubridge_ht_device = mem_deref(aubridge_ht_device);
+	aubridge_ht_bus    = mem_deref(aubridge_ht_bus);
 
 	return 0;
 }
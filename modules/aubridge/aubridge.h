@@ -5,10 +5,16 @@
  */
 
 
+/** Device name prefix of a conference bus */
+#define BUS_PREFIX "bus:"
+
+
 struct device;
+struct bus_member;
 
 struct ausrc_st {
 	struct device *dev;
+	struct bus_member *bm;
 	struct ausrc_prm prm;
 	ausrc_read_h *rh;
 	void *arg;
@@ -16,6 +22,7 @@ struct ausrc_st {
 
 struct auplay_st {
 	struct device *dev;
+	struct bus_member *bm;
 	struct auplay_prm prm;
 	auplay_write_h *wh;
 	void *arg;
@@ -23,6 +30,7 @@ struct auplay_st {
 
 
 extern struct hash *aubridge_ht_device;
+extern struct hash *aubridge_ht_bus;
 
 
 int aubridge_play_alloc(struct auplay_st **stp, const struct auplay *ap,
@@ -36,3 +44,8 @@ int aubridge_src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 int  aubridge_device_connect(struct device **devp, const char *device,
 			     struct auplay_st *auplay, struct ausrc_st *ausrc);
 void aubridge_device_stop(struct device *dev);
+
+
+int  aubridge_bus_attach(struct bus_member **mp, const char *device,
+			 const struct auplay_st *auplay,
+			 const struct ausrc_st *ausrc);
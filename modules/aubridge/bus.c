@@ -0,0 +1,480 @@
+/**
+ * @file bus.c Audio bridge -- conference mixing bus
+ *
+ * Any number of players (writers) and sources (readers) can attach to a
+ * named bus. One clocked thread per bus pulls one packet-time from every
+ * writer, sums all of them in an accumulator and delivers the sum minus
+ * the paired writer (mix-minus) to every reader.
+ *
+ * The device name "bus:<name>/<key>" gives the member a key. A player and
+ * a source with the same key are one conference leg and are paired, so
+ * the source does not hear its own player. Members without a key hear the
+ * whole mix.
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re_atomic.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "aubridge.h"
+
+
+/* The packet-time is fixed to 20 milliseconds */
+enum {PTIME = 20};
+
+
+struct bus {
+	struct le le;
+	char name[64];
+	struct list writerl;       /**< Members with a player          */
+	struct list readerl;       /**< Members with a source          */
+	uint32_t srate;            /**< Sampling rate [Hz]             */
+	uint8_t ch;                /**< Number of channels             */
+	enum aufmt fmt;            /**< Sample format                  */
+	size_t sampc;              /**< Samples per packet-time        */
+	void *accv;                /**< Accumulator, 32-bit per sample */
+	void *outv;                /**< Mix-minus output               */
+	mtx_t *mtx;                /**< Protects lists and buffers     */
+	thrd_t thread;
+	RE_ATOMIC bool run;
+};
+
+struct bus_member {
+	struct le le;
+	struct bus *bus;
+	const struct auplay_st *auplay; /**< Writer, or NULL           */
+	const struct ausrc_st *ausrc;   /**< Reader, or NULL           */
+	char key[64];                   /**< Conference leg, or empty  */
+	struct bus_member *peer;        /**< Paired member             */
+	void *sampv;                    /**< Samples of current period */
+};
+
+
+static void bus_stop(struct bus *bus)
+{
+	if (re_atomic_rlx(&bus->run)) {
+		re_atomic_rlx_set(&bus->run, false);
+		thrd_join(bus->thread, NULL);
+	}
+}
+
+
+static void bus_destructor(void *arg)
+{
+	struct bus *bus = arg;
+
+	bus_stop(bus);
+
+	list_unlink(&bus->le);
+	mem_deref(bus->accv);
+	mem_deref(bus->outv);
+	mem_deref(bus->mtx);
+}
+
+
+static void member_destructor(void *arg)
+{
+	struct bus_member *m = arg;
+	struct bus *bus = m->bus;
+	bool empty;
+
+	mtx_lock(bus->mtx);
+
+	list_unlink(&m->le);
+	if (m->peer)
+		m->peer->peer = NULL;
+
+	empty = !list_head(&bus->writerl) && !list_head(&bus->readerl);
+
+	mtx_unlock(bus->mtx);
+
+	if (empty)
+		bus_stop(bus);
+
+	mem_deref(m->sampv);
+	mem_deref(bus);
+}
+
+
+static bool list_apply_handler(struct le *le, void *arg)
+{
+	struct bus *bus = le->data;
+
+	return 0 == str_cmp(bus->name, arg);
+}
+
+
+static struct bus *find_bus(const char *name)
+{
+	return list_ledata(hash_lookup(aubridge_ht_bus,
+				       hash_joaat_str(name),
+				       list_apply_handler, (void *)name));
+}
+
+
+/*
+ * The mixing loops have no branches and no dependencies between
+ * samples, so that the compiler can vectorize them.
+ */
+static void acc_s16(int32_t *accv, const int16_t *sampv, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		accv[i] += sampv[i];
+}
+
+
+static void acc_float(float *accv, const float *sampv, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		accv[i] += sampv[i];
+}
+
+
+static void minus_s16(int16_t *outv, const int32_t *accv,
+		      const int16_t *ownv, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		int32_t v = accv[i] - ownv[i];
+
+		v = v > 32767 ? 32767 : v;
+		v = v < -32768 ? -32768 : v;
+
+		outv[i] = (int16_t)v;
+	}
+}
+
+
+static void sat_s16(int16_t *outv, const int32_t *accv, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		int32_t v = accv[i];
+
+		v = v > 32767 ? 32767 : v;
+		v = v < -32768 ? -32768 : v;
+
+		outv[i] = (int16_t)v;
+	}
+}
+
+
+static void minus_float(float *outv, const float *accv, const float *ownv,
+			size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		float v = accv[i] - ownv[i];
+
+		v = v > 1.0f ? 1.0f : v;
+		v = v < -1.0f ? -1.0f : v;
+
+		outv[i] = v;
+	}
+}
+
+
+static void sat_float(float *outv, const float *accv, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		float v = accv[i];
+
+		v = v > 1.0f ? 1.0f : v;
+		v = v < -1.0f ? -1.0f : v;
+
+		outv[i] = v;
+	}
+}
+
+
+static void bus_mix(struct bus *bus, uint64_t ts)
+{
+	const size_t n = bus->sampc;
+	struct auframe af;
+	struct le *le;
+
+	memset(bus->accv, 0, n * sizeof(int32_t));
+
+	LIST_FOREACH(&bus->writerl, le) {
+		struct bus_member *m = le->data;
+
+		if (!m->auplay->wh) {
+			memset(m->sampv, 0, n * aufmt_sample_size(bus->fmt));
+			continue;
+		}
+
+		auframe_init(&af, bus->fmt, m->sampv, n, bus->srate,
+			     bus->ch);
+		af.timestamp = ts * 1000;
+
+		m->auplay->wh(&af, m->auplay->arg);
+
+		if (bus->fmt == AUFMT_FLOAT)
+			acc_float(bus->accv, m->sampv, n);
+		else
+			acc_s16(bus->accv, m->sampv, n);
+	}
+
+	LIST_FOREACH(&bus->readerl, le) {
+		struct bus_member *m = le->data;
+		const void *ownv = m->peer ? m->peer->sampv : NULL;
+
+		if (!m->ausrc->rh)
+			continue;
+
+		if (bus->fmt == AUFMT_FLOAT) {
+			if (ownv)
+				minus_float(bus->outv, bus->accv, ownv, n);
+			else
+				sat_float(bus->outv, bus->accv, n);
+		}
+		else {
+			if (ownv)
+				minus_s16(bus->outv, bus->accv, ownv, n);
+			else
+				sat_s16(bus->outv, bus->accv, n);
+		}
+
+		auframe_init(&af, bus->fmt, bus->outv, n, bus->srate,
+			     bus->ch);
+		af.timestamp = ts * 1000;
+
+		m->ausrc->rh(&af, m->ausrc->arg);
+	}
+}
+
+
+static int bus_thread(void *arg)
+{
+	uint64_t now, ts = tmr_jiffies();
+	struct bus *bus = arg;
+
+	info("aubridge: bus '%s' start: %u Hz, %u channels, format=%s\n",
+	     bus->name, bus->srate, bus->ch, aufmt_name(bus->fmt));
+
+	while (re_atomic_rlx(&bus->run)) {
+
+		(void)sys_msleep(4);
+
+		if (!re_atomic_rlx(&bus->run))
+			break;
+
+		now = tmr_jiffies();
+
+		if (ts > now)
+			continue;
+
+		mtx_lock(bus->mtx);
+		bus_mix(bus, ts);
+		mtx_unlock(bus->mtx);
+
+		ts += PTIME;
+	}
+
+	return 0;
+}
+
+
+static int bus_alloc(struct bus **busp, const char *name)
+{
+	struct bus *bus;
+	int err;
+
+	bus = mem_zalloc(sizeof(*bus), bus_destructor);
+	if (!bus)
+		return ENOMEM;
+
+	str_ncpy(bus->name, name, sizeof(bus->name));
+
+	err = mutex_alloc(&bus->mtx);
+	if (err) {
+		mem_deref(bus);
+		return err;
+	}
+
+	hash_append(aubridge_ht_bus, hash_joaat_str(name), &bus->le, bus);
+
+	info("aubridge: created bus '%s'\n", name);
+
+	*busp = bus;
+
+	return 0;
+}
+
+
+/* The first member sets the parameters, all others must match */
+static int bus_set_prm(struct bus *bus, uint32_t srate, uint8_t ch,
+		       enum aufmt fmt)
+{
+	size_t sampc;
+
+	if (list_head(&bus->writerl) || list_head(&bus->readerl)) {
+
+		if (srate != bus->srate || ch != bus->ch || fmt != bus->fmt) {
+			warning("aubridge: bus '%s': incompatible "
+				"parameters\n", bus->name);
+			return EINVAL;
+		}
+
+		return 0;
+	}
+
+	if (fmt != AUFMT_S16LE && fmt != AUFMT_FLOAT) {
+		warning("aubridge: bus '%s': unsupported format %s\n",
+			bus->name, aufmt_name(fmt));
+		return ENOTSUP;
+	}
+
+	sampc = (size_t)srate * ch * PTIME / 1000;
+
+	bus->accv = mem_deref(bus->accv);
+	bus->outv = mem_deref(bus->outv);
+
+	/* note: int32_t and float have the same size */
+	bus->accv = mem_zalloc(sampc * sizeof(int32_t), NULL);
+	bus->outv = mem_zalloc(sampc * aufmt_sample_size(fmt), NULL);
+	if (!bus->accv || !bus->outv)
+		return ENOMEM;
+
+	bus->srate = srate;
+	bus->ch    = ch;
+	bus->fmt   = fmt;
+	bus->sampc = sampc;
+
+	return 0;
+}
+
+
+/* Pair with the unpaired member of the other kind that has the same key */
+static void member_pair(struct bus_member *m, struct list *lst)
+{
+	struct le *le;
+
+	if (!str_isset(m->key))
+		return;
+
+	LIST_FOREACH(lst, le) {
+		struct bus_member *p = le->data;
+
+		if (p->peer || 0 != str_cmp(p->key, m->key))
+			continue;
+
+		m->peer = p;
+		p->peer = m;
+		break;
+	}
+}
+
+
+/**
+ * Attach a player or a source to a conference bus
+ *
+ * @param mp     Pointer to allocated bus member
+ * @param device Bus name and optional member key, "<name>[/<key>]"
+ * @param auplay Audio player, or NULL
+ * @param ausrc  Audio source, or NULL
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aubridge_bus_attach(struct bus_member **mp, const char *device,
+			const struct auplay_st *auplay,
+			const struct ausrc_st *ausrc)
+{
+	struct bus_member *m;
+	struct bus *bus;
+	char name[64];
+	const char *key;
+	size_t len;
+	uint32_t srate;
+	uint8_t ch;
+	int fmt;
+	int err;
+
+	if (!mp || (!auplay == !ausrc))
+		return EINVAL;
+	if (!str_isset(device))
+		return ENODEV;
+
+	key = strchr(device, '/');
+	len = key ? (size_t)(key - device) : str_len(device);
+	if (!len)
+		return ENODEV;
+
+	str_ncpy(name, device, min(len + 1, sizeof(name)));
+
+	srate = auplay ? auplay->prm.srate : ausrc->prm.srate;
+	ch    = auplay ? auplay->prm.ch    : ausrc->prm.ch;
+	fmt   = auplay ? auplay->prm.fmt   : ausrc->prm.fmt;
+
+	bus = find_bus(name);
+	if (bus) {
+		mem_ref(bus);
+	}
+	else {
+		err = bus_alloc(&bus, name);
+		if (err)
+			return err;
+	}
+
+	m = mem_zalloc(sizeof(*m), NULL);
+	if (!m) {
+		mem_deref(bus);
+		return ENOMEM;
+	}
+
+	m->bus    = bus;
+	m->auplay = auplay;
+	m->ausrc  = ausrc;
+
+	if (key)
+		str_ncpy(m->key, key + 1, sizeof(m->key));
+
+	mtx_lock(bus->mtx);
+
+	err = bus_set_prm(bus, srate, ch, fmt);
+	if (err)
+		goto unlock;
+
+	if (auplay) {
+		m->sampv = mem_zalloc(bus->sampc * aufmt_sample_size(fmt),
+				      NULL);
+		if (!m->sampv) {
+			err = ENOMEM;
+			goto unlock;
+		}
+
+		member_pair(m, &bus->readerl);
+		list_append(&bus->writerl, &m->le, m);
+	}
+	else {
+		member_pair(m, &bus->writerl);
+		list_append(&bus->readerl, &m->le, m);
+	}
+
+	mem_destructor(m, member_destructor);
+
+ unlock:
+	mtx_unlock(bus->mtx);
+
+	if (err) {
+		mem_deref(m->sampv);
+		mem_deref(m);
+		mem_deref(bus);
+		return err;
+	}
+
+	if (!re_atomic_rlx(&bus->run)) {
+
+		re_atomic_rlx_set(&bus->run, true);
+		err = thread_create_name(&bus->thread, "aubridge bus",
+					 bus_thread, bus);
+		if (err) {
+			re_atomic_rlx_set(&bus->run, false);
+			mem_deref(m);
+			return err;
+		}
+	}
+
+	*mp = m;
+
+	return 0;
+}
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Alfred E. Heggestad
  */
+#include <string.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -16,6 +17,7 @@ static void auplay_destructor(void *arg)
 	aubridge_device_stop(st->dev);
 
 	mem_deref(st->dev);
+	mem_deref(st->bm);
 }
 
 
@@ -37,7 +39,15 @@ int aubridge_play_alloc(struct auplay_st **stp, const struct auplay *ap,
 	st->wh  = wh;
 	st->arg = arg;
 
-	err = aubridge_device_connect(&st->dev, device, st, NULL);
+	if (str_isset(device) &&
+	    0 == strncmp(device, BUS_PREFIX, sizeof(BUS_PREFIX) - 1)) {
+		err = aubridge_bus_attach(&st->bm,
+					  device + sizeof(BUS_PREFIX) - 1,
+					  st, NULL);
+	}
+	else {
+		err = aubridge_device_connect(&st->dev, device, st, NULL);
+	}
 	if (err)
 		goto out;
 
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Alfred E. Heggestad
  */
+#include <string.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -16,6 +17,7 @@ static void ausrc_destructor(void *arg)
 	aubridge_device_stop(st->dev);
 
 	mem_deref(st->dev);
+	mem_deref(st->bm);
 }
 
 
@@ -38,7 +40,15 @@ int aubridge_src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 	st->rh   = rh;
 	st->arg  = arg;
 
-	err = aubridge_device_connect(&st->dev, device, NULL, st);
+	if (str_isset(device) &&
+	    0 == strncmp(device, BUS_PREFIX, sizeof(BUS_PREFIX) - 1)) {
+		err = aubridge_bus_attach(&st->bm,
+					  device + sizeof(BUS_PREFIX) - 1,
+					  NULL, st);
+	}
+	else {
+		err = aubridge_device_connect(&st->dev, device, NULL, st);
+	}
 	if (err)
 		goto out;
 
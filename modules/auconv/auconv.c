@@ -13,6 +13,7 @@ struct auconv_enc {
 	struct aufilt_enc_st af;  /* base class */
 
 	enum aufmt target_fmt;
+	struct auarena *arena;
 	void *buf;
 	size_t sampc;
 };
@@ -32,6 +33,7 @@ static void enc_destructor(void *arg)
 	struct auconv_enc *st = arg;
 
 	list_unlink(&st->af.le);
+	mem_deref(st->arena);
 	mem_deref(st->buf);
 }
 
@@ -62,6 +64,7 @@ static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 		return EINVAL;
 
 	st->target_fmt = conf_config()->audio.enc_fmt;
+	st->arena      = mem_ref(prm->arena);
 
 	*stp = (struct aufilt_enc_st *)st;
 
@@ -129,9 +132,13 @@ static int encode_frame(struct aufilt_enc_st *st, struct auframe *af)
 
 	if (af->fmt != ac->target_fmt) {
 
-		if (!ac->buf || af->sampc != ac->sampc) {
+		size_t sz = aufmt_sample_size(ac->target_fmt);
+		void *buf = auarena_get(ac->arena, af->sampc * sz);
 
-			size_t sz = aufmt_sample_size(ac->target_fmt);
+		if (buf)
+			return process_frame(buf, ac->target_fmt, af);
+
+		if (!ac->buf || af->sampc != ac->sampc) {
 
 			ac->buf = mem_reallocarray(ac->buf, af->sampc,
 						   sz, NULL);
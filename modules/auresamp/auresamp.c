@@ -33,11 +33,13 @@ struct auresamp_st {
 		struct aufilt_dec_st daf;
 	} u;                     /* inheritance                              */
 
-	int16_t *sampv;          /* s16le audio data buffer                  */
-	int16_t *rsampv;         /* resampled data                           */
+	void *rsampv;            /* resampled data                           */
 	size_t rsampsz;          /* size of rsampv buffer                    */
-	struct auresamp resamp;  /* resampler                                */
+	struct aupoly *rs;       /* polyphase resampler                      */
+	uint32_t irate;          /* input sampling rate of the resampler     */
+	uint8_t ich;             /* input channels of the resampler          */
 	struct aufilt_prm oprm;  /* filter output parameters                 */
+	struct auarena *arena;   /* frame arena, or NULL                     */
 	const char *dbg;         /* debugging "encoder"/"decoder"            */
 };
 
@@ -47,7 +49,8 @@ static void common_destructor(void *arg)
 	struct auresamp_st *st = arg;
 
 	mem_deref(st->rsampv);
-	mem_deref(st->sampv);
+	mem_deref(st->rs);
+	mem_deref(st->arena);
 }
 
 
@@ -69,38 +72,17 @@ static void dec_destructor(void *arg)
 }
 
 
-static int sampv_alloc(struct auresamp_st *st, struct auframe *af)
+static size_t rsampv_size(const struct auresamp_st *st,
+			  const struct auframe *af)
 {
-	size_t psize_out;
-	size_t psize;
-
-	/* s16le used internally */
-	psize = af->sampc * af->ch * 2;
-
-	/* output format == input format */
-	psize_out = aufmt_sample_size(af->fmt) * af->sampc *
-			st->oprm.srate * st->oprm.ch / (af->srate * af->ch);
-
-	st->sampv = mem_zalloc(max(psize, psize_out), NULL);
-
-	if (!st->sampv)
-		return ENOMEM;
-
-	return 0;
+	return aupoly_outc(st->rs, af->sampc) * aufmt_sample_size(af->fmt);
 }
 
 
 static int rsampv_check_size(struct auresamp_st *st, struct auframe *af)
 {
-	uint64_t ptime;
-	size_t psize;
-
-	ptime = af->sampc * 1000 / af->srate;
-	psize = ptime * st->oprm.srate * st->oprm.ch *
-		aufmt_sample_size(af->fmt) / 1000;
+	size_t psize = rsampv_size(st, af);
 
-	/* auresamp minimum output size is the input size */
-	psize = max(psize, auframe_size(af));
 	if (st->rsampsz < psize) {
 		st->rsampsz = 0;
 		st->rsampv = mem_deref(st->rsampv);
@@ -115,18 +97,23 @@ static int rsampv_check_size(struct auresamp_st *st, struct auframe *af)
 }
 
 
-static int resamp_setup(struct auresamp_st *st, struct auframe *af)
+/* Take the output buffer from the frame arena, or from the filter state */
+static void *rsampv_get(struct auresamp_st *st, struct auframe *af,
+			size_t *rsampcp)
 {
-	int err = 0;
+	size_t sz = rsampv_size(st, af);
+	void *rsampv = auarena_get(st->arena, sz);
 
-	err = auresamp_setup(&st->resamp, af->srate, af->ch,
-			     st->oprm.srate, st->oprm.ch);
-	if (err) {
-		warning("resample: auresamp_setup error (%m)\n", err);
-		return err;
+	if (rsampv) {
+		*rsampcp = sz / aufmt_sample_size(af->fmt);
+		return rsampv;
 	}
 
-	return rsampv_check_size(st, af);
+	if (rsampv_check_size(st, af))
+		return NULL;
+
+	*rsampcp = st->rsampsz / aufmt_sample_size(af->fmt);
+	return st->rsampv;
 }
 
 
@@ -147,8 +134,8 @@ static int common_update(struct auresamp_st **stp, struct aufilt_prm *oprm,
 	if (!st)
 		return ENOMEM;
 
-	st->oprm = *oprm;
-	auresamp_init(&st->resamp);
+	st->oprm  = *oprm;
+	st->arena = mem_ref(oprm->arena);
 
 	*stp = st;
 	return 0;
@@ -157,8 +144,8 @@ static int common_update(struct auresamp_st **stp, struct aufilt_prm *oprm,
 
 static int common_resample(struct auresamp_st *st, struct auframe *af)
 {
+	void *rsampv;
 	size_t rsampc;
-	int16_t *sampv;
 	int err = 0;
 
 	if (st->dbg) {
@@ -173,48 +160,43 @@ static int common_resample(struct auresamp_st *st, struct auframe *af)
 	if (st->oprm.srate == af->srate && st->oprm.ch == af->ch) {
 		st->rsampsz = 0;
 		st->rsampv = mem_deref(st->rsampv);
-		st->sampv  = mem_deref(st->sampv);
+		st->rs = mem_deref(st->rs);
 		return 0;
 	}
 
-	sampv  = af->sampv;
-	if (af->fmt != AUFMT_S16LE) {
-		if (!st->sampv)
-			err = sampv_alloc(st, af);
-
-		if (err)
+	/* the resampler works on s16le and float, the core converts */
+	if (af->fmt != AUFMT_S16LE && af->fmt != AUFMT_FLOAT)
+		return ENOTSUP;
+
+	/* the resampler keeps the filter history between the frames */
+	if (!st->rs || st->irate != af->srate || st->ich != af->ch) {
+		st->rs = mem_deref(st->rs);
+		err = aupoly_alloc(&st->rs, af->srate, af->ch,
+				   st->oprm.srate, st->oprm.ch);
+		if (err) {
+			warning("resample: aupoly_alloc error (%m)\n", err);
 			return err;
+		}
 
-		auconv_to_s16(st->sampv, af->fmt, af->sampv, af->sampc);
-		sampv = st->sampv;
+		st->irate = af->srate;
+		st->ich   = af->ch;
 	}
 
-	if (st->resamp.irate != af->srate || st->resamp.ich != af->ch)
-		err = resamp_setup(st, af);
-	else
-		err = rsampv_check_size(st, af);
-
-	if (err)
-		return err;
+	rsampv = rsampv_get(st, af, &rsampc);
+	if (!rsampv)
+		return ENOMEM;
 
-	rsampc = st->rsampsz / 2;
-	err = auresamp(&st->resamp, st->rsampv, &rsampc, sampv, af->sampc);
+	err = aupoly_process(st->rs, rsampv, &rsampc, af->sampv, af->sampc,
+			     af->fmt);
 	if (err) {
-		warning("resample: auresamp error (%m)\n", err);
+		warning("resample: aupoly_process error (%m)\n", err);
 		return err;
 	}
 
+	af->sampv = rsampv;
 	af->sampc = rsampc;
-	af->fmt   = st->oprm.fmt;
 	af->srate = st->oprm.srate;
 	af->ch    = st->oprm.ch;
-	if (st->oprm.fmt != AUFMT_S16LE) {
-		auconv_from_s16(st->oprm.fmt, st->sampv, st->rsampv, rsampc);
-		af->sampv = st->sampv;
-	}
-	else {
-		af->sampv = st->rsampv;
-	}
 
 	return err;
 }
@@ -281,7 +263,8 @@ static int decode(struct aufilt_dec_st *aufilt_dec_st, struct auframe *af)
 
 
 static struct aufilt resample = {
-	LE_INIT, "auresamp", encode_update, encode, decode_update, decode
+	LE_INIT, "auresamp", encode_update, encode, decode_update, decode,
+	AUFILT_FMT(AUFMT_S16LE) | AUFILT_FMT(AUFMT_FLOAT)
 };
 
 
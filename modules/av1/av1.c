@@ -27,6 +27,8 @@ static struct vidcodec av1 = {
 	.decupdh   = av1_decode_update,
 	.dech      = av1_decode,
 	.packetizeh = av1_encode_packetize,
+	.actmaph    = av1_encode_actmap,
+	.encdebugh  = av1_encode_debug,
 };
 
 
@@ -13,6 +13,8 @@ int av1_encode_packet(struct videnc_state *ves, bool update,
 		      const struct vidframe *frame, uint64_t timestamp);
 int av1_encode_packetize(struct videnc_state *ves,
 			 const struct vidpacket *packet);
+int av1_encode_actmap(struct videnc_state *ves, const struct vidactmap *map);
+int av1_encode_debug(struct re_printf *pf, const struct videnc_state *ves);
 
 
 /* Decode */
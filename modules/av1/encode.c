@@ -20,6 +20,11 @@
 #endif
 
 
+enum {
+	TILE_MIN_WIDTH = 256,
+};
+
+
 struct videnc_state {
 	aom_codec_ctx_t ctx;
 	struct vidsz size;
@@ -29,15 +34,76 @@ struct videnc_state {
 	bool ctxup;
 	videnc_packet_h *pkth;
 	const struct video *vid;
+
+	/* Encoder configuration and its encode time */
+	unsigned threads;
+	unsigned tile_cols;
+	unsigned tile_rows;
+	int32_t cpuused;
+	unsigned n_enc;
+	uint64_t enc_usec;
 };
 
 
+static void enc_stats(const struct videnc_state *ves)
+{
+	if (!ves->n_enc)
+		return;
+
+	debug("av1: %u x %u threads=%u tiles=%ux%u cpuused=%d:"
+	      " %.2f ms/frame (%u frames)\n",
+	      ves->size.w, ves->size.h, ves->threads,
+	      1u << ves->tile_cols, 1u << ves->tile_rows, ves->cpuused,
+	      ves->enc_usec / 1000.0 / ves->n_enc, ves->n_enc);
+}
+
+
 static void destructor(void *arg)
 {
 	struct videnc_state *ves = arg;
 
-	if (ves->ctxup)
+	if (ves->ctxup) {
+		enc_stats(ves);
 		aom_codec_destroy(&ves->ctx);
+	}
+
+	videnc_threads_free(ves->threads);
+}
+
+
+/* Threads for the picture size, if not set with av1_enc_threads */
+static unsigned auto_threads(const struct vidsz *size)
+{
+	const uint32_t pixels = size->w * size->h;
+
+	if (pixels >= 1920 * 1080)
+		return 8;
+	else if (pixels >= 1280 * 720)
+		return 4;
+	else if (pixels >= 640 * 360)
+		return 2;
+	else
+		return 1;
+}
+
+
+/*
+ * Tile columns and rows (log2). The columns are split first, the rows
+ * only if there are threads left for them.
+ */
+static void tiles_log2(struct videnc_state *ves, const struct vidsz *size)
+{
+	unsigned cols = 0, rows = 0;
+
+	while (cols < 6 && (size->w >> (cols + 1)) >= TILE_MIN_WIDTH &&
+	       (1u << (cols + 1)) <= ves->threads)
+		++cols;
+
+	if ((2u << cols) <= ves->threads && size->h >= 720)
+		rows = 1;
+
+	ves->tile_cols = cols;
+	ves->tile_rows = rows;
 }
 
 
@@ -84,17 +150,33 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 {
 	aom_codec_enc_cfg_t cfg;
 	aom_codec_err_t res;
+	uint32_t threads = 0;
+	int32_t cpuused = 8;
 
 	res = aom_codec_enc_config_default(&aom_codec_av1_cx_algo, &cfg,
 					   AOM_USAGE_REALTIME);
 	if (res)
 		return EPROTO;
 
+	conf_get_u32(conf_cur(), "av1_enc_threads", &threads);
+	conf_get_i32(conf_cur(), "av1_enc_cpuused", &cpuused);
+
+	if (ves->ctxup)
+		enc_stats(ves);
+
+	videnc_threads_free(ves->threads);
+	ves->threads  = videnc_threads_alloc(threads ? threads
+						 : auto_threads(size));
+	ves->cpuused  = cpuused;
+	ves->n_enc    = 0;
+	ves->enc_usec = 0;
+	tiles_log2(ves, size);
+
 	cfg.g_w               = size->w;
 	cfg.g_h               = size->h;
 	cfg.g_timebase.num    = 1;
 	cfg.g_timebase.den    = VIDEO_TIMEBASE;
-	cfg.g_threads         = 8;
+	cfg.g_threads         = ves->threads;
 	cfg.g_error_resilient = AOM_ERROR_RESILIENT_DEFAULT;
 	cfg.g_pass            = AOM_RC_ONE_PASS;
 	cfg.g_lag_in_frames   = 0;
@@ -121,12 +203,38 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 
 	ves->ctxup = true;
 
-	res = aom_codec_control(&ves->ctx, AOME_SET_CPUUSED, 8);
+	res = aom_codec_control(&ves->ctx, AOME_SET_CPUUSED, cpuused);
 	if (res) {
 		warning("av1: codec ctrl C: %s\n",
 			aom_codec_err_to_string(res));
 	}
 
+	res = aom_codec_control(&ves->ctx, AV1E_SET_TILE_COLUMNS,
+				(int)ves->tile_cols);
+	if (res) {
+		warning("av1: codec ctrl tile columns: %s\n",
+			aom_codec_err_to_string(res));
+	}
+
+	res = aom_codec_control(&ves->ctx, AV1E_SET_TILE_ROWS,
+				(int)ves->tile_rows);
+	if (res) {
+		warning("av1: codec ctrl tile rows: %s\n",
+			aom_codec_err_to_string(res));
+	}
+
+	res = aom_codec_control(&ves->ctx, AV1E_SET_ROW_MT,
+				ves->threads > 1 ? 1u : 0u);
+	if (res) {
+		warning("av1: codec ctrl row-mt: %s\n",
+			aom_codec_err_to_string(res));
+	}
+
+	info("av1: encoder opened, picture size %u x %u"
+	     " (threads=%u, tiles=%ux%u, cpuused=%d)\n",
+	     size->w, size->h, ves->threads,
+	     1u << ves->tile_cols, 1u << ves->tile_rows, cpuused);
+
 	return 0;
 }
 
@@ -151,6 +259,7 @@ int av1_encode_packet(struct videnc_state *ves, bool update,
 	aom_codec_err_t res;
 	aom_image_t *img;
 	aom_img_fmt_t img_fmt;
+	uint64_t t0;
 	int err = 0;
 
 	if (!ves || !frame || frame->fmt != VID_FMT_YUV420P)
@@ -185,6 +294,8 @@ int av1_encode_packet(struct videnc_state *ves, bool update,
 		img->planes[i] = frame->data[i];
 	}
 
+	t0 = tmr_jiffies_usec();
+
 	res = aom_codec_encode(&ves->ctx, img, timestamp, 1, flags);
 	if (res) {
 		warning("av1: enc error: %s\n", aom_codec_err_to_string(res));
@@ -192,6 +303,9 @@ int av1_encode_packet(struct videnc_state *ves, bool update,
 		goto out;
 	}
 
+	ves->enc_usec += tmr_jiffies_usec() - t0;
+	++ves->n_enc;
+
 	for (;;) {
 		const aom_codec_cx_pkt_t *pkt;
 		uint64_t rtp_ts;
@@ -241,3 +355,51 @@ int av1_encode_packetize(struct videnc_state *ves,
 
 	return err;
 }
+
+
+/*
+ * Inactive blocks are coded as skipped, the map has one byte per
+ * 16 x 16 block. A map of another frame size is ignored.
+ */
+int av1_encode_actmap(struct videnc_state *ves, const struct vidactmap *map)
+{
+	aom_active_map_t am;
+	aom_codec_err_t res;
+
+	if (!ves || !map)
+		return EINVAL;
+
+	if (!ves->ctxup ||
+	    map->cols != (ves->size.w + 15) / 16 ||
+	    map->rows != (ves->size.h + 15) / 16)
+		return 0;
+
+	am.active_map = (unsigned char *)map->map;
+	am.rows       = map->rows;
+	am.cols       = map->cols;
+
+	res = aom_codec_control(&ves->ctx, AOME_SET_ACTIVEMAP, &am);
+	if (res) {
+		warning("av1: active map: %s\n", aom_codec_err_to_string(res));
+		return EPROTO;
+	}
+
+	return 0;
+}
+
+
+int av1_encode_debug(struct re_printf *pf, const struct videnc_state *ves)
+{
+	double ms;
+
+	if (!ves || !ves->ctxup)
+		return 0;
+
+	ms = ves->n_enc ? ves->enc_usec / 1000.0 / ves->n_enc : 0.0;
+
+	return re_hprintf(pf, "     av1: threads=%u tiles=%ux%u"
+			  " cpuused=%d %.2f ms/frame (%u frames)\n",
+			  ves->threads, 1u << ves->tile_cols,
+			  1u << ves->tile_rows, ves->cpuused,
+			  ms, ves->n_enc);
+}
@@ -9,6 +9,8 @@
 #include <baresip.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/avutil.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/mem.h>
 #include <libavutil/pixdesc.h>
 #include "h26x.h"
@@ -29,6 +31,7 @@ struct viddec_state {
 	const AVCodec *codec;
 	AVCodecContext *ctx;
 	AVFrame *pict;
+	AVFrame *hw_pict;
 	struct mbuf *mb;
 	bool got_keyframe;
 	size_t frag_start;
@@ -57,6 +60,9 @@ static void destructor(void *arg)
 
 	if (st->pict)
 		av_frame_free(&st->pict);
+
+	if (st->hw_pict)
+		av_frame_free(&st->hw_pict);
 }
 
 
@@ -138,6 +144,10 @@ static int init_decoder(struct viddec_state *st, const char *name)
 
 	/* Hardware accelleration */
 	if (avcodec_hw_device_ctx) {
+		st->hw_pict = av_frame_alloc();
+		if (!st->hw_pict)
+			return ENOMEM;
+
 		st->ctx->hw_device_ctx = av_buffer_ref(avcodec_hw_device_ctx);
 		st->ctx->get_format = get_hw_format;
 
@@ -199,8 +209,89 @@ int avcodec_decode_update(struct viddec_state **vdsp,
 }
 
 
+/*
+ * Map the surface for reading and copy it once into the frame of the
+ * caller, which may be the texture memory of the display
+ */
+static int hw_download(struct vidframe *dst, const struct vidframe_hw *hw)
+{
+	const AVFrame *surface;
+	AVFrame *sw;
+	uint8_t *data[4];
+	int linesize[4];
+	int i, ret;
+	int err = 0;
+
+	if (!dst || !hw || !hw->surface)
+		return EINVAL;
+
+	if (dst->fmt != hw->fmt || !vidsz_cmp(&dst->size, &hw->size))
+		return ENOTSUP;
+
+	surface = hw->surface;
+
+	sw = av_frame_alloc();
+	if (!sw)
+		return ENOMEM;
+
+	ret = av_hwframe_map(sw, surface, AV_HWFRAME_MAP_READ);
+	if (ret < 0)
+		ret = av_hwframe_transfer_data(sw, surface, 0);
+	if (ret < 0) {
+		warning("avcodec: decode: could not download surface (%s)\n",
+			av_err2str(ret));
+		err = EIO;
+		goto out;
+	}
+
+	if (avpixfmt_to_vidfmt(sw->format) != dst->fmt) {
+		err = ENOTSUP;
+		goto out;
+	}
+
+	for (i=0; i<4; i++) {
+		data[i]     = dst->data[i];
+		linesize[i] = dst->linesize[i];
+	}
+
+	av_image_copy(data, linesize, (const uint8_t **)sw->data,
+		      sw->linesize, sw->format, hw->size.w, hw->size.h);
+
+ out:
+	av_frame_free(&sw);
+
+	return err;
+}
+
+
+/* Hand over the surface if the format in system memory is known */
+static bool hw_frame_set(struct viddec_state *st, struct vidframe_hw *hw)
+{
+	const AVHWFramesContext *fctx;
+	enum vidfmt fmt;
+
+	if (!hw || !st->hw_pict->hw_frames_ctx)
+		return false;
+
+	fctx = (AVHWFramesContext *)(void *)st->hw_pict->hw_frames_ctx->data;
+
+	fmt = avpixfmt_to_vidfmt(fctx->sw_format);
+	if (fmt == (enum vidfmt)-1)
+		return false;
+
+	hw->type      = av_hwdevice_get_type_name(avcodec_hw_type);
+	hw->surface   = st->hw_pict;
+	hw->size.w    = st->ctx->width;
+	hw->size.h    = st->ctx->height;
+	hw->fmt       = fmt;
+	hw->downloadh = hw_download;
+
+	return true;
+}
+
+
 static int ffdecode(struct viddec_state *st, struct vidframe *frame,
-		    bool *intra)
+		    struct vidframe_hw *hw, bool *intra)
 {
 	AVFrame *hw_frame = NULL;
 	AVPacket *avpkt;
@@ -208,9 +299,8 @@ static int ffdecode(struct viddec_state *st, struct vidframe *frame,
 	int err = 0;
 
 	if (st->ctx->hw_device_ctx) {
-		hw_frame = av_frame_alloc();
-		if (!hw_frame)
-			return ENOMEM;
+		hw_frame = st->hw_pict;
+		av_frame_unref(hw_frame); /* release the previous surface */
 	}
 
 	err = mbuf_fill(st->mb, 0x00, AV_INPUT_BUFFER_PADDING_SIZE);
@@ -250,6 +340,21 @@ static int ffdecode(struct viddec_state *st, struct vidframe *frame,
 
 	if (got_picture) {
 
+		if (hw_frame && hw_frame_set(st, hw)) {
+
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(58, 29, 100)
+			if (hw_frame->flags & AV_FRAME_FLAG_KEY) {
+#else
+			if (hw_frame->key_frame) {
+#endif
+				*intra = true;
+				st->got_keyframe = true;
+				++st->stats.n_key;
+			}
+
+			goto out;
+		}
+
 		if (hw_frame) {
 			av_frame_unref(st->pict); /* cleanup old frame */
 			/* retrieve data from GPU to CPU */
@@ -296,7 +401,6 @@ static int ffdecode(struct viddec_state *st, struct vidframe *frame,
 	}
 
  out:
-	av_frame_free(&hw_frame);
 	av_packet_free(&avpkt);
 	return err;
 }
@@ -439,7 +543,7 @@ int avcodec_decode_h264(struct viddec_state *st, struct vidframe *frame,
 		goto out;
 	}
 
-	err = ffdecode(st, frame, &pkt->intra);
+	err = ffdecode(st, frame, pkt->hw, &pkt->intra);
 	if (err)
 		goto out;
 
@@ -613,7 +717,7 @@ int avcodec_decode_h265(struct viddec_state *vds, struct vidframe *frame,
 		goto out;
 	}
 
-	err = ffdecode(vds, frame, &pkt->intra);
+	err = ffdecode(vds, frame, pkt->hw, &pkt->intra);
 	if (err)
 		goto out;
 
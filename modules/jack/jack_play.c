@@ -20,6 +20,7 @@ struct auplay_st {
 
 	jack_client_t *client;
 	jack_port_t **portv;
+	float **bufv;                 /* port buffers of current cycle */
 	jack_nframes_t nframes;       /* num frames per port (channel) */
 
 	struct auresamp *resamp;
@@ -44,7 +45,7 @@ static int process_handler(jack_nframes_t nframes, void *arg)
 	struct auplay_st *st = arg;
 	struct auframe af;
 	size_t sampc = nframes * st->prm.ch;
-	size_t ch, j;
+	size_t ch;
 	int err;
 
 	if (st->prm.fmt == AUFMT_S16LE) {
@@ -110,7 +111,8 @@ static int process_handler(jack_nframes_t nframes, void *arg)
 		}
 
 		/* convert from 16-bit to float */
-		auconv_from_s16(AUFMT_FLOAT, st->sampv, st->sampv_lin, sampc);
+		(void)aufmt_convert(AUFMT_FLOAT, st->sampv,
+				    AUFMT_S16LE, st->sampv_lin, sampc);
 
 		if (st->resamp && st->resamp->up &&
 			sampc_rs_out + st->extra >= sampc) {
@@ -136,17 +138,11 @@ static int process_handler(jack_nframes_t nframes, void *arg)
 	}
 
 	/* de-interleave floats [LRLRLRLR] -> [LLLLL]+[RRRRR] */
-	for (ch = 0; ch < st->prm.ch; ch++) {
+	for (ch = 0; ch < st->prm.ch; ch++)
+		st->bufv[ch] = jack_port_get_buffer(st->portv[ch],
+						    st->nframes);
 
-		jack_default_audio_sample_t *buffer;
-
-		buffer = jack_port_get_buffer(st->portv[ch], st->nframes);
-
-		for (j = 0; j < nframes; j++) {
-			float samp = st->sampv[j*st->prm.ch + ch];
-			buffer[j] = samp;
-		}
-	}
+	aufmt_deinterleave(st->bufv, st->sampv, st->prm.ch, nframes);
 
 	return 0;
 }
@@ -163,6 +159,7 @@ static void auplay_destructor(void *arg)
 
 	mem_deref(st->sampv);
 	mem_deref(st->portv);
+	mem_deref(st->bufv);
 	mem_deref(st->resamp);
 	mem_deref(st->sampv_rs);
 	mem_deref(st->sampv_lin);
@@ -412,7 +409,8 @@ int jack_play_alloc(struct auplay_st **stp, const struct auplay *ap,
 		st->device = device;
 
 	st->portv = mem_reallocarray(NULL, prm->ch, sizeof(*st->portv), NULL);
-	if (!st->portv) {
+	st->bufv  = mem_reallocarray(NULL, prm->ch, sizeof(*st->bufv), NULL);
+	if (!st->portv || !st->bufv) {
 		err = ENOMEM;
 		goto out;
 	}
@@ -21,6 +21,7 @@ struct ausrc_st {
 
 	jack_client_t *client;
 	jack_port_t **portv;
+	float **bufv;                 /* port buffers of current cycle */
 	jack_nframes_t nframes;       /* num frames per port (channel) */
 };
 
@@ -30,25 +31,17 @@ static int process_handler(jack_nframes_t nframes, void *arg)
 	struct ausrc_st *st = arg;
 	struct auframe af;
 	size_t sampc = nframes * st->prm.ch;
-	size_t ch, j;
+	size_t ch;
 	uint64_t ts;
 
 	ts = jack_frames_to_time(st->client, jack_last_frame_time(st->client));
 
-	/* 2. convert from 16-bit to float and copy to Jack */
+	/* interleave [LLLLL]+[RRRRR] -> [LRLRLRLR] */
+	for (ch = 0; ch < st->prm.ch; ch++)
+		st->bufv[ch] = jack_port_get_buffer(st->portv[ch],
+						    st->nframes);
 
-	/* 3. de-interleave [LRLRLRLR] -> [LLLLL]+[RRRRR] */
-	for (ch = 0; ch < st->prm.ch; ch++) {
-
-		const jack_default_audio_sample_t *buffer;
-
-		buffer = jack_port_get_buffer(st->portv[ch], st->nframes);
-
-		for (j = 0; j < nframes; j++) {
-			float samp = buffer[j];
-			st->sampv[j*st->prm.ch + ch] = samp;
-		}
-	}
+	aufmt_interleave(st->sampv, st->bufv, st->prm.ch, nframes);
 
 	auframe_init(&af, st->prm.fmt, st->sampv, sampc, st->prm.srate,
 		     st->prm.ch);
@@ -72,6 +65,7 @@ static void ausrc_destructor(void *arg)
 
 	mem_deref(st->sampv);
 	mem_deref(st->portv);
+	mem_deref(st->bufv);
 }
 
 
@@ -231,7 +225,8 @@ int jack_src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 		st->device = device;
 
 	st->portv = mem_reallocarray(NULL, prm->ch, sizeof(*st->portv), NULL);
-	if (!st->portv) {
+	st->bufv  = mem_reallocarray(NULL, prm->ch, sizeof(*st->bufv), NULL);
+	if (!st->portv || !st->bufv) {
 		err = ENOMEM;
 		goto out;
 	}
@@ -40,6 +40,42 @@ static int call_audio_debug(struct re_printf *pf, void *arg)
 }
 
 
+/**
+ * Print the per-stage latency histograms of the current call
+ *
+ * @param pf   Print handler
+ * @param arg  Command arguments (carg)
+ *             carg->prm "reset" clears the histograms
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+static int call_latency(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	struct ua *ua = carg->data ? carg->data : menu_uacur();
+	struct call *call = ua_call(ua);
+	struct le *le;
+	int err = 0;
+
+	if (!call) {
+		(void)re_hprintf(pf, "call not found\n");
+		return EINVAL;
+	}
+
+	if (!str_casecmp(carg->prm, "reset")) {
+		LIST_FOREACH(call_streaml(call), le)
+			stream_latency_reset(le->data);
+
+		return 0;
+	}
+
+	LIST_FOREACH(call_streaml(call), le)
+		err |= stream_latency_debug(pf, le->data);
+
+	return err;
+}
+
+
 static int cmd_find_call(struct re_printf *pf, void *arg)
 {
 	struct cmd_arg *carg = arg;
@@ -145,6 +181,61 @@ static int call_reinvite(struct re_printf *pf, void *arg)
 }
 
 
+/**
+ * Relay the RTP media of the active call to another call
+ *
+ * @param pf   Print handler
+ * @param arg  Command arguments (carg)
+ *             carg->data is an optional pointer to a User-Agent
+ *             carg->prm is the call-id of the other call and an
+ *             optional "stop"
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+static int cmd_call_relay(struct re_printf *pf, void *arg)
+{
+	struct cmd_arg *carg = arg;
+	struct ua *ua = carg->data ? carg->data : menu_uacur();
+	struct call *call = ua_call(ua);
+	struct call *peer;
+	struct pl pl_id, pl_stop = PL_INIT;
+	char *id = NULL;
+	int err;
+
+	err = re_regex(carg->prm, str_len(carg->prm), "[^ ]+[ ]*[^ ]*",
+		       &pl_id, NULL, &pl_stop);
+	if (err) {
+		(void)re_hprintf(pf, "usage: /relay <callid> [stop]\n");
+		return EINVAL;
+	}
+
+	if (!call) {
+		(void)re_hprintf(pf, "no active call\n");
+		return ENOENT;
+	}
+
+	err = pl_strdup(&id, &pl_id);
+	if (err)
+		return err;
+
+	peer = uag_call_find(id);
+	if (!peer || peer == call) {
+		(void)re_hprintf(pf, "call %s not found\n", id);
+		err = EINVAL;
+		goto out;
+	}
+
+	err = call_relay(call, peer, pl_strcasecmp(&pl_stop, "stop") != 0);
+	if (err)
+		(void)re_hprintf(pf, "relay failed (%m)\n", err);
+
+ out:
+	mem_deref(id);
+
+	return err;
+}
+
+
 /**
  * Resume the active call
  *
@@ -449,9 +540,11 @@ static const struct cmd callcmdv[] = {
 {"audio_debug", 'A',       0, "Audio stream",         call_audio_debug     },
 {"callfind",     0,  CMD_PRM, "Find call <callid>",   cmd_find_call        },
 {"hold",        'x',       0, "Call hold",            cmd_call_hold        },
+{"latency",       0, CMD_PRM, "Stage latency [reset]", call_latency        },
 {"line",        '@', CMD_PRM, "Set current call <line>", set_current_call  },
 {"mute",        'm',       0, "Call mute/un-mute",    call_mute            },
 {"reinvite",    'I',       0, "Send re-INVITE",       call_reinvite        },
+{"relay",         0, CMD_PRM, "Relay to <callid> [stop]", cmd_call_relay },
 {"resume",      'X',       0, "Call resume",          cmd_call_resume      },
 {"sndcode",      0,  CMD_PRM, "Send Code",            send_code            },
 {"statmode",    'S',       0, "Statusmode toggle",    toggle_statmode      },
@@ -22,6 +22,8 @@ struct mix {
 	struct aubuf *ab;
 	const struct audio *au;
 	struct aufilt_prm prm;
+	struct aupoly *rs;        /* resampler to the encoder parameters */
+	struct aufilt_prm rsprm;  /* input parameters of the resampler   */
 	bool ready;
 	struct le le_priv;
 };
@@ -33,8 +35,6 @@ struct mixminus_enc {
 	struct list mixers;
 	int16_t *sampv;
 	int16_t *rsampv;
-	int16_t *fsampv;
-	struct auresamp resamp;
 	struct aufilt_prm prm;
 	struct le le_priv;
 };
@@ -43,7 +43,6 @@ struct mixminus_dec {
 	struct aufilt_dec_st af;  /* inheritance */
 
 	const struct audio *au;
-	int16_t *fsampv;
 	struct aufilt_prm prm;
 };
 
@@ -60,7 +59,6 @@ static void enc_destructor(void *arg)
 	list_flush(&st->mixers);
 	mem_deref(st->sampv);
 	mem_deref(st->rsampv);
-	mem_deref(st->fsampv);
 	list_unlink(&st->le_priv);
 
 	for (le = list_head(&encs); le; le = le->next) {
@@ -84,16 +82,11 @@ static void enc_destructor(void *arg)
 	}
 }
 
-static void dec_destructor(void *arg)
-{
-	struct mixminus_dec *st = arg;
-	mem_deref(st->fsampv);
-}
-
 static void mix_destructor(void *arg)
 {
 	struct mix *mix = arg;
 	mem_deref(mix->ab);
+	mem_deref(mix->rs);
 }
 
 
@@ -128,13 +121,8 @@ static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 	if (!st->rsampv)
 		return ENOMEM;
 
-	st->fsampv = mem_zalloc(psize, NULL);
-	if (!st->fsampv)
-		return ENOMEM;
-
 	st->prm = *prm;
 	st->au = au;
-	auresamp_init(&st->resamp);
 
 	list_append(&encs, &st->le_priv, st);
 
@@ -194,7 +182,6 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 			 const struct audio *au)
 {
 	struct mixminus_dec *st;
-	size_t psize;
 	(void)af;
 	(void)prm;
 
@@ -204,16 +191,10 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 	if (*stp)
 		return 0;
 
-	st = mem_zalloc(sizeof(*st), dec_destructor);
+	st = mem_zalloc(sizeof(*st), NULL);
 	if (!st)
 		return ENOMEM;
 
-	psize = AUDIO_SAMPSZ * sizeof(int16_t);
-
-	st->fsampv = mem_zalloc(psize, NULL);
-	if (!st->fsampv)
-		return ENOMEM;
-
 	st->au = au;
 	st->prm = *prm;
 
@@ -242,6 +223,21 @@ static void read_samp(struct aubuf *ab, int16_t *sampv, size_t sampc,
 }
 
 
+/* The resampler is only set up when the mix parameters change */
+static int mix_resampler(struct mix *mix, const struct aufilt_prm *prm)
+{
+	if (mix->rs && mix->rsprm.srate == mix->prm.srate &&
+	    mix->rsprm.ch == mix->prm.ch)
+		return 0;
+
+	mix->rs    = mem_deref(mix->rs);
+	mix->rsprm = mix->prm;
+
+	return aupoly_alloc(&mix->rs, mix->prm.srate, mix->prm.ch,
+			    prm->srate, prm->ch);
+}
+
+
 static int encode(struct aufilt_enc_st *aufilt_enc_st, struct auframe *af)
 {
 	struct mixminus_enc *enc = (struct mixminus_enc *)aufilt_enc_st;
@@ -253,12 +249,11 @@ static int encode(struct aufilt_enc_st *aufilt_enc_st, struct auframe *af)
 	int32_t sample;
 	int err = 0;
 
-	stime = 1000 * af->sampc / (enc->prm.srate * enc->prm.ch);
+	/* s16le is the native format, the core converts to it */
+	if (af->fmt != AUFMT_S16LE)
+		return ENOTSUP;
 
-	if (enc->prm.fmt != AUFMT_S16LE) {
-		auconv_to_s16(enc->fsampv, enc->prm.fmt, af->sampv, af->sampc);
-		sampv = enc->fsampv;
-	}
+	stime = 1000 * af->sampc / (enc->prm.srate * enc->prm.ch);
 
 	for (lem = list_head(&enc->mixers); lem; lem = lem->next) {
 		mix = lem->data;
@@ -276,42 +271,31 @@ static int encode(struct aufilt_enc_st *aufilt_enc_st, struct auframe *af)
 		if (!mix->prm.srate || !mix->prm.ch)
 			continue;
 
-		err = auresamp_setup(&enc->resamp, mix->prm.srate, mix->prm.ch,
-				     enc->prm.srate, enc->prm.ch);
-		if (err) {
-			warning("mixminus/auresamp_setup error (%m)\n", err);
-			return err;
-		}
+		if (mix->prm.srate != enc->prm.srate ||
+		    mix->prm.ch != enc->prm.ch) {
+			err = mix_resampler(mix, &enc->prm);
+			if (err) {
+				warning("mixminus/aupoly_alloc error (%m)\n",
+					err);
+				return err;
+			}
 
-		if (enc->resamp.resample) {
 			outc = AUDIO_SAMPSZ;
 			sampv_mix = enc->rsampv;
 
-			if (enc->prm.srate > mix->prm.srate) {
-				inc = af->sampc / enc->resamp.ratio;
-			}
-			else {
-				inc = af->sampc * enc->resamp.ratio;
-			}
-
-			if (enc->prm.ch == 2 && mix->prm.ch == 1) {
-				inc = inc / 2;
-			}
-
-			if (enc->prm.ch == 1 && mix->prm.ch == 2) {
-				inc = inc * 2;
-			}
+			inc = af->sampc / enc->prm.ch * mix->prm.srate /
+				enc->prm.srate * mix->prm.ch;
 
 			read_samp(mix->ab, enc->sampv, inc, stime);
 
-			err = auresamp(&enc->resamp, sampv_mix, &outc,
-				       enc->sampv, inc);
+			err = aupoly_process(mix->rs, sampv_mix, &outc,
+					     enc->sampv, inc, AUFMT_S16LE);
 			if (err) {
-				warning("mixminus/auresamp error (%m)\n", err);
+				warning("mixminus/aupoly error (%m)\n", err);
 				return err;
 			}
 			if (outc != af->sampc) {
-				warning("mixminus/auresamp sample count "
+				warning("mixminus/aupoly sample count "
 					"error\n");
 				return EINVAL;
 			}
@@ -332,11 +316,6 @@ static int encode(struct aufilt_enc_st *aufilt_enc_st, struct auframe *af)
 		}
 	}
 
-	if (enc->prm.fmt != AUFMT_S16LE) {
-		auconv_from_s16(enc->prm.fmt, af->sampv, sampv,
-				af->sampc);
-	}
-
 	return err;
 }
 
@@ -348,7 +327,9 @@ static int decode(struct aufilt_dec_st *aufilt_dec_st, struct auframe *af)
 	struct le *le;
 	struct le *lem;
 	struct mix *mix;
-	int16_t *sampv;
+
+	if (af->fmt != AUFMT_S16LE)
+		return ENOTSUP;
 
 	for (le = list_head(&encs); le; le = le->next) {
 		enc = le->data;
@@ -367,15 +348,7 @@ static int decode(struct aufilt_dec_st *aufilt_dec_st, struct auframe *af)
 			mix->prm.ch = dec->prm.ch;
 			mix->prm.srate = dec->prm.srate;
 
-			sampv = af->sampv;
-
-			if (dec->prm.fmt != AUFMT_S16LE) {
-				sampv = dec->fsampv;
-				auconv_to_s16(sampv, dec->prm.fmt,
-					      (void *)af->sampv, af->sampc);
-			}
-
-			aubuf_write_samp(mix->ab, sampv, af->sampc);
+			aubuf_write_samp(mix->ab, af->sampv, af->sampc);
 		}
 	}
 
@@ -442,7 +415,8 @@ static int debug_conference(struct re_printf *pf, void *arg)
 
 
 static struct aufilt mixminus = {
-	LE_INIT, "mixminus", encode_update, encode, decode_update, decode
+	LE_INIT, "mixminus", encode_update, encode, decode_update, decode,
+	AUFILT_FMT(AUFMT_S16LE)
 };
 
 
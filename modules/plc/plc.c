@@ -58,12 +58,6 @@ static int update(struct aufilt_dec_st **stp, void **ctx,
 		return ENOSYS;
 	}
 
-	if (prm->fmt != AUFMT_S16LE) {
-		warning("plc: unsupported sample format (%s)\n",
-			aufmt_name(prm->fmt));
-		return ENOTSUP;
-	}
-
 	st = mem_zalloc(sizeof(*st), destructor);
 	if (!st)
 		return ENOMEM;
@@ -112,7 +106,8 @@ static int decode(struct aufilt_dec_st *st, struct auframe *af)
 static struct aufilt plc = {
 	.name    = "plc",
 	.decupdh = update,
-	.dech    = decode
+	.dech    = decode,
+	.fmts    = AUFILT_FMT(AUFMT_S16LE)
 };
 
 
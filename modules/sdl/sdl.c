@@ -182,36 +182,25 @@ static int alloc(struct vidisp_st **stp, const struct vidisp *vd,
 }
 
 
-static int display(struct vidisp_st *st, const char *title,
-		   const struct vidframe *frame, uint64_t timestamp)
+static int texture_setup(struct vidisp_st *st, const char *title,
+			 const struct vidsz *size, enum vidfmt fmt)
 {
-	void *pixels;
-	uint8_t *d;
-	int dpitch, ret;
-	unsigned i, h;
 	uint32_t format;
-	(void)timestamp;
-
-	if (!st || !frame)
-		return EINVAL;
-
-	if (st->quit)
-		return ENODEV;
 
-	format = match_fmt(frame->fmt);
+	format = match_fmt(fmt);
 	if (format == SDL_PIXELFORMAT_UNKNOWN) {
 		warning("sdl: pixel format not supported (%s)\n",
-			vidfmt_name(frame->fmt));
+			vidfmt_name(fmt));
 		return ENOTSUP;
 	}
 
-	if (!vidsz_cmp(&st->size, &frame->size) || frame->fmt != st->fmt) {
+	if (!vidsz_cmp(&st->size, size) || fmt != st->fmt) {
 		if (st->size.w && st->size.h) {
 			info("sdl: reset size:"
 			     " %s %u x %u ---> %s %u x %u\n",
 			     vidfmt_name(st->fmt), st->size.w, st->size.h,
-			     vidfmt_name(frame->fmt),
-			     frame->size.w, frame->size.h);
+			     vidfmt_name(fmt),
+			     size->w, size->h);
 		}
 		sdl_reset(st);
 	}
@@ -227,17 +216,17 @@ static int display(struct vidisp_st *st, const char *title,
 
 		if (title) {
 			re_snprintf(capt, sizeof(capt), "%s - %u x %u",
-				    title, frame->size.w, frame->size.h);
+				    title, size->w, size->h);
 		}
 		else {
 			re_snprintf(capt, sizeof(capt), "%u x %u",
-				    frame->size.w, frame->size.h);
+				    size->w, size->h);
 		}
 
 		st->window = SDL_CreateWindow(capt,
 					      SDL_WINDOWPOS_CENTERED,
 					      SDL_WINDOWPOS_CENTERED,
-					      frame->size.w, frame->size.h,
+					      size->w, size->h,
 					      st->flags);
 		if (!st->window) {
 			warning("sdl: unable to create sdl window: %s\n",
@@ -245,8 +234,8 @@ static int display(struct vidisp_st *st, const char *title,
 			return ENODEV;
 		}
 
-		st->size = frame->size;
-		st->fmt = frame->fmt;
+		st->size = *size;
+		st->fmt = fmt;
 
 		SDL_RaiseWindow(st->window);
 		SDL_SetWindowBordered(st->window, true);
@@ -273,7 +262,7 @@ static int display(struct vidisp_st *st, const char *title,
 		}
 
 		SDL_RenderSetLogicalSize(st->renderer,
-					 frame->size.w, frame->size.h);
+					 size->w, size->h);
 	}
 
 	if (!st->texture) {
@@ -281,7 +270,7 @@ static int display(struct vidisp_st *st, const char *title,
 		st->texture = SDL_CreateTexture(st->renderer,
 						format,
 						SDL_TEXTUREACCESS_STREAMING,
-						frame->size.w, frame->size.h);
+						size->w, size->h);
 		if (!st->texture) {
 			warning("sdl: unable to create texture: %s\n",
 				SDL_GetError());
@@ -289,6 +278,29 @@ static int display(struct vidisp_st *st, const char *title,
 		}
 	}
 
+	return 0;
+}
+
+
+static int display(struct vidisp_st *st, const char *title,
+		   const struct vidframe *frame, uint64_t timestamp)
+{
+	void *pixels;
+	uint8_t *d;
+	int dpitch, ret, err;
+	unsigned i, h;
+	(void)timestamp;
+
+	if (!st || !frame)
+		return EINVAL;
+
+	if (st->quit)
+		return ENODEV;
+
+	err = texture_setup(st, title, &frame->size, frame->fmt);
+	if (err)
+		return err;
+
 	/* NOTE: poll events first */
 	poll_events(st);
 
@@ -340,6 +352,80 @@ static int display(struct vidisp_st *st, const char *title,
 }
 
 
+/*
+ * Download the hardware surface straight into the texture memory,
+ * instead of into a decoder frame that is then copied once more
+ */
+static int display_hw(struct vidisp_st *st, const char *title,
+		      const struct vidframe_hw *hw, uint64_t timestamp)
+{
+	struct vidframe frame;
+	void *pixels;
+	uint8_t *d;
+	int dpitch, ret, err;
+	(void)timestamp;
+
+	if (!st || !hw)
+		return EINVAL;
+
+	if (st->quit)
+		return ENODEV;
+
+	if (hw->fmt != VID_FMT_YUV420P && hw->fmt != VID_FMT_NV12 &&
+	    hw->fmt != VID_FMT_NV21)
+		return ENOTSUP;
+
+	err = texture_setup(st, title, &hw->size, hw->fmt);
+	if (err)
+		return err;
+
+	poll_events(st);
+
+	ret = SDL_LockTexture(st->texture, NULL, &pixels, &dpitch);
+	if (ret != 0) {
+		warning("sdl: unable to lock texture (ret=%d)\n", ret);
+		return ENODEV;
+	}
+
+	memset(&frame, 0, sizeof(frame));
+	frame.size = hw->size;
+	frame.fmt  = hw->fmt;
+
+	/* the planes follow each other, see display() */
+	d = pixels;
+	frame.data[0]     = d;
+	frame.linesize[0] = dpitch;
+	d += (size_t)dpitch * hw->size.h;
+
+	if (hw->fmt == VID_FMT_YUV420P) {
+		const int cpitch = dpitch / 2;
+
+		frame.data[1]     = d;
+		frame.linesize[1] = cpitch;
+		d += (size_t)cpitch * ((hw->size.h + 1) / 2);
+		frame.data[2]     = d;
+		frame.linesize[2] = cpitch;
+	}
+	else {
+		frame.data[1]     = d;
+		frame.linesize[1] = dpitch;
+	}
+
+	err = hw->downloadh ? hw->downloadh(&frame, hw) : ENOTSUP;
+
+	SDL_UnlockTexture(st->texture);
+
+	if (err)
+		return err;
+
+	SDL_RenderClear(st->renderer);
+	SDL_RenderCopy(st->renderer, st->texture, NULL, NULL);
+	SDL_RenderPresent(st->renderer);
+
+	return 0;
+}
+
+
 static void hide(struct vidisp_st *st)
 {
 	if (!st || !st->window)
@@ -368,6 +454,8 @@ static int module_init(void)
 	if (err)
 		return err;
 
+	vid->disphwh = display_hw;
+
 	return 0;
 }
 
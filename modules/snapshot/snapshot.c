@@ -26,12 +26,106 @@
  */
 
 
+/* A copied frame waiting to be saved by the worker thread */
+struct snapshot {
+	struct le le;              /**< Linked-list element  */
+	struct vidframe *frame;    /**< Copy of the frame    */
+	char path[100];            /**< Path of the PNG-file */
+};
+
+static struct {
+	thrd_t thrd;               /**< Worker thread        */
+	mtx_t *lock;               /**< Protects the queue   */
+	cnd_t wait;                /**< Worker thread wait   */
+	struct list jobl;          /**< Queued snapshots     */
+	RE_ATOMIC bool run;        /**< Worker is active     */
+} worker;
+
 static bool flag_enc, flag_dec;
 static char path_enc[100], path_dec[100];
 
 static char *png_filename(const struct tm *tmx, const char *name,
 			char *buf, unsigned int length);
 
+
+static void snapshot_destructor(void *arg)
+{
+	struct snapshot *snap = arg;
+
+	mem_deref(snap->frame);
+}
+
+
+/* PNG encoding of a large frame takes long, it is done by the worker */
+static int worker_thread(void *arg)
+{
+	(void)arg;
+
+	mtx_lock(worker.lock);
+
+	while (re_atomic_rlx(&worker.run) || worker.jobl.head) {
+		struct snapshot *snap;
+
+		snap = list_ledata(list_head(&worker.jobl));
+		if (!snap) {
+			cnd_wait(&worker.wait, worker.lock);
+			continue;
+		}
+
+		list_unlink(&snap->le);
+
+		mtx_unlock(worker.lock);
+
+		png_save_vidframe(snap->frame, snap->path);
+		mem_deref(snap);
+
+		mtx_lock(worker.lock);
+	}
+
+	mtx_unlock(worker.lock);
+
+	return 0;
+}
+
+
+/* Takes the ownership of the frame */
+static int snapshot_queue(struct vidframe *frame, const char *path)
+{
+	struct snapshot *snap;
+
+	snap = mem_zalloc(sizeof(*snap), snapshot_destructor);
+	if (!snap) {
+		mem_deref(frame);
+		return ENOMEM;
+	}
+
+	snap->frame = frame;
+	str_ncpy(snap->path, path, sizeof(snap->path));
+
+	mtx_lock(worker.lock);
+	list_append(&worker.jobl, &snap->le, snap);
+	cnd_signal(&worker.wait);
+	mtx_unlock(worker.lock);
+
+	return 0;
+}
+
+
+static int snapshot_save(const struct vidframe *frame, const char *path)
+{
+	struct vidframe *copy;
+	int err;
+
+	err = vidframe_alloc(&copy, frame->fmt, &frame->size);
+	if (err)
+		return err;
+
+	vidframe_copy(copy, frame);
+
+	return snapshot_queue(copy, path);
+}
+
+
 static int encode(struct vidfilt_enc_st *st, struct vidframe *frame,
 			uint64_t *timestamp)
 {
@@ -43,7 +137,7 @@ static int encode(struct vidfilt_enc_st *st, struct vidframe *frame,
 
 	if (flag_enc) {
 		flag_enc = false;
-		png_save_vidframe(frame, path_enc);
+		snapshot_save(frame, path_enc);
 	}
 
 	return 0;
@@ -61,13 +155,35 @@ static int decode(struct vidfilt_dec_st *st, struct vidframe *frame,
 
 	if (flag_dec) {
 		flag_dec = false;
-		png_save_vidframe(frame, path_dec);
+		snapshot_save(frame, path_dec);
 	}
 
 	return 0;
 }
 
 
+/* Only the requested snapshot is downloaded from the hardware surface */
+static int decode_hw(struct vidfilt_dec_st *st, const struct vidframe_hw *hw,
+		     uint64_t *timestamp)
+{
+	struct vidframe *frame = NULL;
+	int err;
+	(void)st;
+	(void)timestamp;
+
+	if (!hw || !flag_dec)
+		return 0;
+
+	flag_dec = false;
+
+	err = vidframe_hw_download(&frame, hw);
+	if (err)
+		return err;
+
+	return snapshot_queue(frame, path_dec);
+}
+
+
 static int do_snapshot(struct re_printf *pf, void *arg)
 {
 	time_t tnow;
@@ -126,6 +242,7 @@ static struct vidfilt snapshot = {
 	.name = "snapshot",
 	.ench = encode,
 	.dech = decode,
+	.dechwh = decode_hw,
 };
 
 
@@ -140,8 +257,45 @@ static const struct cmd cmdv[] = {
 };
 
 
+static void worker_stop(void)
+{
+	if (!re_atomic_rlx(&worker.run))
+		return;
+
+	re_atomic_rlx_set(&worker.run, false);
+
+	mtx_lock(worker.lock);
+	cnd_signal(&worker.wait);
+	mtx_unlock(worker.lock);
+
+	/* the queued snapshots are saved before the thread exits */
+	thrd_join(worker.thrd, NULL);
+}
+
+
 static int module_init(void)
 {
+	int err;
+
+	err = mutex_alloc(&worker.lock);
+	if (err)
+		return err;
+
+	if (cnd_init(&worker.wait) != thrd_success) {
+		worker.lock = mem_deref(worker.lock);
+		return ENOMEM;
+	}
+
+	re_atomic_rlx_set(&worker.run, true);
+	err = thread_create_name(&worker.thrd, "snapshot", worker_thread,
+				 NULL);
+	if (err) {
+		re_atomic_rlx_set(&worker.run, false);
+		cnd_destroy(&worker.wait);
+		worker.lock = mem_deref(worker.lock);
+		return err;
+	}
+
 	vidfilt_register(baresip_vidfiltl(), &snapshot);
 	return cmd_register(baresip_commands(), cmdv, RE_ARRAY_SIZE(cmdv));
 }
@@ -151,6 +305,11 @@ static int module_close(void)
 {
 	vidfilt_unregister(&snapshot);
 	cmd_unregister(baresip_commands(), cmdv);
+
+	worker_stop();
+	cnd_destroy(&worker.wait);
+	worker.lock = mem_deref(worker.lock);
+
 	return 0;
 }
 
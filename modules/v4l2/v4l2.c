@@ -41,9 +41,26 @@
  * @defgroup v4l2 v4l2
  *
  * V4L2 (Video for Linux 2) video-source module
+ *
+ * The capture thread dequeues the buffers from the driver and hands them
+ * over to the frame thread without copying. A buffer is queued to the
+ * driver again when its frame is released, so a slow encoder does not
+ * stall the capture. If the encoder cannot keep up, the oldest frame is
+ * dropped.
+ *
+ * Example config:
+ \verbatim
+  v4l2_queue    2    # Frames between capture and encoder (0 is inline)
+ \endverbatim
  */
 
 
+enum {
+	QUEUE_DEFAULT = 2,
+	QUEUE_MAX     = 8,
+	BUFFERS       = 4,  /* Capture buffers besides the frame queue */
+};
+
 struct buffer {
 	void  *start;
 	size_t length;
@@ -52,6 +69,7 @@ struct buffer {
 struct vidsrc_st {
 	int fd;
 	thrd_t thread;
+	thrd_t thread_frame;
 	RE_ATOMIC bool run;
 	struct vidsz sz;
 	u_int32_t pixfmt;
@@ -59,6 +77,22 @@ struct vidsrc_st {
 	unsigned int   n_buffers;
 	vidsrc_frame_h *frameh;
 	void *arg;
+
+	/* Captured frames, from the capture thread to the frame thread */
+	mtx_t *mtx;
+	cnd_t cnd;
+	struct list frameq;
+	uint32_t queue;
+	uint64_t n_frames;
+	uint64_t n_dropped;
+};
+
+/* Reference to a dequeued buffer, which is queued again when released */
+struct frame {
+	struct le le;
+	struct vidsrc_st *st;
+	struct v4l2_buffer buf;
+	uint64_t timestamp;
 };
 
 
@@ -143,7 +177,7 @@ static int init_mmap(struct vidsrc_st *st, const char *dev_name)
 
 	memset(&req, 0, sizeof(req));
 
-	req.count  = 4;
+	req.count  = BUFFERS + st->queue;
 	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = V4L2_MEMORY_MMAP;
 
@@ -360,6 +394,82 @@ static void call_frame_handler(struct vidsrc_st *st, uint8_t *buf,
 }
 
 
+static void frame_destructor(void *arg)
+{
+	struct frame *f = arg;
+
+	list_unlink(&f->le);
+
+	if (-1 == xioctl(f->st->fd, VIDIOC_QBUF, &f->buf))
+		warning("v4l2: VIDIOC_QBUF: %m\n", errno);
+}
+
+
+/* Queue a frame for the frame thread, the oldest is dropped if full */
+static void frame_enqueue(struct vidsrc_st *st, struct frame *f)
+{
+	struct frame *old = NULL;
+
+	mtx_lock(st->mtx);
+
+	if (list_count(&st->frameq) >= st->queue) {
+		old = list_ledata(list_head(&st->frameq));
+		list_unlink(&old->le);
+		++st->n_dropped;
+	}
+
+	list_append(&st->frameq, &f->le, f);
+	++st->n_frames;
+
+	cnd_signal(&st->cnd);
+	mtx_unlock(st->mtx);
+
+	/* the buffer of the dropped frame goes back to the driver */
+	mem_deref(old);
+}
+
+
+static void frame_thread_stop(struct vidsrc_st *st)
+{
+	mtx_lock(st->mtx);
+	cnd_signal(&st->cnd);
+	mtx_unlock(st->mtx);
+
+	thrd_join(st->thread_frame, NULL);
+}
+
+
+static int frame_thread(void *arg)
+{
+	struct vidsrc_st *st = arg;
+
+	mtx_lock(st->mtx);
+
+	while (re_atomic_rlx(&st->run)) {
+		struct frame *f;
+
+		f = list_ledata(list_head(&st->frameq));
+		if (!f) {
+			cnd_wait(&st->cnd, st->mtx);
+			continue;
+		}
+
+		list_unlink(&f->le);
+		mtx_unlock(st->mtx);
+
+		call_frame_handler(st, st->buffers[f->buf.index].start,
+				   f->timestamp);
+		mem_deref(f);
+
+		mtx_lock(st->mtx);
+	}
+
+	mtx_unlock(st->mtx);
+
+	return 0;
+}
+
+
 static int read_frame(struct vidsrc_st *st)
 {
 	struct v4l2_buffer buf;
@@ -390,12 +500,31 @@ static int read_frame(struct vidsrc_st *st)
 
 	if (buf.index >= st->n_buffers) {
 		warning("v4l2: index >= n_buffers\n");
+		return EINVAL;
 	}
 
 	ts = buf.timestamp;
 	timestamp = 1000000U * ts.tv_sec + ts.tv_usec;
 	timestamp = timestamp * VIDEO_TIMEBASE / 1000000U;
 
+	if (st->queue) {
+		struct frame *f;
+
+		f = mem_zalloc(sizeof(*f), frame_destructor);
+		if (!f) {
+			(void)xioctl(st->fd, VIDIOC_QBUF, &buf);
+			return ENOMEM;
+		}
+
+		f->st        = st;
+		f->buf       = buf;
+		f->timestamp = timestamp;
+
+		frame_enqueue(st, f);
+
+		return 0;
+	}
+
 	call_frame_handler(st, st->buffers[buf.index].start, timestamp);
 
 	if (-1 == xioctl (st->fd, VIDIOC_QBUF, &buf)) {
@@ -452,14 +581,31 @@ static void destructor(void *arg)
 	if (re_atomic_rlx(&st->run)) {
 		debug("v4l2: stopping read thread\n");
 		re_atomic_rlx_set(&st->run, false);
+
+		if (st->queue)
+			frame_thread_stop(st);
+
 		thrd_join(st->thread, NULL);
 	}
 
+	if (st->n_dropped) {
+		info("v4l2: %llu of %llu frames dropped\n",
+		     st->n_dropped, st->n_frames);
+	}
+
+	/* the pending buffers go back to the driver */
+	list_flush(&st->frameq);
+
 	stop_capturing(st);
 	uninit_device(st);
 
 	if (st->fd >= 0)
 		v4l2_close(st->fd);
+
+	if (st->mtx) {
+		mem_deref(st->mtx);
+		cnd_destroy(&st->cnd);
+	}
 }
 
 
@@ -518,6 +664,22 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 	st->frameh = frameh;
 	st->arg    = arg;
 	st->pixfmt = 0;
+	st->queue  = QUEUE_DEFAULT;
+
+	(void)conf_get_u32(conf_cur(), "v4l2_queue", &st->queue);
+	st->queue = min(st->queue, QUEUE_MAX);
+
+	if (st->queue) {
+		err = mutex_alloc(&st->mtx);
+		if (err)
+			goto out;
+
+		if (cnd_init(&st->cnd) != thrd_success) {
+			st->mtx = mem_deref(st->mtx);
+			err = ENOMEM;
+			goto out;
+		}
+	}
 
 	err = vd_open(st, dev);
 	if (err)
@@ -536,9 +698,21 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 		goto out;
 
 	re_atomic_rlx_set(&st->run, true);
+
+	if (st->queue) {
+		err = thread_create_name(&st->thread_frame, "v4l2 frame",
+					 frame_thread, st);
+		if (err) {
+			re_atomic_rlx_set(&st->run, false);
+			goto out;
+		}
+	}
+
 	err = thread_create_name(&st->thread, "v4l2", read_thread, st);
 	if (err) {
 		re_atomic_rlx_set(&st->run, false);
+		if (st->queue)
+			frame_thread_stop(st);
 		goto out;
 	}
 
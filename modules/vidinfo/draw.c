@@ -3,6 +3,10 @@
  *
  * Copyright (C) 2010 - 2015 Alfred E. Heggestad
  */
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -10,6 +14,31 @@
 #include "xga_font_data.h"
 
 
+/*
+ * The overlay is rendered once into a luma bitmap and a mask, and only
+ * rendered again when the text changes. For every frame the bitmap is
+ * blended into the frame, the background is dimmed to half the luma and
+ * the drawn pixels replace the luma and get a neutral chroma.
+ */
+
+enum {
+	TEXT_SIZE  = 512,
+	LUMA_WHITE = 235,
+	LUMA_BLACK = 16,
+	CHROMA_GRAY = 128,
+};
+
+
+struct overlay {
+	uint8_t *luma;            /**< Luma of the drawn pixels         */
+	uint8_t *mask;            /**< 0xff for drawn, 0 for dimmed     */
+	uint8_t *cmask;           /**< Chroma mask, half resolution     */
+	unsigned w;               /**< Width in pixels, even            */
+	unsigned h;               /**< Height in pixels, even           */
+	char text[TEXT_SIZE];     /**< Text of the rendered bitmap      */
+};
+
+
 static void dim_region(struct vidframe *frame,
 		       int x0, int y0, unsigned width, unsigned height)
 {
@@ -57,20 +86,13 @@ static void draw_char(struct vidframe *frame, int x0, int y0, uint8_t ch)
 
 
 static void draw_text(struct vidframe *frame, struct vidpt *pos,
-		      const char *fmt, ...)
+		      const char *text)
 {
-	char buf[4096] = "";
-	va_list ap;
-	int len, i;
 	const unsigned x0 = pos->x;
 
-	va_start(ap, fmt);
-	len = re_vsnprintf(buf, sizeof(buf), fmt, ap);
-	va_end(ap);
-
-	for (i=0; i<len; i++) {
+	for (; *text; text++) {
 
-		int ch = buf[i];
+		const uint8_t ch = *text;
 
 		if (ch == '\n') {
 			pos->x = x0;
@@ -85,51 +107,329 @@ static void draw_text(struct vidframe *frame, struct vidpt *pos,
 }
 
 
-int vidinfo_draw_box(struct vidframe *frame, uint64_t timestamp,
-		     const struct stats *stats, const struct video *vid,
-		     int x0, int y0, int width, int height)
+/**
+ * Print the video info text
+ *
+ * @param buf   Buffer for the text
+ * @param size  Size of the buffer
+ * @param frame Decoded video frame
+ * @param stats Decode statistics
+ * @param vid   Video object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidinfo_text(char *buf, size_t size, const struct vidframe *frame,
+		 const struct stats *stats, const struct video *vid)
 {
 	const struct vidcodec *vc;
-	struct stream *strm;
 	const struct rtcp_stats *rtcp;
-	struct vidpt pos = {x0+2, y0+2};
-	int64_t dur;
+	int n, len;
 
-	dur = timestamp - stats->last_timestamp;
-
-	dim_region(frame, x0, y0, width, height);
+	if (!buf || !size || !frame || !stats)
+		return EINVAL;
 
-	vidframe_draw_rect(frame, x0, y0, width, height, 255, 255, 255);
-	vidframe_draw_rect(frame, x0+1, y0+1, width, height, 0, 0, 0);
-
-	draw_text(frame, &pos,
-		  "[%H]\n"
-		  "Resolution:   %u x %u\n"
-		  "Framerate:    %.1f\n"
-		  ,
-		  fmt_gmtime, NULL,
-		  frame->size.w, frame->size.h,
-		  (double)VIDEO_TIMEBASE / (double)dur);
+	len = re_snprintf(buf, size,
+			  "[%H]\n"
+			  "Resolution:   %u x %u\n"
+			  "Framerate:    %.1f\n"
+			  ,
+			  fmt_gmtime, NULL,
+			  frame->size.w, frame->size.h,
+			  stats->fps);
+	if (len < 0)
+		return ENOMEM;
 
 	vc = video_codec(vid, false);
 	if (vc) {
-		draw_text(frame, &pos, "Decoder:      %s\n", vc->name);
+		n = re_snprintf(buf + len, size - len,
+				"Decoder:      %s\n", vc->name);
+		if (n < 0)
+			return ENOMEM;
+
+		len += n;
 	}
 
-	strm = video_strm(vid);
-	rtcp = stream_rtcp_stats(strm);
+	rtcp = stream_rtcp_stats(video_strm(vid));
 	if (rtcp && rtcp->rx.sent) {
 
 		double loss;
 
 		loss = 100.0 * (double)rtcp->rx.lost / (double)rtcp->rx.sent;
 
-		draw_text(frame, &pos,
-			  "Jitter:       %.1f ms\n"
-			  "Packetloss:   %.2f %%\n"
-			  ,
-			  (double)rtcp->rx.jit * .001, loss);
+		n = re_snprintf(buf + len, size - len,
+				"Jitter:       %.1f ms\n"
+				"Packetloss:   %.2f %%\n"
+				,
+				(double)rtcp->rx.jit * .001, loss);
+		if (n < 0)
+			return ENOMEM;
+	}
+
+	return 0;
+}
+
+
+static void overlay_destructor(void *arg)
+{
+	struct overlay *ov = arg;
+
+	mem_deref(ov->luma);
+	mem_deref(ov->mask);
+	mem_deref(ov->cmask);
+}
+
+
+/**
+ * Allocate an overlay bitmap
+ *
+ * @param ovp    Pointer to allocated overlay
+ * @param width  Width in pixels, rounded down to even
+ * @param height Height in pixels, rounded down to even
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidinfo_overlay_alloc(struct overlay **ovp,
+			  unsigned width, unsigned height)
+{
+	struct overlay *ov;
+	const size_t sz = (size_t)(width & ~1u) * (height & ~1u);
+
+	if (!ovp || !sz)
+		return EINVAL;
+
+	ov = mem_zalloc(sizeof(*ov), overlay_destructor);
+	if (!ov)
+		return ENOMEM;
+
+	ov->w = width & ~1u;
+	ov->h = height & ~1u;
+
+	ov->luma  = mem_zalloc(sz, NULL);
+	ov->mask  = mem_zalloc(sz, NULL);
+	ov->cmask = mem_zalloc(sz / 4, NULL);
+	if (!ov->luma || !ov->mask || !ov->cmask) {
+		mem_deref(ov);
+		return ENOMEM;
+	}
+
+	*ovp = ov;
+
+	return 0;
+}
+
+
+static void overlay_point(struct overlay *ov, unsigned x, unsigned y,
+			  uint8_t luma)
+{
+	const size_t i = (size_t)y * ov->w + x;
+
+	if (x >= ov->w || y >= ov->h)
+		return;
+
+	ov->luma[i] = luma;
+	ov->mask[i] = 0xff;
+	ov->cmask[(size_t)(y / 2) * (ov->w / 2) + x / 2] = 0xff;
+}
+
+
+static void overlay_rect(struct overlay *ov, unsigned x0, unsigned y0,
+			 unsigned w, unsigned h, uint8_t luma)
+{
+	for (unsigned x = x0; x < x0 + w; x++) {
+		overlay_point(ov, x, y0, luma);
+		overlay_point(ov, x, y0 + h - 1, luma);
+	}
+
+	for (unsigned y = y0; y < y0 + h; y++) {
+		overlay_point(ov, x0, y, luma);
+		overlay_point(ov, x0 + w - 1, y, luma);
+	}
+}
+
+
+static void overlay_char(struct overlay *ov, unsigned x0, unsigned y0,
+			 uint8_t ch)
+{
+	const uint8_t *font = &vidinfo_cga_font[ch * FONT_HEIGHT];
+
+	for (unsigned y = 0; y < FONT_HEIGHT; y++) {
+
+		for (unsigned x = 0; x < FONT_WIDTH; x++) {
+
+			if (font[y] & 1<<(7-x))
+				overlay_point(ov, x0+x, y0+y, LUMA_WHITE);
+		}
+	}
+}
+
+
+static void overlay_render(struct overlay *ov, const char *text)
+{
+	const size_t sz = (size_t)ov->w * ov->h;
+	unsigned x = 2, y = 2;
+
+	memset(ov->luma, 0, sz);
+	memset(ov->mask, 0, sz);
+	memset(ov->cmask, 0, sz / 4);
+
+	overlay_rect(ov, 0, 0, ov->w, ov->h, LUMA_WHITE);
+	overlay_rect(ov, 1, 1, ov->w - 2, ov->h - 2, LUMA_BLACK);
+
+	for (; *text; text++) {
+
+		const uint8_t ch = *text;
+
+		if (ch == '\n') {
+			x  = 2;
+			y += FONT_HEIGHT;
+			continue;
+		}
+
+		overlay_char(ov, x, y, ch);
+
+		x += FONT_WIDTH;
 	}
+}
+
+
+/**
+ * Update the overlay bitmap, it is only rendered if the text changed
+ *
+ * @param ov   Overlay bitmap
+ * @param text Text to render
+ */
+void vidinfo_overlay_update(struct overlay *ov, const char *text)
+{
+	if (!ov || !text)
+		return;
+
+	if (0 == str_cmp(ov->text, text) && ov->text[0])
+		return;
+
+	overlay_render(ov, text);
+	str_ncpy(ov->text, text, sizeof(ov->text));
+}
+
+
+/* Dim the background to half the luma, replace the drawn pixels */
+static void blend_luma(uint8_t *p, const uint8_t *luma, const uint8_t *mask,
+		       unsigned n)
+{
+	unsigned x = 0;
+
+#if defined(__SSE2__)
+	const __m128i lo7 = _mm_set1_epi8(0x7f);
+
+	for (; x + 16 <= n; x += 16) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)&p[x]);
+		__m128i l = _mm_loadu_si128((const __m128i *)&luma[x]);
+		__m128i m = _mm_loadu_si128((const __m128i *)&mask[x]);
+
+		v = _mm_and_si128(_mm_srli_epi16(v, 1), lo7);
+		v = _mm_or_si128(_mm_and_si128(m, l), _mm_andnot_si128(m, v));
+
+		_mm_storeu_si128((__m128i *)&p[x], v);
+	}
+#endif
+
+	for (; x < n; x++)
+		p[x] = mask[x] ? luma[x] : p[x] >> 1;
+}
+
+
+static void blend_chroma(uint8_t *p, const uint8_t *mask, unsigned n)
+{
+	unsigned x = 0;
+
+#if defined(__SSE2__)
+	const __m128i gray = _mm_set1_epi8((char)CHROMA_GRAY);
+
+	for (; x + 16 <= n; x += 16) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)&p[x]);
+		__m128i m = _mm_loadu_si128((const __m128i *)&mask[x]);
+
+		v = _mm_or_si128(_mm_and_si128(m, gray),
+				 _mm_andnot_si128(m, v));
+
+		_mm_storeu_si128((__m128i *)&p[x], v);
+	}
+#endif
+
+	for (; x < n; x++) {
+		if (mask[x])
+			p[x] = CHROMA_GRAY;
+	}
+}
+
+
+/**
+ * Blend the overlay bitmap into a video frame
+ *
+ * @param frame Video frame in YUV420P format
+ * @param ov    Overlay bitmap
+ * @param x0    Left position, even
+ * @param y0    Top position, even
+ */
+void vidinfo_overlay_blend(struct vidframe *frame, const struct overlay *ov,
+			   unsigned x0, unsigned y0)
+{
+	const unsigned cw = ov->w / 2;
+
+	if (!frame || !ov || frame->fmt != VID_FMT_YUV420P)
+		return;
+
+	if (x0 + ov->w > frame->size.w || y0 + ov->h > frame->size.h)
+		return;
+
+	for (unsigned y = 0; y < ov->h; y++) {
+
+		blend_luma(frame->data[0] + (size_t)(y0 + y) *
+			   frame->linesize[0] + x0,
+			   &ov->luma[(size_t)y * ov->w],
+			   &ov->mask[(size_t)y * ov->w], ov->w);
+	}
+
+	for (unsigned y = 0; y < ov->h / 2; y++) {
+
+		const uint8_t *mask = &ov->cmask[(size_t)y * cw];
+		const unsigned cy = y0 / 2 + y;
+
+		blend_chroma(frame->data[1] + (size_t)cy *
+			     frame->linesize[1] + x0 / 2, mask, cw);
+		blend_chroma(frame->data[2] + (size_t)cy *
+			     frame->linesize[2] + x0 / 2, mask, cw);
+	}
+}
+
+
+/**
+ * Draw the video info box directly into a frame of any format
+ *
+ * @param frame  Video frame
+ * @param text   Text of the box
+ * @param x0     Left position
+ * @param y0     Top position
+ * @param width  Width of the box
+ * @param height Height of the box
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidinfo_draw_box(struct vidframe *frame, const char *text,
+		     int x0, int y0, int width, int height)
+{
+	struct vidpt pos = {x0+2, y0+2};
+
+	if (!frame || !text)
+		return EINVAL;
+
+	dim_region(frame, x0, y0, width, height);
+
+	vidframe_draw_rect(frame, x0, y0, width, height, 255, 255, 255);
+	vidframe_draw_rect(frame, x0+1, y0+1, width, height, 0, 0, 0);
+
+	draw_text(frame, &pos, text);
 
 	return 0;
 }
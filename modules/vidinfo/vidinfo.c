@@ -37,6 +37,7 @@ struct vidinfo_dec {
 	struct vidfilt_dec_st vf;  /* base member (inheritance) */
 
 	struct stats stats;
+	struct overlay *ov;
 	const struct video *vid;
 };
 
@@ -49,6 +50,7 @@ static void decode_destructor(void *arg)
 	struct vidinfo_dec *st = arg;
 
 	list_unlink(&st->vf.le);
+	mem_deref(st->ov);
 }
 
 
@@ -57,6 +59,7 @@ static int decode_update(struct vidfilt_dec_st **stp, void **ctx,
 			 const struct video *vid)
 {
 	struct vidinfo_dec *st;
+	int err;
 	(void)prm;
 	(void)vid;
 
@@ -70,6 +73,13 @@ static int decode_update(struct vidfilt_dec_st **stp, void **ctx,
 	if (!st)
 		return ENOMEM;
 
+	err = vidinfo_overlay_alloc(&st->ov, MAX_PIXELS_WIDTH,
+				    MAX_PIXELS_HEIGHT);
+	if (err) {
+		mem_deref(st);
+		return err;
+	}
+
 	st->vid = vid;
 
 	*stp = (struct vidfilt_dec_st *)st;
@@ -78,6 +88,31 @@ static int decode_update(struct vidfilt_dec_st **stp, void **ctx,
 }
 
 
+/*
+ * The framerate is averaged over one second, so that the text and the
+ * overlay bitmap change at most once per second.
+ */
+static void stats_update(struct stats *stats, uint64_t timestamp)
+{
+	if (!stats->ts_fps || timestamp < stats->ts_fps) {
+		stats->ts_fps = timestamp;
+		stats->frames = 0;
+		return;
+	}
+
+	++stats->frames;
+
+	if (timestamp - stats->ts_fps >= VIDEO_TIMEBASE) {
+
+		stats->fps = (double)stats->frames * VIDEO_TIMEBASE /
+			(double)(timestamp - stats->ts_fps);
+
+		stats->ts_fps = timestamp;
+		stats->frames = 0;
+	}
+}
+
+
 static int decode(struct vidfilt_dec_st *_st, struct vidframe *frame,
 		  uint64_t *timestamp)
 {
@@ -88,7 +123,13 @@ static int decode(struct vidfilt_dec_st *_st, struct vidframe *frame,
 
 	if (frame && timestamp) {
 
+		char text[512];
 		unsigned x0, y0;
+		int err;
+
+		if (frame->size.w < MAX_PIXELS_WIDTH + 4 ||
+		    frame->size.h < MAX_PIXELS_HEIGHT + 4)
+			return 0;
 
 		switch (box_layout) {
 
@@ -99,17 +140,28 @@ static int decode(struct vidfilt_dec_st *_st, struct vidframe *frame,
 
 		case LAYOUT_BOTTOM:
 			x0 = 4;
-			y0 = frame->size.h - MAX_PIXELS_HEIGHT;
+			y0 = (frame->size.h - MAX_PIXELS_HEIGHT) & ~1u;
 			break;
 
 		default:
 			return EINVAL;
 		}
 
-		vidinfo_draw_box(frame, *timestamp, &st->stats, st->vid,
-				 x0, y0, MAX_PIXELS_WIDTH, MAX_PIXELS_HEIGHT);
+		stats_update(&st->stats, *timestamp);
+
+		err = vidinfo_text(text, sizeof(text), frame, &st->stats,
+				   st->vid);
+		if (err)
+			return err;
 
-		st->stats.last_timestamp = *timestamp;
+		if (frame->fmt == VID_FMT_YUV420P) {
+			vidinfo_overlay_update(st->ov, text);
+			vidinfo_overlay_blend(frame, st->ov, x0, y0);
+		}
+		else {
+			vidinfo_draw_box(frame, text, x0, y0,
+					 MAX_PIXELS_WIDTH, MAX_PIXELS_HEIGHT);
+		}
 	}
 
 	return 0;
@@ -6,10 +6,20 @@
 
 
 struct stats {
-	uint64_t last_timestamp;
+	uint64_t ts_fps;      /**< Start of the framerate interval   */
+	unsigned frames;      /**< Decoded frames in the interval    */
+	double fps;           /**< Framerate of the last interval    */
 };
 
+struct overlay;
 
-int vidinfo_draw_box(struct vidframe *frame, uint64_t timestamp,
-		     const struct stats *stats, const struct video *vid,
-		     int x0, int y0, int width, int height);
+
+int  vidinfo_text(char *buf, size_t size, const struct vidframe *frame,
+		  const struct stats *stats, const struct video *vid);
+int  vidinfo_overlay_alloc(struct overlay **ovp,
+			   unsigned width, unsigned height);
+void vidinfo_overlay_update(struct overlay *ov, const char *text);
+void vidinfo_overlay_blend(struct vidframe *frame, const struct overlay *ov,
+			   unsigned x0, unsigned y0);
+int  vidinfo_draw_box(struct vidframe *frame, const char *text,
+		      int x0, int y0, int width, int height);
@@ -177,6 +177,13 @@ static inline int packetize(bool marker, const uint8_t *buf, size_t len,
 
 	maxlen -= sizeof(hdr);
 
+	/* fragments of a partition have about the same size */
+	if (len > maxlen) {
+		const size_t n = (len + maxlen - 1) / maxlen;
+
+		maxlen = (len + n - 1) / n;
+	}
+
 	while (len > maxlen) {
 
 		hdr_encode(hdr, noref, start, partid, picid);
@@ -346,3 +353,34 @@ int vp8_encode_packetize(struct videnc_state *ves,
 
 	return 0;
 }
+
+
+/*
+ * Inactive macroblocks are coded as skipped, the map has one byte per
+ * macroblock. A map of another frame size is ignored.
+ */
+int vp8_encode_actmap(struct videnc_state *ves, const struct vidactmap *map)
+{
+	vpx_active_map_t am;
+	vpx_codec_err_t res;
+
+	if (!ves || !map)
+		return EINVAL;
+
+	if (!ves->ctxup ||
+	    map->cols != (ves->size.w + 15) / 16 ||
+	    map->rows != (ves->size.h + 15) / 16)
+		return 0;
+
+	am.active_map = (unsigned char *)map->map;
+	am.rows       = map->rows;
+	am.cols       = map->cols;
+
+	res = vpx_codec_control(&ves->ctx, VP8E_SET_ACTIVEMAP, &am);
+	if (res) {
+		warning("vp8: active map: %s\n", vpx_codec_err_to_string(res));
+		return EPROTO;
+	}
+
+	return 0;
+}
@@ -34,6 +34,7 @@ static struct vp8_vidcodec vp8 = {
 		.dech      = vp8_decode,
 		.fmtp_ench = vp8_fmtp_enc,
 		.packetizeh = vp8_encode_packetize,
+		.actmaph    = vp8_encode_actmap,
 	},
 	.max_fs   = 8100,  /* 1920 x 1080 / (16^2) */
 };
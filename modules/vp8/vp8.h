@@ -17,6 +17,7 @@ int vp8_encode(struct videnc_state *ves, bool update,
 	       const struct vidframe *frame, uint64_t timestamp);
 int vp8_encode_packetize(struct videnc_state *ves,
 			 const struct vidpacket *packet);
+int vp8_encode_actmap(struct videnc_state *ves, const struct vidactmap *map);
 
 
 /* Decode */
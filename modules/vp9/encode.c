@@ -15,6 +15,7 @@
 
 enum {
 	HDR_SIZE = 3,
+	TILE_MIN_WIDTH = 256,
 };
 
 
@@ -32,9 +33,28 @@ struct videnc_state {
 	unsigned n_frames;
 	unsigned n_key_frames;
 	size_t n_bytes;
+
+	/* Encoder configuration and its encode time */
+	unsigned threads;
+	unsigned tile_cols;
+	int32_t cpuused;
+	unsigned n_enc;
+	uint64_t enc_usec;
 };
 
 
+static void enc_stats(const struct videnc_state *ves)
+{
+	if (!ves->n_enc)
+		return;
+
+	debug("vp9: %u x %u threads=%u tile_columns=%u cpuused=%d:"
+	      " %.2f ms/frame (%u frames)\n",
+	      ves->size.w, ves->size.h, ves->threads, 1u << ves->tile_cols,
+	      ves->cpuused, ves->enc_usec / 1000.0 / ves->n_enc, ves->n_enc);
+}
+
+
 static void destructor(void *arg)
 {
 	struct videnc_state *ves = arg;
@@ -46,9 +66,41 @@ static void destructor(void *arg)
 		      ves->n_frames,
 		      ves->n_key_frames,
 		      ves->n_bytes);
+		enc_stats(ves);
 
 		vpx_codec_destroy(&ves->ctx);
 	}
+
+	videnc_threads_free(ves->threads);
+}
+
+
+/* Threads for the picture size, if not set with vp9_enc_threads */
+static unsigned auto_threads(const struct vidsz *size)
+{
+	const uint32_t pixels = size->w * size->h;
+
+	if (pixels >= 1920 * 1080)
+		return 8;
+	else if (pixels >= 1280 * 720)
+		return 4;
+	else if (pixels >= 640 * 360)
+		return 2;
+	else
+		return 1;
+}
+
+
+/* Tile columns (log2), each tile column can be encoded by one thread */
+static unsigned tile_cols_log2(unsigned width, unsigned threads)
+{
+	unsigned n = 0;
+
+	while (n < 6 && (width >> (n + 1)) >= TILE_MIN_WIDTH &&
+	       (1u << (n + 1)) <= threads)
+		++n;
+
+	return n;
 }
 
 
@@ -103,11 +155,27 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 {
 	vpx_codec_enc_cfg_t cfg;
 	vpx_codec_err_t res;
+	uint32_t threads = 0;
+	int32_t cpuused = 8;
 
 	res = vpx_codec_enc_config_default(&vpx_codec_vp9_cx_algo, &cfg, 0);
 	if (res)
 		return EPROTO;
 
+	conf_get_u32(conf_cur(), "vp9_enc_threads", &threads);
+	conf_get_i32(conf_cur(), "vp9_enc_cpuused", &cpuused);
+
+	if (ves->ctxup)
+		enc_stats(ves);
+
+	videnc_threads_free(ves->threads);
+	ves->threads   = videnc_threads_alloc(threads ? threads
+						  : auto_threads(size));
+	ves->tile_cols = tile_cols_log2(size->w, ves->threads);
+	ves->cpuused   = cpuused;
+	ves->n_enc     = 0;
+	ves->enc_usec  = 0;
+
 	/*
 	  Profile 0 = 8 bit yuv420p
 	  Profile 1 = 8 bit yuv422/440/444p
@@ -116,6 +184,7 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 	 */
 
 	cfg.g_profile         = 0;
+	cfg.g_threads         = ves->threads;
 	cfg.g_w               = size->w;
 	cfg.g_h               = size->h;
 	cfg.g_timebase.num    = 1;
@@ -142,10 +211,23 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 
 	ves->ctxup = true;
 
-	res = vpx_codec_control(&ves->ctx, VP8E_SET_CPUUSED, 8);
+	res = vpx_codec_control(&ves->ctx, VP8E_SET_CPUUSED, cpuused);
+	if (res) {
+		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
+	}
+
+	res = vpx_codec_control(&ves->ctx, VP9E_SET_TILE_COLUMNS,
+				(int)ves->tile_cols);
+	if (res) {
+		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
+	}
+#ifdef VPX_CTRL_VP9E_SET_ROW_MT
+	res = vpx_codec_control(&ves->ctx, VP9E_SET_ROW_MT,
+				ves->threads > 1 ? 1 : 0);
 	if (res) {
 		warning("vp9: codec ctrl: %s\n", vpx_codec_err_to_string(res));
 	}
+#endif
 #ifdef VP9E_SET_NOISE_SENSITIVITY
 	res = vpx_codec_control(&ves->ctx, VP9E_SET_NOISE_SENSITIVITY, 0);
 	if (res) {
@@ -153,7 +235,9 @@ static int open_encoder(struct videnc_state *ves, const struct vidsz *size)
 	}
 #endif
 
-	info("vp9: encoder opened, picture size %u x %u\n", size->w, size->h);
+	info("vp9: encoder opened, picture size %u x %u"
+	     " (threads=%u, tile_columns=%u, cpuused=%d)\n",
+	     size->w, size->h, ves->threads, 1u << ves->tile_cols, cpuused);
 
 	return 0;
 }
@@ -220,6 +304,7 @@ int vp9_encode(struct videnc_state *ves, bool update,
 	vpx_codec_err_t res;
 	vpx_image_t *img = NULL;
 	vpx_img_fmt_t img_fmt;
+	uint64_t t0;
 	int err = 0, i;
 
 	if (!ves || !frame)
@@ -266,6 +351,8 @@ int vp9_encode(struct videnc_state *ves, bool update,
 		img->planes[i] = frame->data[i];
 	}
 
+	t0 = tmr_jiffies_usec();
+
 	res = vpx_codec_encode(&ves->ctx, img, timestamp, 1,
 			       flags, VPX_DL_REALTIME);
 	if (res) {
@@ -274,6 +361,9 @@ int vp9_encode(struct videnc_state *ves, bool update,
 		goto out;
 	}
 
+	ves->enc_usec += tmr_jiffies_usec() - t0;
+	++ves->n_enc;
+
 	++ves->picid;
 
 	for (;;) {
@@ -336,3 +426,50 @@ int vp9_encode_packetize(struct videnc_state *ves,
 
 	return 0;
 }
+
+
+/*
+ * Inactive macroblocks are coded as skipped, the map has one byte per
+ * macroblock. A map of another frame size is ignored.
+ */
+int vp9_encode_actmap(struct videnc_state *ves, const struct vidactmap *map)
+{
+	vpx_active_map_t am;
+	vpx_codec_err_t res;
+
+	if (!ves || !map)
+		return EINVAL;
+
+	if (!ves->ctxup ||
+	    map->cols != (ves->size.w + 15) / 16 ||
+	    map->rows != (ves->size.h + 15) / 16)
+		return 0;
+
+	am.active_map = (unsigned char *)map->map;
+	am.rows       = map->rows;
+	am.cols       = map->cols;
+
+	res = vpx_codec_control(&ves->ctx, VP8E_SET_ACTIVEMAP, &am);
+	if (res) {
+		warning("vp9: active map: %s\n", vpx_codec_err_to_string(res));
+		return EPROTO;
+	}
+
+	return 0;
+}
+
+
+int vp9_encode_debug(struct re_printf *pf, const struct videnc_state *ves)
+{
+	double ms;
+
+	if (!ves || !ves->ctxup)
+		return 0;
+
+	ms = ves->n_enc ? ves->enc_usec / 1000.0 / ves->n_enc : 0.0;
+
+	return re_hprintf(pf, "     vp9: threads=%u tile_columns=%u"
+			  " cpuused=%d %.2f ms/frame (%u frames)\n",
+			  ves->threads, 1u << ves->tile_cols, ves->cpuused,
+			  ms, ves->n_enc);
+}
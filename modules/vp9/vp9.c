@@ -38,6 +38,8 @@ static struct vp9_vidcodec vp9 = {
 		.dech      = vp9_decode,
 		.fmtp_ench = vp9_fmtp_enc,
 		.packetizeh = vp9_encode_packetize,
+		.actmaph    = vp9_encode_actmap,
+		.encdebugh  = vp9_encode_debug,
 	},
 	.max_fs = 3600
 };
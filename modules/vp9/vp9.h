@@ -17,6 +17,8 @@ int vp9_encode(struct videnc_state *ves, bool update,
 	       const struct vidframe *frame, uint64_t timestamp);
 int vp9_encode_packetize(struct videnc_state *ves,
 			 const struct vidpacket *pkt);
+int vp9_encode_actmap(struct videnc_state *ves, const struct vidactmap *map);
+int vp9_encode_debug(struct re_printf *pf, const struct videnc_state *ves);
 
 
 /* Decode */
@@ -18,7 +18,23 @@
  * Configuration options:
  *
  \verbatim
-  webrtc_aec_extended_filter {yes,no} # Enable extended_filter
+  webrtc_aec_extended_filter {yes,no}      # Enable extended_filter
+  webrtc_aec_mode            {inline,thread}
+  webrtc_aec_threads         1             # DSP worker threads
+  webrtc_aec_delay           20            # Pipeline delay [ms]
+ \endverbatim
+ *
+ * In "thread" mode the AudioProcessing instances run on a shared pool
+ * of DSP worker threads instead of the audio TX and RX threads. The
+ * near-end signal is delayed by a fixed pipeline delay, blocks which
+ * are not processed in time are sent unprocessed and counted as late.
+ *
+ * Commands:
+ *
+ \verbatim
+  webrtc_aec_debug                   Show DSP worker statistics
+  webrtc_aec_bench <near.wav> <far.wav>
+                                     Benchmark the filter on a WAV pair
  \endverbatim
  *
  * This code is experimental.
@@ -29,14 +45,20 @@
  */
 
 
+#define SOUND_CARD_BUF 20
+
+
 using namespace webrtc;
 
 static bool webrtc_aec_extended_filter;
+static enum aec_mode webrtc_aec_mode = AEC_MODE_INLINE;
 
 static void aec_destructor(void *arg)
 {
 	struct aec *st = (struct aec *)arg;
 
+	webrtc_aec_dsp_detach(st);
+
 	if (st->inst)
 		delete st->inst;
 
@@ -116,6 +138,15 @@ int webrtc_aec_alloc(struct aec **stp, void **ctx, struct aufilt_prm *prm)
 
 	aec->inst->SetExtraOptions(config);
 
+	if (webrtc_aec_mode == AEC_MODE_THREAD) {
+		err = webrtc_aec_dsp_attach(aec);
+		if (err) {
+			warning("webrtc_aec: could not attach to DSP pool"
+				" (%m)\n", err);
+			goto out;
+		}
+	}
+
  out:
 	if (err)
 		mem_deref(aec);
@@ -128,34 +159,177 @@ int webrtc_aec_alloc(struct aec **stp, void **ctx, struct aufilt_prm *prm)
 }
 
 
+static AudioProcessing::ChannelLayout get_layout(uint8_t ch)
+{
+	switch (ch) {
+
+	case 1: return AudioProcessing::kMono;
+	case 2: return AudioProcessing::kStereo;
+	default: return (AudioProcessing::ChannelLayout)-1;
+	}
+}
+
+
+/**
+ * Process one block of near-end (capture) samples
+ *
+ * @param aec   AEC instance
+ * @param sampv Block of blocksize samples (in/out)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int webrtc_aec_process_near(struct aec *aec, float *sampv)
+{
+	size_t samples_per_channel = aec->blocksize / aec->ch;
+	const float *src = sampv;
+	float *dest = sampv;
+	int r;
+
+	// NOTE: important
+	aec->inst->set_stream_delay_ms(SOUND_CARD_BUF);
+
+	r = aec->inst->ProcessStream(&src,
+				     samples_per_channel,
+				     aec->srate,
+				     get_layout(aec->ch),
+				     aec->srate,
+				     get_layout(aec->ch),
+				     &dest);
+	if (r != 0) {
+		warning("webrtc_aec: encode:"
+			" ProcessStream error (%d)\n",
+			r);
+		return EPROTO;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Process one block of far-end (render) samples
+ *
+ * @param aec   AEC instance
+ * @param sampv Block of blocksize samples (in/out)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int webrtc_aec_process_far(struct aec *aec, float *sampv)
+{
+	webrtc::StreamConfig config(aec->srate, aec->ch, false);
+	const float *src = sampv;
+	float *dest = sampv;
+	int r;
+
+	r = aec->inst->ProcessReverseStream(&src, config, config, &dest);
+	if (r != 0) {
+		warning("webrtc_aec: decode: ProcessReverseStream"
+			" error (%d)\n", r);
+		return EPROTO;
+	}
+
+	return 0;
+}
+
+
 static struct aufilt webrtc_aec = {
 	.le      = LE_INIT,
 	.name    = "webrtc_aec",
 	.encupdh = webrtc_aec_encode_update,
 	.ench    = webrtc_aec_encode,
 	.decupdh = webrtc_aec_decode_update,
-	.dech    = webrtc_aec_decode
+	.dech    = webrtc_aec_decode,
+	.fmts    = AUFILT_FMT(AUFMT_FLOAT)
 };
 
 
-static int module_init(void)
+static int cmd_bench(struct re_printf *pf, void *arg)
 {
-	aufilt_register(baresip_aufiltl(), &webrtc_aec);
+	const struct cmd_arg *carg = (const struct cmd_arg *)arg;
+	struct pl pl_near, pl_far;
+	char *near_file = NULL, *far_file = NULL;
+	int err;
+
+	err = re_regex(carg->prm, str_len(carg->prm), "[^ ]+ [^ ]+",
+		       &pl_near, &pl_far);
+	if (err)
+		return re_hprintf(pf, "usage: webrtc_aec_bench"
+				  " <near.wav> <far.wav>\n");
+
+	err  = pl_strdup(&near_file, &pl_near);
+	err |= pl_strdup(&far_file, &pl_far);
+	if (err)
+		goto out;
+
+	err = webrtc_aec_bench(pf, &webrtc_aec, near_file, far_file);
+
+ out:
+	mem_deref(near_file);
+	mem_deref(far_file);
+
+	return err;
+}
+
+
+static const struct cmd cmdv[] = {
+	{"webrtc_aec_debug", 0, 0, "Show webrtc_aec DSP statistics",
+	 webrtc_aec_pool_debug},
+	{"webrtc_aec_bench", 0, CMD_PRM,
+	 "Benchmark webrtc_aec <near.wav> <far.wav>", cmd_bench},
+};
 
+
+static int module_init(void)
+{
 	struct conf *conf = conf_cur();
+	struct pl mode;
+	uint32_t threads = 1;
+	uint32_t delay = 20;
+	int err;
+
 	conf_get_bool(
 		conf,
 		"webrtc_aec_extended_filter",
 		&webrtc_aec_extended_filter
 	);
 
-	return 0;
+	if (0 == conf_get(conf, "webrtc_aec_mode", &mode)) {
+
+		if (0 == pl_strcasecmp(&mode, "thread")) {
+			webrtc_aec_mode = AEC_MODE_THREAD;
+		}
+		else if (0 == pl_strcasecmp(&mode, "inline")) {
+			webrtc_aec_mode = AEC_MODE_INLINE;
+		}
+		else {
+			warning("webrtc_aec: unknown mode '%r'\n", &mode);
+			return EINVAL;
+		}
+	}
+
+	conf_get_u32(conf, "webrtc_aec_threads", &threads);
+	conf_get_u32(conf, "webrtc_aec_delay", &delay);
+
+	if (webrtc_aec_mode == AEC_MODE_THREAD) {
+		const uint32_t blocks = (delay + BLOCKSIZE - 1) / BLOCKSIZE;
+
+		err = webrtc_aec_pool_init(threads, blocks);
+		if (err)
+			return err;
+	}
+
+	aufilt_register(baresip_aufiltl(), &webrtc_aec);
+
+	return cmd_register(baresip_commands(), cmdv, RE_ARRAY_SIZE(cmdv));
 }
 
 
 static int module_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
 	aufilt_unregister(&webrtc_aec);
+	webrtc_aec_pool_close();
+
 	return 0;
 }
 
@@ -4,6 +4,8 @@
  * Copyright (C) 2010 Alfred E. Heggestad
  */
 
+#include <atomic>
+
 #define WEBRTC_POSIX 1
 #include <webrtc/modules/audio_processing/include/audio_processing.h>
 #include <webrtc/system_wrappers/include/trace.h>
@@ -16,12 +18,21 @@
 using namespace webrtc;
 
 
+enum aec_mode {
+	AEC_MODE_INLINE = 0,  /* Process in the aufilt handlers           */
+	AEC_MODE_THREAD,      /* Process on the shared DSP worker pool     */
+};
+
+
+struct aec_dsp;
+
 struct aec {
 	AudioProcessing *inst;
 	mtx_t mutex;
 	uint32_t srate;
 	uint8_t ch;
 	uint32_t blocksize;
+	struct aec_dsp *dsp;     /**< DSP worker state, NULL if inline */
 };
 
 
@@ -44,3 +55,25 @@ int webrtc_aec_decode(struct aufilt_dec_st *st, struct auframe *af);
 /* Common */
 
 int  webrtc_aec_alloc(struct aec **stp, void **ctx, struct aufilt_prm *prm);
+int  webrtc_aec_process_near(struct aec *aec, float *sampv);
+int  webrtc_aec_process_far(struct aec *aec, float *sampv);
+
+
+/* DSP worker pool */
+
+int  webrtc_aec_pool_init(unsigned threads, uint32_t delay);
+void webrtc_aec_pool_close(void);
+int  webrtc_aec_dsp_attach(struct aec *aec);
+void webrtc_aec_dsp_detach(struct aec *aec);
+void webrtc_aec_dsp_near(struct aec *aec, float *sampv);
+void webrtc_aec_dsp_far(struct aec *aec, const float *sampv);
+bool webrtc_aec_dsp_idle(const struct aec *aec);
+void webrtc_aec_dsp_sync(struct aec *aec);
+int  webrtc_aec_dsp_debug(struct re_printf *pf, const struct aec *aec);
+int  webrtc_aec_pool_debug(struct re_printf *pf, void *unused);
+
+
+/* Benchmark */
+
+int  webrtc_aec_bench(struct re_printf *pf, const struct aufilt *af,
+		      const char *near_file, const char *far_file);
@@ -0,0 +1,155 @@
+/**
+ * @file bench.cpp  WebRTC Acoustic Echo Cancellation (AEC) -- Benchmark
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+
+#include <time.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "aec.h"
+
+
+/*
+ * Replay a near-end/far-end WAV pair through the filter as fast as
+ * possible and report the CPU time used per second of audio. The CPU
+ * time is measured for the whole process, so DSP worker threads are
+ * included when running in threaded mode.
+ */
+
+
+static int read_block(struct aufile *af, int16_t *s16, size_t sampc)
+{
+	size_t sz = sampc * sizeof(int16_t);
+	int err;
+
+	err = aufile_read(af, (uint8_t *)s16, &sz);
+	if (err)
+		return err;
+
+	if (sz < sampc * sizeof(int16_t))
+		return ENODATA;
+
+	return 0;
+}
+
+
+int webrtc_aec_bench(struct re_printf *pf, const struct aufilt *af,
+		     const char *near_file, const char *far_file)
+{
+	struct aufile *af_near = NULL, *af_far = NULL;
+	struct aufile_prm prm_near, prm_far;
+	struct aufilt_enc_st *enc = NULL;
+	struct aufilt_dec_st *dec = NULL;
+	struct aufilt_prm prm;
+	struct auframe af_n, af_f;
+	int16_t *s16 = NULL;
+	float *near_flt = NULL, *far_flt = NULL;
+	struct aec *aec;
+	void *ctx = NULL;
+	uint64_t frames = 0;
+	size_t sampc;
+	clock_t c0, c1;
+	uint64_t t0, t1;
+	double cpu_ms, audio_s;
+	int err;
+
+	err  = aufile_open(&af_near, &prm_near, near_file, AUFILE_READ);
+	err |= aufile_open(&af_far, &prm_far, far_file, AUFILE_READ);
+	if (err) {
+		re_hprintf(pf, "webrtc_aec: could not open files (%m)\n", err);
+		goto out;
+	}
+
+	if (prm_near.srate != prm_far.srate ||
+	    prm_near.channels != prm_far.channels ||
+	    prm_near.fmt != AUFMT_S16LE || prm_far.fmt != AUFMT_S16LE) {
+		re_hprintf(pf, "webrtc_aec: WAV files must have same format"
+			   " (S16LE)\n");
+		err = EINVAL;
+		goto out;
+	}
+
+	prm.srate = prm_near.srate;
+	prm.ch    = prm_near.channels;
+	prm.fmt   = AUFMT_FLOAT;
+
+	err  = webrtc_aec_encode_update(&enc, &ctx, af, &prm, NULL);
+	err |= webrtc_aec_decode_update(&dec, &ctx, af, &prm, NULL);
+	if (err)
+		goto out;
+
+	aec = (struct aec *)ctx;
+	sampc = aec->blocksize;
+
+	s16      = (int16_t *)mem_alloc(sampc * sizeof(int16_t), NULL);
+	near_flt = (float *)mem_alloc(sampc * sizeof(float), NULL);
+	far_flt  = (float *)mem_alloc(sampc * sizeof(float), NULL);
+	if (!s16 || !near_flt || !far_flt) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	c0 = clock();
+	t0 = tmr_jiffies_usec();
+
+	for (;;) {
+		if (read_block(af_far, s16, sampc))
+			break;
+		auconv_from_s16(AUFMT_FLOAT, far_flt, s16, sampc);
+
+		if (read_block(af_near, s16, sampc))
+			break;
+		auconv_from_s16(AUFMT_FLOAT, near_flt, s16, sampc);
+
+		auframe_init(&af_f, AUFMT_FLOAT, far_flt, sampc,
+			     prm.srate, prm.ch);
+		auframe_init(&af_n, AUFMT_FLOAT, near_flt, sampc,
+			     prm.srate, prm.ch);
+
+		err  = webrtc_aec_decode(dec, &af_f);
+		err |= webrtc_aec_encode(enc, &af_n);
+		if (err)
+			goto out;
+
+		/* keep the workers from overrunning, we want all blocks
+		 * processed to measure the real cost */
+		webrtc_aec_dsp_sync(aec);
+
+		++frames;
+	}
+
+	c1 = clock();
+	t1 = tmr_jiffies_usec();
+
+	if (!frames) {
+		re_hprintf(pf, "webrtc_aec: no audio\n");
+		goto out;
+	}
+
+	cpu_ms  = 1000.0 * (double)(c1 - c0) / CLOCKS_PER_SEC;
+	audio_s = (double)frames * BLOCKSIZE / 1000.0;
+
+	err  = re_hprintf(pf, "webrtc_aec: benchmark (%s mode)\n",
+			  aec->dsp ? "thread" : "inline");
+	err |= re_hprintf(pf, "  audio:      %.2f s (%u Hz, %u ch)\n",
+			  audio_s, prm.srate, prm.ch);
+	err |= re_hprintf(pf, "  cpu:        %.1f ms\n", cpu_ms);
+	err |= re_hprintf(pf, "  wall:       %.1f ms\n",
+			  (double)(t1 - t0) / 1000.0);
+	err |= re_hprintf(pf, "  cpu/audio:  %.3f ms per second\n",
+			  cpu_ms / audio_s);
+	err |= webrtc_aec_dsp_debug(pf, aec);
+
+ out:
+	mem_deref(far_flt);
+	mem_deref(near_flt);
+	mem_deref(s16);
+	mem_deref(dec);
+	mem_deref(enc);
+	mem_deref(af_far);
+	mem_deref(af_near);
+
+	return err;
+}
@@ -72,32 +72,28 @@ int webrtc_aec_decode_update(struct aufilt_dec_st **stp, void **ctx,
 static int decode_float(struct aec_dec *dec, float *sampv, size_t sampc)
 {
 	struct aec *aec = dec->aec;
-	webrtc::StreamConfig config(aec->srate, aec->ch, false);
 	size_t i;
-	int r;
 	int err = 0;
 
 	if (sampc % aec->blocksize)
 		return EINVAL;
 
+	if (aec->dsp) {
+		for (i = 0; i < sampc; i += aec->blocksize)
+			webrtc_aec_dsp_far(aec, &sampv[i]);
+
+		return 0;
+	}
+
 	mtx_lock(&aec->mutex);
 
 	for (i = 0; i < sampc; i += aec->blocksize) {
 
-		const float *src = &sampv[i];
-		float *dest = &sampv[i];
-
-		r = aec->inst->ProcessReverseStream(&src, config, config,
-						    &dest);
-		if (r != 0) {
-			warning("webrtc_aec: decode: ProcessReverseStream"
-				" error (%d)\n", r);
-			err = EPROTO;
-			goto out;
-		}
+		err = webrtc_aec_process_far(aec, &sampv[i]);
+		if (err)
+			break;
 	}
 
- out:
 	mtx_unlock(&aec->mutex);
 
 	return err;
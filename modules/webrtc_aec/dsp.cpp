@@ -0,0 +1,605 @@
+/**
+ * @file dsp.cpp  WebRTC Acoustic Echo Cancellation (AEC) -- DSP workers
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "aec.h"
+
+
+/*
+ * In threaded mode the aufilt handlers only copy 10 ms blocks into
+ * single-producer/single-consumer rings. A shared pool of DSP workers
+ * runs the AudioProcessing instances and the encoder picks up the
+ * processed near-end block a fixed number of blocks later. If a block
+ * is not ready in time the unprocessed input is sent instead and the
+ * lateness counter is incremented, so the TX thread never waits.
+ */
+
+
+enum {
+	RING_SIZE = 16,  /* must be power of two */
+	MAX_BLOCK = 48000 * BLOCKSIZE / 1000 * MAX_CHANNELS,
+	DELAY_MAX = RING_SIZE / 2,
+	MAX_THREADS = 16,
+};
+
+
+struct aec_block {
+	uint64_t seq;
+	float sampv[MAX_BLOCK];
+};
+
+/* Lock-free SPSC ring */
+struct aec_ring {
+	std::atomic<uint32_t> head;  /**< Written by producer only */
+	std::atomic<uint32_t> tail;  /**< Written by consumer only */
+	struct aec_block blockv[RING_SIZE];
+};
+
+struct aec_worker;
+struct aec_pool;
+
+struct aec_dsp {
+	struct le le;                       /**< Member of worker list  */
+	struct aec_pool *pool;              /**< Pool reference         */
+	struct aec_worker *w;               /**< Owning worker          */
+	struct aec_ring far;                /**< Decoder  -> worker     */
+	struct aec_ring near_in;            /**< Encoder  -> worker     */
+	struct aec_ring near_out;           /**< Worker   -> encoder    */
+	struct aec_block delayv[DELAY_MAX+1];  /**< Unprocessed input   */
+	uint32_t delay;                     /**< Pipeline delay [blocks] */
+	uint64_t seq;                       /**< Next near-end sequence */
+
+	struct {
+		std::atomic<uint64_t> n_near;    /**< Near blocks sent      */
+		std::atomic<uint64_t> n_late;    /**< Not ready in time     */
+		std::atomic<uint64_t> n_stale;   /**< Processed too late    */
+		std::atomic<uint64_t> n_overrun; /**< Near ring full        */
+		std::atomic<uint64_t> n_far_overrun; /**< Far ring full     */
+		std::atomic<uint64_t> n_proc;    /**< Blocks processed      */
+		std::atomic<uint64_t> proc_usec; /**< Time in APM [us]      */
+		std::atomic<uint64_t> proc_max;  /**< Max time per block    */
+	} stats;
+};
+
+struct aec_worker {
+	thrd_t thrd;
+	std::atomic<bool> run;
+	mtx_t *mtx;          /**< Protects aecl against attach/detach */
+	struct list aecl;    /**< List of struct aec_dsp             */
+	mtx_t *lock_wait;    /**< Protects wake and idle             */
+	cnd_t wake;          /**< Signaled when a block is queued    */
+	cnd_t idle;          /**< Signaled when the rings are empty  */
+	std::atomic<bool> pending;  /**< A block was queued since last pass */
+	std::atomic<bool> sleeping; /**< The worker is parked on wake       */
+	unsigned n;
+	unsigned idx;
+};
+
+struct aec_pool {
+	struct aec_worker *workerv;
+	unsigned workerc;
+	uint32_t delay;
+};
+
+
+static struct aec_pool *pool;
+
+
+static bool ring_put(struct aec_ring *r, uint64_t seq,
+		     const float *sampv, size_t sampc)
+{
+	uint32_t head = r->head.load(std::memory_order_relaxed);
+	uint32_t tail = r->tail.load(std::memory_order_acquire);
+	struct aec_block *b;
+
+	if (head - tail >= RING_SIZE)
+		return false;
+
+	b = &r->blockv[head & (RING_SIZE - 1)];
+	b->seq = seq;
+	memcpy(b->sampv, sampv, sampc * sizeof(float));
+
+	r->head.store(head + 1, std::memory_order_release);
+
+	return true;
+}
+
+
+static struct aec_block *ring_peek(struct aec_ring *r)
+{
+	uint32_t tail = r->tail.load(std::memory_order_relaxed);
+	uint32_t head = r->head.load(std::memory_order_acquire);
+
+	if (head == tail)
+		return NULL;
+
+	return &r->blockv[tail & (RING_SIZE - 1)];
+}
+
+
+static void ring_pop(struct aec_ring *r)
+{
+	uint32_t tail = r->tail.load(std::memory_order_relaxed);
+
+	r->tail.store(tail + 1, std::memory_order_release);
+}
+
+
+static bool ring_empty(const struct aec_ring *r)
+{
+	return r->head.load(std::memory_order_acquire) ==
+		r->tail.load(std::memory_order_acquire);
+}
+
+
+static void stat_max(std::atomic<uint64_t> &v, uint64_t x)
+{
+	if (x > v.load(std::memory_order_relaxed))
+		v.store(x, std::memory_order_relaxed);
+}
+
+
+/* called on the worker thread */
+static bool dsp_process(struct aec *aec)
+{
+	struct aec_dsp *dsp = aec->dsp;
+	struct aec_block *b;
+	bool busy = false;
+	uint64_t t0, dt;
+
+	/* render (far-end) blocks must be analysed before capture */
+	while ((b = ring_peek(&dsp->far))) {
+
+		(void)webrtc_aec_process_far(aec, b->sampv);
+		ring_pop(&dsp->far);
+		busy = true;
+	}
+
+	while ((b = ring_peek(&dsp->near_in))) {
+
+		t0 = tmr_jiffies_usec();
+		(void)webrtc_aec_process_near(aec, b->sampv);
+		dt = tmr_jiffies_usec() - t0;
+
+		dsp->stats.n_proc.fetch_add(1, std::memory_order_relaxed);
+		dsp->stats.proc_usec.fetch_add(dt, std::memory_order_relaxed);
+		stat_max(dsp->stats.proc_max, dt);
+
+		if (!ring_put(&dsp->near_out, b->seq, b->sampv,
+			      aec->blocksize)) {
+			dsp->stats.n_stale.fetch_add(
+				1, std::memory_order_relaxed);
+		}
+
+		ring_pop(&dsp->near_in);
+		busy = true;
+	}
+
+	return busy;
+}
+
+
+/*
+ * Called by the producers for every block. The lock is only taken when
+ * the worker is parked, a busy worker finds the pending flag on its own.
+ * Both flags are sequentially consistent, so either the producer sees
+ * the worker sleeping or the worker sees the block pending.
+ */
+static void worker_wake(struct aec_worker *w)
+{
+	w->pending.store(true);
+
+	if (!w->sleeping.load())
+		return;
+
+	mtx_lock(w->lock_wait);
+	cnd_signal(&w->wake);
+	mtx_unlock(w->lock_wait);
+}
+
+
+static int worker_thread(void *arg)
+{
+	struct aec_worker *w = (struct aec_worker *)arg;
+
+	while (w->run.load(std::memory_order_acquire)) {
+		bool busy = false;
+		struct le *le;
+
+		mtx_lock(w->mtx);
+		LIST_FOREACH(&w->aecl, le) {
+			busy |= dsp_process((struct aec *)le->data);
+		}
+		mtx_unlock(w->mtx);
+
+		if (busy)
+			continue;
+
+		mtx_lock(w->lock_wait);
+
+		cnd_broadcast(&w->idle);
+
+		w->sleeping.store(true);
+
+		while (!w->pending.exchange(false) &&
+		       w->run.load(std::memory_order_acquire))
+			cnd_wait(&w->wake, w->lock_wait);
+
+		w->sleeping.store(false);
+
+		mtx_unlock(w->lock_wait);
+	}
+
+	return 0;
+}
+
+
+static void pool_destructor(void *arg)
+{
+	struct aec_pool *p = (struct aec_pool *)arg;
+
+	for (unsigned i = 0; i < p->workerc; i++) {
+		struct aec_worker *w = &p->workerv[i];
+
+		if (w->run.load()) {
+			w->run.store(false);
+			worker_wake(w);
+			thrd_join(w->thrd, NULL);
+		}
+
+		if (w->lock_wait) {
+			cnd_destroy(&w->wake);
+			cnd_destroy(&w->idle);
+		}
+
+		mem_deref(w->lock_wait);
+		mem_deref(w->mtx);
+	}
+
+	mem_deref(p->workerv);
+}
+
+
+/**
+ * Start the shared pool of DSP worker threads
+ *
+ * @param threads Number of worker threads
+ * @param delay   Pipeline delay in blocks of 10 ms
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int webrtc_aec_pool_init(unsigned threads, uint32_t delay)
+{
+	struct aec_pool *p;
+	int err = 0;
+
+	if (pool)
+		return 0;
+
+	if (threads < 1)
+		threads = 1;
+	else if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+
+	if (delay < 1)
+		delay = 1;
+	else if (delay > DELAY_MAX)
+		delay = DELAY_MAX;
+
+	p = (struct aec_pool *)mem_zalloc(sizeof(*p), pool_destructor);
+	if (!p)
+		return ENOMEM;
+
+	p->workerv = (struct aec_worker *)mem_zalloc(
+		threads * sizeof(*p->workerv), NULL);
+	if (!p->workerv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	p->delay = delay;
+
+	for (unsigned i = 0; i < threads; i++) {
+		struct aec_worker *w = &p->workerv[i];
+
+		w->idx = i;
+
+		err = mutex_alloc(&w->mtx);
+		if (err)
+			goto out;
+
+		++p->workerc;
+
+		err = mutex_alloc(&w->lock_wait);
+		if (err)
+			goto out;
+
+		if (cnd_init(&w->wake) != thrd_success) {
+			w->lock_wait = (mtx_t *)mem_deref(w->lock_wait);
+			err = ENOMEM;
+			goto out;
+		}
+
+		if (cnd_init(&w->idle) != thrd_success) {
+			cnd_destroy(&w->wake);
+			w->lock_wait = (mtx_t *)mem_deref(w->lock_wait);
+			err = ENOMEM;
+			goto out;
+		}
+
+		w->run.store(true);
+		err = thread_create_name(&w->thrd, "webrtc_aec", worker_thread,
+					 w);
+		if (err) {
+			w->run.store(false);
+			goto out;
+		}
+	}
+
+	info("webrtc_aec: DSP pool with %u threads, pipeline delay %u ms\n",
+	     threads, delay * BLOCKSIZE);
+
+ out:
+	if (err)
+		mem_deref(p);
+	else
+		pool = p;
+
+	return err;
+}
+
+
+/*
+ * Every attached DSP holds a reference to the pool, the workers are
+ * stopped when the last AEC instance is detached.
+ */
+void webrtc_aec_pool_close(void)
+{
+	pool = (struct aec_pool *)mem_deref(pool);
+}
+
+
+/**
+ * Attach an AEC instance to the least loaded DSP worker
+ *
+ * @param aec AEC instance
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int webrtc_aec_dsp_attach(struct aec *aec)
+{
+	struct aec_worker *w = NULL;
+	struct aec_dsp *dsp;
+
+	if (!aec)
+		return EINVAL;
+
+	if (!pool)
+		return ENOSYS;
+
+	if (aec->blocksize > MAX_BLOCK)
+		return ENOTSUP;
+
+	dsp = (struct aec_dsp *)mem_zalloc(sizeof(*dsp), NULL);
+	if (!dsp)
+		return ENOMEM;
+
+	dsp->pool  = (struct aec_pool *)mem_ref(pool);
+	dsp->delay = pool->delay;
+
+	for (unsigned i = 0; i < pool->workerc; i++) {
+		if (!w || pool->workerv[i].n < w->n)
+			w = &pool->workerv[i];
+	}
+
+	dsp->w = w;
+	aec->dsp = dsp;
+
+	mtx_lock(w->mtx);
+	list_append(&w->aecl, &dsp->le, aec);
+	++w->n;
+	mtx_unlock(w->mtx);
+
+	return 0;
+}
+
+
+/**
+ * Detach an AEC instance from its DSP worker
+ *
+ * When this function returns the worker is no longer using the instance
+ *
+ * @param aec AEC instance
+ */
+void webrtc_aec_dsp_detach(struct aec *aec)
+{
+	struct aec_dsp *dsp;
+	struct aec_worker *w;
+
+	if (!aec || !aec->dsp)
+		return;
+
+	dsp = aec->dsp;
+	w = dsp->w;
+
+	mtx_lock(w->mtx);
+	list_unlink(&dsp->le);
+	--w->n;
+	mtx_unlock(w->mtx);
+
+	aec->dsp = NULL;
+
+	mem_deref(dsp->pool);
+	mem_deref(dsp);
+}
+
+
+/**
+ * Hand one near-end block to the DSP worker and replace it with the
+ * processed block from the fixed pipeline delay ago
+ *
+ * Called on the audio TX thread, never blocks.
+ *
+ * @param aec   AEC instance
+ * @param sampv Block of samples (in/out)
+ */
+void webrtc_aec_dsp_near(struct aec *aec, float *sampv)
+{
+	struct aec_dsp *dsp = aec->dsp;
+	const size_t sz = aec->blocksize * sizeof(float);
+	struct aec_block *slot, *b;
+	uint64_t seq, target;
+
+	seq = dsp->seq++;
+
+	slot = &dsp->delayv[seq % (dsp->delay + 1)];
+	memcpy(slot->sampv, sampv, sz);
+	slot->seq = seq;
+
+	if (ring_put(&dsp->near_in, seq, sampv, aec->blocksize))
+		worker_wake(dsp->w);
+	else
+		dsp->stats.n_overrun.fetch_add(1, std::memory_order_relaxed);
+
+	/* pipeline is filling up */
+	if (seq < dsp->delay) {
+		memset(sampv, 0, sz);
+		return;
+	}
+
+	target = seq - dsp->delay;
+
+	while ((b = ring_peek(&dsp->near_out)) && b->seq < target) {
+		ring_pop(&dsp->near_out);
+		dsp->stats.n_stale.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (b && b->seq == target) {
+		memcpy(sampv, b->sampv, sz);
+		ring_pop(&dsp->near_out);
+	}
+	else {
+		slot = &dsp->delayv[target % (dsp->delay + 1)];
+		memcpy(sampv, slot->sampv, sz);
+		dsp->stats.n_late.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	dsp->stats.n_near.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+/**
+ * Hand one far-end block to the DSP worker
+ *
+ * @param aec   AEC instance
+ * @param sampv Block of samples
+ */
+void webrtc_aec_dsp_far(struct aec *aec, const float *sampv)
+{
+	struct aec_dsp *dsp = aec->dsp;
+
+	if (ring_put(&dsp->far, 0, sampv, aec->blocksize)) {
+		worker_wake(dsp->w);
+	}
+	else {
+		dsp->stats.n_far_overrun.fetch_add(1,
+						   std::memory_order_relaxed);
+	}
+}
+
+
+bool webrtc_aec_dsp_idle(const struct aec *aec)
+{
+	if (!aec || !aec->dsp)
+		return true;
+
+	return ring_empty(&aec->dsp->far) && ring_empty(&aec->dsp->near_in);
+}
+
+
+/**
+ * Wait until the DSP worker has processed all queued blocks
+ *
+ * @param aec AEC instance
+ */
+void webrtc_aec_dsp_sync(struct aec *aec)
+{
+	struct aec_worker *w;
+
+	if (!aec || !aec->dsp)
+		return;
+
+	w = aec->dsp->w;
+
+	mtx_lock(w->lock_wait);
+
+	while (!webrtc_aec_dsp_idle(aec))
+		cnd_wait(&w->idle, w->lock_wait);
+
+	mtx_unlock(w->lock_wait);
+}
+
+
+int webrtc_aec_dsp_debug(struct re_printf *pf, const struct aec *aec)
+{
+	const struct aec_dsp *dsp;
+	uint64_t n_proc;
+	int err;
+
+	if (!aec || !aec->dsp)
+		return 0;
+
+	dsp = aec->dsp;
+	n_proc = dsp->stats.n_proc.load();
+
+	err  = re_hprintf(pf, "  aec %p: worker=%u delay=%ums srate=%u\n",
+			  aec, dsp->w->idx, dsp->delay * BLOCKSIZE,
+			  aec->srate);
+	err |= re_hprintf(pf, "    near=%llu late=%llu stale=%llu"
+			  " overrun=%llu far_overrun=%llu\n",
+			  (unsigned long long)dsp->stats.n_near.load(),
+			  (unsigned long long)dsp->stats.n_late.load(),
+			  (unsigned long long)dsp->stats.n_stale.load(),
+			  (unsigned long long)dsp->stats.n_overrun.load(),
+			  (unsigned long long)dsp->stats.n_far_overrun.load());
+	err |= re_hprintf(pf, "    processed=%llu avg=%lluus max=%lluus\n",
+			  (unsigned long long)n_proc,
+			  (unsigned long long)(n_proc ?
+				 dsp->stats.proc_usec.load() / n_proc : 0),
+			  (unsigned long long)dsp->stats.proc_max.load());
+
+	return err;
+}
+
+
+int webrtc_aec_pool_debug(struct re_printf *pf, void *unused)
+{
+	int err = 0;
+	(void)unused;
+
+	if (!pool)
+		return re_hprintf(pf, "webrtc_aec: inline mode\n");
+
+	err |= re_hprintf(pf, "webrtc_aec: DSP pool (%u threads)\n",
+			  pool->workerc);
+
+	for (unsigned i = 0; i < pool->workerc; i++) {
+		struct aec_worker *w = &pool->workerv[i];
+		struct le *le;
+
+		mtx_lock(w->mtx);
+		LIST_FOREACH(&w->aecl, le) {
+			err |= webrtc_aec_dsp_debug(pf,
+						    (struct aec *)le->data);
+		}
+		mtx_unlock(w->mtx);
+	}
+
+	return err;
+}
@@ -11,9 +11,6 @@
 #include "aec.h"
 
 
-#define SOUND_CARD_BUF 20
-
-
 struct aec_enc {
 	struct aufilt_enc_st af;  /* inheritance */
 
@@ -73,55 +70,31 @@ int webrtc_aec_encode_update(struct aufilt_enc_st **stp, void **ctx,
 }
 
 
-static AudioProcessing::ChannelLayout get_layout(uint8_t ch)
-{
-	switch (ch) {
-
-	case 1: return AudioProcessing::kMono;
-	case 2: return AudioProcessing::kStereo;
-	default: return (AudioProcessing::ChannelLayout)-1;
-	}
-}
-
-
 static int encode_float(struct aec_enc *enc, float *sampv, size_t sampc)
 {
 	struct aec *aec = enc->aec;
 	size_t i;
-	int r;
 	int err = 0;
 
 	if (sampc % aec->blocksize)
 		return EINVAL;
 
+	if (aec->dsp) {
+		for (i = 0; i < sampc; i += aec->blocksize)
+			webrtc_aec_dsp_near(aec, &sampv[i]);
+
+		return 0;
+	}
+
 	mtx_lock(&aec->mutex);
 
 	for (i = 0; i < sampc; i += aec->blocksize) {
 
-		size_t samples_per_channel = aec->blocksize / aec->ch;
-		const float *src = &sampv[i];
-		float *dest = &sampv[i];
-
-		// NOTE: important
-		aec->inst->set_stream_delay_ms(SOUND_CARD_BUF);
-
-		r = aec->inst->ProcessStream(&src,
-					     samples_per_channel,
-					     aec->srate,
-					     get_layout(aec->ch),
-					     aec->srate,
-					     get_layout(aec->ch),
-					     &dest);
-		if (r != 0) {
-			warning("webrtc_aec: encode:"
-				" ProcessStream error (%d)\n",
-				r);
-			err = EPROTO;
-			goto out;
-		}
+		err = webrtc_aec_process_near(aec, &sampv[i]);
+		if (err)
+			break;
 	}
 
- out:
 	mtx_unlock(&aec->mutex);
 
 	return err;
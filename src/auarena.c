@@ -0,0 +1,142 @@
+/**
+ * @file auarena.c  Audio frame arena
+ *
+ * A frame arena is a single block of memory, allocated once when the audio
+ * pipeline is set up, that is carved into a fixed number of equally sized
+ * slots. Every stage of the pipeline takes its output buffer from the arena
+ * and the arena is reset before each frame, so the steady-state path does
+ * not allocate any memory.
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+enum {
+	SLOT_ALIGN = 64,   /* Cache line, and wide enough for SIMD loads */
+};
+
+
+/** Defines an audio frame arena */
+struct auarena {
+	uint8_t *mem;      /**< Allocated memory                         */
+	uint8_t *base;     /**< First slot, aligned to SLOT_ALIGN        */
+	size_t slotsz;     /**< Size of one slot in [bytes]              */
+	unsigned slotc;    /**< Number of slots                          */
+	unsigned next;     /**< Next free slot                           */
+	uint64_t misses;   /**< Requests that did not fit                */
+};
+
+
+static void destructor(void *arg)
+{
+	struct auarena *ar = arg;
+
+	mem_deref(ar->mem);
+}
+
+
+/**
+ * Allocate an audio frame arena
+ *
+ * @param arp    Pointer to allocated arena
+ * @param slotsz Size of one slot in [bytes]
+ * @param slotc  Number of slots
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int auarena_alloc(struct auarena **arp, size_t slotsz, unsigned slotc)
+{
+	struct auarena *ar;
+	uintptr_t p;
+
+	if (!arp || !slotsz || !slotc)
+		return EINVAL;
+
+	ar = mem_zalloc(sizeof(*ar), destructor);
+	if (!ar)
+		return ENOMEM;
+
+	ar->slotsz = (slotsz + SLOT_ALIGN - 1) & ~(size_t)(SLOT_ALIGN - 1);
+	ar->slotc  = slotc;
+
+	ar->mem = mem_zalloc(ar->slotsz * slotc + SLOT_ALIGN - 1, NULL);
+	if (!ar->mem) {
+		mem_deref(ar);
+		return ENOMEM;
+	}
+
+	p = (uintptr_t)ar->mem;
+	p = (p + SLOT_ALIGN - 1) & ~(uintptr_t)(SLOT_ALIGN - 1);
+	ar->base = (uint8_t *)p;
+
+	*arp = ar;
+
+	return 0;
+}
+
+
+/**
+ * Release all slots of the arena, must be called before each frame
+ *
+ * @param ar Audio frame arena
+ */
+void auarena_reset(struct auarena *ar)
+{
+	if (!ar)
+		return;
+
+	ar->next = 0;
+}
+
+
+/**
+ * Get a buffer from the arena, which is valid until the next reset
+ *
+ * @param ar Audio frame arena
+ * @param sz Wanted size in [bytes]
+ *
+ * @return Buffer aligned to 64 bytes, or NULL if it does not fit
+ *
+ * @note This function has REAL-TIME properties
+ */
+void *auarena_get(struct auarena *ar, size_t sz)
+{
+	if (!ar)
+		return NULL;
+
+	if (sz > ar->slotsz || ar->next >= ar->slotc) {
+		++ar->misses;
+		return NULL;
+	}
+
+	return ar->base + ar->slotsz * ar->next++;
+}
+
+
+/**
+ * Get the number of requests that did not fit into the arena
+ *
+ * @param ar Audio frame arena
+ *
+ * @return Number of misses
+ */
+uint64_t auarena_misses(const struct auarena *ar)
+{
+	return ar ? ar->misses : 0;
+}
+
+
+/**
+ * Get the size of one arena slot
+ *
+ * @param ar Audio frame arena
+ *
+ * @return Slot size in [bytes]
+ */
+size_t auarena_slotsz(const struct auarena *ar)
+{
+	return ar ? ar->slotsz : 0;
+}
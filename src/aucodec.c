@@ -72,6 +72,10 @@ const struct aucodec *aucodec_find(const struct list *aucodecl,
 		return ac;
 	}
 
+	/* try the deferred modules */
+	if (!module_lazy_load(name))
+		return aucodec_find(aucodecl, name, srate, ch);
+
 	return NULL;
 }
 
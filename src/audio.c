@@ -88,7 +88,15 @@ struct autx {
 	size_t aubuf_maxsz;           /**< Maximum aubuf size in [bytes]   */
 	volatile bool aubuf_started;  /**< Aubuf was started flag          */
 	struct list filtl;            /**< Audio filters in encoding order */
+	struct auarena *arena;        /**< Frame arena for audio filters   */
 	struct mbuf *mb;              /**< Buffer for outgoing RTP packets */
+	struct txshare *share;        /**< Shared encoder (optional)       */
+	struct le le_share;           /**< Leg of the shared encoder       */
+	struct mbuf *mb_share;        /**< Buffer for the other legs       */
+	struct red_enc *red;          /**< Redundant audio (optional)      */
+	struct mbuf *mb_red;          /**< Buffer for redundant audio      */
+	int pt_red;                   /**< Payload type for RED            */
+	char *params;                 /**< Encoder parameters              */
 	char *module;                 /**< Audio source module name        */
 	char *device;                 /**< Audio source device name        */
 	void *sampv;                  /**< Sample buffer                   */
@@ -106,6 +114,8 @@ struct autx {
 	struct {
 		uint64_t aubuf_overrun;
 		uint64_t aubuf_underrun;
+		uint64_t frames;      /**< Frames through the filters      */
+		uint64_t conv;        /**< Sample format conversions       */
 	} stats;
 
 	struct {
@@ -175,12 +185,74 @@ static double autx_calc_seconds(const struct autx *autx)
 }
 
 
-static void stop_tx(struct autx *tx, struct audio *a)
+/* Unsubscribe from the shared encoder, called in the main thread */
+static void autx_share_leave(struct autx *tx)
 {
-	if (!tx || !a)
+	struct txshare *share = tx->share;
+
+	if (!share)
 		return;
 
-	stream_enable_tx(a->strm, false);
+	txshare_leave(share, &tx->le_share);
+
+	mtx_lock(tx->mtx);
+	tx->share = NULL;
+	mtx_unlock(tx->mtx);
+
+	mem_deref(share);
+}
+
+
+static void autx_share_leader_handler(void *leg);
+
+
+/*
+ * Subscribe to the shared encoder of all calls with the same source,
+ * codec and encoder parameters, called in the main thread
+ */
+static int autx_share_join(struct autx *tx, struct audio *a)
+{
+	struct txshare *share = NULL;
+	char *key = NULL;
+	int err;
+
+	autx_share_leave(tx);
+
+	if (!a->cfg.txshare || !tx->ac)
+		return 0;
+
+	if (!tx->mb_share) {
+		tx->mb_share = mbuf_alloc(STREAM_PRESZ + 4096);
+		if (!tx->mb_share)
+			return ENOMEM;
+	}
+
+	err = re_sdprintf(&key, "audio:%s/%u/%u;%s;%s,%s;%u;%s",
+			  tx->ac->name, tx->ac->srate, tx->ac->ch,
+			  tx->params, tx->module, tx->device, tx->ptime,
+			  aufmt_name(tx->enc_fmt));
+	if (err)
+		return err;
+
+	err = txshare_alloc(&share, key, autx_share_leader_handler);
+	if (err)
+		goto out;
+
+	mtx_lock(tx->mtx);
+	tx->share = share;
+	mtx_unlock(tx->mtx);
+
+	txshare_join(share, &tx->le_share, a);
+
+ out:
+	mem_deref(key);
+
+	return err;
+}
+
+
+static void stop_source(struct autx *tx, struct audio *a)
+{
 	if (a->cfg.txmode == AUDIO_MODE_THREAD &&
 	    re_atomic_rlx(&tx->thr.run)) {
 		re_atomic_rlx_set(&tx->thr.run, false);
@@ -191,6 +263,18 @@ static void stop_tx(struct autx *tx, struct audio *a)
 	tx->ausrc = mem_deref(tx->ausrc);
 	tx->aubuf = mem_deref(tx->aubuf);
 
+	autx_share_leave(tx);
+}
+
+
+static void stop_tx(struct autx *tx, struct audio *a)
+{
+	if (!tx || !a)
+		return;
+
+	stream_enable_tx(a->strm, false);
+	stop_source(tx, a);
+
 	list_flush(&tx->filtl);
 }
 
@@ -208,11 +292,16 @@ static void audio_destructor(void *arg)
 	mem_deref(a->tx.enc);
 	mem_deref(a->tx.aubuf);
 	mem_deref(a->tx.mb);
+	mem_deref(a->tx.mb_share);
+	mem_deref(a->tx.red);
+	mem_deref(a->tx.mb_red);
+	mem_deref(a->tx.params);
 	mem_deref(a->tx.sampv);
 	mem_deref(a->tx.module);
 	mem_deref(a->tx.device);
 
 	list_flush(&a->tx.filtl);
+	mem_deref(a->tx.arena);
 
 	mem_deref(a->strm);
 	mem_deref(a->telev);
@@ -284,111 +373,126 @@ static int append_rtpext(struct audio *au, struct mbuf *mb,
 
 
 /*
- * Encode audio and send via stream
- *
- * @note This function has REAL-TIME properties
+ * Write the RTP header extensions of a leg at the start of the buffer
  */
-static void encode_rtp_send(struct audio *a, struct autx *tx,
-			    struct auframe *af)
+static int autx_rtpext(struct audio *a, struct mbuf *mb,
+		       const struct auframe *af, size_t *ext_len)
 {
 	struct bundle *bun = stream_bundle(a->strm);
 	bool bundled = bundle_state(bun) != BUNDLE_NONE;
-	size_t frame_size;  /* number of samples per channel */
-	size_t sampc_rtp;
-	size_t len;
-	size_t ext_len = 0;
-	uint32_t ts_delta = 0;
-	bool marker = tx->marker;
 	int err;
 
-	if (!tx->ac || !tx->ac->ench)
-		return;
+	mb->pos = mb->end = STREAM_PRESZ;
+	*ext_len = 0;
 
-	if (tx->ac->srate != af->srate || tx->ac->ch != af->ch) {
-		warning("audio: srate/ch of frame %u/%u vs audio codec %u/%u. "
-			"Use module auresamp!\n",
-			af->srate, af->ch, tx->ac->srate, tx->ac->ch);
-		return;
+	if (!a->level_enabled && !bundled)
+		return 0;
+
+	/* skip the extension header */
+	mb->pos += RTPEXT_HDR_SIZE;
+
+	if (a->level_enabled) {
+		err = append_rtpext(a, mb, af->fmt, af->sampv, af->sampc);
+		if (err)
+			return err;
 	}
 
-	tx->mb->pos = tx->mb->end = STREAM_PRESZ;
+	if (bundled) {
+		const char *mid = stream_mid(a->strm);
 
-	if (a->level_enabled || bundled) {
+		rtpext_encode(mb, bundle_extmap_mid(bun),
+			      str_len(mid), (void *)mid);
+	}
 
-		/* skip the extension header */
-		tx->mb->pos += RTPEXT_HDR_SIZE;
+	*ext_len = mb->pos - STREAM_PRESZ;
 
-		if (a->level_enabled) {
-			err = append_rtpext(a, tx->mb, af->fmt,
-					    af->sampv, af->sampc);
-			if (err)
-				return;
-		}
+	/* write the Extension header at the beginning */
+	mb->pos = STREAM_PRESZ;
 
-		if (bundled) {
-			const char *mid = stream_mid(a->strm);
+	err = rtpext_hdr_encode(mb, *ext_len - RTPEXT_HDR_SIZE);
+	if (err)
+		return err;
 
-			rtpext_encode(tx->mb, bundle_extmap_mid(bun),
-				      str_len(mid), (void *)mid);
-		}
+	mb->pos = STREAM_PRESZ + *ext_len;
+	mb->end = STREAM_PRESZ + *ext_len;
 
-		ext_len = tx->mb->pos - STREAM_PRESZ;
+	return 0;
+}
 
-		/* write the Extension header at the beginning */
-		tx->mb->pos = STREAM_PRESZ;
 
-		err = rtpext_hdr_encode(tx->mb, ext_len - RTPEXT_HDR_SIZE);
-		if (err)
-			return;
+/*
+ * RFC 2198 -- send an encoded frame with the previous frames as redundant
+ * blocks. Called with the lock of the leg held.
+ */
+static int autx_red_send(struct audio *a, struct autx *tx,
+			 const struct mbuf *mb, bool marker, size_t ext_len,
+			 size_t len, uint32_t rtp_ts)
+{
+	struct mbuf *mbr = tx->mb_red;
+	int pt = stream_pt_enc(a->strm);
+	int err;
 
-		tx->mb->pos = STREAM_PRESZ + ext_len;
-		tx->mb->end = STREAM_PRESZ + ext_len;
-	}
+	if (pt < 0)
+		return EINVAL;
 
-	len = mbuf_get_space(tx->mb);
+	mbr->pos = mbr->end = STREAM_PRESZ;
 
-	err = tx->ac->ench(tx->enc, &marker, mbuf_buf(tx->mb), &len,
-			   af->fmt, af->sampv, af->sampc);
+	err  = mbuf_write_mem(mbr, mb->buf + STREAM_PRESZ, ext_len);
+	err |= red_enc_packet(tx->red, mbr, (uint8_t)pt, rtp_ts,
+			      mb->buf + STREAM_PRESZ + ext_len, len);
+	if (err)
+		return err;
 
-	if ((err & 0xffff0000) == 0x00010000) {
+	mbr->pos = STREAM_PRESZ;
 
-		/* MPA needs some special treatment here */
+	return stream_send(a->strm, ext_len!=0, marker, tx->pt_red, rtp_ts,
+			   mbr);
+}
 
-		ts_delta = err & 0xffff;
-		af->sampc = 0;
-	}
-	else if (err) {
-		warning("audio: %s encode error: %d samples (%m)\n",
-			tx->ac->name, af->sampc, err);
-		goto out;
-	}
 
-	tx->mb->pos = STREAM_PRESZ;
-	tx->mb->end = STREAM_PRESZ + ext_len + len;
+/*
+ * Send an encoded frame of one leg and advance its RTP timestamp
+ */
+static int autx_send(struct audio *a, struct autx *tx, struct mbuf *mb,
+		     bool marker, size_t ext_len, size_t len,
+		     uint32_t ts_delta, size_t sampc)
+{
+	size_t frame_size;  /* number of samples per channel */
+	size_t sampc_rtp;
+	int err = 0;
 
-	if (mbuf_get_left(tx->mb)) {
+	mb->pos = STREAM_PRESZ;
+	mb->end = STREAM_PRESZ + ext_len + len;
+
+	if (mbuf_get_left(mb)) {
 
 		uint32_t rtp_ts = tx->ts_ext & 0xffffffff;
 
 		if (len) {
-			mtx_lock(a->tx.mtx);
-			err = stream_send(a->strm, ext_len!=0, marker, -1,
-					  rtp_ts, tx->mb);
-			mtx_unlock(a->tx.mtx);
+			mtx_lock(tx->mtx);
+			if (red_enc_distance(tx->red)) {
+				err = autx_red_send(a, tx, mb, marker,
+						    ext_len, len, rtp_ts);
+			}
+			else {
+				err = stream_send(a->strm, ext_len!=0, marker,
+						  -1, rtp_ts, mb);
+			}
+			mtx_unlock(tx->mtx);
 			if (err)
 				goto out;
 		}
 
 		if (ts_delta) {
-			mtx_lock(a->tx.mtx);
+			mtx_lock(tx->mtx);
 			tx->ts_ext += ts_delta;
-			mtx_unlock(a->tx.mtx);
+			mtx_unlock(tx->mtx);
 			goto out;
 		}
 	}
 
 	/* Convert from audio samplerate to RTP clockrate */
-	sampc_rtp = af->sampc * tx->ac->crate / tx->ac->srate;
+	sampc_rtp = sampc * tx->ac->crate / tx->ac->srate;
 
 	/* The RTP clock rate used for generating the RTP timestamp is
 	 * independent of the number of channels and the encoding
@@ -397,9 +501,124 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 	 */
 	frame_size = sampc_rtp / tx->ac->ch;
 
-	mtx_lock(a->tx.mtx);
+	mtx_lock(tx->mtx);
 	tx->ts_ext += (uint32_t)frame_size;
-	mtx_unlock(a->tx.mtx);
+	mtx_unlock(tx->mtx);
+
+ out:
+	tx->marker = false;
+
+	return err;
+}
+
+
+/*
+ * Send the frame encoded by the leader on all other legs of the shared
+ * encoder. The packets are built in the buffer of the leader, so that the
+ * other legs are not touched except for their RTP timestamp. Muted legs
+ * only advance the RTP timestamp.
+ */
+static void autx_share_send(struct txshare *share, struct autx *leader,
+			    const struct auframe *af, const uint8_t *pld,
+			    size_t len, bool marker, uint32_t ts_delta)
+{
+	struct mbuf *mb = leader->mb_share;
+	struct le *le;
+
+	txshare_lock(share);
+
+	LIST_FOREACH(txshare_legl(share), le) {
+		struct audio *a = le->data;
+		struct autx *tx = &a->tx;
+		size_t ext_len;
+
+		if (tx == leader)
+			continue;
+
+		if (tx->muted) {
+			(void)autx_send(a, tx, mb, false, 0, 0, ts_delta,
+					af->sampc);
+			continue;
+		}
+
+		if (autx_rtpext(a, mb, af, &ext_len))
+			continue;
+
+		if (mbuf_write_mem(mb, pld, len))
+			continue;
+
+		(void)autx_send(a, tx, mb, marker || tx->marker, ext_len, len,
+				ts_delta, af->sampc);
+	}
+
+	txshare_unlock(share);
+}
+
+
+/*
+ * Encode audio and send via stream
+ *
+ * @note This function has REAL-TIME properties
+ */
+static void encode_rtp_send(struct audio *a, struct autx *tx,
+			    struct txshare *share, struct auframe *af,
+			    uint64_t *t)
+{
+	struct lattrace *lat = stream_lattrace(a->strm, true);
+	size_t len;
+	size_t ext_len = 0;
+	uint32_t ts_delta = 0;
+	bool marker = tx->marker;
+	int err;
+
+	if (!tx->ac || !tx->ac->ench)
+		return;
+
+	if (tx->ac->srate != af->srate || tx->ac->ch != af->ch) {
+		warning("audio: srate/ch of frame %u/%u vs audio codec %u/%u. "
+			"Use module auresamp!\n",
+			af->srate, af->ch, tx->ac->srate, tx->ac->ch);
+		return;
+	}
+
+	err = autx_rtpext(a, tx->mb, af, &ext_len);
+	if (err)
+		goto out;
+
+	len = mbuf_get_space(tx->mb);
+
+	err = tx->ac->ench(tx->enc, &marker, mbuf_buf(tx->mb), &len,
+			   af->fmt, af->sampv, af->sampc);
+
+	lattrace_stamp(lat, "encode", t);
+
+	if ((err & 0xffff0000) == 0x00010000) {
+
+		/* MPA needs some special treatment here */
+
+		ts_delta = err & 0xffff;
+		af->sampc = 0;
+	}
+	else if (err) {
+		warning("audio: %s encode error: %d samples (%m)\n",
+			tx->ac->name, af->sampc, err);
+		goto out;
+	}
+
+	/* the other legs first, the stream might encrypt in place */
+	if (share) {
+		autx_share_send(share, tx, af, mbuf_buf(tx->mb), len, marker,
+				ts_delta);
+
+		/* a muted leader only encodes for the other legs */
+		if (tx->muted)
+			len = 0;
+	}
+
+	err = autx_send(a, tx, tx->mb, marker, ext_len, len, ts_delta,
+			af->sampc);
+	if (!err && len)
+		lattrace_stamp(lat, "send", t);
 
  out:
 	tx->marker = false;
@@ -412,12 +631,15 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 static void poll_aubuf_tx(struct audio *a)
 {
 	struct autx *tx = &a->tx;
+	struct lattrace *lat = stream_lattrace(a->strm, true);
+	struct txshare *share;
 	struct auframe af;
 	size_t sampc;
 	size_t sz;
-	struct le *le;
 	uint32_t srate;
 	uint8_t ch;
+	uint64_t t0, t;
+	uint64_t q = 0;
 	int err = 0;
 
 	sz = aufmt_sample_size(tx->src_fmt);
@@ -428,17 +650,38 @@ static void poll_aubuf_tx(struct audio *a)
 	srate = tx->ausrc_prm.srate;
 	ch = tx->ausrc_prm.ch;
 
+	t0 = t = lattrace_now(lat);
+
+	/* the oldest frame has waited for the frames queued behind it */
+	if (lat && srate && ch) {
+		size_t cur = aubuf_cur_size(tx->aubuf);
+
+		if (cur > tx->psize)
+			q = (uint64_t)(cur - tx->psize) * 1000000 /
+				((uint64_t)srate * ch * sz);
+
+		lattrace_add(lat, "aubuf", q);
+	}
+
 	/* timed read from audio-buffer */
 	auframe_init(&af, tx->src_fmt, tx->sampv, sampc, srate, ch);
 	aubuf_read_auframe(tx->aubuf, &af);
 
-	/* Process exactly one audio-frame in list order */
-	for (le = tx->filtl.head; le; le = le->next) {
-		struct aufilt_enc_st *st = le->data;
+	mtx_lock(tx->mtx);
+	share = mem_ref(tx->share);
+	mtx_unlock(tx->mtx);
 
-		if (st->af && st->af->ench)
-			err |= st->af->ench(st, &af);
-	}
+	/* only the leader of a shared encoder runs the filters and encoder */
+	if (share && !txshare_leader(share, a))
+		goto out;
+
+	/* all filter output of the previous frame has been sent */
+	auarena_reset(tx->arena);
+
+	/* Process exactly one audio-frame in list order */
+	err = aufilt_encode(&tx->filtl, &af, tx->enc_fmt, tx->arena,
+			    lat, &t, &tx->stats.conv);
+	++tx->stats.frames;
 	if (err) {
 		warning("audio: aufilter encode: %m\n", err);
 	}
@@ -451,7 +694,13 @@ static void poll_aubuf_tx(struct audio *a)
 	}
 
 	/* Encode and send */
-	encode_rtp_send(a, tx, &af);
+	encode_rtp_send(a, tx, share, &af, &t);
+
+	if (t0)
+		lattrace_add(lat, "total", t - t0 + q);
+
+ out:
+	mem_deref(share);
 }
 
 
@@ -522,10 +771,12 @@ static void ausrc_read_handler(struct auframe *af, void *arg)
 	struct audio *a = arg;
 	struct autx *tx = &a->tx;
 	enum aufmt fmt;
+	bool shared;
 	unsigned i;
 
 	mtx_lock(tx->mtx);
 	fmt = tx->src_fmt;
+	shared = tx->share != NULL;
 	mtx_unlock(tx->mtx);
 
 	if (fmt != af->fmt) {
@@ -536,7 +787,8 @@ static void ausrc_read_handler(struct auframe *af, void *arg)
 		return;
 	}
 
-	if (tx->muted)
+	/* the leader of a shared encoder also encodes for other legs */
+	if (tx->muted && !shared)
 		auframe_mute(af);
 
 	if (aubuf_cur_size(tx->aubuf) >= tx->aubuf_maxsz) {
@@ -641,6 +893,60 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 }
 
 
+/*
+ * RFC 2198 -- the payload types of the redundant and the primary blocks,
+ * which are all of the preferred codec
+ */
+static int red_fmtp_enc(struct mbuf *mb, const struct sdp_format *fmt,
+			bool offer, void *arg)
+{
+	const struct aucodec *ac = arg;
+	const struct sdp_format *pf = NULL;
+	struct le *le;
+	int err;
+	(void)offer;
+
+	if (!mb || !fmt || !ac)
+		return 0;
+
+	for (le = list_head(fmt->le.list); le; le = le->next) {
+		const struct sdp_format *f = le->data;
+
+		if (0 == str_casecmp(f->name, ac->name) &&
+		    f->srate == ac->crate && f->ch == ac->pch) {
+			pf = f;
+			break;
+		}
+	}
+
+	if (!pf)
+		return 0;
+
+	err = mbuf_printf(mb, "a=fmtp:%s %s", fmt->id, pf->id);
+
+	for (unsigned i = 0; i < RED_MAX; i++)
+		err |= mbuf_printf(mb, "/%s", pf->id);
+
+	err |= mbuf_write_str(mb, "\r\n");
+
+	return err;
+}
+
+
+/* RFC 2198 -- with the clock rate of the preferred codec */
+static int add_red_codec(struct audio *a, const struct list *aucodecl)
+{
+	struct aucodec *ac = list_ledata(list_head(aucodecl));
+
+	if (!ac)
+		return 0;
+
+	return sdp_format_add(NULL, stream_sdpmedia(a->strm), false,
+			      NULL, "red", ac->crate, ac->pch,
+			      red_fmtp_enc, NULL, ac, false, NULL);
+}
+
+
 static int add_telev_codec(struct audio *a)
 {
 	struct sdp_media *m = stream_sdpmedia(audio_strm(a));
@@ -664,6 +970,42 @@ static int add_telev_codec(struct audio *a)
 }
 
 
+/* Adapt the redundancy to the loss reported by the peer */
+static void rtcp_handler(struct stream *strm, struct rtcp_msg *msg, void *arg)
+{
+	struct audio *a = arg;
+	double loss;
+
+	MAGIC_CHECK(a);
+
+	if (fec_rtcp_loss(msg, rtp_sess_ssrc(stream_rtp_sock(strm)), &loss))
+		return;
+
+	mtx_lock(a->tx.mtx);
+	red_enc_set_distance(a->tx.red, red_distance(loss));
+	mtx_unlock(a->tx.mtx);
+}
+
+
+static int start_source(struct autx *tx, struct audio *a,
+			struct list *ausrcl);
+
+
+/*
+ * An RTP relay sends on the stream instead of the encoder, so the source
+ * and with it the encoder are stopped while it is active
+ */
+static void stream_relay_handler(bool relayed, void *arg)
+{
+	struct audio *a = arg;
+
+	if (relayed)
+		stop_source(&a->tx, a);
+	else if (a->started)
+		(void)start_source(&a->tx, a, baresip_ausrcl());
+}
+
+
 /**
  * Allocate an audio stream
  *
@@ -728,15 +1070,19 @@ int audio_alloc(struct audio **ap, struct list *streaml,
 			   stream_prm, &cfg->avt, sdp_sess,
 			   MEDIA_AUDIO,
 			   mnat, mnat_sess, menc, menc_sess, offerer,
-			   stream_recv_handler, NULL, stream_pt_handler,
-			   a);
+			   stream_recv_handler, rtcp_handler,
+			   stream_pt_handler, a);
 	if (err)
 		goto out;
 
+	stream_set_relay_handler(a->strm, stream_relay_handler);
+
 	err = aurecv_alloc(&a->aur, &a->cfg, AUDIO_SAMPSZ, ptime);
 	if (err)
 		goto out;
 
+	aurecv_set_lattrace(a->aur, stream_lattrace(a->strm, false));
+
 	if (cfg->avt.rtp_bw.max) {
 		sdp_media_set_lbandwidth(stream_sdpmedia(a->strm),
 					 SDP_BANDWIDTH_AS,
@@ -756,6 +1102,12 @@ int audio_alloc(struct audio **ap, struct list *streaml,
 			goto out;
 	}
 
+	if (cfg->audio.red) {
+		err = add_red_codec(a, aucodecl);
+		if (err)
+			goto out;
+	}
+
 	err  = sdp_media_set_lattr(stream_sdpmedia(a->strm), true,
 				   "minptime", "%u", minptime);
 	err |= sdp_media_set_lattr(stream_sdpmedia(a->strm), true,
@@ -914,6 +1266,53 @@ static void aufilt_param_set(struct aufilt_prm *prm,
 	prm->srate      = ac->srate;
 	prm->ch         = ac->ch;
 	prm->fmt        = fmt;
+	prm->arena      = NULL;
+}
+
+
+/*
+ * Allocate the frame arena for the encode filter chain. Each filter needs
+ * at most two buffers per frame, plus one for a format conversion in front
+ * of it, and one more for the conversion to the encoder format. The slots
+ * are sized for the largest sample format, sampling rate and channel count
+ * of the source and the encoder, and for the maximum packet time, since
+ * the peer may change the ptime later.
+ */
+static int arena_setup(struct autx *tx, const struct config_audio *cfg,
+		       const struct list *aufiltl)
+{
+	uint32_t srate = max(tx->ac->srate, cfg->srate_src);
+	uint8_t ch = (uint8_t)max(tx->ac->ch, cfg->channels_src);
+	unsigned slotc = 0;
+	struct auarena *arena;
+	struct le *le;
+	size_t slotsz;
+	int err;
+
+	for (le = list_head(aufiltl); le; le = le->next) {
+		const struct aufilt *af = le->data;
+
+		if (af->encupdh)
+			slotc += 3;
+	}
+
+	if (!slotc)
+		return 0;
+
+	++slotc;
+
+	slotsz = sizeof(float) * calc_nsamp(srate, ch, MAX_PTIME);
+
+	err = auarena_alloc(&arena, slotsz, slotc);
+	if (err)
+		return err;
+
+	mtx_lock(tx->mtx);
+	mem_deref(tx->arena);
+	tx->arena = arena;
+	mtx_unlock(tx->mtx);
+
+	return 0;
 }
 
 
@@ -969,6 +1368,19 @@ static int aufilt_setup(struct audio *a, struct list *aufiltl)
 
 	aufilt_param_set(&encprm, tx->ac, tx->enc_fmt);
 	aufilt_param_set(&plprm, aurecv_codec(a->aur), a->cfg.play_fmt);
+
+	if (update_enc) {
+		/* the filters rely on the arena for format conversions */
+		err = arena_setup(tx, &a->cfg, aufiltl);
+		if (err) {
+			warning("audio: frame arena setup failed (%m)\n",
+				err);
+			return err;
+		}
+
+		encprm.arena = tx->arena;
+	}
+
 	if (a->cfg.srate_play && a->cfg.srate_play != plprm.srate) {
 		plprm.srate = a->cfg.srate_play;
 	}
@@ -1004,7 +1416,9 @@ static int aufilt_setup(struct audio *a, struct list *aufiltl)
 			}
 			else {
 				decst->af = af;
-				aurecv_filt_append(a->aur, decst);
+				err = aurecv_filt_append(a->aur, decst);
+				if (err)
+					mem_deref(decst);
 			}
 		}
 
@@ -1019,6 +1433,84 @@ static int aufilt_setup(struct audio *a, struct list *aufiltl)
 }
 
 
+/* Open the audio source and start the TX thread */
+static int open_source(struct autx *tx, struct audio *a, struct list *ausrcl)
+{
+	struct ausrc_prm prm = tx->ausrc_prm;
+	size_t psize_alloc = tx->psize;
+	size_t sz;
+	int err;
+
+	err = ausrc_alloc(&tx->ausrc, ausrcl, tx->module, &prm, tx->device,
+			  ausrc_read_handler, ausrc_error_handler, a);
+	if (err) {
+		warning("audio: start_source failed (%s.%s): %m\n",
+			tx->module, tx->device, err);
+		return err;
+	}
+
+	mtx_lock(tx->mtx);
+	/* recalculate and resize aubuf if ausrc_alloc changes prm */
+	tx->src_fmt = prm.fmt;
+	sz = aufmt_sample_size(tx->src_fmt);
+	tx->psize = sz * calc_nsamp(prm.srate, prm.ch, prm.ptime);
+	if (psize_alloc != tx->psize) {
+		tx->ausrc_prm = prm;
+		tx->aubuf_maxsz = tx->psize * 30;
+		err = aubuf_resize(tx->aubuf, tx->psize, tx->aubuf_maxsz);
+		if (err) {
+			mtx_unlock(tx->mtx);
+			return err;
+		}
+	}
+
+	mtx_unlock(tx->mtx);
+	tx->as = ausrc_find(ausrcl, tx->module);
+
+	switch (a->cfg.txmode) {
+
+	case AUDIO_MODE_POLL:
+		break;
+
+	case AUDIO_MODE_THREAD:
+		if (!re_atomic_rlx(&tx->thr.run)) {
+			re_atomic_rlx_set(&tx->thr.run, true);
+			err = thread_create_name(&tx->thr.tid, "Audio TX",
+						 tx_thread, a);
+			if (err) {
+				re_atomic_rlx_set(&tx->thr.run, false);
+				return err;
+			}
+		}
+		break;
+
+	default:
+		warning("audio: tx mode not supported (%d)\n", a->cfg.txmode);
+		return ENOTSUP;
+	}
+
+	info("audio: source started with sample format %s\n",
+	     aufmt_name(tx->src_fmt));
+
+	return 0;
+}
+
+
+/* The next leg of the shared encoder takes over with its own source */
+static void autx_share_leader_handler(void *leg)
+{
+	struct audio *a = leg;
+	int err;
+
+	if (a->tx.ausrc || a->hold || stream_is_relayed(a->strm))
+		return;
+
+	err = open_source(&a->tx, a, baresip_ausrcl());
+	if (err)
+		warning("audio: shared encoder takeover failed (%m)\n", err);
+}
+
+
 static int start_source(struct autx *tx, struct audio *a, struct list *ausrcl)
 {
 	const struct aucodec *ac = tx->ac;
@@ -1039,8 +1531,9 @@ static int start_source(struct autx *tx, struct audio *a, struct list *ausrcl)
 		channels_dsp = a->cfg.channels_src;
 	}
 
-	/* Start Audio Source */
-	if (!tx->ausrc && ausrc_find(ausrcl, NULL) && !a->hold) {
+	/* Start Audio Source, not while an RTP relay is sending */
+	if (!tx->ausrc && ausrc_find(ausrcl, NULL) && !a->hold &&
+	    !stream_is_relayed(a->strm)) {
 
 		struct ausrc_prm prm;
 		size_t sz;
@@ -1066,62 +1559,17 @@ static int start_source(struct autx *tx, struct audio *a, struct list *ausrcl)
 				return err;
 		}
 
-		err = ausrc_alloc(&tx->ausrc, ausrcl,
-				  tx->module,
-				  &prm, tx->device,
-				  ausrc_read_handler, ausrc_error_handler, a);
-		if (err) {
-			warning("audio: start_source failed (%s.%s): %m\n",
-				tx->module, tx->device, err);
+		/* before the source, which might start sending */
+		err = autx_share_join(tx, a);
+		if (err)
 			return err;
-		}
 
-		mtx_lock(tx->mtx);
-		/* recalculate and resize aubuf if ausrc_alloc changes prm */
-		tx->src_fmt = prm.fmt;
-		sz = aufmt_sample_size(tx->src_fmt);
-		tx->psize = sz * calc_nsamp(prm.srate, prm.ch, prm.ptime);
-		if (psize_alloc != tx->psize) {
-			tx->ausrc_prm = prm;
-			tx->aubuf_maxsz = tx->psize * 30;
-			err = aubuf_resize(tx->aubuf, tx->psize,
-					   tx->aubuf_maxsz);
-			if (err) {
-				mtx_unlock(tx->mtx);
+		/* the other legs send the packets of the leader */
+		if (!tx->share || txshare_leader(tx->share, a)) {
+			err = open_source(tx, a, ausrcl);
+			if (err)
 				return err;
-			}
 		}
-
-		mtx_unlock(tx->mtx);
-		tx->as = ausrc_find(ausrcl, tx->module);
-
-		switch (a->cfg.txmode) {
-
-		case AUDIO_MODE_POLL:
-			break;
-
-		case AUDIO_MODE_THREAD:
-			if (!re_atomic_rlx(&tx->thr.run)) {
-				re_atomic_rlx_set(&tx->thr.run, true);
-				err = thread_create_name(&tx->thr.tid,
-							 "Audio TX",
-							 tx_thread, a);
-				if (err) {
-					re_atomic_rlx_set(&tx->thr.run,
-							   false);
-					return err;
-				}
-			}
-			break;
-
-		default:
-			warning("audio: tx mode not supported (%d)\n",
-				a->cfg.txmode);
-			return ENOTSUP;
-		}
-
-		info("audio: source started with sample format %s\n",
-		     aufmt_name(tx->src_fmt));
 	}
 
 	stream_enable_tx(a->strm, true);
@@ -1313,6 +1761,43 @@ bool audio_started(const struct audio *a)
 }
 
 
+/*
+ * RFC 2198 -- redundancy with the clock rate of the encoder, if the peer
+ * accepted it. Called with the lock held.
+ */
+static int autx_red_set(struct audio *a, const struct aucodec *ac)
+{
+	struct autx *tx = &a->tx;
+	const struct sdp_format *rf = NULL;
+	int err;
+
+	if (a->cfg.red)
+		rf = sdp_media_rformat(stream_sdpmedia(a->strm), "red");
+
+	if (!rf || rf->srate != ac->crate) {
+		tx->red    = mem_deref(tx->red);
+		tx->pt_red = -1;
+		return 0;
+	}
+
+	if (!tx->mb_red) {
+		tx->mb_red = mbuf_alloc(STREAM_PRESZ + 4096);
+		if (!tx->mb_red)
+			return ENOMEM;
+	}
+
+	if (!tx->red) {
+		err = red_enc_alloc(&tx->red, 1);
+		if (err)
+			return err;
+	}
+
+	tx->pt_red = rf->pt;
+
+	return 0;
+}
+
+
 /**
  * Set the audio encoder used
  *
@@ -1351,6 +1836,13 @@ int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 		tx->ac = ac;
 	}
 
+	tx->params = mem_deref(tx->params);
+	if (params) {
+		err = str_dup(&tx->params, params);
+		if (err)
+			return err;
+	}
+
 	if (ac->encupdh) {
 		struct auenc_param prm;
 
@@ -1367,6 +1859,8 @@ int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 
 	mtx_lock(a->tx.mtx);
 	stream_update_encoder(a->strm, pt_tx);
+	if (autx_red_set(a, ac))
+		warning("audio: could not enable redundant audio\n");
 	mtx_unlock(a->tx.mtx);
 
 	telev_set_srate(a->telev, ac->crate);
@@ -1636,6 +2130,28 @@ int audio_level_get(const struct audio *a, double *levelp)
 }
 
 
+/**
+ * Get the audio statistics
+ *
+ * @param a    Audio object
+ * @param st   Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int audio_stats(const struct audio *a, struct audio_stat *st)
+{
+	if (!a || !st)
+		return EINVAL;
+
+	memset(st, 0, sizeof(*st));
+
+	st->tx_overrun  = a->tx.stats.aubuf_overrun;
+	st->tx_underrun = a->tx.stats.aubuf_underrun;
+
+	return aurecv_stats(a->aur, st);
+}
+
+
 /**
  * Print the audio debug information
  *
@@ -1679,6 +2195,10 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  aufmt_name(tx->src_fmt));
 	err |= re_hprintf(pf, "       time = %.3f sec\n",
 			  autx_calc_seconds(tx));
+	err |= re_hprintf(pf, "       conversions: %.2f per frame\n",
+			  tx->stats.frames ?
+			  (double)tx->stats.conv / tx->stats.frames : .0);
+	err |= txshare_debug(pf, tx->share);
 
 	err |= aurecv_debug(pf, a->aur);
 	err |= re_hprintf(pf,
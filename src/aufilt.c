@@ -4,6 +4,7 @@
  * Copyright (C) 2010 Alfred E. Heggestad
  */
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 #include "core.h"
 
@@ -37,3 +38,148 @@ void aufilt_unregister(struct aufilt *af)
 
 	list_unlink(&af->le);
 }
+
+
+/*
+ * Select the sample format for a filter. Filters without native formats
+ * take any format. Otherwise float is preferred, so that a float pipeline
+ * stays in float.
+ */
+static enum aufmt native_fmt(const struct aufilt *af, enum aufmt fmt)
+{
+	if (!af->fmts || (af->fmts & AUFILT_FMT(fmt)))
+		return fmt;
+
+	if (af->fmts & AUFILT_FMT(AUFMT_FLOAT))
+		return AUFMT_FLOAT;
+
+	if (af->fmts & AUFILT_FMT(AUFMT_S16LE))
+		return AUFMT_S16LE;
+
+	return fmt;
+}
+
+
+static int convert(struct auframe *af, enum aufmt fmt,
+		   struct auarena *arena, uint64_t *convc)
+{
+	void *sampv;
+	int err;
+
+	/* the arena is set up with the filters, without them nothing is
+	 * converted here */
+	if (af->fmt == fmt || !arena)
+		return 0;
+
+	sampv = auarena_get(arena, af->sampc * aufmt_sample_size(fmt));
+	if (!sampv)
+		return ENOMEM;
+
+	err = aufmt_convert(fmt, sampv, af->fmt, af->sampv, af->sampc);
+	if (err)
+		return err;
+
+	af->sampv = sampv;
+	af->fmt   = fmt;
+
+	if (convc)
+		++*convc;
+
+	return 0;
+}
+
+
+/**
+ * Process one audio frame through the encode filters in list order
+ *
+ * The sample format is converted only in front of a filter that does not
+ * take the current format, and once at the end to the encoder format.
+ *
+ * @param filtl List of encode filter states
+ * @param af    Audio frame
+ * @param fmt   Sample format of the encoder
+ * @param arena Frame arena for the converted samples
+ * @param lat   Latency trace (optional)
+ * @param t     Stage timestamp for the latency trace
+ * @param convc Incremented for each conversion (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note This function has REAL-TIME properties
+ */
+int aufilt_encode(const struct list *filtl, struct auframe *af,
+		  int fmt, struct auarena *arena,
+		  struct lattrace *lat, uint64_t *t, uint64_t *convc)
+{
+	struct le *le;
+	int err = 0;
+
+	if (!af)
+		return EINVAL;
+
+	for (le = list_head(filtl); le; le = le->next) {
+		struct aufilt_enc_st *st = le->data;
+		int e;
+
+		if (!st->af || !st->af->ench)
+			continue;
+
+		e = convert(af, native_fmt(st->af, af->fmt), arena, convc);
+		if (e) {
+			err |= e;
+			continue;
+		}
+
+		err |= st->af->ench(st, af);
+		lattrace_stamp(lat, st->af->name, t);
+	}
+
+	err |= convert(af, fmt, arena, convc);
+
+	return err;
+}
+
+
+/**
+ * Process one audio frame through the decode filters in reverse list order
+ *
+ * @param filtl List of decode filter states
+ * @param af    Audio frame
+ * @param fmt   Sample format of the player
+ * @param arena Frame arena for the converted samples
+ * @param lat   Latency trace (optional)
+ * @param t     Stage timestamp for the latency trace
+ * @param convc Incremented for each conversion (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note This function has REAL-TIME properties
+ */
+int aufilt_decode(const struct list *filtl, struct auframe *af,
+		  int fmt, struct auarena *arena,
+		  struct lattrace *lat, uint64_t *t, uint64_t *convc)
+{
+	struct le *le;
+	int err;
+
+	if (!af)
+		return EINVAL;
+
+	for (le = list_tail(filtl); le; le = le->prev) {
+		struct aufilt_dec_st *st = le->data;
+
+		if (!st->af || !st->af->dech)
+			continue;
+
+		err = convert(af, native_fmt(st->af, af->fmt), arena, convc);
+		if (err)
+			return err;
+
+		err = st->af->dech(st, af);
+		lattrace_stamp(lat, st->af->name, t);
+		if (err)
+			return err;
+	}
+
+	return convert(af, fmt, arena, convc);
+}
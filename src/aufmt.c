@@ -0,0 +1,223 @@
+/**
+ * @file src/aufmt.c  Audio sample format conversion
+ *
+ * The conversion kernels are simple loops without branches and without
+ * dependencies between samples, so that the compiler can vectorize them
+ * (SSE/AVX on x86, NEON on ARM).
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "core.h"
+
+
+#define S16_SCALE  32768.0f
+#define S24_SCALE  8388608.0f
+
+
+static void s16_to_float(float *restrict dst, const int16_t *restrict src,
+			 size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = (float)src[i] * (1.0f / S16_SCALE);
+}
+
+
+static void float_to_s16(int16_t *restrict dst, const float *restrict src,
+			 size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		float v = src[i] * S16_SCALE;
+
+		v = v > 32767.0f ? 32767.0f : v;
+		v = v < -32768.0f ? -32768.0f : v;
+
+		dst[i] = (int16_t)v;
+	}
+}
+
+
+static void s24_to_float(float *restrict dst, const uint8_t *restrict src,
+			 size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		int32_t v = (int32_t)((uint32_t)src[3*i]   <<  8 |
+				      (uint32_t)src[3*i+1] << 16 |
+				      (uint32_t)src[3*i+2] << 24) >> 8;
+
+		dst[i] = (float)v * (1.0f / S24_SCALE);
+	}
+}
+
+
+static void float_to_s24(uint8_t *restrict dst, const float *restrict src,
+			 size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		float f = src[i] * S24_SCALE;
+		int32_t v;
+
+		f = f > 8388607.0f ? 8388607.0f : f;
+		f = f < -8388608.0f ? -8388608.0f : f;
+
+		v = (int32_t)f;
+
+		dst[3*i]   = (uint8_t)(v);
+		dst[3*i+1] = (uint8_t)(v >> 8);
+		dst[3*i+2] = (uint8_t)(v >> 16);
+	}
+}
+
+
+static void s16_to_s24(uint8_t *restrict dst, const int16_t *restrict src,
+		       size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		dst[3*i]   = 0;
+		dst[3*i+1] = (uint8_t)(src[i]);
+		dst[3*i+2] = (uint8_t)(src[i] >> 8);
+	}
+}
+
+
+static void s24_to_s16(int16_t *restrict dst, const uint8_t *restrict src,
+		       size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = (int16_t)(src[3*i+1] | src[3*i+2] << 8);
+}
+
+
+/**
+ * Convert a vector of audio samples from one format to another
+ *
+ * Supported formats are AUFMT_S16LE, AUFMT_S24_3LE and AUFMT_FLOAT.
+ *
+ * @param dst_fmt Destination sample format (enum aufmt)
+ * @param dstv    Destination samples
+ * @param src_fmt Source sample format (enum aufmt)
+ * @param srcv    Source samples
+ * @param sampc   Number of samples, including all channels
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note This function has REAL-TIME properties
+ */
+int aufmt_convert(int dst_fmt, void *dstv, int src_fmt, const void *srcv,
+		  size_t sampc)
+{
+	if (!dstv || !srcv)
+		return EINVAL;
+
+	if (dst_fmt == src_fmt) {
+		if (dstv != srcv)
+			memmove(dstv, srcv,
+				sampc * aufmt_sample_size(dst_fmt));
+		return 0;
+	}
+
+	switch (dst_fmt << 8 | src_fmt) {
+
+	case AUFMT_FLOAT << 8 | AUFMT_S16LE:
+		s16_to_float(dstv, srcv, sampc);
+		break;
+
+	case AUFMT_S16LE << 8 | AUFMT_FLOAT:
+		float_to_s16(dstv, srcv, sampc);
+		break;
+
+	case AUFMT_FLOAT << 8 | AUFMT_S24_3LE:
+		s24_to_float(dstv, srcv, sampc);
+		break;
+
+	case AUFMT_S24_3LE << 8 | AUFMT_FLOAT:
+		float_to_s24(dstv, srcv, sampc);
+		break;
+
+	case AUFMT_S24_3LE << 8 | AUFMT_S16LE:
+		s16_to_s24(dstv, srcv, sampc);
+		break;
+
+	case AUFMT_S16LE << 8 | AUFMT_S24_3LE:
+		s24_to_s16(dstv, srcv, sampc);
+		break;
+
+	default:
+		return ENOTSUP;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Interleave planar float samples, [LLLL]+[RRRR] -> [LRLRLRLR]
+ *
+ * @param dstv   Interleaved destination samples
+ * @param srcv   Array of one source vector per channel
+ * @param ch     Number of channels
+ * @param frames Number of samples per channel
+ */
+void aufmt_interleave(float *dstv, float * const *srcv, uint8_t ch,
+		      size_t frames)
+{
+	if (!dstv || !srcv)
+		return;
+
+	if (ch == 2) {
+		const float *restrict l = srcv[0];
+		const float *restrict r = srcv[1];
+
+		for (size_t i = 0; i < frames; i++) {
+			dstv[2*i]   = l[i];
+			dstv[2*i+1] = r[i];
+		}
+
+		return;
+	}
+
+	for (uint8_t c = 0; c < ch; c++) {
+		const float *restrict s = srcv[c];
+
+		for (size_t i = 0; i < frames; i++)
+			dstv[i*ch + c] = s[i];
+	}
+}
+
+
+/**
+ * De-interleave float samples, [LRLRLRLR] -> [LLLL]+[RRRR]
+ *
+ * @param dstv   Array of one destination vector per channel
+ * @param srcv   Interleaved source samples
+ * @param ch     Number of channels
+ * @param frames Number of samples per channel
+ */
+void aufmt_deinterleave(float * const *dstv, const float *srcv, uint8_t ch,
+			size_t frames)
+{
+	if (!dstv || !srcv)
+		return;
+
+	if (ch == 2) {
+		float *restrict l = dstv[0];
+		float *restrict r = dstv[1];
+
+		for (size_t i = 0; i < frames; i++) {
+			l[i] = srcv[2*i];
+			r[i] = srcv[2*i+1];
+		}
+
+		return;
+	}
+
+	for (uint8_t c = 0; c < ch; c++) {
+		float *restrict d = dstv[c];
+
+		for (size_t i = 0; i < frames; i++)
+			d[i] = srcv[i*ch + c];
+	}
+}
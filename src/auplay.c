@@ -75,6 +75,10 @@ const struct auplay *auplay_find(const struct list *auplayl, const char *name)
 		return ap;
 	}
 
+	/* try the deferred modules */
+	if (!module_lazy_load(str_isset(name) ? name : NULL))
+		return auplay_find(auplayl, name);
+
 	return NULL;
 }
 
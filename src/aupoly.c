@@ -0,0 +1,542 @@
+/**
+ * @file aupoly.c  Polyphase audio resampler
+ *
+ * The resampler converts between any two sampling rates with a rational
+ * ratio up/down, e.g. 44100 Hz to 8000 Hz is 80/441. The anti-aliasing
+ * filter is a Kaiser windowed sinc, which is split into one phase per
+ * up-sampling step. Each output sample is the dot product of one phase
+ * with the most recent input samples, so only the output samples are
+ * computed and never the up-sampled signal.
+ *
+ * The filter banks are computed once per ratio and shared by all streams.
+ * A stream only keeps the filter history and the current phase, so the
+ * frames of a stream can be resampled without any per-frame setup.
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "core.h"
+
+
+enum {
+	ZEROX      =   16,  /* Zero crossings of the sinc on each side     */
+	TAP_ALIGN  =    4,  /* Taps per phase are a multiple of this       */
+	MAX_PHASES = 1024,  /* Upper limit for the up-sampling factor      */
+};
+
+#define ROLLOFF      0.92  /* Cutoff relative to the lower Nyquist rate */
+#define KAISER_BETA  8.0   /* Stop-band attenuation of about 80 dB      */
+
+static const double PI = 3.14159265358979323846264338328;
+
+
+/** Defines the filter bank for one resampling ratio */
+struct aupoly_bank {
+	struct le le;      /**< Linked list element for the cache        */
+	uint32_t up;       /**< Up-sampling factor, number of phases     */
+	uint32_t down;     /**< Down-sampling factor                     */
+	unsigned tapc;     /**< Taps per phase                           */
+	float *coefv;      /**< Coefficients, up * tapc, reverse order   */
+};
+
+/** Defines a polyphase resampler stream */
+struct aupoly {
+	struct aupoly_bank *bank; /**< Shared filter bank                */
+	uint8_t ich;       /**< Input channels                           */
+	uint8_t och;       /**< Output channels                          */
+	uint8_t pch;       /**< Filtered channels, the lower of both     */
+	size_t idx;        /**< Input frame of the next output frame     */
+	uint32_t phase;    /**< Phase of the next output frame           */
+	float *bufv;       /**< History and input, one row per channel   */
+	size_t framec;     /**< Input frames that fit into one row       */
+};
+
+
+static struct {
+	struct list bankl; /**< Cached filter banks                      */
+	mtx_t *mtx;        /**< Protects the cache                       */
+} cache;
+
+
+static void bank_destructor(void *arg)
+{
+	struct aupoly_bank *bank = arg;
+
+	mem_deref(bank->coefv);
+}
+
+
+static void destructor(void *arg)
+{
+	struct aupoly *rs = arg;
+
+	mem_deref(rs->bufv);
+	mem_deref(rs->bank);
+}
+
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+
+	for (int k = 1; k < 64 && term > sum * 1e-12; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum  += term;
+	}
+
+	return sum;
+}
+
+
+static int bank_alloc(struct aupoly_bank **bankp, uint32_t up,
+		      uint32_t down)
+{
+	struct aupoly_bank *bank;
+	double fc, d;
+
+	bank = mem_zalloc(sizeof(*bank), bank_destructor);
+	if (!bank)
+		return ENOMEM;
+
+	bank->up   = up;
+	bank->down = down;
+
+	/* cutoff as a fraction of the input Nyquist rate */
+	fc = ROLLOFF * min(1.0, (double)up / down);
+
+	if (up == down) {
+		bank->tapc = TAP_ALIGN;
+	}
+	else {
+		bank->tapc = (unsigned)ceil(2.0 * ZEROX / fc);
+		bank->tapc = (bank->tapc + TAP_ALIGN - 1) & ~(TAP_ALIGN - 1);
+	}
+
+	bank->coefv = mem_zalloc(up * bank->tapc * sizeof(float), NULL);
+	if (!bank->coefv) {
+		mem_deref(bank);
+		return ENOMEM;
+	}
+
+	/* same rate, only the newest sample */
+	if (up == down) {
+		bank->coefv[bank->tapc - 1] = 1.0f;
+		goto out;
+	}
+
+	d = bank->tapc / 2.0;
+
+	for (uint32_t p = 0; p < up; p++) {
+		float *coefv = &bank->coefv[p * bank->tapc];
+		double sum = 0.0;
+
+		/* tap j is applied to the input sample j frames back */
+		for (unsigned j = 0; j < bank->tapc; j++) {
+			double t = j + (double)p / up - d;
+			double x = fc * t;
+			double h, w;
+
+			if (fabs(t) >= d)
+				continue;
+
+			h = x == 0.0 ? 1.0 : sin(PI * x) / (PI * x);
+			w = bessel_i0(KAISER_BETA * sqrt(1.0 - (t/d) * (t/d)))
+				/ bessel_i0(KAISER_BETA);
+
+			coefv[bank->tapc - 1 - j] = (float)(h * w);
+			sum += h * w;
+		}
+
+		/* unity gain at DC for every phase */
+		for (unsigned j = 0; j < bank->tapc; j++)
+			coefv[j] = (float)(coefv[j] / sum);
+	}
+
+ out:
+	*bankp = bank;
+
+	return 0;
+}
+
+
+static int bank_get(struct aupoly_bank **bankp, uint32_t up, uint32_t down)
+{
+	struct aupoly_bank *bank = NULL;
+	struct le *le;
+	int err = 0;
+
+	if (cache.mtx)
+		mtx_lock(cache.mtx);
+
+	LIST_FOREACH(&cache.bankl, le) {
+		struct aupoly_bank *b = le->data;
+
+		if (b->up == up && b->down == down) {
+			bank = mem_ref(b);
+			goto out;
+		}
+	}
+
+	err = bank_alloc(&bank, up, down);
+	if (err)
+		goto out;
+
+	/* the cache keeps a reference until aupoly_close() */
+	if (cache.mtx)
+		list_append(&cache.bankl, &bank->le, mem_ref(bank));
+
+ out:
+	if (cache.mtx)
+		mtx_unlock(cache.mtx);
+
+	if (!err)
+		*bankp = bank;
+
+	return err;
+}
+
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+
+/**
+ * Allocate a polyphase resampler stream
+ *
+ * The number of channels can be converted between mono and any other
+ * channel count, or must be the same.
+ *
+ * @param rsp   Pointer to allocated resampler
+ * @param irate Input sampling rate in [Hz]
+ * @param ich   Input channels
+ * @param orate Output sampling rate in [Hz]
+ * @param och   Output channels
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aupoly_alloc(struct aupoly **rsp, uint32_t irate, uint8_t ich,
+		 uint32_t orate, uint8_t och)
+{
+	struct aupoly *rs;
+	uint32_t g;
+	int err;
+
+	if (!rsp || !irate || !ich || !orate || !och)
+		return EINVAL;
+
+	if (ich != och && ich != 1 && och != 1)
+		return ENOTSUP;
+
+	g = gcd(irate, orate);
+	if (orate / g > MAX_PHASES)
+		return ENOTSUP;
+
+	rs = mem_zalloc(sizeof(*rs), destructor);
+	if (!rs)
+		return ENOMEM;
+
+	rs->ich = ich;
+	rs->och = och;
+	rs->pch = min(ich, och);
+
+	err = bank_get(&rs->bank, orate / g, irate / g);
+	if (err) {
+		mem_deref(rs);
+		return err;
+	}
+
+	*rsp = rs;
+
+	return 0;
+}
+
+
+/**
+ * Get the maximum number of output samples for a number of input samples
+ *
+ * @param rs  Polyphase resampler
+ * @param inc Number of input samples, including all channels
+ *
+ * @return Maximum number of output samples, including all channels
+ */
+size_t aupoly_outc(const struct aupoly *rs, size_t inc)
+{
+	const struct aupoly_bank *bank;
+
+	if (!rs)
+		return 0;
+
+	bank = rs->bank;
+
+	return ((inc / rs->ich * bank->up + bank->down - 1) / bank->down + 1)
+		* rs->och;
+}
+
+
+/**
+ * Reset the filter history, e.g. after a discontinuity in the input
+ *
+ * @param rs Polyphase resampler
+ */
+void aupoly_reset(struct aupoly *rs)
+{
+	if (!rs)
+		return;
+
+	rs->idx   = 0;
+	rs->phase = 0;
+
+	if (rs->bufv)
+		memset(rs->bufv, 0, rs->pch * (rs->bank->tapc - 1 + rs->framec)
+		       * sizeof(float));
+}
+
+
+static int buf_check(struct aupoly *rs, size_t framec)
+{
+	const size_t hist = rs->bank->tapc - 1;
+	float *bufv;
+
+	if (framec <= rs->framec)
+		return 0;
+
+	bufv = mem_zalloc(rs->pch * (hist + framec) * sizeof(float), NULL);
+	if (!bufv)
+		return ENOMEM;
+
+	for (uint8_t c = 0; c < rs->pch && rs->bufv; c++) {
+		memcpy(&bufv[c * (hist + framec)],
+		       &rs->bufv[c * (hist + rs->framec)],
+		       hist * sizeof(float));
+	}
+
+	mem_deref(rs->bufv);
+	rs->bufv   = bufv;
+	rs->framec = framec;
+
+	return 0;
+}
+
+
+/* Write the input frames after the history, down-mixed if needed */
+static void ingest(struct aupoly *rs, const void *inv, int fmt,
+		   size_t framec)
+{
+	const size_t hist = rs->bank->tapc - 1;
+	const uint8_t mixc = rs->ich / rs->pch;
+	float gain = 1.0f / mixc;
+
+	if (fmt == AUFMT_S16LE)
+		gain /= 32768.0f;
+
+	for (uint8_t c = 0; c < rs->pch; c++) {
+		float *restrict row =
+			&rs->bufv[c * (hist + rs->framec) + hist];
+
+		if (fmt == AUFMT_S16LE) {
+			const int16_t *restrict src = inv;
+
+			for (size_t i = 0; i < framec; i++) {
+				int32_t v = 0;
+
+				for (uint8_t k = 0; k < mixc; k++)
+					v += src[i * rs->ich + c + k];
+
+				row[i] = (float)v * gain;
+			}
+		}
+		else {
+			const float *restrict src = inv;
+
+			for (size_t i = 0; i < framec; i++) {
+				float v = 0.0f;
+
+				for (uint8_t k = 0; k < mixc; k++)
+					v += src[i * rs->ich + c + k];
+
+				row[i] = v * gain;
+			}
+		}
+	}
+}
+
+
+/*
+ * Four independent partial sums, which the compiler maps to one SIMD
+ * register (SSE/NEON). A single sum would be a serial dependency chain,
+ * that is not vectorized without -ffast-math.
+ */
+static inline float dot(const float *restrict a, const float *restrict b,
+			unsigned n)
+{
+	float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+	for (unsigned k = 0; k < n; k += TAP_ALIGN) {
+		s0 += a[k]   * b[k];
+		s1 += a[k+1] * b[k+1];
+		s2 += a[k+2] * b[k+2];
+		s3 += a[k+3] * b[k+3];
+	}
+
+	return (s0 + s1) + (s2 + s3);
+}
+
+
+static inline void store(void *outv, int fmt, size_t i, float v)
+{
+	if (fmt == AUFMT_S16LE) {
+		v *= 32768.0f;
+		v  = v > 32767.0f ? 32767.0f : v;
+		v  = v < -32768.0f ? -32768.0f : v;
+
+		((int16_t *)outv)[i] = (int16_t)lrintf(v);
+	}
+	else {
+		((float *)outv)[i] = v;
+	}
+}
+
+
+/**
+ * Resample one frame of a stream
+ *
+ * The number of output samples depends on the phase of the stream, and is
+ * constant for frames where the ratio gives an integer number of samples.
+ *
+ * @param rs    Polyphase resampler
+ * @param outv  Output samples
+ * @param outc  Size of output buffer, and number of output samples
+ * @param inv   Input samples
+ * @param inc   Number of input samples, including all channels
+ * @param fmt   Sample format of input and output (AUFMT_S16LE/AUFMT_FLOAT)
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note This function has REAL-TIME properties, except for the first
+ *       frame and a frame that is larger than all previous frames
+ */
+int aupoly_process(struct aupoly *rs, void *outv, size_t *outc,
+		   const void *inv, size_t inc, int fmt)
+{
+	const struct aupoly_bank *bank;
+	const uint32_t up = rs ? rs->bank->up : 0;
+	size_t framec, hist, pos, total, ofc, i = 0;
+	uint32_t di, dp, p = 0;
+	int err;
+
+	if (!rs || !outv || !outc || !inv)
+		return EINVAL;
+
+	if (fmt != AUFMT_S16LE && fmt != AUFMT_FLOAT)
+		return ENOTSUP;
+
+	if (inc % rs->ich)
+		return EINVAL;
+
+	bank   = rs->bank;
+	hist   = bank->tapc - 1;
+	framec = inc / rs->ich;
+
+	/* output frames at the positions before the end of the input */
+	pos   = rs->idx * up + rs->phase;
+	total = framec * up;
+	ofc   = pos < total ? (total - pos + bank->down - 1) / bank->down : 0;
+
+	if (*outc < ofc * rs->och)
+		return ENOMEM;
+
+	err = buf_check(rs, framec);
+	if (err)
+		return err;
+
+	ingest(rs, inv, fmt, framec);
+
+	di = bank->down / up;
+	dp = bank->down % up;
+
+	for (uint8_t c = 0; c < rs->pch; c++) {
+		const float *row = &rs->bufv[c * (hist + rs->framec)];
+
+		i = rs->idx;
+		p = rs->phase;
+
+		for (size_t k = 0; k < ofc; k++) {
+			float v = dot(&bank->coefv[p * bank->tapc], &row[i],
+				      bank->tapc);
+
+			/* up-mix from mono */
+			for (uint8_t oc = c; oc < rs->och; oc += rs->pch)
+				store(outv, fmt, k * rs->och + oc, v);
+
+			i += di;
+			p += dp;
+			if (p >= up) {
+				p -= up;
+				++i;
+			}
+		}
+	}
+
+	if (ofc) {
+		rs->idx   = i;
+		rs->phase = p;
+	}
+
+	rs->idx -= framec;
+
+	/* keep the newest input frames as history */
+	for (uint8_t c = 0; c < rs->pch; c++) {
+		float *row = &rs->bufv[c * (hist + rs->framec)];
+
+		memmove(row, &row[framec], hist * sizeof(float));
+	}
+
+	*outc = ofc * rs->och;
+
+	return 0;
+}
+
+
+/**
+ * Initialise the filter bank cache
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aupoly_init(void)
+{
+	if (cache.mtx)
+		return 0;
+
+	list_init(&cache.bankl);
+
+	return mutex_alloc(&cache.mtx);
+}
+
+
+/**
+ * Release all cached filter banks
+ */
+void aupoly_close(void)
+{
+	if (!cache.mtx)
+		return;
+
+	mtx_lock(cache.mtx);
+	list_flush(&cache.bankl);
+	mtx_unlock(cache.mtx);
+
+	cache.mtx = mem_deref(cache.mtx);
+}
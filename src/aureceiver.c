@@ -19,13 +19,17 @@
 
  Processing decoder pipeline:
 
-       .--------.   .-------.   .--------.   .--------.
- |\    |        |   |       |   |        |   |        |
- | |<--| auplay |<--| aubuf |<--| aufilt |<--| decode |<--- RTP
- |/    |        |   |       |   |        |   |        |
-       '--------'   '-------'   '--------'   '--------'
+       .--------.   .-------.   .---------.   .--------.   .--------.
+ |\    |        |   |       |   |         |   |        |   |        |
+ | |<--| auplay |<--| aubuf |<--| playout |<--| aufilt |<--| decode |<--
+ |/    |        |   |       |   |         |   |        |   |        |
+       '--------'   '-------'   '---------'   '--------'   '--------'
 
  \endverbatim
+ *
+ * The playout stage is only active with audio_buffer_mode "stretch". It
+ * time-stretches frames towards a target latency derived from the RTP
+ * timestamps, and the aubuf then runs in fixed mode.
  */
 
 enum {
@@ -34,6 +38,7 @@ enum {
 
 
 struct audio_recv {
+	/* Data written only by the RX thread */
 	uint32_t srate;               /**< Decoder sample rate               */
 	uint32_t ch;                  /**< Decoder channel number            */
 	enum aufmt fmt;               /**< Decoder sample format             */
@@ -41,28 +46,51 @@ struct audio_recv {
 	struct audec_state *dec;      /**< Audio decoder state (optional)    */
 	const struct aucodec *ac;     /**< Current audio decoder             */
 	struct aubuf *aubuf;          /**< Audio buffer before auplay        */
+	struct playout *playout;      /**< Time-stretching playout (optional)*/
 	mtx_t *aubuf_mtx;             /**< Mutex for aubuf allocation        */
 	uint32_t ssrc;                /**< Incoming synchronization source   */
 	struct list filtl;            /**< Audio filters in decoding order   */
+	struct auarena *arena;        /**< Frame arena for conversions       */
 	void *sampv;                  /**< Sample buffer                     */
 	size_t sampvsz;               /**< Sample buffer size                */
 	uint64_t t;                   /**< Last auframe push time            */
 	uint32_t ptime;               /**< Packet time for receiving [us]    */
-
-	double level_last;            /**< Last audio level value [dBov]     */
-	bool level_set;               /**< True if level_last is set         */
 	struct timestamp_recv ts_recv;/**< Receive timestamp state           */
 	uint8_t extmap_aulevel;       /**< ID Range 1-14 inclusive           */
 	int pt;                       /**< Payload type of audio codec       */
+	RE_ATOMIC unsigned gen;       /**< Applied configuration generation  */
+	struct lattrace *lat;         /**< Latency trace (optional)          */
+
+	RE_ATOMIC int level_last;     /**< Last audio level value [dBov]     */
+	RE_ATOMIC bool level_set;     /**< True if level_last is set         */
 
 	struct {
-		uint64_t n_discard;   /**< Nbr of discarded packets          */
+		RE_ATOMIC uint64_t n_discard; /**< Nbr of discarded packets  */
 		RE_ATOMIC uint64_t latency;   /**< Latency in [ms]           */
-		int32_t jitter;       /**< Auframe push jitter [us]          */
+		RE_ATOMIC int32_t jitter;     /**< Auframe push jitter [us]  */
 		int32_t dmax;         /**< Max deviation [us]                */
+		uint64_t frames;      /**< Frames through the filters        */
+		uint64_t conv;        /**< Sample format conversions         */
 	} stats;
 
-	mtx_t *mtx;
+	/* Control plane protected by mtx, taken over in aurecv_sync() */
+	struct {
+		const struct aucodec *ac;  /**< Audio decoder                */
+		struct audec_state *dec;   /**< New decoder state            */
+		bool dec_set;              /**< Replace the decoder state    */
+		char *params;              /**< Decoder parameters to update */
+		struct list filtl;         /**< Filters to append            */
+		unsigned filtc;            /**< Filters in the chain         */
+		struct auarena *arena;     /**< New frame arena              */
+		bool flush;                /**< Flush the filter chain       */
+		int pt;                    /**< Payload type of audio codec  */
+		uint8_t extmap_aulevel;    /**< ID Range 1-14 inclusive      */
+		unsigned gen;              /**< Configuration generation     */
+	} ctl;
+
+	RE_ATOMIC unsigned pubgen;    /**< Published configuration generation*/
+	RE_ATOMIC bool busy;          /**< RX thread uses the data plane     */
+	mtx_t *mtx;                   /**< Mutex protects the control plane  */
 
 	const struct auplay *ap;      /**< Audio player module               */
 	struct auplay_st *auplay;     /**< Audio player                      */
@@ -80,31 +108,124 @@ static void destructor(void *arg)
 
 	mem_deref(ar->dec);
 	mem_deref(ar->aubuf);
+	mem_deref(ar->playout);
 	mem_deref(ar->aubuf_mtx);
 	mem_deref(ar->sampv);
 	mem_deref(ar->mtx);
 	list_flush(&ar->filtl);
+	mem_deref(ar->arena);
+	mem_deref(ar->ctl.dec);
+	mem_deref(ar->ctl.params);
+	list_flush(&ar->ctl.filtl);
+	mem_deref(ar->ctl.arena);
 	mem_deref(ar->module);
 	mem_deref(ar->device);
+	mem_deref(ar->lat);
 }
 
 
-static int aurecv_process_decfilt(struct audio_recv *ar, struct auframe *af)
+/*
+ * Take over the control plane, called with mtx locked. This runs in the
+ * RX thread, or in the control thread while the RX thread is idle, so
+ * that replaced decoders and filters are released right away.
+ */
+static void aurecv_apply(struct audio_recv *ar)
 {
-	int err = 0;
+	struct le *le;
+	int err;
 
-	/* Process exactly one audio-frame in reverse list order */
-	for (struct le *le = ar->filtl.tail; le; le = le->prev) {
+	if (re_atomic_rlx(&ar->gen) == ar->ctl.gen)
+		return;
+
+	if (ar->ctl.dec_set) {
+		mem_deref(ar->dec);
+		ar->dec = ar->ctl.dec;
+		ar->ctl.dec = NULL;
+		ar->ctl.dec_set = false;
+	}
+
+	ar->ac = ar->ctl.ac;
+
+	if (ar->ctl.params) {
+		if (ar->ac && ar->ac->decupdh) {
+			err = ar->ac->decupdh(&ar->dec, ar->ac,
+					      ar->ctl.params);
+			if (err)
+				warning("audio_recv: update decoder: %m\n",
+					err);
+		}
+
+		ar->ctl.params = mem_deref(ar->ctl.params);
+	}
+
+	if (ar->ctl.flush) {
+		playout_reset(ar->playout);
+		list_flush(&ar->filtl);
+		ar->ctl.flush = false;
+	}
+
+	/* move the new filters, without any allocation */
+	le = list_head(&ar->ctl.filtl);
+	while (le) {
 		struct aufilt_dec_st *st = le->data;
 
-		if (st->af && st->af->dech)
-			err = st->af->dech(st, af);
+		le = le->next;
+		list_move(&st->le, &ar->filtl);
+	}
 
-		if (err)
-			break;
+	if (ar->ctl.arena) {
+		mem_deref(ar->arena);
+		ar->arena = ar->ctl.arena;
+		ar->ctl.arena = NULL;
 	}
 
-	return err;
+	ar->pt  = ar->ctl.pt;
+	ar->extmap_aulevel = ar->ctl.extmap_aulevel;
+
+	re_atomic_rls_set(&ar->gen, ar->ctl.gen);
+}
+
+
+/*
+ * Publish the control plane to the RX thread, called with mtx locked.
+ *
+ * Either the RX thread sees the new generation after it has set the busy
+ * flag, or the busy flag is still cleared here and the control plane is
+ * taken over right now.
+ */
+static void aurecv_publish(struct audio_recv *ar)
+{
+	re_atomic_seq_set(&ar->pubgen, ++ar->ctl.gen);
+
+	if (!re_atomic_seq(&ar->busy))
+		aurecv_apply(ar);
+}
+
+
+/*
+ * Take over the control plane in the RX thread. The RX thread owns the
+ * decoder and the filters, and only takes the mutex after a change.
+ */
+static void aurecv_sync(struct audio_recv *ar)
+{
+	if (re_atomic_seq(&ar->pubgen) == re_atomic_acq(&ar->gen))
+		return;
+
+	mtx_lock(ar->mtx);
+	aurecv_apply(ar);
+	mtx_unlock(ar->mtx);
+}
+
+
+static int aurecv_process_decfilt(struct audio_recv *ar, struct auframe *af,
+				  uint64_t *t)
+{
+	/* Process exactly one audio-frame in reverse list order */
+	auarena_reset(ar->arena);
+	++ar->stats.frames;
+
+	return aufilt_decode(&ar->filtl, af, ar->play_fmt, ar->arena,
+			     ar->lat, t, &ar->stats.conv);
 }
 
 
@@ -113,11 +234,11 @@ static double aurecv_calc_seconds(const struct audio_recv *ar)
 	uint64_t dur;
 	double seconds;
 
-	if (!ar->ac)
+	if (!ar->ctl.ac)
 		return .0;
 
 	dur = timestamp_duration(&ar->ts_recv);
-	seconds = timestamp_calc_seconds(dur, ar->ac->crate);
+	seconds = timestamp_calc_seconds(dur, ar->ctl.ac->crate);
 
 	return seconds;
 }
@@ -148,7 +269,8 @@ static int aurecv_alloc_aubuf(struct audio_recv *ar, const struct auframe *af)
 			err);
 	}
 
-	aubuf_set_mode(ar->aubuf, cfg->adaptive ?
+	/* the playout stage adapts the latency by itself */
+	aubuf_set_mode(ar->aubuf, cfg->adaptive && !cfg->stretch ?
 		       AUBUF_ADAPTIVE : AUBUF_FIXED);
 	aubuf_set_silence(ar->aubuf, cfg->silence);
 	mtx_unlock(ar->aubuf_mtx);
@@ -156,10 +278,12 @@ static int aurecv_alloc_aubuf(struct audio_recv *ar, const struct auframe *af)
 }
 
 
-static int aurecv_push_aubuf(struct audio_recv *ar, const struct auframe *af)
+static int aurecv_push_aubuf(struct audio_recv *ar, struct auframe *af,
+			     uint64_t t0)
 {
 	int err;
 	uint64_t bpms;
+	uint64_t t, tp;
 
 	if (!ar->aubuf) {
 		err = aurecv_alloc_aubuf(ar, af);
@@ -167,15 +291,28 @@ static int aurecv_push_aubuf(struct audio_recv *ar, const struct auframe *af)
 			return err;
 	}
 
+	t  = tmr_jiffies_usec();
+	tp = lattrace_now(ar->lat);
+
+	if (ar->playout) {
+		bpms = (uint64_t)af->srate * af->ch *
+		       aufmt_sample_size(af->fmt) / 1000;
+		playout_process(ar->playout, af, t, bpms ?
+				(uint32_t)(aubuf_cur_size(ar->aubuf) / bpms) :
+				0);
+		lattrace_stamp(ar->lat, "playout", &tp);
+	}
+
 #ifndef RELEASE
 	int32_t d, da;
-	uint64_t t;
-	t = tmr_jiffies_usec();
 	if (ar->t) {
 		d = (int32_t) (int64_t) ((t - ar->t) - ar->ptime);
 		da = abs(d);
+		int32_t jitter = re_atomic_rlx(&ar->stats.jitter);
+
 		ar->stats.dmax = max(ar->stats.dmax, da);
-		ar->stats.jitter += (da - ar->stats.jitter) / JITTER_EMA_COEFF;
+		re_atomic_rlx_set(&ar->stats.jitter,
+				  jitter + (da - jitter) / JITTER_EMA_COEFF);
 	}
 
 	ar->t = t;
@@ -194,6 +331,15 @@ static int aurecv_push_aubuf(struct audio_recv *ar, const struct auframe *af)
 		re_atomic_rlx_set(&ar->stats.latency,
 				  aubuf_cur_size(ar->aubuf) / bpms);
 
+	/* the frame waits in the aubuf until everything before is played */
+	if (ar->lat && bpms) {
+		uint64_t q = aubuf_cur_size(ar->aubuf) * 1000 / bpms;
+
+		lattrace_add(ar->lat, "aubuf", q);
+		if (t0)
+			lattrace_add(ar->lat, "total", tp - t0 + q);
+	}
+
 	return 0;
 }
 
@@ -208,11 +354,16 @@ static int aurecv_stream_decode(struct audio_recv *ar,
 	int err = 0;
 	const struct aucodec *ac = ar->ac;
 	bool flush = ar->ssrc != hdr->ssrc;
+	uint64_t t0 = lattrace_marked(ar->lat, hdr->seq);
+	uint64_t t  = t0;
 
 	/* No decoder set */
 	if (!ac)
 		return 0;
 
+	/* from the socket until here, includes the jitter buffer */
+	lattrace_stamp(ar->lat, "jbuf", &t);
+
 	ar->ssrc = hdr->ssrc;
 
 	/* TODO: PLC */
@@ -243,6 +394,8 @@ static int aurecv_stream_decode(struct audio_recv *ar,
 		sampc = 0;
 	}
 
+	lattrace_stamp(ar->lat, "decode", &t);
+
 	auframe_init(&af, ar->fmt, ar->sampv, sampc, ac->srate, ac->ch);
 	af.timestamp = ((uint64_t) hdr->ts) * AUDIO_TIMEBASE / ac->crate;
 
@@ -251,14 +404,16 @@ static int aurecv_stream_decode(struct audio_recv *ar,
 		goto out;
 	}
 
-	if (flush)
+	if (flush) {
 		aubuf_flush(ar->aubuf);
+		playout_reset(ar->playout);
+	}
 
-	err = aurecv_process_decfilt(ar, &af);
+	err = aurecv_process_decfilt(ar, &af, &t);
 	if (err)
 		goto out;
 
-	err = aurecv_push_aubuf(ar, &af);
+	err = aurecv_push_aubuf(ar, &af, t0);
  out:
 	return err;
 }
@@ -279,22 +434,16 @@ static const struct rtpext *rtpext_find(const struct rtpext *extv, size_t extc,
 }
 
 
-/* Handle incoming stream data from the network */
-void aurecv_receive(struct audio_recv *ar, const struct rtp_header *hdr,
-		    struct rtpext *extv, size_t extc,
-		    struct mbuf *mb, unsigned lostc, bool *ignore)
+static void aurecv_handle(struct audio_recv *ar,
+			  const struct rtp_header *hdr,
+			  struct rtpext *extv, size_t extc,
+			  struct mbuf *mb, bool *ignore)
 {
 	bool discard = false;
 	bool drop = *ignore;
 	int wrap;
-	(void) lostc;
 
-	if (!mb)
-		return;
-
-	mtx_lock(ar->mtx);
 	if (hdr->pt != ar->pt) {
-		mtx_unlock(ar->mtx);
 		*ignore = true;
 		return;
 	}
@@ -304,8 +453,10 @@ void aurecv_receive(struct audio_recv *ar, const struct rtp_header *hdr,
 	/* RFC 5285 -- A General Mechanism for RTP Header Extensions */
 	const struct rtpext *ext = rtpext_find(extv, extc, ar->extmap_aulevel);
 	if (ext) {
-		ar->level_last = -(double)(ext->data[0] & 0x7f);
-		ar->level_set = true;
+		const int level = -(int)(ext->data[0] & 0x7f);
+
+		re_atomic_rlx_set(&ar->level_last, level);
+		re_atomic_rlx_set(&ar->level_set, true);
 	}
 
 	/* Save timestamp for incoming RTP packets */
@@ -338,8 +489,9 @@ void aurecv_receive(struct audio_recv *ar, const struct rtp_header *hdr,
 	ar->ts_recv.last = hdr->ts;
 
 	if (discard) {
-		++ar->stats.n_discard;
-		goto out;
+		re_atomic_rlx_set(&ar->stats.n_discard,
+				  re_atomic_rlx(&ar->stats.n_discard) + 1);
+		return;
 	}
 
 	/* TODO:  what if lostc > 1 ?*/
@@ -350,9 +502,32 @@ void aurecv_receive(struct audio_recv *ar, const struct rtp_header *hdr,
 /*                (void)aurecv_stream_decode(ar, hdr, mb, lostc, drop);*/
 
 	(void)aurecv_stream_decode(ar, hdr, mb, 0, drop);
+}
 
-out:
-	mtx_unlock(ar->mtx);
+
+/*
+ * Handle incoming stream data from the network
+ *
+ * @note This function runs in the RX thread, and does not take any lock
+ *       unless the configuration was changed
+ */
+void aurecv_receive(struct audio_recv *ar, const struct rtp_header *hdr,
+		    struct rtpext *extv, size_t extc,
+		    struct mbuf *mb, unsigned lostc, bool *ignore)
+{
+	(void) lostc;
+
+	if (!mb)
+		return;
+
+	re_atomic_seq_set(&ar->busy, true);
+	aurecv_sync(ar);
+
+	aurecv_handle(ar, hdr, extv, extc, mb, ignore);
+
+	/* an update published during this packet is taken over now */
+	re_atomic_seq_set(&ar->busy, false);
+	aurecv_sync(ar);
 }
 
 
@@ -362,7 +537,8 @@ void aurecv_set_extmap(struct audio_recv *ar, uint8_t aulevel)
 		return;
 
 	mtx_lock(ar->mtx);
-	ar->extmap_aulevel = aulevel;
+	ar->ctl.extmap_aulevel = aulevel;
+	aurecv_publish(ar);
 	mtx_unlock(ar->mtx);
 }
 
@@ -387,6 +563,16 @@ int aurecv_set_device(struct audio_recv *ar, const char *device)
 }
 
 
+void aurecv_set_lattrace(struct audio_recv *ar, struct lattrace *lat)
+{
+	if (!ar)
+		return;
+
+	mem_deref(ar->lat);
+	ar->lat = mem_ref(lat);
+}
+
+
 uint64_t aurecv_latency(const struct audio_recv *ar)
 {
 	if (!ar)
@@ -396,6 +582,19 @@ uint64_t aurecv_latency(const struct audio_recv *ar)
 }
 
 
+int aurecv_stats(const struct audio_recv *ar, struct audio_stat *st)
+{
+	if (!ar || !st)
+		return EINVAL;
+
+	st->rx_discard = re_atomic_rlx(&ar->stats.n_discard);
+	st->rx_jitter  = re_atomic_rlx(&ar->stats.jitter);
+	st->rx_latency = re_atomic_rlx(&ar->stats.latency);
+
+	return 0;
+}
+
+
 int aurecv_alloc(struct audio_recv **aupp, const struct config_audio *cfg,
 		 size_t sampc, uint32_t ptime)
 {
@@ -418,11 +617,18 @@ int aurecv_alloc(struct audio_recv **aupp, const struct config_audio *cfg,
 	ar->sampv   = mem_zalloc(ar->sampvsz, NULL);
 	ar->ptime   = ptime * 1000;
 	ar->pt      = -1;
+	ar->ctl.pt  = -1;
 	if (!ar->sampv) {
 		err = ENOMEM;
 		goto out;
 	}
 
+	if (cfg->adaptive && cfg->stretch) {
+		err = playout_alloc(&ar->playout, &cfg->buffer, ptime);
+		if (err)
+			goto out;
+	}
+
 	err  = mutex_alloc(&ar->mtx);
 	err |= mutex_alloc(&ar->aubuf_mtx);
 
@@ -441,15 +647,26 @@ void aurecv_flush(struct audio_recv *ar)
 	if (!ar)
 		return;
 
-	mtx_lock(ar->mtx);
+	mtx_lock(ar->aubuf_mtx);
 	aubuf_flush(ar->aubuf);
+	mtx_unlock(ar->aubuf_mtx);
 
-	/* Reset audio filter chain */
-	list_flush(&ar->filtl);
+	/* Reset audio filter chain, the RX thread takes it over */
+	mtx_lock(ar->mtx);
+	list_flush(&ar->ctl.filtl);
+	ar->ctl.filtc = 0;
+	ar->ctl.arena = mem_deref(ar->ctl.arena);
+	ar->ctl.flush = true;
+	aurecv_publish(ar);
 	mtx_unlock(ar->mtx);
 }
 
 
+/*
+ * A new decoder gets a new state, which is handed over to the RX thread.
+ * The parameters of the current decoder are updated by the RX thread,
+ * since it uses the decoder state without a lock.
+ */
 int aurecv_decoder_set(struct audio_recv *ar,
 		       const struct aucodec *ac, int pt, const char *params)
 {
@@ -462,20 +679,41 @@ int aurecv_decoder_set(struct audio_recv *ar,
 	     ac->name, ac->srate, ac->ch);
 
 	mtx_lock(ar->mtx);
-	if (ac != ar->ac) {
-		ar->ac = ac;
-		ar->dec = mem_deref(ar->dec);
-	}
+	if (ac != ar->ctl.ac) {
+		struct audec_state *dec = NULL;
+
+		if (ac->decupdh) {
+			err = ac->decupdh(&dec, ac, params);
+			if (err) {
+				warning("audio_recv: alloc decoder: %m\n",
+					err);
+				goto out;
+			}
+		}
 
-	if (ac->decupdh) {
-		err = ac->decupdh(&ar->dec, ac, params);
+		mem_deref(ar->ctl.dec);
+		ar->ctl.ac      = ac;
+		ar->ctl.dec     = dec;
+		ar->ctl.dec_set = true;
+		ar->ctl.params  = mem_deref(ar->ctl.params);
+	}
+	else if (ac->decupdh && ar->ctl.dec_set) {
+		/* not taken over by the RX thread yet */
+		err = ac->decupdh(&ar->ctl.dec, ac, params);
 		if (err) {
 			warning("audio_recv: alloc decoder: %m\n", err);
 			goto out;
 		}
 	}
+	else if (ac->decupdh) {
+		ar->ctl.params = mem_deref(ar->ctl.params);
+		err = str_dup(&ar->ctl.params, params ? params : "");
+		if (err)
+			goto out;
+	}
 
-	ar->pt = pt;
+	ar->ctl.pt = pt;
+	aurecv_publish(ar);
 
 out:
 	mtx_unlock(ar->mtx);
@@ -485,23 +723,47 @@ out:
 
 int aurecv_payload_type(const struct audio_recv *ar)
 {
+	int pt;
+
 	if (!ar)
 		return -1;
 
-	return ar->pt;
+	mtx_lock(ar->mtx);
+	pt = ar->ctl.pt;
+	mtx_unlock(ar->mtx);
+
+	return pt;
 }
 
 
 int aurecv_filt_append(struct audio_recv *ar, struct aufilt_dec_st *decst)
 {
+	struct auarena *arena;
+	size_t slotsz;
+	int err;
+
 	if (!ar || !decst)
 		return EINVAL;
 
+	/* one conversion in front of each filter, and one at the end */
+	slotsz = ar->sampvsz / aufmt_sample_size(ar->cfg->dec_fmt) *
+		 sizeof(float);
+
 	mtx_lock(ar->mtx);
-	list_append(&ar->filtl, &decst->le, decst);
+	err = auarena_alloc(&arena, slotsz, ar->ctl.filtc + 2);
+	if (err)
+		goto out;
+
+	list_append(&ar->ctl.filtl, &decst->le, decst);
+	++ar->ctl.filtc;
+	mem_deref(ar->ctl.arena);
+	ar->ctl.arena = arena;
+	aurecv_publish(ar);
+
+ out:
 	mtx_unlock(ar->mtx);
 
-	return 0;
+	return err;
 }
 
 
@@ -512,7 +774,7 @@ bool aurecv_filt_empty(const struct audio_recv *ar)
 		return false;
 
 	mtx_lock(ar->mtx);
-	empty = list_isempty(&ar->filtl);
+	empty = ar->ctl.filtc == 0;
 	mtx_unlock(ar->mtx);
 
 	return empty;
@@ -521,29 +783,19 @@ bool aurecv_filt_empty(const struct audio_recv *ar)
 
 bool aurecv_level_set(const struct audio_recv *ar)
 {
-	bool set;
 	if (!ar)
 		return false;
 
-	mtx_lock(ar->mtx);
-	set = ar->level_set;
-	mtx_unlock(ar->mtx);
-
-	return set;
+	return re_atomic_rlx(&ar->level_set);
 }
 
 
 double aurecv_level(const struct audio_recv *ar)
 {
-	double v;
 	if (!ar)
 		return 0.0;
 
-	mtx_lock(ar->mtx);
-	v = ar->level_last;
-	mtx_unlock(ar->mtx);
-
-	return v;
+	return (double)re_atomic_rlx(&ar->level_last);
 }
 
 
@@ -555,7 +807,7 @@ const struct aucodec *aurecv_codec(const struct audio_recv *ar)
 		return NULL;
 
 	mtx_lock(ar->mtx);
-	ac = ar->ac;
+	ac = ar->ctl.ac;
 	mtx_unlock(ar->mtx);
 	return ac;
 }
@@ -582,7 +834,11 @@ void aurecv_stop(struct audio_recv *ar)
 
 	ar->auplay = mem_deref(ar->auplay);
 	mtx_lock(ar->mtx);
-	ar->ac = NULL;
+	ar->ctl.ac      = NULL;
+	ar->ctl.dec     = mem_deref(ar->ctl.dec);
+	ar->ctl.dec_set = true;
+	ar->ctl.params  = mem_deref(ar->ctl.params);
+	aurecv_publish(ar);
 	mtx_unlock(ar->mtx);
 }
 
@@ -631,6 +887,7 @@ static void check_plframe(struct auframe *af1, struct auframe *af2)
 static void auplay_write_handler(struct auframe *af, void *arg)
 {
 	struct audio_recv *ar = arg;
+	uint64_t t = lattrace_now(ar->lat);
 
 	if (!ar->done_first) {
 		struct auframe afr;
@@ -645,6 +902,7 @@ static void auplay_write_handler(struct auframe *af, void *arg)
 	}
 
 	aurecv_read(ar, af);
+	lattrace_stamp(ar->lat, "auplay", &t);
 }
 
 
@@ -740,7 +998,7 @@ int aurecv_debug(struct re_printf *pf, const struct audio_recv *ar)
 	       1000.0;
 	err  = mbuf_printf(mb,
 			   " rx:   decode: %H %s\n",
-			   aucodec_print, ar->ac,
+			   aucodec_print, ar->ctl.ac,
 			   aufmt_name(ar->fmt));
 	mtx_lock(ar->aubuf_mtx);
 	err |= mbuf_printf(mb, "       aubuf: %H"
@@ -749,17 +1007,24 @@ int aurecv_debug(struct re_printf *pf, const struct audio_recv *ar)
 			   aubuf_cur_size(ar->aubuf) / bpms,
 			   aubuf_maxsz(ar->aubuf) / bpms);
 	mtx_unlock(ar->aubuf_mtx);
+	if (ar->playout) {
+		err |= mbuf_printf(mb, "       playout: %H\n",
+				   playout_debug, ar->playout);
+	}
 #ifndef RELEASE
 	err |= mbuf_printf(mb, "       SW jitter: %.2fms\n",
-			   (double) ar->stats.jitter / 1000);
+			   (double) re_atomic_rlx(&ar->stats.jitter) / 1000);
 	err |= mbuf_printf(mb, "       deviation: %.2fms\n",
 			   (double) ar->stats.dmax / 1000);
 #endif
 	err |= mbuf_printf(mb, "       n_discard: %llu\n",
-			   ar->stats.n_discard);
-	if (ar->level_set) {
+			   re_atomic_rlx(&ar->stats.n_discard));
+	err |= mbuf_printf(mb, "       conversions: %.2f per frame\n",
+			   ar->stats.frames ?
+			   (double)ar->stats.conv / ar->stats.frames : .0);
+	if (re_atomic_rlx(&ar->level_set)) {
 		err |= mbuf_printf(mb, "       level %.3f dBov\n",
-				   ar->level_last);
+				   (double)re_atomic_rlx(&ar->level_last));
 	}
 	if (ar->ts_recv.is_set) {
 		err |= mbuf_printf(mb, "       time = %.3f sec\n",
@@ -801,6 +1066,8 @@ int aurecv_print_pipeline(struct re_printf *pf, const struct audio_recv *ar)
 	err = re_hprintf(pf, "audio rx pipeline:  %10s",
 			 ar->ap ? ar->ap->name : "(play)");
 	err = mbuf_printf(mb, " <--- aubuf");
+	if (ar->playout)
+		err |= mbuf_printf(mb, " <--- playout");
 	mtx_lock(ar->mtx);
 	for (le = list_head(&ar->filtl); le; le = le->next) {
 		struct aufilt_dec_st *st = le->data;
@@ -810,8 +1077,10 @@ int aurecv_print_pipeline(struct re_printf *pf, const struct audio_recv *ar)
 	}
 	mtx_unlock(ar->mtx);
 
+	mtx_lock(ar->mtx);
 	err |= mbuf_printf(mb, " <--- %s",
-			   ar->ac ? ar->ac->name : "(decoder)");
+			   ar->ctl.ac ? ar->ctl.ac->name : "(decoder)");
+	mtx_unlock(ar->mtx);
 
 	if (err)
 		goto out;
@@ -75,6 +75,10 @@ const struct ausrc *ausrc_find(const struct list *ausrcl, const char *name)
 		return as;
 	}
 
+	/* try the deferred modules */
+	if (!module_lazy_load(str_isset(name) ? name : NULL))
+		return ausrc_find(ausrcl, name);
+
 	return NULL;
 }
 
@@ -128,6 +128,10 @@ int baresip_init(struct config *cfg)
 	if (err)
 		return err;
 
+	err = aupoly_init();
+	if (err)
+		return err;
+
 	err = message_init(&baresip.message);
 	if (err) {
 		warning("baresip: message init failed: %m\n", err);
@@ -156,6 +160,8 @@ void baresip_close(void)
 
 	baresip.net = mem_deref(baresip.net);
 
+	aupoly_close();
+
 	ui_reset(&baresip.uis);
 }
 
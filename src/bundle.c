@@ -153,8 +153,7 @@ int bundle_set_extmap(struct bundle *bun, struct sdp_media *sdp,
 
 	bun->extmap_mid = extmap_mid;
 
-	err = sdp_media_set_lattr(sdp, true, "extmap",
-				  "%u %s", bun->extmap_mid, uri_mid);
+	err = sdp_media_set_extmap(sdp, bun->extmap_mid, uri_mid);
 
 	return err;
 }
@@ -234,10 +233,11 @@ static struct stream *lookup_remote_ssrc(const struct list *streaml,
 		struct stream *strm = le->data;
 		uint32_t rssrc;
 
-		if (stream_ssrc_rx(strm, &rssrc))
-			continue;
+		if (!stream_ssrc_rx(strm, &rssrc) && ssrc == rssrc)
+			return strm;
 
-		if (ssrc == rssrc)
+		/* RFC 5956 -- the FEC stream of the media stream */
+		if (!stream_ssrc_rx_fec(strm, &rssrc) && ssrc == rssrc)
 			return strm;
 	}
 
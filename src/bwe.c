@@ -0,0 +1,676 @@
+/**
+ * @file bwe.c  Send-side bandwidth estimation
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * Send-side bandwidth estimator
+ *
+ * Loosely follows Google Congestion Control (draft-ietf-rmcat-gcc-02)
+ * with transport-wide feedback. Every sent packet is recorded with its
+ * transport-wide sequence number, size and send time. The feedback from
+ * the receiver provides the arrival time of each packet.
+ *
+ * Delay-based controller: packets sent within GROUP_US are grouped, and
+ * the one-way delay variation between groups is accumulated, smoothed
+ * and fed to a trendline filter. The slope is compared against an
+ * adaptive threshold and signals over-use, under-use or normal. An AIMD
+ * controller decreases the rate to 85% of the acknowledged bitrate on
+ * over-use and increases it by 8% per second otherwise.
+ *
+ * Loss-based controller: the rate is decreased by half the loss fraction
+ * if more than 10% of the packets are lost, and increased by 5% if less
+ * than 2% are lost.
+ *
+ * The target bitrate is the minimum of both, within [min, max].
+ */
+
+
+enum {
+	HIST_SIZE     = 1024,     /**< Send history, power of 2          */
+	GROUP_US      = 5000,     /**< Burst time of a packet group      */
+	TREND_WINDOW  = 20,       /**< Trendline window [groups]         */
+	OVERUSE_MS    = 10,       /**< Over-use time before signaling    */
+	ACKED_WINDOW  = 500000,   /**< Acknowledged bitrate window [us]  */
+	DECR_INTERVAL = 200000,   /**< Min. time between decreases [us]  */
+	LOSS_PACKETS  = 20,       /**< Min. packets for loss estimation  */
+	LOSS_INTERVAL = 100000,   /**< Min. loss update interval [us]    */
+	MAX_GAP_US    = 1000000,  /**< Max. arrival gap between groups   */
+};
+
+
+enum bwe_state {
+	BWE_HOLD,
+	BWE_INCREASE,
+	BWE_DECREASE,
+};
+
+
+struct sent {
+	uint64_t send;            /**< Send time [us]                    */
+	uint32_t size;            /**< Packet size [bytes]               */
+	uint16_t seq;             /**< Transport-wide sequence number    */
+	bool valid;               /**< Entry is in use                   */
+};
+
+
+struct group {
+	uint64_t send_first;      /**< Send time of first packet [us]    */
+	uint64_t send;            /**< Send time of last packet [us]     */
+	int64_t arrival;          /**< Arrival time of last packet [us]  */
+	bool valid;               /**< Group has packets                 */
+};
+
+
+struct trendline {
+	double acc;               /**< Accumulated delay [ms]            */
+	double smoothed;          /**< Smoothed accumulated delay [ms]   */
+	double xv[TREND_WINDOW];  /**< Arrival time [ms]                 */
+	double yv[TREND_WINDOW];  /**< Smoothed delay [ms]               */
+	unsigned n;               /**< Number of samples in window       */
+	unsigned num_deltas;      /**< Number of deltas, saturated       */
+	int64_t first_arrival;    /**< Arrival time of first group [us]  */
+	double slope;             /**< Last computed slope               */
+	double prev_slope;        /**< Previous slope                    */
+	double threshold;         /**< Adaptive threshold                */
+	double overuse_ms;        /**< Time in over-use [ms] or -1       */
+	unsigned overuse_cnt;     /**< Consecutive over-use samples      */
+};
+
+
+/** Defines the send-side bandwidth estimator */
+struct bwe {
+	struct sent hist[HIST_SIZE];  /**< Send history                  */
+	struct group prev;            /**< Previous packet group         */
+	struct group cur;             /**< Current packet group          */
+	struct trendline tl;          /**< Trendline filter              */
+	enum bwe_usage usage;         /**< Detector output               */
+	enum bwe_state state;         /**< Rate controller state         */
+
+	uint32_t min;                 /**< Minimum bitrate [bit/s]       */
+	uint32_t max;                 /**< Maximum bitrate [bit/s]       */
+	double rate_delay;            /**< Delay-based rate [bit/s]      */
+	double rate_loss;             /**< Loss-based rate [bit/s]       */
+	uint64_t ts_update;           /**< Last rate update [us]         */
+	uint64_t ts_decrease;         /**< Last decrease [us]            */
+
+	uint64_t acked_bytes;         /**< Bytes in acked window         */
+	int64_t acked_start;          /**< Start of acked window [us]    */
+	bool acked_set;               /**< Acked window started          */
+	uint32_t acked;               /**< Acknowledged bitrate [bit/s]  */
+
+	uint32_t loss_recv;           /**< Received packets for loss     */
+	uint32_t loss_lost;           /**< Lost packets for loss         */
+	uint64_t ts_loss;             /**< Last loss update [us]         */
+	double loss;                  /**< Last loss fraction            */
+
+	struct {
+		uint64_t n_sent;      /**< Packets sent                  */
+		uint64_t n_recv;      /**< Packets reported received     */
+		uint64_t n_lost;      /**< Packets reported lost         */
+		uint64_t n_overuse;   /**< Over-use signals              */
+	} stat;
+
+	mtx_t *mtx;                   /**< Protects all fields           */
+#ifdef RE_BWE_TRACE
+	uint64_t ts0;                 /**< Time of first update          */
+	char buf[160];                /**< Buffer for trace              */
+#endif
+};
+
+
+static double absd(double x)
+{
+	return x < 0 ? -x : x;
+}
+
+
+static double clamp_rate(const struct bwe *bwe, double rate)
+{
+	if (rate < bwe->min)
+		return bwe->min;
+	if (rate > bwe->max)
+		return bwe->max;
+
+	return rate;
+}
+
+
+static void destructor(void *arg)
+{
+	struct bwe *bwe = arg;
+
+	mem_deref(bwe->mtx);
+}
+
+
+/**
+ * Allocate a send-side bandwidth estimator
+ *
+ * @param bwep  Pointer to allocated bandwidth estimator
+ * @param min   Minimum bitrate in [bit/s]
+ * @param start Start bitrate in [bit/s]
+ * @param max   Maximum bitrate in [bit/s]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bwe_alloc(struct bwe **bwep, uint32_t min, uint32_t start, uint32_t max)
+{
+	struct bwe *bwe;
+	int err;
+
+	if (!bwep || !min || min > max)
+		return EINVAL;
+
+	bwe = mem_zalloc(sizeof(*bwe), destructor);
+	if (!bwe)
+		return ENOMEM;
+
+	bwe->min = min;
+	bwe->max = max;
+	bwe->rate_delay = clamp_rate(bwe, start);
+	bwe->rate_loss  = bwe->rate_delay;
+	bwe->usage = BWE_NORMAL;
+	bwe->state = BWE_HOLD;
+
+	bwe->tl.threshold  = 12.5;
+	bwe->tl.overuse_ms = -1;
+
+	err = mutex_alloc(&bwe->mtx);
+	if (err)
+		mem_deref(bwe);
+	else
+		*bwep = bwe;
+
+	return err;
+}
+
+
+/**
+ * Record a sent packet
+ *
+ * @param bwe  Bandwidth estimator
+ * @param seq  Transport-wide sequence number
+ * @param size Packet size in [bytes]
+ * @param now  Send time in [us]
+ */
+void bwe_sent(struct bwe *bwe, uint16_t seq, size_t size, uint64_t now)
+{
+	struct sent *s;
+
+	if (!bwe)
+		return;
+
+	mtx_lock(bwe->mtx);
+
+	s = &bwe->hist[seq & (HIST_SIZE - 1)];
+	s->seq   = seq;
+	s->size  = (uint32_t)size;
+	s->send  = now;
+	s->valid = true;
+
+	++bwe->stat.n_sent;
+
+	mtx_unlock(bwe->mtx);
+}
+
+
+static void trendline_reset(struct trendline *tl)
+{
+	tl->acc = 0;
+	tl->smoothed = 0;
+	tl->n = 0;
+	tl->num_deltas = 0;
+	tl->first_arrival = 0;
+	tl->overuse_ms = -1;
+	tl->overuse_cnt = 0;
+}
+
+
+static double linear_fit_slope(const struct trendline *tl)
+{
+	double sum_x = 0, sum_y = 0, avg_x, avg_y;
+	double num = 0, den = 0;
+
+	for (unsigned i = 0; i < tl->n; i++) {
+		sum_x += tl->xv[i];
+		sum_y += tl->yv[i];
+	}
+
+	avg_x = sum_x / tl->n;
+	avg_y = sum_y / tl->n;
+
+	for (unsigned i = 0; i < tl->n; i++) {
+		num += (tl->xv[i] - avg_x) * (tl->yv[i] - avg_y);
+		den += (tl->xv[i] - avg_x) * (tl->xv[i] - avg_x);
+	}
+
+	return den > 0 ? num / den : tl->slope;
+}
+
+
+static void threshold_update(struct trendline *tl, double m, double dt_ms)
+{
+	const double k = absd(m) < tl->threshold ? 0.039 : 0.0087;
+
+	/* ignore spikes */
+	if (absd(m) > tl->threshold + 15.0)
+		return;
+
+	if (dt_ms > 100)
+		dt_ms = 100;
+
+	tl->threshold += k * (absd(m) - tl->threshold) * dt_ms;
+
+	if (tl->threshold < 6)
+		tl->threshold = 6;
+	else if (tl->threshold > 600)
+		tl->threshold = 600;
+}
+
+
+static enum bwe_usage detect(struct bwe *bwe, double dt_ms)
+{
+	struct trendline *tl = &bwe->tl;
+	double m;
+
+	if (tl->n < TREND_WINDOW)
+		return bwe->usage;
+
+	m = tl->slope * tl->num_deltas * 4.0;
+
+	if (m > tl->threshold) {
+
+		if (tl->overuse_ms < 0)
+			tl->overuse_ms = dt_ms / 2;
+		else
+			tl->overuse_ms += dt_ms;
+
+		++tl->overuse_cnt;
+
+		if (tl->overuse_ms > OVERUSE_MS && tl->overuse_cnt > 1 &&
+		    tl->slope >= tl->prev_slope) {
+			tl->overuse_ms  = 0;
+			tl->overuse_cnt = 0;
+			bwe->usage = BWE_OVERUSE;
+			++bwe->stat.n_overuse;
+		}
+	}
+	else if (m < -tl->threshold) {
+		tl->overuse_ms = -1;
+		tl->overuse_cnt = 0;
+		bwe->usage = BWE_UNDERUSE;
+	}
+	else {
+		tl->overuse_ms = -1;
+		tl->overuse_cnt = 0;
+		bwe->usage = BWE_NORMAL;
+	}
+
+	tl->prev_slope = tl->slope;
+	threshold_update(tl, m, dt_ms);
+
+	return bwe->usage;
+}
+
+
+/* One delay sample between two packet groups */
+static void trendline_update(struct bwe *bwe, double delta_ms,
+			     double arr_delta_ms, int64_t arrival)
+{
+	struct trendline *tl = &bwe->tl;
+
+	if (!tl->first_arrival)
+		tl->first_arrival = arrival;
+
+	if (tl->num_deltas < 60)
+		++tl->num_deltas;
+
+	tl->acc += delta_ms;
+	tl->smoothed = 0.9 * tl->smoothed + 0.1 * tl->acc;
+
+	if (tl->n == TREND_WINDOW) {
+		const size_t sz = (TREND_WINDOW - 1) * sizeof(double);
+
+		memmove(tl->xv, tl->xv + 1, sz);
+		memmove(tl->yv, tl->yv + 1, sz);
+		--tl->n;
+	}
+
+	tl->xv[tl->n] = (double)(arrival - tl->first_arrival) / 1000.0;
+	tl->yv[tl->n] = tl->smoothed;
+	++tl->n;
+
+	if (tl->n == TREND_WINDOW)
+		tl->slope = linear_fit_slope(tl);
+
+	(void)detect(bwe, arr_delta_ms);
+}
+
+
+static void group_complete(struct bwe *bwe)
+{
+	struct group *prev = &bwe->prev, *cur = &bwe->cur;
+
+	if (prev->valid) {
+		int64_t arr_delta  = cur->arrival - prev->arrival;
+		int64_t send_delta = (int64_t)(cur->send - prev->send);
+
+		const double delta_ms = (arr_delta - send_delta) / 1000.0;
+
+		if (arr_delta < -MAX_GAP_US || arr_delta > MAX_GAP_US) {
+			trendline_reset(&bwe->tl);
+		}
+		else {
+			trendline_update(bwe, delta_ms, arr_delta / 1000.0,
+					 cur->arrival);
+		}
+	}
+
+	*prev = *cur;
+}
+
+
+static void acked_update(struct bwe *bwe, uint32_t size, int64_t arrival)
+{
+	int64_t dt;
+
+	if (!bwe->acked_set) {
+		bwe->acked_start = arrival;
+		bwe->acked_bytes = 0;
+		bwe->acked_set   = true;
+	}
+
+	bwe->acked_bytes += size;
+
+	dt = arrival - bwe->acked_start;
+	if (dt < ACKED_WINDOW)
+		return;
+
+	uint32_t bps = (uint32_t)(bwe->acked_bytes * 8 * 1000000 / dt);
+
+	bwe->acked = bwe->acked ? (bwe->acked + bps) / 2 : bps;
+
+	bwe->acked_start = arrival;
+	bwe->acked_bytes = 0;
+}
+
+
+/**
+ * Handle the feedback for one sent packet
+ *
+ * Packets must be reported in transport-wide sequence number order,
+ * bwe_update() must be called after all packets of a feedback message.
+ *
+ * @param bwe      Bandwidth estimator
+ * @param seq      Transport-wide sequence number
+ * @param received True if the packet was received, false if lost
+ * @param arrival  Arrival time in [us], in the clock of the receiver
+ */
+void bwe_feedback(struct bwe *bwe, uint16_t seq, bool received,
+		  int64_t arrival)
+{
+	struct sent *s;
+
+	if (!bwe)
+		return;
+
+	mtx_lock(bwe->mtx);
+
+	s = &bwe->hist[seq & (HIST_SIZE - 1)];
+	if (!s->valid || s->seq != seq)
+		goto out;
+
+	s->valid = false;
+
+	if (!received) {
+		++bwe->loss_lost;
+		++bwe->stat.n_lost;
+		goto out;
+	}
+
+	++bwe->loss_recv;
+	++bwe->stat.n_recv;
+
+	acked_update(bwe, s->size, arrival);
+
+	if (bwe->cur.valid && s->send < bwe->cur.send_first)
+		goto out;  /* reordered */
+
+	if (bwe->cur.valid && s->send - bwe->cur.send_first <= GROUP_US) {
+		bwe->cur.send = s->send;
+		if (arrival > bwe->cur.arrival)
+			bwe->cur.arrival = arrival;
+		goto out;
+	}
+
+	if (bwe->cur.valid)
+		group_complete(bwe);
+
+	bwe->cur.send_first = s->send;
+	bwe->cur.send       = s->send;
+	bwe->cur.arrival    = arrival;
+	bwe->cur.valid      = true;
+
+ out:
+	mtx_unlock(bwe->mtx);
+}
+
+
+static void loss_update(struct bwe *bwe, uint64_t now)
+{
+	const uint32_t total = bwe->loss_recv + bwe->loss_lost;
+
+	if (total < LOSS_PACKETS || now < bwe->ts_loss + LOSS_INTERVAL)
+		return;
+
+	bwe->loss = (double)bwe->loss_lost / total;
+
+	if (bwe->loss > 0.10)
+		bwe->rate_loss *= 1.0 - 0.5 * bwe->loss;
+	else if (bwe->loss < 0.02)
+		bwe->rate_loss *= 1.05;
+
+	/* do not run away from what is actually used */
+	if (bwe->rate_loss > 1.5 * bwe->rate_delay)
+		bwe->rate_loss = 1.5 * bwe->rate_delay;
+
+	bwe->rate_loss = clamp_rate(bwe, bwe->rate_loss);
+
+	bwe->loss_recv = 0;
+	bwe->loss_lost = 0;
+	bwe->ts_loss   = now;
+}
+
+
+static void delay_update(struct bwe *bwe, uint64_t now)
+{
+	double dt = bwe->ts_update ? (double)(now - bwe->ts_update) / 1e6 : 0;
+
+	if (dt > 1.0)
+		dt = 1.0;
+
+	switch (bwe->usage) {
+
+	case BWE_OVERUSE:
+		bwe->state = BWE_DECREASE;
+		break;
+
+	case BWE_UNDERUSE:
+		bwe->state = BWE_HOLD;
+		break;
+
+	case BWE_NORMAL:
+		if (bwe->state == BWE_HOLD)
+			bwe->state = BWE_INCREASE;
+		break;
+	}
+
+	switch (bwe->state) {
+
+	case BWE_INCREASE:
+		/* application limited, do not increase further */
+		if (bwe->acked && bwe->rate_delay > 1.5 * bwe->acked)
+			break;
+
+		bwe->rate_delay += bwe->rate_delay * 0.08 * dt;
+		break;
+
+	case BWE_DECREASE:
+		if (now < bwe->ts_decrease + DECR_INTERVAL)
+			break;
+
+		if (bwe->acked)
+			bwe->rate_delay = 0.85 * bwe->acked;
+		else
+			bwe->rate_delay *= 0.85;
+
+		bwe->ts_decrease = now;
+		bwe->usage = BWE_NORMAL;
+		bwe->state = BWE_HOLD;
+		break;
+
+	case BWE_HOLD:
+		break;
+	}
+
+	bwe->rate_delay = clamp_rate(bwe, bwe->rate_delay);
+	bwe->ts_update  = now;
+}
+
+
+static uint32_t target_bitrate(const struct bwe *bwe)
+{
+	double rate = bwe->rate_delay < bwe->rate_loss ?
+		bwe->rate_delay : bwe->rate_loss;
+
+	return (uint32_t)clamp_rate(bwe, rate);
+}
+
+
+#ifdef RE_BWE_TRACE
+static void plot_bwe(struct bwe *bwe, uint64_t now)
+{
+	if (!bwe->ts0)
+		bwe->ts0 = now;
+
+	re_snprintf(bwe->buf, sizeof(bwe->buf),
+		    "%s, 0x%p, %llu, %u, %u, %u, %u, %.3f, %.3f, %d",
+		    __func__,                          /* row 1  - grep     */
+		    bwe,                               /* row 2  - grep opt */
+		    (now - bwe->ts0) / 1000,           /* row 3  - x-axis   */
+		    (uint32_t)bwe->rate_delay / 1000,  /* row 4  - plot     */
+		    (uint32_t)bwe->rate_loss / 1000,   /* row 5  - plot     */
+		    bwe->acked / 1000,                 /* row 6  - plot     */
+		    target_bitrate(bwe) / 1000,        /* row 7  - plot     */
+		    bwe->tl.slope * bwe->tl.num_deltas * 4.0, /* row 8 */
+		    bwe->tl.threshold,                 /* row 9  - plot     */
+		    bwe->usage);                       /* row 10 - plot     */
+	re_trace_event("bwe", "plot", 'P', NULL, 0, RE_TRACE_ARG_STRING_COPY,
+		       "line", bwe->buf);
+}
+#endif
+
+
+/**
+ * Run the rate controllers after a feedback message
+ *
+ * @param bwe Bandwidth estimator
+ * @param now Current time in [us]
+ *
+ * @return Target bitrate in [bit/s]
+ */
+uint32_t bwe_update(struct bwe *bwe, uint64_t now)
+{
+	uint32_t target;
+
+	if (!bwe)
+		return 0;
+
+	mtx_lock(bwe->mtx);
+
+	loss_update(bwe, now);
+	delay_update(bwe, now);
+	target = target_bitrate(bwe);
+
+#ifdef RE_BWE_TRACE
+	plot_bwe(bwe, now);
+#endif
+
+	mtx_unlock(bwe->mtx);
+
+	return target;
+}
+
+
+/**
+ * Get the current target bitrate
+ *
+ * @param bwe Bandwidth estimator
+ *
+ * @return Target bitrate in [bit/s]
+ */
+uint32_t bwe_target(const struct bwe *bwe)
+{
+	uint32_t target;
+
+	if (!bwe)
+		return 0;
+
+	mtx_lock(bwe->mtx);
+	target = target_bitrate(bwe);
+	mtx_unlock(bwe->mtx);
+
+	return target;
+}
+
+
+enum bwe_usage bwe_usage(const struct bwe *bwe)
+{
+	return bwe ? bwe->usage : BWE_NORMAL;
+}
+
+
+static const char *usage_name(enum bwe_usage usage)
+{
+	switch (usage) {
+
+	case BWE_NORMAL:   return "normal";
+	case BWE_OVERUSE:  return "overuse";
+	case BWE_UNDERUSE: return "underuse";
+	default:           return "?";
+	}
+}
+
+
+int bwe_debug(struct re_printf *pf, const struct bwe *bwe)
+{
+	int err;
+
+	if (!bwe)
+		return 0;
+
+	mtx_lock(bwe->mtx);
+	err  = re_hprintf(pf, " bwe: target=%u kbit/s (delay=%u loss=%u"
+			  " acked=%u) range=%u-%u\n",
+			  target_bitrate(bwe) / 1000,
+			  (uint32_t)bwe->rate_delay / 1000,
+			  (uint32_t)bwe->rate_loss / 1000,
+			  bwe->acked / 1000,
+			  bwe->min / 1000, bwe->max / 1000);
+	err |= re_hprintf(pf, "      usage=%s threshold=%.1f loss=%.1f%%"
+			  " sent=%llu recv=%llu lost=%llu overuse=%llu\n",
+			  usage_name(bwe->usage), bwe->tl.threshold,
+			  bwe->loss * 100.0,
+			  bwe->stat.n_sent, bwe->stat.n_recv,
+			  bwe->stat.n_lost, bwe->stat.n_overuse);
+	mtx_unlock(bwe->mtx);
+
+	return err;
+}
@@ -833,6 +833,9 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	debug("call: alloc with params laddr=%j, af=%s, use_rtp=%d\n",
 	      &prm->laddr, net_af2name(prm->af), prm->use_rtp);
 
+	/* the codec lists must be complete for the SDP offer/answer */
+	(void)module_lazy_load(NULL);
+
 	call = mem_zalloc(sizeof(*call), call_destructor);
 	if (!call)
 		return ENOMEM;
@@ -2779,6 +2782,69 @@ int call_replace_transfer(struct call *call, struct call *source_call)
 }
 
 
+static int relay_pair(struct stream *a, struct stream *b, bool enable)
+{
+	int err;
+
+	if (!a || !b)
+		return 0;
+
+	if (!enable) {
+		stream_relay_stop(a);
+		stream_relay_stop(b);
+		return 0;
+	}
+
+	err  = stream_relay_start(a, b);
+	err |= stream_relay_start(b, a);
+	if (err) {
+		stream_relay_stop(a);
+		stream_relay_stop(b);
+	}
+
+	return err;
+}
+
+
+/**
+ * Relay the RTP media of two calls to each other, without decoding and
+ * re-encoding. Both calls must have negotiated the same codecs.
+ *
+ * @param call   Call object
+ * @param peer   Other call object
+ * @param enable True to start relaying, false to stop
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int call_relay(struct call *call, struct call *peer, bool enable)
+{
+	int err;
+
+	if (!call || !peer || call == peer)
+		return EINVAL;
+
+	info("call: %s RTP relay %s <-> %s\n", enable ? "start" : "stop",
+	     call->peer_uri, peer->peer_uri);
+
+	err = relay_pair(audio_strm(call->audio), audio_strm(peer->audio),
+			 enable);
+	if (err)
+		goto out;
+
+	err = relay_pair(video_strm(call->video), video_strm(peer->video),
+			 enable);
+
+ out:
+	if (err) {
+		warning("call: RTP relay failed (%m)\n", err);
+		(void)relay_pair(audio_strm(call->audio),
+				 audio_strm(peer->audio), false);
+	}
+
+	return err;
+}
+
+
 int call_af(const struct call *call)
 {
 	return call ? call->af : AF_UNSPEC;
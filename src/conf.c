@@ -338,6 +338,7 @@ enum jbuf_type conf_get_jbuf_type(const struct pl *pl)
 	if (0 == pl_strcasecmp(pl, "off"))      return JBUF_OFF;
 	if (0 == pl_strcasecmp(pl, "fixed"))    return JBUF_FIXED;
 	if (0 == pl_strcasecmp(pl, "adaptive")) return JBUF_ADAPTIVE;
+	if (0 == pl_strcasecmp(pl, "frame"))    return JBUF_FRAME;
 
 	warning("unsupported jitter buffer type (%r)\n", pl);
 	return JBUF_FIXED;
@@ -348,6 +349,7 @@ bool conf_aubuf_adaptive(const struct pl *pl)
 {
 	if (0 == pl_strcasecmp(pl, "fixed"))    return false;
 	if (0 == pl_strcasecmp(pl, "adaptive")) return true;
+	if (0 == pl_strcasecmp(pl, "stretch"))  return true;
 
 	warning("unsupported audio buffer mode (%r)\n", pl);
 	return false;
@@ -477,6 +479,7 @@ struct conf *conf_cur(void)
  */
 void conf_close(void)
 {
+	module_lazy_flush();
 	conf_obj = mem_deref(conf_obj);
 }
 
@@ -66,6 +66,7 @@ static struct config core_config = {
 		AUFMT_S16LE,
 		{20, 160},
 		false,
+		false,
 		-35.0,
 		101
 	},
@@ -81,6 +82,7 @@ static struct config core_config = {
 		30,
 		true,
 		VID_FMT_YUV420P,
+		false,
 	},
 
 	/** Audio/Video Transport */
@@ -102,6 +104,7 @@ static struct config core_config = {
 		0,
 		false,
 		RECEIVE_MODE_MAIN,
+		false,
 	},
 
 	/* Network */
@@ -274,12 +277,23 @@ static const char *jbuf_type_str(enum jbuf_type jbtype)
 		return "fixed";
 	case JBUF_ADAPTIVE:
 		return "adaptive";
+	case JBUF_FRAME:
+		return "frame";
 	}
 
 	return "?";
 }
 
 
+static const char *aubuf_mode_str(const struct config_audio *cfg)
+{
+	if (!cfg->adaptive)
+		return "fixed";
+
+	return cfg->stretch ? "stretch" : "adaptive";
+}
+
+
 static void decode_sip_transports(struct config_sip *cfg,
 				      const struct pl *pl)
 {
@@ -469,11 +483,15 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 		return EINVAL;
 	}
 
-	if (0 == conf_get(conf, "audio_buffer_mode", &pl))
+	if (0 == conf_get(conf, "audio_buffer_mode", &pl)) {
 		cfg->audio.adaptive = conf_aubuf_adaptive(&pl);
+		cfg->audio.stretch  = 0 == pl_strcasecmp(&pl, "stretch");
+	}
 
 	(void)conf_get_float(conf, "audio_silence", &cfg->audio.silence);
 	(void)conf_get_u32(conf, "audio_telev_pt", &cfg->audio.telev_pt);
+	(void)conf_get_bool(conf, "audio_txshare", &cfg->audio.txshare);
+	(void)conf_get_bool(conf, "audio_red", &cfg->audio.red);
 
 	/* Video */
 	(void)conf_get_csv(conf, "video_source",
@@ -493,6 +511,13 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	(void)conf_get_bool(conf, "video_fullscreen", &cfg->video.fullscreen);
 
 	conf_get_vidfmt(conf, "videnc_format", &cfg->video.enc_fmt);
+	(void)conf_get_bool(conf, "video_bwe", &cfg->video.bwe);
+	(void)conf_get_bool(conf, "video_txshare", &cfg->video.txshare);
+	(void)conf_get_u32(conf, "video_simulcast", &cfg->video.simulcast);
+	(void)conf_get_bool(conf, "video_fec", &cfg->video.fec);
+	(void)conf_get_bool(conf, "video_adaptive", &cfg->video.adaptive);
+	(void)conf_get_u32(conf, "video_enc_threads",
+			   &cfg->video.enc_threads);
 
 	/* AVT - Audio/Video Transport */
 	if (0 == conf_get_u32(conf, "rtp_tos", &v))
@@ -539,6 +564,8 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 		cfg->avt.rxmode = resolve_receive_mode(&rxmode);
 	}
 
+	(void)conf_get_bool(conf, "rtp_latency_trace", &cfg->avt.lattrace);
+
 	if (err) {
 		warning("config: configure parse error (%m)\n", err);
 	}
@@ -631,9 +658,12 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "auenc_format\t\t%s\n"
 			 "audec_format\t\t%s\n"
 			 "audio_buffer\t\t%H\t\t# ms\n"
-			 "audio_buffer_mode\t%s\t\t# fixed, adaptive\n"
+			 "audio_buffer_mode\t%s\t\t# fixed, adaptive,"
+				" stretch\n"
 			 "audio_silence\t\t%.1lf\t\t# in [dB]\n"
 			 "audio_telev_pt\t\t%u\n"
+			 "audio_txshare\t\t%s\n"
+			 "audio_red\t\t%s\n"
 			 "\n",
 			 cfg->audio.audio_path,
 			 cfg->audio.play_mod,  cfg->audio.play_dev,
@@ -649,9 +679,11 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 aufmt_name(cfg->audio.enc_fmt),
 			 aufmt_name(cfg->audio.dec_fmt),
 			 range_print, &cfg->audio.buffer,
-			 cfg->audio.adaptive ? "adaptive" : "fixed",
+			 aubuf_mode_str(&cfg->audio),
 			 cfg->audio.silence,
-			 cfg->audio.telev_pt);
+			 cfg->audio.telev_pt,
+			 cfg->audio.txshare ? "yes" : "no",
+			 cfg->audio.red ? "yes" : "no");
 	if (err)
 		return err;
 
@@ -665,13 +697,25 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "video_fps\t\t%.2f\n"
 			 "video_fullscreen\t%s\n"
 			 "videnc_format\t\t%s\n"
+			 "video_bwe\t\t%s\n"
+			 "video_txshare\t\t%s\n"
+			 "video_simulcast\t\t%u\n"
+			 "video_fec\t\t%s\n"
+			 "video_adaptive\t\t%s\n"
+			 "video_enc_threads\t%u\n"
 			 "\n",
 			 cfg->video.src_mod, cfg->video.src_dev,
 			 cfg->video.disp_mod, cfg->video.disp_dev,
 			 cfg->video.width, cfg->video.height,
 			 cfg->video.bitrate, cfg->video.fps,
 			 cfg->video.fullscreen ? "yes" : "no",
-			 vidfmt_name(cfg->video.enc_fmt));
+			 vidfmt_name(cfg->video.enc_fmt),
+			 cfg->video.bwe ? "yes" : "no",
+			 cfg->video.txshare ? "yes" : "no",
+			 cfg->video.simulcast,
+			 cfg->video.fec ? "yes" : "no",
+			 cfg->video.adaptive ? "yes" : "no",
+			 cfg->video.enc_threads);
 	if (err)
 		return err;
 
@@ -689,6 +733,7 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "rtp_timeout\t\t%u # in seconds\n"
 			 "avt_bundle\t\t%s\n"
 			 "rtp_rxmode\t\t\t%s\n"
+			 "rtp_latency_trace\t%s\n"
 			 "\n"
 			 "# Network\n"
 			 "net_interface\t\t%s\n"
@@ -707,6 +752,7 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->avt.rtp_timeout,
 			 cfg->avt.bundle ? "yes" : "no",
 			 rtp_receive_mode_str(cfg->avt.rxmode),
+			 cfg->avt.lattrace ? "yes" : "no",
 
 			 cfg->net.ifname,
 			 net_af_str(cfg->net.af)
@@ -891,10 +937,15 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "auenc_format\t\ts16\t\t# s16, float, ..\n"
 			  "audec_format\t\ts16\t\t# s16, float, ..\n"
 			  "audio_buffer\t\t%H\t\t# ms\n"
-			  "audio_buffer_mode\t%s\t\t# fixed, adaptive\n"
+			  "audio_buffer_mode\t%s\t\t# fixed, adaptive,"
+				" stretch\n"
 			  "audio_silence\t\t%.1lf\t\t# in [dB]\n"
 			  "audio_telev_pt\t\t%u\t\t"
 			  "# payload type for telephone-event\n"
+			  "#audio_txshare\t\tno\t\t"
+			  "# share encoder between calls\n"
+			  "#audio_red\t\tno\t\t"
+			  "# redundant audio (RFC 2198)\n"
 			  "\n"
 			  ,
 			  default_audio_path(),
@@ -902,7 +953,7 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  default_audio_device(),
 			  default_audio_device(),
 			  range_print, &cfg->audio.buffer,
-			  cfg->audio.adaptive ? "adaptive" : "fixed",
+			  aubuf_mode_str(&cfg->audio),
 			  cfg->audio.silence,
 			  cfg->audio.telev_pt);
 
@@ -915,6 +966,12 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "video_fps\t\t%.2f\n"
 			  "video_fullscreen\tno\n"
 			  "videnc_format\t\t%s\n"
+			  "video_bwe\t\tno\n"
+			  "#video_txshare\t\tno\n"
+			  "#video_simulcast\t1\t\t# layers, 1..3\n"
+			  "#video_fec\t\tno\t\t# FEC stream (RFC 5109)\n"
+			  "#video_adaptive\t\tno\t\t# skip static frames\n"
+			  "#video_enc_threads\t0\t\t# all calls, 0=no limit\n"
 			  ,
 			  default_video_device(),
 			  default_video_display(),
@@ -933,13 +990,14 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "audio_jitter_buffer_delay\t%u-%u\t\t"
 					"# (min. frames)-(max. packets)\n"
 			  "video_jitter_buffer_type\tfixed\t\t# off, fixed,"
-				" adaptive\n"
+				" adaptive, frame\n"
 			  "video_jitter_buffer_delay\t%u-%u\t\t"
 					"# (min. frames)-(max. packets)\n"
 			  "rtp_stats\t\tno\n"
 			  "#rtp_timeout\t\t60\n"
 			  "#avt_bundle\t\tno\n"
 			  "#rtp_rxmode\t\tmain\n"
+			  "#rtp_latency_trace\tno\n"
 			  "\n# Network\n"
 			  "#dns_server\t\t1.1.1.1:53\n"
 			  "#dns_server\t\t1.0.0.1:53\n"
@@ -1216,6 +1274,12 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "#module\t\t\t" "srtp" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" "dtls_srtp" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" "gzrtp" MOD_EXT "\n");
+
+	(void)re_fprintf(f, "\n# Modules loaded on first use or first call"
+			 " (module [names])\n");
+	(void)re_fprintf(f, "#module_lazy\t\t" "v4l2" MOD_EXT "\n");
+	(void)re_fprintf(f, "#module_lazy\t\t" "avcodec" MOD_EXT
+			 "\tH264,H265\n");
 	(void)re_fprintf(f, "\n");
 
 	(void)re_fprintf(f, "\n#------------------------------------"
@@ -1341,6 +1405,19 @@ int config_write_template(const char *file, const struct config *cfg)
 			" greater 0 increases speed over quality\n"
 			);
 
+	(void)re_fprintf(f,
+			"\n# vp9\n"
+			"#vp9_enc_threads\t0\t\t# 0=from picture size\n"
+			"#vp9_enc_cpuused\t8\t\t# realtime speed 5..9\n"
+			"\n# av1\n"
+			"#av1_enc_threads\t0\t\t# 0=from picture size\n"
+			"#av1_enc_cpuused\t8\t\t# realtime speed 5..10\n");
+
+	(void)re_fprintf(f,
+			"\n# v4l2\n"
+			"#v4l2_queue\t\t2\t\t# frames between capture"
+			" and encoder\n");
+
 	(void)re_fprintf(f,
 			"\n# ctrl_dbus\n"
 			"#ctrl_dbus_use\tsystem\t\t# system, session\n");
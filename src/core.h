@@ -27,6 +27,7 @@ enum {
 
 /* forward declarations */
 struct stream_param;
+struct lattrace;
 
 
 /*
@@ -114,6 +115,26 @@ void audio_sdp_attr_decode(struct audio *a);
 int aucodec_print(struct re_printf *pf, const struct aucodec *ac);
 
 
+/*
+ * Audio Filter
+ */
+
+int aufilt_encode(const struct list *filtl, struct auframe *af,
+		  int fmt, struct auarena *arena,
+		  struct lattrace *lat, uint64_t *t, uint64_t *convc);
+int aufilt_decode(const struct list *filtl, struct auframe *af,
+		  int fmt, struct auarena *arena,
+		  struct lattrace *lat, uint64_t *t, uint64_t *convc);
+
+
+/*
+ * Polyphase audio resampler
+ */
+
+int  aupoly_init(void);
+void aupoly_close(void);
+
+
 /*
  * Audio Receiver Pipeline
  */
@@ -139,7 +160,9 @@ void aurecv_stop(struct audio_recv *ar);
 void aurecv_stop_auplay(struct audio_recv *ar);
 
 const struct aucodec *aurecv_codec(const struct audio_recv *ar);
+void aurecv_set_lattrace(struct audio_recv *ar, struct lattrace *lat);
 uint64_t aurecv_latency(const struct audio_recv *ar);
+int aurecv_stats(const struct audio_recv *ar, struct audio_stat *st);
 bool aurecv_started(const struct audio_recv *ar);
 bool aurecv_filt_empty(const struct audio_recv *ar);
 bool aurecv_level_set(const struct audio_recv *ar);
@@ -148,6 +171,57 @@ int aurecv_debug(struct re_printf *pf, const struct audio_recv *ar);
 int aurecv_print_pipeline(struct re_printf *pf, const struct audio_recv *ar);
 
 
+/*
+ * Audio Playout
+ */
+
+struct playout;
+
+/** Playout statistics */
+struct playout_stat {
+	uint32_t target;          /**< Target latency [ms]              */
+	uint32_t level;           /**< Smoothed buffer level [ms]       */
+	uint32_t jitter;          /**< Jitter percentile [ms]           */
+	uint64_t n_accel;         /**< Number of accelerated frames     */
+	uint64_t n_decel;         /**< Number of decelerated frames     */
+	uint64_t samp_removed;    /**< Samples removed per channel      */
+	uint64_t samp_inserted;   /**< Samples inserted per channel     */
+	uint64_t n_reset;         /**< Number of statistics resets      */
+};
+
+int  playout_alloc(struct playout **pop, const struct range *buffer,
+		   uint32_t ptime);
+void playout_process(struct playout *po, struct auframe *af,
+		     uint64_t arrival, uint32_t cur);
+void playout_reset(struct playout *po);
+const struct playout_stat *playout_stat(const struct playout *po);
+int  playout_debug(struct re_printf *pf, const struct playout *po);
+
+
+/*
+ * Bandwidth Estimation
+ */
+
+struct bwe;
+
+/** Bandwidth usage as detected from the delay variation */
+enum bwe_usage {
+	BWE_NORMAL,
+	BWE_OVERUSE,
+	BWE_UNDERUSE,
+};
+
+int  bwe_alloc(struct bwe **bwep, uint32_t min, uint32_t start,
+	       uint32_t max);
+void bwe_sent(struct bwe *bwe, uint16_t seq, size_t size, uint64_t now);
+void bwe_feedback(struct bwe *bwe, uint16_t seq, bool received,
+		  int64_t arrival);
+uint32_t bwe_update(struct bwe *bwe, uint64_t now);
+uint32_t bwe_target(const struct bwe *bwe);
+enum bwe_usage bwe_usage(const struct bwe *bwe);
+int  bwe_debug(struct re_printf *pf, const struct bwe *bwe);
+
+
 /*
  * Call Control
  */
@@ -214,11 +288,133 @@ void     metric_inc_err(struct metric *metric);
 
 struct metric *metric_alloc(void);
 
+
+/*
+ * Forward Error Correction
+ */
+
+enum {
+	RED_MAX = 2,  /**< Max. redundant audio blocks per packet */
+};
+
+struct fec_enc;
+struct fec_dec;
+struct red_enc;
+
+/** Block of a redundant audio packet */
+struct red_block {
+	uint8_t pt;            /**< Payload type             */
+	uint32_t ts;           /**< RTP timestamp            */
+	const uint8_t *data;   /**< Block data               */
+	size_t len;            /**< Block length             */
+};
+
+int  fec_enc_alloc(struct fec_enc **encp, unsigned k);
+void fec_enc_set_group(struct fec_enc *enc, unsigned k);
+int  fec_enc_packet(struct fec_enc *enc, struct mbuf *mb,
+		    const struct rtp_header *hdr,
+		    const uint8_t *pld, size_t len);
+int  fec_enc_flush(struct fec_enc *enc, struct mbuf *mb);
+int  fec_enc_debug(struct re_printf *pf, const struct fec_enc *enc);
+int  fec_dec_alloc(struct fec_dec **decp);
+void fec_dec_media(struct fec_dec *dec, const struct rtp_header *hdr,
+		   struct mbuf *mb);
+int  fec_dec_fec(struct fec_dec *dec, const struct mbuf *mb, uint32_t ssrc,
+		 struct rtp_header *hdrp, struct mbuf **mbp);
+int  fec_dec_debug(struct re_printf *pf, const struct fec_dec *dec);
+int  fec_rtcp_loss(const struct rtcp_msg *msg, uint32_t ssrc, double *lossp);
+unsigned fec_group(double loss);
+unsigned red_distance(double loss);
+int  red_enc_alloc(struct red_enc **encp, unsigned distance);
+void red_enc_set_distance(struct red_enc *enc, unsigned distance);
+unsigned red_enc_distance(const struct red_enc *enc);
+int  red_enc_packet(struct red_enc *enc, struct mbuf *mb, uint8_t pt,
+		    uint32_t ts, const uint8_t *pld, size_t len);
+int  red_decode(struct red_block *blkv, size_t *blkcp, uint32_t ts,
+		const struct mbuf *mb);
+
+
+/*
+ * Latency Tracing
+ */
+
+int  lattrace_alloc(struct lattrace **ltp, const char *media, bool tx);
+uint64_t lattrace_now(const struct lattrace *lt);
+void lattrace_add(struct lattrace *lt, const char *stage, uint64_t usec);
+void lattrace_stamp(struct lattrace *lt, const char *stage, uint64_t *t);
+void lattrace_mark(struct lattrace *lt, uint16_t key);
+uint64_t lattrace_marked(const struct lattrace *lt, uint16_t key);
+uint64_t lattrace_percentile(const struct lattrace *lt, const char *stage,
+			     double pct);
+void lattrace_reset(struct lattrace *lt);
+int  lattrace_debug(struct re_printf *pf, const struct lattrace *lt);
+
+
 /*
  * Module
  */
 
-int module_init(const struct conf *conf);
+int  module_init(const struct conf *conf);
+int  module_lazy_load(const char *name);
+void module_lazy_flush(void);
+
+
+/*
+ * OpenMetrics
+ */
+
+/** Source of the values in an OpenMetrics sample */
+enum openmetrics_src {
+	OM_SRC_STREAM = 1<<0,
+	OM_SRC_RTCP   = 1<<1,
+	OM_SRC_JBUF   = 1<<2,
+	OM_SRC_AUDIO  = 1<<3,
+};
+
+/** OpenMetrics metric families */
+enum openmetrics_id {
+	OM_TX_PACKETS = 0,
+	OM_TX_BYTES,
+	OM_TX_ERRORS,
+	OM_TX_BITRATE,
+	OM_RX_PACKETS,
+	OM_RX_BYTES,
+	OM_RX_ERRORS,
+	OM_RX_BITRATE,
+	OM_RTCP_TX_LOST,
+	OM_RTCP_RX_LOST,
+	OM_RTCP_TX_JITTER,
+	OM_RTCP_RX_JITTER,
+	OM_RTCP_RTT,
+	OM_JBUF_PUT,
+	OM_JBUF_GET,
+	OM_JBUF_OOS,
+	OM_JBUF_DUPS,
+	OM_JBUF_LATE,
+	OM_JBUF_LOST,
+	OM_JBUF_OVERFLOW,
+	OM_JBUF_UNDERFLOW,
+	OM_JBUF_FLUSH,
+	OM_AUDIO_TX_OVERRUN,
+	OM_AUDIO_TX_UNDERRUN,
+	OM_AUDIO_RX_DISCARD,
+	OM_AUDIO_RX_LATENCY,
+	OM_AUDIO_RX_JITTER,
+
+	OM_MAX
+};
+
+/** Statistics of one media stream */
+struct openmetrics_sample {
+	const char *callid;     /**< Call-ID label                      */
+	const char *media;      /**< Media name label                   */
+	unsigned src;           /**< Available sources                  */
+	int64_t v[OM_MAX];      /**< Values per metric family           */
+};
+
+int openmetrics_print(struct mbuf *mb,
+		      const struct openmetrics_sample *samplev,
+		      size_t samplec, uint32_t callc, uint32_t estabc);
 
 
 /*
@@ -259,6 +455,7 @@ int stunuri_decode_uri(struct stun_uri **sup, const struct uri *uri);
  */
 
 int sdp_decode_multipart(const struct pl *ctype_prm, struct mbuf *mb);
+int sdp_media_set_extmap(struct sdp_media *m, uint8_t id, const char *uri);
 
 
 /* bundle (per media stream) */
@@ -308,6 +505,7 @@ typedef void (stream_rtp_h)(const struct rtp_header *hdr,
 			    struct mbuf *mb, unsigned lostc, bool *ignore,
 			    void *arg);
 typedef int (stream_pt_h)(uint8_t pt, struct mbuf *mb, void *arg);
+typedef void (stream_relay_h)(bool relayed, void *arg);
 
 
 int  stream_alloc(struct stream **sp, struct list *streaml,
@@ -325,6 +523,7 @@ void stream_set_ldir(struct stream *s, enum sdp_dir dir);
 void stream_set_rtcp_interval(struct stream *s, uint32_t n);
 void stream_set_srate(struct stream *s, uint32_t srate_tx, uint32_t srate_rx);
 bool stream_is_ready(const struct stream *strm);
+bool stream_has_menc(const struct stream *strm);
 int  stream_print(struct re_printf *pf, const struct stream *s);
 void stream_remove_menc_media_state(struct stream *strm);
 enum media_type stream_type(const struct stream *strm);
@@ -333,6 +532,7 @@ struct rtp_sock *stream_rtp_sock(const struct stream *strm);
 const struct sa *stream_raddr(const struct stream *strm);
 const char *stream_mid(const struct stream *strm);
 uint8_t stream_generate_extmap_id(struct stream *strm);
+struct lattrace *stream_lattrace(const struct stream *strm, bool tx);
 
 /* Send */
 void stream_update_encoder(struct stream *s, int pt_enc);
@@ -341,15 +541,26 @@ int  stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 		 struct mbuf *mb);
 int  stream_resend(struct stream *s, uint16_t seq, bool ext, bool marker,
 		  int pt, uint32_t ts, struct mbuf *mb);
+int  stream_send_ssrc(struct stream *s, uint32_t ssrc, uint16_t seq,
+		      bool ext, bool marker, int pt, uint32_t ts,
+		      struct mbuf *mb);
+int  stream_relay_send(struct stream *s, const struct rtp_header *hdr,
+		       struct mbuf *mb);
+int  stream_ssrc_add(struct stream *s, uint32_t ssrc);
+void stream_ssrc_remove(struct stream *s, uint32_t ssrc);
 
 /* Receive */
 void stream_flush(struct stream *s);
 int  stream_ssrc_rx(const struct stream *strm, uint32_t *ssrc);
+int  stream_ssrc_rx_fec(const struct stream *strm, uint32_t *ssrc);
 
 
 struct bundle *stream_bundle(const struct stream *strm);
 void stream_parse_mid(struct stream *strm);
 void stream_enable_bundle(struct stream *strm, enum bundle_state st);
+int  stream_enable_twcc(struct stream *strm, uint8_t extid);
+void stream_set_relay_handler(struct stream *strm, stream_relay_h *relayh);
+bool stream_is_relayed(const struct stream *strm);
 void stream_enable_natpinhole(struct stream *strm, bool enable);
 void stream_open_natpinhole(struct stream *strm);
 void stream_stop_natpinhole(struct stream *strm);
@@ -358,6 +569,64 @@ void stream_mnat_connected(struct stream *strm, const struct sa *raddr1,
 			   const struct sa *raddr2);
 
 
+/*
+ * RTP relay
+ */
+
+struct stream_relay;
+
+int  relay_alloc(struct stream_relay **relayp, struct stream *src,
+		 struct stream *dst);
+void relay_close(struct stream_relay *relay);
+void relay_forward(struct stream_relay *relay, const struct rtp_header *hdr,
+		   struct mbuf *mb);
+void relay_feedback(struct stream_relay *relay, const struct rtcp_msg *msg);
+struct stream *relay_src(const struct stream_relay *relay);
+struct stream *relay_dst(const struct stream_relay *relay);
+uint32_t relay_ssrc(const struct stream_relay *relay);
+int  relay_debug(struct re_printf *pf, const struct stream_relay *relay);
+
+
+/*
+ * Shared encoder
+ */
+
+struct txshare;
+
+typedef void (txshare_leader_h)(void *leg);
+
+int  txshare_alloc(struct txshare **shp, const char *key,
+		   txshare_leader_h *leaderh);
+void txshare_join(struct txshare *sh, struct le *le, void *leg);
+void txshare_leave(struct txshare *sh, struct le *le);
+void txshare_lock(struct txshare *sh);
+void txshare_unlock(struct txshare *sh);
+bool txshare_leader(struct txshare *sh, const void *leg);
+struct list *txshare_legl(struct txshare *sh);
+void txshare_picup_req(struct txshare *sh);
+bool txshare_picup(struct txshare *sh, uint64_t now);
+int  txshare_debug(struct re_printf *pf, const struct txshare *sh);
+
+
+/*
+ * Transport-wide Congestion Control
+ */
+
+struct twcc_recv;
+
+typedef void (twcc_status_h)(uint16_t seq, bool received, int64_t arrival,
+			     void *arg);
+
+int  twcc_recv_alloc(struct twcc_recv **twp);
+void twcc_recv_packet(struct twcc_recv *tw, struct rtp_sock *rtp,
+		      uint32_t ssrc, uint16_t seq, uint64_t now);
+int  twcc_recv_debug(struct re_printf *pf, const struct twcc_recv *tw);
+int  twcc_ext_decode(const struct rtp_header *hdr, const struct mbuf *mb,
+		     uint8_t id, uint16_t *seqp);
+int  twcc_decode(const struct twcc *twcc, twcc_status_h *statush,
+		 void *arg);
+
+
 /*
  * User-Agent
  */
@@ -423,6 +692,53 @@ int  video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx,
 int  video_print(struct re_printf *pf, const struct video *v);
 
 
+/*
+ * Video frame difference
+ */
+
+enum { VIDDIFF_BLOCK = 16 };
+
+struct viddiff;
+
+int  viddiff_alloc(struct viddiff **vdp);
+int  viddiff_update(struct viddiff *vd, const struct vidframe *frame,
+		    bool full);
+void viddiff_reset(struct viddiff *vd);
+unsigned viddiff_changed(const struct viddiff *vd);
+void viddiff_actmap(const struct viddiff *vd, struct vidactmap *map);
+
+
+/*
+ * Video jitter buffer
+ */
+
+struct vidjbuf;
+
+/** Video jitter buffer statistics */
+struct vidjbuf_stat {
+	uint64_t n_put;           /**< Number of packets put            */
+	uint64_t n_frames;        /**< Number of complete frames        */
+	uint64_t n_skipped;       /**< Number of frames given up        */
+	uint64_t n_nack;          /**< Number of packets NACKed         */
+	uint64_t n_recovered;     /**< Missing packets received later   */
+	uint64_t n_late;          /**< Packets after frame was released */
+	uint64_t n_dups;          /**< Duplicate packets                */
+	uint64_t n_flush;         /**< Number of flushes                */
+};
+
+typedef void (vidjbuf_nack_h)(uint16_t pid, uint16_t blp, void *arg);
+
+int  vidjbuf_alloc(struct vidjbuf **vjbp, uint32_t max_frames,
+		   vidjbuf_nack_h *nackh, void *arg);
+int  vidjbuf_put(struct vidjbuf *vjb, const struct rtp_header *hdr,
+		 struct mbuf *mb);
+int  vidjbuf_get(struct vidjbuf *vjb, struct rtp_header *hdr,
+		 struct mbuf **mbp, bool *lostp);
+void vidjbuf_flush(struct vidjbuf *vjb);
+int  vidjbuf_stats(const struct vidjbuf *vjb, struct vidjbuf_stat *stat);
+int  vidjbuf_debug(struct re_printf *pf, const struct vidjbuf *vjb);
+
+
 /*
  * Timestamp helpers
  */
@@ -518,6 +834,8 @@ void rtprecv_set_ts_last(struct rtp_receiver *rx, uint64_t ts_last);
 void rtprecv_flush(struct rtp_receiver *rx);
 void rtprecv_enable(struct rtp_receiver *rx, bool enable);
 int  rtprecv_get_ssrc(struct rtp_receiver *rx, uint32_t *ssrc);
+void rtprecv_set_ssrc_fec(struct rtp_receiver *rx, uint32_t ssrc);
+int  rtprecv_get_ssrc_fec(struct rtp_receiver *rx, uint32_t *ssrc);
 void rtprecv_enable_mux(struct rtp_receiver *rx, bool enable);
 int  rtprecv_debug(struct re_printf *pf, const struct rtp_receiver *rx);
 int  rtprecv_start_thread(struct rtp_receiver *rx);
@@ -526,3 +844,6 @@ void rtprecv_mnat_connected_handler(const struct sa *raddr1,
 int  rtprecv_start_rtcp(struct rtp_receiver *rx, const char *cname,
 			const struct sa *peer, bool pinhole);
 bool rtprecv_running(const struct rtp_receiver *rx);
+void rtprecv_set_relay(struct rtp_receiver *rx, struct stream_relay *relay);
+int  rtprecv_enable_twcc(struct rtp_receiver *rx, uint8_t extid);
+void rtprecv_set_fec(struct rtp_receiver *rx, int fec_pt, int red_pt);
@@ -0,0 +1,831 @@
+/**
+ * @file fec.c  Forward Error Correction and redundant audio data
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * RFC 5109 -- RTP Payload Format for Generic Forward Error Correction
+ *
+ * The sender XORs a group of up to 16 consecutive media packets into one
+ * FEC packet, which is sent as a separate stream with its own SSRC and
+ * sequence numbers, so the sequence numbers of the media stream are kept.
+ * If one packet of the group is lost, the receiver recovers it from the
+ * FEC packet and the other packets of the group:
+ *
+ *  0                   1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |E|L|P|X|  CC   |M| PT recovery |            SN base            |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                          TS recovery                          |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |        length recovery        |       Protection Length       |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |             mask              |  XOR of the payloads ...      |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ * Only one protection level with the short mask (L=0) is used. The
+ * protected bit string of a media packet is everything after the fixed
+ * RTP header: the CSRC list, the header extension, the payload and the
+ * padding. The P, X and CC bits and the length of that string are
+ * recovered as well (RFC 5109 section 7.3).
+ *
+ *
+ * RFC 2198 -- RTP Payload for Redundant Audio Data
+ *
+ * An audio packet carries the previous packets as redundant blocks in
+ * front of the primary block, so a lost packet is taken from one of the
+ * next packets:
+ *
+ *  0                   1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |F|   block PT  |  timestamp offset         |   block length    |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |0|   block PT  |  redundant blocks ..., primary block ...
+ * +-+-+-+-+-+-+-+-+
+ */
+
+
+enum {
+	FEC_HDR_SIZE = 14,    /**< FEC header and level header          */
+	FEC_GROUP    = 16,    /**< Max. packets per FEC packet          */
+	FEC_WIN      = 64,    /**< Received packets, power of 2         */
+	FEC_PLD_MAX  = 1500,  /**< Max. protected payload length        */
+	RED_PLD_MAX  = 1023,  /**< Max. redundant block length          */
+	RED_TS_MAX   = 16383, /**< Max. timestamp offset                */
+};
+
+
+/** FEC encoder, protects one media stream */
+struct fec_enc {
+	uint8_t buf[FEC_PLD_MAX];  /**< XOR of the payloads              */
+	size_t maxlen;             /**< Protection length                */
+	uint16_t seq_base;         /**< First sequence number of group   */
+	uint16_t mask;             /**< Protected packets of group       */
+	uint8_t pxcc;              /**< XOR of the P, X and CC fields    */
+	uint8_t mpt;               /**< XOR of marker and payload types  */
+	uint32_t ts;               /**< XOR of timestamps                */
+	uint16_t len;              /**< XOR of payload lengths           */
+	unsigned n;                /**< Packets in the current group     */
+	unsigned k;                /**< Packets per FEC packet, 0 is off */
+	uint64_t n_fec;            /**< FEC packets generated            */
+};
+
+
+/** Received media packet */
+struct fec_pkt {
+	struct mbuf *mb;           /**< RTP packet, referenced           */
+	size_t pos;                /**< End of the fixed RTP header      */
+	size_t end;                /**< End of packet                    */
+	uint32_t ts;               /**< RTP timestamp                    */
+	uint16_t seq;              /**< Sequence number                  */
+	uint8_t pxcc;              /**< P, X and CC fields               */
+	uint8_t mpt;               /**< Marker and payload type          */
+};
+
+
+/** FEC decoder, recovers lost packets of one media stream */
+struct fec_dec {
+	struct fec_pkt pktv[FEC_WIN];  /**< Received packets by seq      */
+	uint64_t n_fec;                /**< FEC packets received         */
+	uint64_t n_recovered;          /**< Packets recovered            */
+	uint64_t n_failed;             /**< Too many packets lost        */
+};
+
+
+/** Previous audio packet */
+struct red_hist {
+	uint8_t buf[RED_PLD_MAX];  /**< Payload                          */
+	size_t len;                /**< Payload length                   */
+	uint32_t ts;               /**< RTP timestamp                    */
+	uint8_t pt;                /**< Payload type                     */
+};
+
+
+/** Redundant audio encoder */
+struct red_enc {
+	struct red_hist histv[RED_MAX];  /**< Previous packets, newest first */
+	unsigned histc;                  /**< Number of previous packets     */
+	unsigned distance;               /**< Redundant blocks to send       */
+};
+
+
+/** Loss fraction and the protection for it */
+static const struct {
+	double loss;
+	unsigned k;         /**< Packets per FEC packet     */
+	unsigned distance;  /**< Redundant audio blocks     */
+} protv[] = {
+	{0.10,  2, 2},
+	{0.05,  4, 1},
+	{0.02,  8, 1},
+	{0.005, 16, 1},
+};
+
+
+static inline uint8_t mpt_encode(bool marker, uint8_t pt)
+{
+	return (marker ? 0x80 : 0x00) | (pt & 0x7f);
+}
+
+
+static inline uint8_t pxcc_encode(const struct rtp_header *hdr)
+{
+	return (hdr->pad ? 0x20 : 0x00) | (hdr->ext ? 0x10 : 0x00) |
+		(hdr->cc & 0x0f);
+}
+
+
+/* Length of the CSRC list and the header extension */
+static size_t hdr_rest_len(const struct rtp_header *hdr)
+{
+	size_t len = hdr->cc * sizeof(uint32_t);
+
+	if (hdr->ext)
+		len += RTPEXT_HDR_SIZE + hdr->x.len * sizeof(uint32_t);
+
+	return len;
+}
+
+
+static void fec_enc_reset(struct fec_enc *enc)
+{
+	memset(enc->buf, 0, enc->maxlen);
+
+	enc->maxlen = 0;
+	enc->mask   = 0;
+	enc->pxcc   = 0;
+	enc->mpt    = 0;
+	enc->ts     = 0;
+	enc->len    = 0;
+	enc->n      = 0;
+}
+
+
+static int fec_enc_write(struct fec_enc *enc, struct mbuf *mb)
+{
+	int err = 0;
+
+	err |= mbuf_write_u8(mb, enc->pxcc);
+	err |= mbuf_write_u8(mb, enc->mpt);
+	err |= mbuf_write_u16(mb, htons(enc->seq_base));
+	err |= mbuf_write_u32(mb, htonl(enc->ts));
+	err |= mbuf_write_u16(mb, htons(enc->len));
+	err |= mbuf_write_u16(mb, htons((uint16_t)enc->maxlen));
+	err |= mbuf_write_u16(mb, htons(enc->mask));
+	err |= mbuf_write_mem(mb, enc->buf, enc->maxlen);
+
+	++enc->n_fec;
+	fec_enc_reset(enc);
+
+	return err;
+}
+
+
+/**
+ * Allocate an FEC encoder
+ *
+ * @param encp Pointer to allocated FEC encoder
+ * @param k    Number of media packets per FEC packet, 0 to disable
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_enc_alloc(struct fec_enc **encp, unsigned k)
+{
+	struct fec_enc *enc;
+
+	if (!encp)
+		return EINVAL;
+
+	enc = mem_zalloc(sizeof(*enc), NULL);
+	if (!enc)
+		return ENOMEM;
+
+	enc->k = min(k, FEC_GROUP);
+
+	*encp = enc;
+
+	return 0;
+}
+
+
+/**
+ * Set the number of media packets per FEC packet, the current group is
+ * completed first
+ *
+ * @param enc FEC encoder
+ * @param k   Number of media packets per FEC packet, 0 to disable
+ */
+void fec_enc_set_group(struct fec_enc *enc, unsigned k)
+{
+	if (!enc)
+		return;
+
+	enc->k = min(k, FEC_GROUP);
+}
+
+
+/**
+ * Add a sent media packet to the FEC encoder. A group ends after k packets
+ * or with the marker bit, so that a frame is not held back.
+ *
+ * @param enc FEC encoder
+ * @param mb  Buffer for the FEC payload, written at the end
+ * @param hdr RTP header of the media packet
+ * @param pld Media packet after the fixed RTP header: CSRC list, header
+ *            extension, payload and padding
+ * @param len Length of the packet after the fixed RTP header
+ *
+ * @return 0 if an FEC payload was written, ENOENT if the group is not
+ * complete, otherwise errorcode
+ */
+int fec_enc_packet(struct fec_enc *enc, struct mbuf *mb,
+		   const struct rtp_header *hdr,
+		   const uint8_t *pld, size_t len)
+{
+	uint16_t offset;
+
+	if (!enc || !mb || !hdr || (!pld && len))
+		return EINVAL;
+
+	if (len > FEC_PLD_MAX)
+		return EOVERFLOW;
+
+	if (!enc->k) {
+		if (enc->n)
+			fec_enc_reset(enc);
+		return ENOENT;
+	}
+
+	/* start a new group if the packet does not fit the mask */
+	offset = hdr->seq - enc->seq_base;
+	if (enc->n && offset >= FEC_GROUP)
+		fec_enc_reset(enc);
+
+	if (!enc->n) {
+		enc->seq_base = hdr->seq;
+		offset = 0;
+	}
+
+	for (size_t i = 0; i < len; i++)
+		enc->buf[i] ^= pld[i];
+
+	enc->maxlen = max(enc->maxlen, len);
+	enc->mask  |= 1 << (15 - offset);
+	enc->pxcc  ^= pxcc_encode(hdr);
+	enc->mpt   ^= mpt_encode(hdr->m, hdr->pt);
+	enc->ts    ^= hdr->ts;
+	enc->len   ^= (uint16_t)len;
+	++enc->n;
+
+	if (enc->n < enc->k && !hdr->m)
+		return ENOENT;
+
+	return fec_enc_write(enc, mb);
+}
+
+
+/**
+ * Complete the current group, e.g. at a partition boundary
+ *
+ * @param enc FEC encoder
+ * @param mb  Buffer for the FEC payload, written at the end
+ *
+ * @return 0 if an FEC payload was written, ENOENT if the group is empty,
+ * otherwise errorcode
+ */
+int fec_enc_flush(struct fec_enc *enc, struct mbuf *mb)
+{
+	if (!enc || !mb)
+		return EINVAL;
+
+	if (!enc->n)
+		return ENOENT;
+
+	return fec_enc_write(enc, mb);
+}
+
+
+int fec_enc_debug(struct re_printf *pf, const struct fec_enc *enc)
+{
+	if (!enc)
+		return 0;
+
+	return re_hprintf(pf, " fec: group=%u packets=%llu\n",
+			  enc->k, enc->n_fec);
+}
+
+
+static void fec_dec_destructor(void *arg)
+{
+	struct fec_dec *dec = arg;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(dec->pktv); i++)
+		mem_deref(dec->pktv[i].mb);
+}
+
+
+/**
+ * Allocate an FEC decoder
+ *
+ * @param decp Pointer to allocated FEC decoder
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int fec_dec_alloc(struct fec_dec **decp)
+{
+	struct fec_dec *dec;
+
+	if (!decp)
+		return EINVAL;
+
+	dec = mem_zalloc(sizeof(*dec), fec_dec_destructor);
+	if (!dec)
+		return ENOMEM;
+
+	*decp = dec;
+
+	return 0;
+}
+
+
+/**
+ * Keep a received media packet for recovery, the packet is referenced.
+ * The CSRC list and the header extension are expected in front of the
+ * payload, as the RTP stack leaves them.
+ *
+ * @param dec FEC decoder
+ * @param hdr RTP header
+ * @param mb  RTP payload
+ */
+void fec_dec_media(struct fec_dec *dec, const struct rtp_header *hdr,
+		   struct mbuf *mb)
+{
+	const size_t rest = hdr ? hdr_rest_len(hdr) : 0;
+	struct fec_pkt *p;
+
+	if (!dec || !hdr || !mb || mb->pos < rest)
+		return;
+
+	p = &dec->pktv[hdr->seq & (FEC_WIN - 1)];
+
+	mem_deref(p->mb);
+	p->mb   = mem_ref(mb);
+	p->pos  = mb->pos - rest;
+	p->end  = mb->end;
+	p->ts   = hdr->ts;
+	p->seq  = hdr->seq;
+	p->pxcc = pxcc_encode(hdr);
+	p->mpt  = mpt_encode(hdr->m, hdr->pt);
+}
+
+
+/* Decode the CSRC list and the header extension of a recovered packet */
+static int fec_hdr_rest_decode(struct rtp_header *hdr, struct mbuf *mb)
+{
+	if (mbuf_get_left(mb) < hdr->cc * sizeof(uint32_t))
+		return EBADMSG;
+
+	for (unsigned i = 0; i < hdr->cc; i++)
+		hdr->csrc[i] = ntohl(mbuf_read_u32(mb));
+
+	if (!hdr->ext)
+		return 0;
+
+	if (mbuf_get_left(mb) < RTPEXT_HDR_SIZE)
+		return EBADMSG;
+
+	hdr->x.type = ntohs(mbuf_read_u16(mb));
+	hdr->x.len  = ntohs(mbuf_read_u16(mb));
+
+	if (mbuf_get_left(mb) < hdr->x.len * sizeof(uint32_t))
+		return EBADMSG;
+
+	mb->pos += hdr->x.len * sizeof(uint32_t);
+
+	return 0;
+}
+
+
+static const struct fec_pkt *fec_dec_find(const struct fec_dec *dec,
+					  uint16_t seq)
+{
+	const struct fec_pkt *p = &dec->pktv[seq & (FEC_WIN - 1)];
+
+	return p->mb && p->seq == seq ? p : NULL;
+}
+
+
+/**
+ * Recover a lost media packet with a received FEC packet
+ *
+ * @param dec  FEC decoder
+ * @param mb   FEC payload
+ * @param ssrc SSRC of the media stream
+ * @param hdrp Returned RTP header of the recovered packet
+ * @param mbp  Returned packet after the fixed RTP header, positioned at
+ *             the payload
+ *
+ * @return 0 if a packet was recovered, ENOENT if no packet is missing or
+ * more than one, otherwise errorcode
+ */
+int fec_dec_fec(struct fec_dec *dec, const struct mbuf *mb, uint32_t ssrc,
+		struct rtp_header *hdrp, struct mbuf **mbp)
+{
+	const uint8_t *p;
+	uint16_t seq_base, mask, len, prot_len;
+	uint16_t seq_lost = 0;
+	unsigned lostc = 0;
+	uint32_t ts;
+	uint8_t pxcc, mpt;
+	struct mbuf *rmb;
+	int err;
+
+	if (!dec || !mb || !hdrp || !mbp)
+		return EINVAL;
+
+	if (mbuf_get_left(mb) < FEC_HDR_SIZE)
+		return EBADMSG;
+
+	p = mbuf_buf(mb);
+
+	/* E and L bits, only the short mask is supported */
+	if (p[0] & 0xc0)
+		return ENOTSUP;
+
+	pxcc     = p[0] & 0x3f;
+	mpt      = p[1];
+	seq_base = p[2] << 8 | p[3];
+	ts       = (uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+	len      = p[8] << 8 | p[9];
+	prot_len = p[10] << 8 | p[11];
+	mask     = p[12] << 8 | p[13];
+
+	if (mbuf_get_left(mb) < FEC_HDR_SIZE + (size_t)prot_len)
+		return EBADMSG;
+
+	++dec->n_fec;
+
+	for (unsigned i = 0; i < FEC_GROUP; i++) {
+		const uint16_t seq = seq_base + i;
+		const struct fec_pkt *q;
+
+		if (!(mask & (1 << (15 - i))))
+			continue;
+
+		q = fec_dec_find(dec, seq);
+		if (!q) {
+			seq_lost = seq;
+			++lostc;
+			continue;
+		}
+
+		pxcc ^= q->pxcc;
+		mpt  ^= q->mpt;
+		ts   ^= q->ts;
+		len  ^= (uint16_t)(q->end - q->pos);
+	}
+
+	if (!lostc)
+		return ENOENT;
+
+	if (lostc > 1) {
+		++dec->n_failed;
+		return ENOENT;
+	}
+
+	if (len > prot_len)
+		return EBADMSG;
+
+	rmb = mbuf_alloc(len);
+	if (!rmb)
+		return ENOMEM;
+
+	(void)mbuf_write_mem(rmb, p + FEC_HDR_SIZE, len);
+
+	for (unsigned i = 0; i < FEC_GROUP; i++) {
+		const struct fec_pkt *q;
+		size_t n;
+
+		if (!(mask & (1 << (15 - i))))
+			continue;
+
+		q = fec_dec_find(dec, seq_base + i);
+		if (!q)
+			continue;
+
+		n = min(q->end - q->pos, (size_t)len);
+
+		for (size_t j = 0; j < n; j++)
+			rmb->buf[j] ^= q->mb->buf[q->pos + j];
+	}
+
+	rmb->pos = 0;
+
+	memset(hdrp, 0, sizeof(*hdrp));
+	hdrp->ver  = RTP_VERSION;
+	hdrp->pad  = (pxcc >> 5) & 0x1;
+	hdrp->ext  = (pxcc >> 4) & 0x1;
+	hdrp->cc   = pxcc & 0x0f;
+	hdrp->m    = (mpt >> 7) & 0x1;
+	hdrp->pt   = mpt & 0x7f;
+	hdrp->seq  = seq_lost;
+	hdrp->ts   = ts;
+	hdrp->ssrc = ssrc;
+
+	err = fec_hdr_rest_decode(hdrp, rmb);
+	if (err) {
+		mem_deref(rmb);
+		return err;
+	}
+
+	fec_dec_media(dec, hdrp, rmb);
+	++dec->n_recovered;
+
+	*mbp = rmb;
+
+	return 0;
+}
+
+
+int fec_dec_debug(struct re_printf *pf, const struct fec_dec *dec)
+{
+	if (!dec)
+		return 0;
+
+	return re_hprintf(pf, " fec: received=%llu recovered=%llu"
+			  " failed=%llu\n",
+			  dec->n_fec, dec->n_recovered, dec->n_failed);
+}
+
+
+/**
+ * Get the loss fraction of our SSRC from an RTCP Sender or Receiver Report
+ *
+ * @param msg   RTCP message
+ * @param ssrc  SSRC of the media sender
+ * @param lossp Returned loss fraction, 0.0 to 1.0
+ *
+ * @return 0 if success, ENOENT if the message has no report for the SSRC
+ */
+int fec_rtcp_loss(const struct rtcp_msg *msg, uint32_t ssrc, double *lossp)
+{
+	const struct rtcp_rr *rrv;
+
+	if (!msg || !lossp)
+		return EINVAL;
+
+	if (msg->hdr.pt == RTCP_SR)
+		rrv = msg->r.sr.rrv;
+	else if (msg->hdr.pt == RTCP_RR)
+		rrv = msg->r.rr.rrv;
+	else
+		return ENOENT;
+
+	for (unsigned i = 0; rrv && i < msg->hdr.count; i++) {
+
+		if (rrv[i].ssrc != ssrc)
+			continue;
+
+		*lossp = rrv[i].fraction / 256.0;
+		return 0;
+	}
+
+	return ENOENT;
+}
+
+
+/**
+ * Get the number of media packets per FEC packet for a loss fraction
+ *
+ * @param loss Loss fraction, 0.0 to 1.0
+ *
+ * @return Packets per FEC packet, 0 if no protection is needed
+ */
+unsigned fec_group(double loss)
+{
+	for (size_t i = 0; i < RE_ARRAY_SIZE(protv); i++) {
+		if (loss >= protv[i].loss)
+			return protv[i].k;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Get the number of redundant audio blocks for a loss fraction
+ *
+ * @param loss Loss fraction, 0.0 to 1.0
+ *
+ * @return Number of redundant blocks, 0 if no redundancy is needed
+ */
+unsigned red_distance(double loss)
+{
+	for (size_t i = 0; i < RE_ARRAY_SIZE(protv); i++) {
+		if (loss >= protv[i].loss)
+			return protv[i].distance;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Allocate a redundant audio encoder (RFC 2198)
+ *
+ * @param encp     Pointer to allocated encoder
+ * @param distance Number of redundant blocks per packet
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int red_enc_alloc(struct red_enc **encp, unsigned distance)
+{
+	struct red_enc *enc;
+
+	if (!encp)
+		return EINVAL;
+
+	enc = mem_zalloc(sizeof(*enc), NULL);
+	if (!enc)
+		return ENOMEM;
+
+	enc->distance = min(distance, RED_MAX);
+
+	*encp = enc;
+
+	return 0;
+}
+
+
+/**
+ * Set the number of redundant blocks per packet. The previous packets are
+ * dropped with a distance of 0, since they are not kept while the primary
+ * blocks are sent without RED.
+ *
+ * @param enc      Redundant audio encoder
+ * @param distance Number of redundant blocks, 0 to send the primary only
+ */
+void red_enc_set_distance(struct red_enc *enc, unsigned distance)
+{
+	if (!enc)
+		return;
+
+	enc->distance = min(distance, RED_MAX);
+
+	if (!enc->distance)
+		enc->histc = 0;
+}
+
+
+unsigned red_enc_distance(const struct red_enc *enc)
+{
+	return enc ? enc->distance : 0;
+}
+
+
+/**
+ * Write a RED payload with the previous packets as redundant blocks, and
+ * keep the primary block for the next packets
+ *
+ * @param enc Redundant audio encoder
+ * @param mb  Buffer for the RED payload, written at the end
+ * @param pt  Payload type of the primary block
+ * @param ts  RTP timestamp of the primary block
+ * @param pld Primary block
+ * @param len Length of the primary block
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int red_enc_packet(struct red_enc *enc, struct mbuf *mb, uint8_t pt,
+		   uint32_t ts, const uint8_t *pld, size_t len)
+{
+	const struct red_hist *blkv[RED_MAX];
+	unsigned n, blkc = 0;
+	int err = 0;
+
+	if (!enc || !mb || (!pld && len))
+		return EINVAL;
+
+	/* the newest packets without a gap, so that the receiver can
+	 * count back the sequence numbers */
+	for (n = 0; n < min(enc->distance, enc->histc); n++) {
+		const uint32_t offset = ts - enc->histv[n].ts;
+
+		if (!offset || offset > RED_TS_MAX)
+			break;
+	}
+
+	/* oldest block first */
+	while (n > 0)
+		blkv[blkc++] = &enc->histv[--n];
+
+	for (unsigned i = 0; i < blkc; i++) {
+		const uint32_t offset = ts - blkv[i]->ts;
+
+		err |= mbuf_write_u8(mb, 0x80 | blkv[i]->pt);
+		err |= mbuf_write_u8(mb, (uint8_t)(offset >> 6));
+		err |= mbuf_write_u8(mb, (uint8_t)((offset & 0x3f) << 2 |
+						   blkv[i]->len >> 8));
+		err |= mbuf_write_u8(mb, (uint8_t)(blkv[i]->len & 0xff));
+	}
+
+	err |= mbuf_write_u8(mb, pt & 0x7f);
+
+	for (unsigned i = 0; i < blkc; i++)
+		err |= mbuf_write_mem(mb, blkv[i]->buf, blkv[i]->len);
+
+	err |= mbuf_write_mem(mb, pld, len);
+	if (err)
+		return err;
+
+	/* a block that is too large is never sent as redundancy */
+	if (len > RED_PLD_MAX) {
+		enc->histc = 0;
+		return 0;
+	}
+
+	memmove(&enc->histv[1], &enc->histv[0],
+		(RED_MAX - 1) * sizeof(enc->histv[0]));
+
+	memcpy(enc->histv[0].buf, pld, len);
+	enc->histv[0].len = len;
+	enc->histv[0].ts  = ts;
+	enc->histv[0].pt  = pt & 0x7f;
+
+	enc->histc = min(enc->histc + 1, RED_MAX);
+
+	return 0;
+}
+
+
+/**
+ * Decode a RED payload into its blocks, the primary block is the last one
+ *
+ * @param blkv  Returned blocks, pointing into the payload
+ * @param blkcp Number of blocks in, number of decoded blocks out
+ * @param ts    RTP timestamp of the RED packet
+ * @param mb    RED payload
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int red_decode(struct red_block *blkv, size_t *blkcp, uint32_t ts,
+	       const struct mbuf *mb)
+{
+	const uint8_t *p, *end;
+	size_t n = 0, total = 0;
+
+	if (!blkv || !blkcp || !*blkcp || !mb)
+		return EINVAL;
+
+	p   = mbuf_buf(mb);
+	end = p + mbuf_get_left(mb);
+
+	for (;;) {
+
+		if (p >= end)
+			return EBADMSG;
+
+		if (n >= *blkcp)
+			return EOVERFLOW;
+
+		blkv[n].pt = p[0] & 0x7f;
+
+		if (!(p[0] & 0x80)) {
+			blkv[n].ts = ts;
+			++p;
+			break;
+		}
+
+		if (end - p < 4)
+			return EBADMSG;
+
+		blkv[n].ts  = ts - ((uint32_t)p[1] << 6 | p[2] >> 2);
+		blkv[n].len = (p[2] & 0x03) << 8 | p[3];
+		total += blkv[n].len;
+		p += 4;
+		++n;
+	}
+
+	if ((size_t)(end - p) < total)
+		return EBADMSG;
+
+	for (size_t i = 0; i < n; i++) {
+		blkv[i].data = p;
+		p += blkv[i].len;
+	}
+
+	blkv[n].data = p;
+	blkv[n].len  = end - p;
+
+	*blkcp = n + 1;
+
+	return 0;
+}
@@ -67,7 +67,9 @@ struct jbuf {
 	int pt;              /**< Payload type                               */
 	bool running;        /**< Jitter buffer is running                   */
 	int32_t rdiff;       /**< Average out of order reverse diff          */
-	struct tmr tmr;      /**< Rdiff down timer                           */
+	uint64_t tdown;      /**< Deadline for wish size down [ms]           */
+	jbuf_clock_h *clockh; /**< Clock handler (optional)                  */
+	void *clock_arg;     /**< Clock handler argument                     */
 
 	mtx_t *lock;         /**< Makes jitter buffer thread safe            */
 	enum jbuf_type jbtype;  /**< Jitter buffer type                      */
@@ -88,6 +90,12 @@ static inline bool seq_less(uint16_t x, uint16_t y)
 }
 
 
+static inline uint64_t jbuf_now(const struct jbuf *jb)
+{
+	return jb->clockh ? jb->clockh(jb->clock_arg) : tmr_jiffies();
+}
+
+
 #ifdef RE_JBUF_TRACE
 static void plot_jbuf(struct jbuf *jb, uint64_t tr)
 {
@@ -117,7 +125,7 @@ static void plot_jbuf_event(struct jbuf *jb, char ph)
 	uint32_t treal;
 	uint64_t tr;
 
-	tr = tmr_jiffies();
+	tr = jbuf_now(jb);
 	if (!jb->tr00)
 		jb->tr00 = tr;
 
@@ -191,7 +199,6 @@ static void jbuf_destructor(void *data)
 {
 	struct jbuf *jb = data;
 
-	tmr_cancel(&jb->tmr);
 	jbuf_flush(jb);
 
 	/* Free all packets in the pool list */
@@ -235,7 +242,6 @@ int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 	jb->min  = min;
 	jb->max  = max;
 	jb->wish = min;
-	tmr_init(&jb->tmr);
 
 	DEBUG_INFO("alloc: delay=%u-%u frames/packets\n", min, max);
 
@@ -287,9 +293,34 @@ int jbuf_set_type(struct jbuf *jb, enum jbuf_type jbtype)
 }
 
 
-static void wish_down(void *arg)
+/**
+ * Set the clock of a jitter buffer
+ *
+ * By default the jitter buffer uses tmr_jiffies(). A virtual clock makes
+ * it possible to replay recorded packet traces faster than real-time.
+ *
+ * @param jb      The jitter buffer.
+ * @param clockh  Clock handler returning the time in [ms], NULL for default
+ * @param arg     Handler argument
+ */
+void jbuf_set_clock(struct jbuf *jb, jbuf_clock_h *clockh, void *arg)
+{
+	if (!jb)
+		return;
+
+	mtx_lock(jb->lock);
+	jb->clockh    = clockh;
+	jb->clock_arg = arg;
+	mtx_unlock(jb->lock);
+}
+
+
+static void wish_down(struct jbuf *jb, uint64_t now)
 {
-	struct jbuf *jb = arg;
+	if (!jb->tdown || now < jb->tdown)
+		return;
+
+	jb->tdown = 0;
 
 	if (jb->wish > jb->min) {
 		DEBUG_INFO("wish size changed %u --> %u\n", jb->wish,
@@ -299,7 +330,7 @@ static void wish_down(void *arg)
 }
 
 
-static void calc_rdiff(struct jbuf *jb, uint16_t seq)
+static void calc_rdiff(struct jbuf *jb, uint16_t seq, uint64_t now)
 {
 	int32_t rdiff;
 	int32_t adiff;
@@ -340,14 +371,14 @@ static void calc_rdiff(struct jbuf *jb, uint16_t seq)
 	}
 	else if (wish < jb->wish) {
 		uint32_t dt = wish + 1 == jb->wish ? 6000 : 1000;
-		if (!tmr_isrunning(&jb->tmr) || tmr_get_expire(&jb->tmr) > dt)
-			tmr_start(&jb->tmr, dt, wish_down, jb);
+		if (!jb->tdown || jb->tdown > now + dt)
+			jb->tdown = now + dt;
 
 		down = true;
 	}
 
-	if (!down && tmr_isrunning(&jb->tmr))
-		tmr_cancel(&jb->tmr);
+	if (!down)
+		jb->tdown = 0;
 }
 
 
@@ -382,7 +413,7 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 		jbuf_flush(jb);
 	}
 
-	tr = tmr_jiffies();
+	tr = jbuf_now(jb);
 	dt = tr - jb->tr;
 	if (jb->tr && dt > JBUF_PUT_TIMEOUT) {
 		DEBUG_INFO("put timeout %lu ms, marker %d\n", dt, hdr->m);
@@ -397,8 +428,10 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 
 	if (jb->running) {
 
-		if (jb->jbtype == JBUF_ADAPTIVE)
-			calc_rdiff(jb, seq);
+		if (jb->jbtype == JBUF_ADAPTIVE) {
+			wish_down(jb, tr);
+			calc_rdiff(jb, seq, tr);
+		}
 
 		/* Packet arrived too late to be put into buffer */
 		if (jb->seq_get && seq_less(seq, jb->seq_get + 1)) {
@@ -515,6 +548,9 @@ int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 	mtx_lock(jb->lock);
 	STAT_INC(n_get);
 
+	if (jb->jbtype == JBUF_ADAPTIVE)
+		wish_down(jb, jbuf_now(jb));
+
 	if (jb->nf <= jb->wish || !jb->packetl.head) {
 		DEBUG_INFO("not enough buffer packets - wait.. "
 			   "(n=%u wish=%u)\n", jb->n, jb->wish);
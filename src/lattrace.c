@@ -0,0 +1,405 @@
+/**
+ * @file lattrace.c  Media pipeline latency tracing
+ *
+ * Every media frame is stamped with a monotonic timestamp at each stage
+ * boundary of the pipeline. The time spent in each stage is collected in a
+ * log-linear histogram with a relative error of about 6% (similar to
+ * HdrHistogram), and exported as Chrome trace counter events if libre is
+ * built with RE_TRACE_ENABLED.
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+enum {
+	SUB_BITS    = 4,                    /* 16 sub-buckets per octave   */
+	SUB_COUNT   = 1 << SUB_BITS,
+	MAX_SHIFT   = 26,                   /* Up to 2^31 [us]             */
+	BUCKETS     = (2 + MAX_SHIFT) * SUB_COUNT,
+	MAX_STAGES  = 24,
+	MARKS       = 512,                  /* Arrival time ring size      */
+};
+
+
+struct lat_stage {
+	char *name;                     /**< Stage name                  */
+	uint64_t count;                 /**< Number of samples           */
+	uint64_t sum;                   /**< Sum of all samples [us]     */
+	uint64_t max;                   /**< Maximum sample [us]         */
+	uint32_t bucketv[BUCKETS];      /**< Log-linear histogram        */
+};
+
+
+struct lat_mark {
+	uint64_t t;                     /**< Arrival time [us]           */
+	uint16_t key;                   /**< Key, e.g. RTP sequence      */
+};
+
+
+/** Defines the latency trace of one stream direction */
+struct lattrace {
+	const char *media;              /**< Media name (static)         */
+	bool tx;                        /**< Transmit direction          */
+	struct lat_stage *stagev[MAX_STAGES]; /**< Stages, pipeline order */
+	size_t stagec;                  /**< Number of stages            */
+	struct lat_mark markv[MARKS];   /**< Arrival times by key        */
+	mtx_t *mtx;                     /**< Protects the histograms     */
+};
+
+
+static void destructor(void *arg)
+{
+	struct lattrace *lt = arg;
+
+	for (size_t i = 0; i < lt->stagec; i++)
+		mem_deref(lt->stagev[i]);
+
+	mem_deref(lt->mtx);
+}
+
+
+/*
+ * Values below 2*SUB_COUNT have their own bucket, above that each
+ * octave is split into SUB_COUNT linear sub-buckets
+ */
+static unsigned bucket_index(uint64_t v)
+{
+	unsigned shift = 0;
+
+	if (v < 2 * SUB_COUNT)
+		return (unsigned)v;
+
+	while ((v >> shift) >= 2 * SUB_COUNT)
+		++shift;
+
+	if (shift > MAX_SHIFT)
+		return BUCKETS - 1;
+
+	return 2 * SUB_COUNT + (shift - 1) * SUB_COUNT +
+		(unsigned)((v >> shift) - SUB_COUNT);
+}
+
+
+/* Highest value which is equivalent to the bucket */
+static uint64_t bucket_value(unsigned ix)
+{
+	unsigned shift;
+	uint64_t mant;
+
+	if (ix < 2 * SUB_COUNT)
+		return ix;
+
+	ix   -= 2 * SUB_COUNT;
+	shift = ix / SUB_COUNT + 1;
+	mant  = SUB_COUNT + ix % SUB_COUNT;
+
+	return ((mant + 1) << shift) - 1;
+}
+
+
+static uint64_t stage_percentile(const struct lat_stage *st, double pct)
+{
+	uint64_t n = 0;
+	uint64_t limit;
+
+	if (!st->count)
+		return 0;
+
+	limit = (uint64_t)(st->count * pct / 100.0 + 0.5);
+	if (!limit)
+		limit = 1;
+
+	for (unsigned i = 0; i < BUCKETS; i++) {
+
+		n += st->bucketv[i];
+		if (n >= limit)
+			return min(bucket_value(i), st->max);
+	}
+
+	return st->max;
+}
+
+
+static void stage_destructor(void *arg)
+{
+	struct lat_stage *st = arg;
+
+	mem_deref(st->name);
+}
+
+
+static struct lat_stage *stage_lookup(struct lattrace *lt, const char *name)
+{
+	struct lat_stage *st;
+
+	for (size_t i = 0; i < lt->stagec; i++) {
+
+		st = lt->stagev[i];
+		if (!str_cmp(st->name, name))
+			return st;
+	}
+
+	if (lt->stagec >= RE_ARRAY_SIZE(lt->stagev))
+		return NULL;
+
+	st = mem_zalloc(sizeof(*st), stage_destructor);
+	if (!st)
+		return NULL;
+
+	if (str_dup(&st->name, name)) {
+		mem_deref(st);
+		return NULL;
+	}
+
+	lt->stagev[lt->stagec++] = st;
+
+	return st;
+}
+
+
+/**
+ * Allocate a latency trace for one direction of a media stream
+ *
+ * @param ltp   Pointer to allocated latency trace
+ * @param media Media name, must be a static string
+ * @param tx    True for the transmit direction
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int lattrace_alloc(struct lattrace **ltp, const char *media, bool tx)
+{
+	struct lattrace *lt;
+	int err;
+
+	if (!ltp || !media)
+		return EINVAL;
+
+	lt = mem_zalloc(sizeof(*lt), destructor);
+	if (!lt)
+		return ENOMEM;
+
+	lt->media = media;
+	lt->tx    = tx;
+
+	err = mutex_alloc(&lt->mtx);
+	if (err)
+		mem_deref(lt);
+	else
+		*ltp = lt;
+
+	return err;
+}
+
+
+/**
+ * Get a timestamp for the start of a pipeline
+ *
+ * @param lt Latency trace (optional)
+ *
+ * @return Current time in [us], or 0 if tracing is disabled
+ */
+uint64_t lattrace_now(const struct lattrace *lt)
+{
+	return lt ? tmr_jiffies_usec() : 0;
+}
+
+
+/**
+ * Add a latency sample to a pipeline stage
+ *
+ * @param lt    Latency trace (optional)
+ * @param stage Stage name
+ * @param usec  Time spent in the stage [us]
+ */
+void lattrace_add(struct lattrace *lt, const char *stage, uint64_t usec)
+{
+	struct lat_stage *st;
+
+	if (!lt || !stage)
+		return;
+
+	mtx_lock(lt->mtx);
+
+	st = stage_lookup(lt, stage);
+	if (st) {
+		++st->count;
+		st->sum += usec;
+		st->max  = max(st->max, usec);
+		++st->bucketv[bucket_index(usec)];
+	}
+
+	mtx_unlock(lt->mtx);
+
+#ifdef RE_TRACE_ENABLED
+	re_trace_event(lt->media, stage, 'C', NULL, 0, RE_TRACE_ARG_INT,
+		       lt->tx ? "tx" : "rx", (void *)(intptr_t)usec);
+#endif
+}
+
+
+/**
+ * Stamp a frame on leaving a pipeline stage
+ *
+ * The time since the previous stamp is added to the stage, and the
+ * timestamp is advanced to the current time.
+ *
+ * @param lt    Latency trace (optional)
+ * @param stage Stage name
+ * @param t     Frame timestamp in [us], nothing is done if zero
+ */
+void lattrace_stamp(struct lattrace *lt, const char *stage, uint64_t *t)
+{
+	uint64_t now;
+
+	if (!lt || !t || !*t)
+		return;
+
+	now = tmr_jiffies_usec();
+
+	lattrace_add(lt, stage, now > *t ? now - *t : 0);
+
+	*t = now;
+}
+
+
+/**
+ * Remember the arrival time of a packet, e.g. when it is read from the
+ * socket and before it is put into a jitter buffer
+ *
+ * @param lt  Latency trace (optional)
+ * @param key Packet key, e.g. the RTP sequence number
+ */
+void lattrace_mark(struct lattrace *lt, uint16_t key)
+{
+	struct lat_mark *mk;
+
+	if (!lt)
+		return;
+
+	mk = &lt->markv[key % MARKS];
+
+	mk->t   = tmr_jiffies_usec();
+	mk->key = key;
+}
+
+
+/**
+ * Get the arrival time of a packet
+ *
+ * @param lt  Latency trace (optional)
+ * @param key Packet key, e.g. the RTP sequence number
+ *
+ * @return Arrival time in [us], or 0 if not known
+ */
+uint64_t lattrace_marked(const struct lattrace *lt, uint16_t key)
+{
+	const struct lat_mark *mk;
+
+	if (!lt)
+		return 0;
+
+	mk = &lt->markv[key % MARKS];
+
+	return mk->key == key ? mk->t : 0;
+}
+
+
+/**
+ * Get a percentile of the latency of a pipeline stage
+ *
+ * @param lt    Latency trace
+ * @param stage Stage name
+ * @param pct   Percentile [0-100]
+ *
+ * @return Latency in [us], or 0 if the stage has no samples
+ */
+uint64_t lattrace_percentile(const struct lattrace *lt, const char *stage,
+			     double pct)
+{
+	uint64_t v = 0;
+
+	if (!lt || !stage)
+		return 0;
+
+	mtx_lock(lt->mtx);
+
+	for (size_t i = 0; i < lt->stagec; i++) {
+		const struct lat_stage *st = lt->stagev[i];
+
+		if (!str_cmp(st->name, stage)) {
+			v = stage_percentile(st, pct);
+			break;
+		}
+	}
+
+	mtx_unlock(lt->mtx);
+
+	return v;
+}
+
+
+/**
+ * Reset all histograms of a latency trace
+ *
+ * @param lt Latency trace
+ */
+void lattrace_reset(struct lattrace *lt)
+{
+	if (!lt)
+		return;
+
+	mtx_lock(lt->mtx);
+
+	for (size_t i = 0; i < lt->stagec; i++)
+		lt->stagev[i] = mem_deref(lt->stagev[i]);
+
+	lt->stagec = 0;
+
+	mtx_unlock(lt->mtx);
+}
+
+
+/**
+ * Print the latency histograms of all pipeline stages
+ *
+ * @param pf Print function
+ * @param lt Latency trace
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int lattrace_debug(struct re_printf *pf, const struct lattrace *lt)
+{
+	int err;
+
+	if (!lt)
+		return 0;
+
+	err = re_hprintf(pf, "%s %s latency [us]:\n"
+			 "  %-16s %8s %8s %8s %8s %8s %8s\n",
+			 lt->media, lt->tx ? "tx" : "rx",
+			 "stage", "count", "mean", "p50", "p90", "p99",
+			 "max");
+
+	mtx_lock(lt->mtx);
+
+	for (size_t i = 0; i < lt->stagec; i++) {
+		const struct lat_stage *st = lt->stagev[i];
+
+		err |= re_hprintf(pf, "  %-16s %8llu %8llu %8llu %8llu"
+				  " %8llu %8llu\n",
+				  st->name, st->count,
+				  st->count ? st->sum / st->count : 0,
+				  stage_percentile(st, 50),
+				  stage_percentile(st, 90),
+				  stage_percentile(st, 99),
+				  st->max);
+	}
+
+	mtx_unlock(lt->mtx);
+
+	return err;
+}
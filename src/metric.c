@@ -3,28 +3,29 @@
  *
  * Copyright (C) 2010 Alfred E. Heggestad
  */
+#include <re_atomic.h>
 #include <re.h>
 #include <baresip.h>
 #include "core.h"
 
 /*
  * Metric
+ *
+ * The counters are atomic, so that the packet path does not take a lock.
  */
 
 struct metric {
 	/* internal stuff: */
 	struct tmr tmr;
-	mtx_t lock;
-	uint64_t ts_start;
-	bool started;
+	RE_ATOMIC uint64_t ts_start;
 
 	/* counters: */
-	uint32_t n_packets;
-	uint32_t n_bytes;
-	uint32_t n_err;
+	RE_ATOMIC uint32_t n_packets;
+	RE_ATOMIC uint32_t n_bytes;
+	RE_ATOMIC uint32_t n_err;
 
-	/* bitrate calculation */
-	uint32_t cur_bitrate;
+	/* bitrate calculation, only in the timer handler */
+	RE_ATOMIC uint32_t cur_bitrate;
 	uint64_t ts_last;
 	uint32_t n_bytes_last;
 };
@@ -34,55 +35,35 @@ static void tmr_handler(void *arg)
 {
 	struct metric *metric = arg;
 	const uint64_t now = tmr_jiffies();
+	const uint32_t n_bytes = re_atomic_rlx(&metric->n_bytes);
 	uint32_t diff;
 
 	tmr_start(&metric->tmr, TMR_INTERVAL * 1000, tmr_handler, metric);
 
-	mtx_lock(&metric->lock);
-
-	if (!metric->started)
-		goto out;
+	if (!re_atomic_rlx(&metric->ts_start))
+		return;
 
 	if (now <= metric->ts_last)
-		goto out;
+		return;
 
 	if (metric->ts_last) {
-		uint32_t bytes = metric->n_bytes - metric->n_bytes_last;
+		uint32_t bytes = n_bytes - metric->n_bytes_last;
 		diff = (uint32_t)(now - metric->ts_last);
-		metric->cur_bitrate = 1000 * 8 * bytes / diff;
+		re_atomic_rlx_set(&metric->cur_bitrate,
+				  1000 * 8 * bytes / diff);
 	}
 
 	/* Update counters */
 	metric->ts_last = now;
-	metric->n_bytes_last = metric->n_bytes;
-
-out:
-	mtx_unlock(&metric->lock);
-}
-
-
-static void metric_start(struct metric *metric)
-{
-	if (metric->started)
-		return;
-
-	metric->ts_start = tmr_jiffies();
-
-	metric->started = true;
+	metric->n_bytes_last = n_bytes;
 }
 
 
 int metric_init(struct metric *metric)
 {
-	int err;
-
 	if (!metric)
 		return EINVAL;
 
-	err = mtx_init(&metric->lock, mtx_plain) != thrd_success;
-	if (err)
-		return ENOMEM;
-
 	tmr_start(&metric->tmr, 100, tmr_handler, metric);
 
 	return 0;
@@ -95,7 +76,6 @@ void metric_reset(struct metric *metric)
 		return;
 
 	tmr_cancel(&metric->tmr);
-	mtx_destroy(&metric->lock);
 }
 
 
@@ -122,80 +102,54 @@ void metric_add_packet(struct metric *metric, size_t packetsize)
 	if (!metric)
 		return;
 
-	mtx_lock(&metric->lock);
-
-	if (!metric->started)
-		metric_start(metric);
-
-	metric->n_bytes += (uint32_t)packetsize;
-	metric->n_packets++;
+	if (!re_atomic_rlx(&metric->ts_start))
+		re_atomic_rlx_set(&metric->ts_start, tmr_jiffies());
 
-	mtx_unlock(&metric->lock);
+	re_atomic_rlx_add(&metric->n_bytes, (uint32_t)packetsize);
+	re_atomic_rlx_add(&metric->n_packets, 1u);
 }
 
 
 double metric_avg_bitrate(const struct metric *metric)
 {
+	uint64_t ts_start;
 	int diff;
 
-	if (!metric || !metric->ts_start)
+	if (!metric)
+		return 0;
+
+	ts_start = re_atomic_rlx(&metric->ts_start);
+	if (!ts_start)
 		return 0;
 
-	diff = (int)(tmr_jiffies() - metric->ts_start);
+	diff = (int)(tmr_jiffies() - ts_start);
 
-	return 1000.0 * 8 * (double)metric->n_bytes / (double)diff;
+	return 1000.0 * 8 * (double)re_atomic_rlx(&metric->n_bytes) /
+		(double)diff;
 }
 
 
 uint32_t metric_n_packets(struct metric *metric)
 {
-	uint32_t n;
-	if (!metric)
-		return 0;
-
-	mtx_lock(&metric->lock);
-	n = metric->n_packets;
-	mtx_unlock(&metric->lock);
-	return n;
+	return metric ? re_atomic_rlx(&metric->n_packets) : 0;
 }
 
 
 uint32_t metric_n_bytes(struct metric *metric)
 {
-	uint32_t n;
-	if (!metric)
-		return 0;
-
-	mtx_lock(&metric->lock);
-	n = metric->n_bytes;
-	mtx_unlock(&metric->lock);
-	return n;
+	return metric ? re_atomic_rlx(&metric->n_bytes) : 0;
 }
 
 
 uint32_t metric_n_err(struct metric *metric)
 {
-	uint32_t n;
-	if (!metric)
-		return 0;
-
-	mtx_lock(&metric->lock);
-	n = metric->n_err;
-	mtx_unlock(&metric->lock);
-	return n;
+	return metric ? re_atomic_rlx(&metric->n_err) : 0;
 }
 
 
 uint32_t metric_bitrate(struct metric *metric)
 {
-	uint32_t n;
-	if (!metric)
-		return 0;
-
-	mtx_lock(&metric->lock);
-	n = metric->cur_bitrate;
-	mtx_unlock(&metric->lock);
-	return n;
+	return metric ? re_atomic_rlx(&metric->cur_bitrate) : 0;
 }
 
 
@@ -204,7 +158,5 @@ void     metric_inc_err(struct metric *metric)
 	if (!metric)
 		return;
 
-	mtx_lock(&metric->lock);
-	++metric->n_err;
-	mtx_unlock(&metric->lock);
+	re_atomic_rlx_add(&metric->n_err, 1u);
 }
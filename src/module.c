@@ -8,6 +8,18 @@
 #include "core.h"
 
 
+/** Defines a module which is loaded on first use */
+struct lazy_mod {
+	struct le le;         /**< Linked list element                 */
+	char *path;           /**< Module path                         */
+	char *name;           /**< Module name incl. extension         */
+	char *names;          /**< Registered names, comma separated   */
+};
+
+
+static struct list lazyl;
+
+
 /*
  * Append module extension, if not exist
  *
@@ -102,7 +114,13 @@ static int load_module(struct mod **modp, const struct pl *modpath,
 
 static int module_handler(const struct pl *val, void *arg)
 {
-	(void)load_module(NULL, arg, val);
+	uint64_t t = tmr_jiffies_usec();
+
+	if (!load_module(NULL, arg, val)) {
+		debug("module: %r loaded in %.1f ms\n", val,
+		      (tmr_jiffies_usec() - t) / 1000.0);
+	}
+
 	return 0;
 }
 
@@ -111,6 +129,7 @@ static int module_app_handler(const struct pl *val, void *arg)
 {
 	struct mod *mod = NULL;
 	const struct mod_export *me;
+	uint64_t t = tmr_jiffies_usec();
 
 	debug("module: loading app %r\n", val);
 
@@ -118,6 +137,9 @@ static int module_app_handler(const struct pl *val, void *arg)
 		return 0;
 	}
 
+	debug("module: %r loaded in %.1f ms\n", val,
+	      (tmr_jiffies_usec() - t) / 1000.0);
+
 	me = mod_export(mod);
 	if (0 != str_casecmp(me->type, "application")) {
 		warning("module_app %r should be type application (%s)\n",
@@ -128,9 +150,84 @@ static int module_app_handler(const struct pl *val, void *arg)
 }
 
 
+static void lazy_destructor(void *arg)
+{
+	struct lazy_mod *lm = arg;
+
+	list_unlink(&lm->le);
+	mem_deref(lm->path);
+	mem_deref(lm->name);
+	mem_deref(lm->names);
+}
+
+
+/*
+ * Register a module which is loaded on first use
+ *
+ * input:    avcodec.so H264,H265
+ *
+ * Without names the module name without extension is used.
+ */
+static int module_lazy_handler(const struct pl *val, void *arg)
+{
+	const struct pl *path = arg;
+	struct pl name, names = PL_INIT;
+	struct lazy_mod *lm;
+	int err;
+
+	if (re_regex(val->p, val->l, "[^ \t]+[ \t]*[^ \t]*",
+		     &name, NULL, &names))
+		return 0;
+
+	if (!pl_isset(&names) &&
+	    re_regex(name.p, name.l, "[^.]+", &names))
+		return 0;
+
+	lm = mem_zalloc(sizeof(*lm), lazy_destructor);
+	if (!lm)
+		return ENOMEM;
+
+	err  = pl_strdup(&lm->path, path);
+	err |= pl_strdup(&lm->name, &name);
+	err |= pl_strdup(&lm->names, &names);
+	if (err) {
+		mem_deref(lm);
+		return err;
+	}
+
+	list_append(&lazyl, &lm->le, lm);
+
+	debug("module: %s deferred until first use of %s\n",
+	      lm->name, lm->names);
+
+	return 0;
+}
+
+
+static bool names_match(const char *names, const char *name)
+{
+	struct pl pl, item;
+
+	pl_set_str(&pl, names);
+
+	while (!re_regex(pl.p, pl.l, "[^,]+", &item)) {
+
+		if (!pl_strcasecmp(&item, name))
+			return true;
+
+		pl_advance(&pl, item.p + item.l - pl.p);
+		if (pl.l)
+			pl_advance(&pl, 1);
+	}
+
+	return false;
+}
+
+
 int module_init(const struct conf *conf)
 {
 	struct pl path;
+	uint64_t t = tmr_jiffies_usec();
 	int err;
 
 	if (!conf)
@@ -139,6 +236,10 @@ int module_init(const struct conf *conf)
 	if (conf_get(conf, "module_path", &path))
 		pl_set_str(&path, ".");
 
+	err = conf_apply(conf, "module_lazy", module_lazy_handler, &path);
+	if (err)
+		return err;
+
 	err = conf_apply(conf, "module", module_handler, &path);
 	if (err)
 		return err;
@@ -147,10 +248,69 @@ int module_init(const struct conf *conf)
 	if (err)
 		return err;
 
+	debug("module: startup took %.1f ms (%u modules, %u deferred)\n",
+	      (tmr_jiffies_usec() - t) / 1000.0,
+	      list_count(mod_list()), list_count(&lazyl));
+
 	return 0;
 }
 
 
+/**
+ * Load the deferred modules which register a name
+ *
+ * The module init handlers and the list of deferred modules belong to
+ * the main thread, a lookup from another thread does not load anything.
+ *
+ * @param name Name of a codec or device driver, NULL for all modules
+ *
+ * @return 0 if a module was loaded, otherwise errorcode
+ */
+int module_lazy_load(const char *name)
+{
+	struct le *le;
+	int err = ENOENT;
+
+	if (re_thread_check(false))
+		return EPERM;
+
+	le = list_head(&lazyl);
+	while (le) {
+		struct lazy_mod *lm = le->data;
+		struct pl path, pl;
+
+		le = le->next;
+
+		if (name && !names_match(lm->names, name))
+			continue;
+
+		/* unlink first, the module init may look up names */
+		list_unlink(&lm->le);
+
+		info("module: loading %s on first use\n", lm->name);
+
+		pl_set_str(&path, lm->path);
+		pl_set_str(&pl, lm->name);
+
+		if (!load_module(NULL, &path, &pl))
+			err = 0;
+
+		mem_deref(lm);
+	}
+
+	return err;
+}
+
+
+/**
+ * Forget all deferred modules which are not loaded yet
+ */
+void module_lazy_flush(void)
+{
+	list_flush(&lazyl);
+}
+
+
 /**
  * Unload all application modules in reverse order
  */
@@ -0,0 +1,403 @@
+/**
+ * @file openmetrics.c  OpenMetrics exposition of media statistics
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * The statistics of all streams are collected into a sample array in one
+ * pass, and then printed family by family as required by OpenMetrics.
+ * The sample array is reused between encodings.
+ *
+ * Each stream is labeled with the Call-ID and the media name:
+ *
+ \verbatim
+  # TYPE baresip_rtp_rx_packets counter
+  # HELP baresip_rtp_rx_packets Received RTP packets
+  baresip_rtp_rx_packets_total{call="6f2a@host",media="audio"} 1234
+ \endverbatim
+ */
+
+
+enum {
+	SAMPLE_MIN = 16,
+};
+
+
+struct openmetrics {
+	struct openmetrics_sample *samplev;  /**< Reused sample array   */
+	size_t samplesz;                     /**< Allocated samples     */
+};
+
+
+struct family {
+	const char *name;          /**< Metric family name               */
+	const char *type;          /**< OpenMetrics type                 */
+	const char *help;          /**< Description                      */
+	enum openmetrics_src src;  /**< Source of the values             */
+	uint32_t div;              /**< Divisor to base unit, 0 for none */
+};
+
+
+static const struct family familyv[OM_MAX] = {
+
+	[OM_TX_PACKETS] = {"baresip_rtp_tx_packets", "counter",
+			   "Sent RTP packets", OM_SRC_STREAM, 0},
+	[OM_TX_BYTES]   = {"baresip_rtp_tx_bytes", "counter",
+			   "Sent RTP bytes", OM_SRC_STREAM, 0},
+	[OM_TX_ERRORS]  = {"baresip_rtp_tx_errors", "counter",
+			   "RTP send errors", OM_SRC_STREAM, 0},
+	[OM_TX_BITRATE] = {"baresip_rtp_tx_bitrate", "gauge",
+			   "Current send bitrate in bit/s", OM_SRC_STREAM,
+			   0},
+	[OM_RX_PACKETS] = {"baresip_rtp_rx_packets", "counter",
+			   "Received RTP packets", OM_SRC_STREAM, 0},
+	[OM_RX_BYTES]   = {"baresip_rtp_rx_bytes", "counter",
+			   "Received RTP bytes", OM_SRC_STREAM, 0},
+	[OM_RX_ERRORS]  = {"baresip_rtp_rx_errors", "counter",
+			   "RTP receive errors", OM_SRC_STREAM, 0},
+	[OM_RX_BITRATE] = {"baresip_rtp_rx_bitrate", "gauge",
+			   "Current receive bitrate in bit/s", OM_SRC_STREAM,
+			   0},
+
+	[OM_RTCP_TX_LOST]   = {"baresip_rtcp_tx_lost", "gauge",
+			       "Sent packets lost, reported by the peer",
+			       OM_SRC_RTCP, 0},
+	[OM_RTCP_RX_LOST]   = {"baresip_rtcp_rx_lost", "gauge",
+			       "Received packets lost", OM_SRC_RTCP, 0},
+	[OM_RTCP_TX_JITTER] = {"baresip_rtcp_tx_jitter_seconds", "gauge",
+			       "Interarrival jitter, reported by the peer",
+			       OM_SRC_RTCP, 1000000},
+	[OM_RTCP_RX_JITTER] = {"baresip_rtcp_rx_jitter_seconds", "gauge",
+			       "Interarrival jitter of received packets",
+			       OM_SRC_RTCP, 1000000},
+	[OM_RTCP_RTT]       = {"baresip_rtcp_rtt_seconds", "gauge",
+			       "Round-trip time", OM_SRC_RTCP, 1000000},
+
+	[OM_JBUF_PUT]       = {"baresip_jbuf_put", "counter",
+			       "Frames put into the jitter buffer",
+			       OM_SRC_JBUF, 0},
+	[OM_JBUF_GET]       = {"baresip_jbuf_get", "counter",
+			       "Frames taken from the jitter buffer",
+			       OM_SRC_JBUF, 0},
+	[OM_JBUF_OOS]       = {"baresip_jbuf_out_of_sequence", "counter",
+			       "Out-of-sequence frames", OM_SRC_JBUF, 0},
+	[OM_JBUF_DUPS]      = {"baresip_jbuf_duplicates", "counter",
+			       "Duplicate frames", OM_SRC_JBUF, 0},
+	[OM_JBUF_LATE]      = {"baresip_jbuf_late", "counter",
+			       "Frames arriving too late", OM_SRC_JBUF, 0},
+	[OM_JBUF_LOST]      = {"baresip_jbuf_lost", "counter",
+			       "Lost frames", OM_SRC_JBUF, 0},
+	[OM_JBUF_OVERFLOW]  = {"baresip_jbuf_overflows", "counter",
+			       "Jitter buffer overflows", OM_SRC_JBUF, 0},
+	[OM_JBUF_UNDERFLOW] = {"baresip_jbuf_underflows", "counter",
+			       "Jitter buffer underflows", OM_SRC_JBUF, 0},
+	[OM_JBUF_FLUSH]     = {"baresip_jbuf_flushes", "counter",
+			       "Jitter buffer flushes", OM_SRC_JBUF, 0},
+
+	[OM_AUDIO_TX_OVERRUN]  = {"baresip_audio_tx_overruns", "counter",
+				  "Audio source buffer overruns",
+				  OM_SRC_AUDIO, 0},
+	[OM_AUDIO_TX_UNDERRUN] = {"baresip_audio_tx_underruns", "counter",
+				  "Audio source buffer underruns",
+				  OM_SRC_AUDIO, 0},
+	[OM_AUDIO_RX_DISCARD]  = {"baresip_audio_rx_discarded", "counter",
+				  "Discarded incoming audio packets",
+				  OM_SRC_AUDIO, 0},
+	[OM_AUDIO_RX_LATENCY]  = {"baresip_audio_rx_latency_seconds",
+				  "gauge", "Audio playout buffer latency",
+				  OM_SRC_AUDIO, 1000},
+	[OM_AUDIO_RX_JITTER]   = {"baresip_audio_rx_jitter_seconds",
+				  "gauge", "Audio playout push jitter",
+				  OM_SRC_AUDIO, 1000000},
+};
+
+
+static void destructor(void *arg)
+{
+	struct openmetrics *om = arg;
+
+	mem_deref(om->samplev);
+}
+
+
+static int sample_grow(struct openmetrics *om, size_t n)
+{
+	struct openmetrics_sample *v;
+	size_t sz;
+
+	if (n <= om->samplesz)
+		return 0;
+
+	sz = om->samplesz ? om->samplesz : SAMPLE_MIN;
+	while (sz < n)
+		sz *= 2;
+
+	if (om->samplev)
+		v = mem_reallocarray(om->samplev, sz, sizeof(*v), NULL);
+	else
+		v = mem_zalloc(sz * sizeof(*v), NULL);
+
+	if (!v)
+		return ENOMEM;
+
+	om->samplev  = v;
+	om->samplesz = sz;
+
+	return 0;
+}
+
+
+static void sample_read(struct openmetrics_sample *s, struct call *call,
+			const struct stream *strm)
+{
+	const struct rtcp_stats *rtcp;
+	struct jbuf_stat jstat;
+	struct audio_stat astat;
+	struct audio *au;
+
+	s->callid = call_id(call);
+	s->media  = stream_name(strm);
+	s->src    = OM_SRC_STREAM;
+
+	s->v[OM_TX_PACKETS] = stream_metric_get_tx_n_packets(strm);
+	s->v[OM_TX_BYTES]   = stream_metric_get_tx_n_bytes(strm);
+	s->v[OM_TX_ERRORS]  = stream_metric_get_tx_n_err(strm);
+	s->v[OM_TX_BITRATE] = stream_metric_get_tx_bitrate(strm);
+	s->v[OM_RX_PACKETS] = stream_metric_get_rx_n_packets(strm);
+	s->v[OM_RX_BYTES]   = stream_metric_get_rx_n_bytes(strm);
+	s->v[OM_RX_ERRORS]  = stream_metric_get_rx_n_err(strm);
+	s->v[OM_RX_BITRATE] = stream_metric_get_rx_bitrate(strm);
+
+	rtcp = stream_rtcp_stats(strm);
+	if (rtcp && (rtcp->tx.sent || rtcp->rx.sent)) {
+		s->v[OM_RTCP_TX_LOST]   = rtcp->tx.lost;
+		s->v[OM_RTCP_RX_LOST]   = rtcp->rx.lost;
+		s->v[OM_RTCP_TX_JITTER] = rtcp->tx.jit;
+		s->v[OM_RTCP_RX_JITTER] = rtcp->rx.jit;
+		s->v[OM_RTCP_RTT]       = rtcp->rtt;
+		s->src |= OM_SRC_RTCP;
+	}
+
+	if (0 == stream_jbuf_stats(strm, &jstat)) {
+		s->v[OM_JBUF_PUT]       = jstat.n_put;
+		s->v[OM_JBUF_GET]       = jstat.n_get;
+		s->v[OM_JBUF_OOS]       = jstat.n_oos;
+		s->v[OM_JBUF_DUPS]      = jstat.n_dups;
+		s->v[OM_JBUF_LATE]      = jstat.n_late;
+		s->v[OM_JBUF_LOST]      = jstat.n_lost;
+		s->v[OM_JBUF_OVERFLOW]  = jstat.n_overflow;
+		s->v[OM_JBUF_UNDERFLOW] = jstat.n_underflow;
+		s->v[OM_JBUF_FLUSH]     = jstat.n_flush;
+		s->src |= OM_SRC_JBUF;
+	}
+
+	au = call_audio(call);
+	if (au && audio_strm(au) == strm && 0 == audio_stats(au, &astat)) {
+		s->v[OM_AUDIO_TX_OVERRUN]  = astat.tx_overrun;
+		s->v[OM_AUDIO_TX_UNDERRUN] = astat.tx_underrun;
+		s->v[OM_AUDIO_RX_DISCARD]  = astat.rx_discard;
+		s->v[OM_AUDIO_RX_LATENCY]  = astat.rx_latency;
+		s->v[OM_AUDIO_RX_JITTER]   = astat.rx_jitter;
+		s->src |= OM_SRC_AUDIO;
+	}
+}
+
+
+static int collect(struct openmetrics *om, size_t *samplec,
+		   uint32_t *callc, uint32_t *estabc)
+{
+	size_t n = 0;
+	struct le *leu, *lec, *les;
+	int err;
+
+	*callc  = 0;
+	*estabc = 0;
+
+	LIST_FOREACH(uag_list(), leu) {
+		struct ua *ua = leu->data;
+
+		LIST_FOREACH(ua_calls(ua), lec) {
+			struct call *call = lec->data;
+
+			++*callc;
+			if (call_state(call) == CALL_STATE_ESTABLISHED)
+				++*estabc;
+
+			err = sample_grow(om,
+					  n + list_count(call_streaml(call)));
+			if (err)
+				return err;
+
+			LIST_FOREACH(call_streaml(call), les) {
+				sample_read(&om->samplev[n++], call,
+					    les->data);
+			}
+		}
+	}
+
+	*samplec = n;
+
+	return 0;
+}
+
+
+static int label_print(struct re_printf *pf, const char *str)
+{
+	int err = 0;
+
+	for (; str && *str && !err; str++) {
+
+		switch (*str) {
+
+		case '\\':
+			err = pf->vph("\\\\", 2, pf->arg);
+			break;
+
+		case '"':
+			err = pf->vph("\\\"", 2, pf->arg);
+			break;
+
+		case '\n':
+			err = pf->vph("\\n", 2, pf->arg);
+			break;
+
+		default:
+			err = pf->vph(str, 1, pf->arg);
+			break;
+		}
+	}
+
+	return err;
+}
+
+
+static int family_print(struct mbuf *mb, enum openmetrics_id id,
+			const struct openmetrics_sample *samplev,
+			size_t samplec)
+{
+	const struct family *f = &familyv[id];
+	const char *suffix = 0 == str_cmp(f->type, "counter") ? "_total" : "";
+	int err;
+
+	err = mbuf_printf(mb, "# TYPE %s %s\n"
+			  "# HELP %s %s\n",
+			  f->name, f->type, f->name, f->help);
+
+	for (size_t i = 0; i < samplec && !err; i++) {
+		const struct openmetrics_sample *s = &samplev[i];
+
+		if (!(s->src & f->src))
+			continue;
+
+		err = mbuf_printf(mb, "%s%s{call=\"%H\",media=\"%s\"} ",
+				  f->name, suffix, label_print, s->callid,
+				  s->media);
+
+		if (f->div)
+			err |= mbuf_printf(mb, "%.6f\n",
+					   (double)s->v[id] / f->div);
+		else
+			err |= mbuf_printf(mb, "%lld\n", s->v[id]);
+	}
+
+	return err;
+}
+
+
+/**
+ * Print media statistics samples as OpenMetrics
+ *
+ * @param mb      Buffer to print into, at the current position
+ * @param samplev Samples, one per media stream
+ * @param samplec Number of samples
+ * @param callc   Number of calls
+ * @param estabc  Number of established calls
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int openmetrics_print(struct mbuf *mb,
+		      const struct openmetrics_sample *samplev,
+		      size_t samplec, uint32_t callc, uint32_t estabc)
+{
+	int err;
+
+	if (!mb || (samplec && !samplev))
+		return EINVAL;
+
+	err = mbuf_printf(mb,
+			  "# TYPE baresip_calls gauge\n"
+			  "# HELP baresip_calls Number of calls\n"
+			  "baresip_calls %u\n"
+			  "# TYPE baresip_calls_established gauge\n"
+			  "# HELP baresip_calls_established"
+			  " Number of established calls\n"
+			  "baresip_calls_established %u\n"
+			  "# TYPE baresip_streams gauge\n"
+			  "# HELP baresip_streams Number of media streams\n"
+			  "baresip_streams %zu\n",
+			  callc, estabc, samplec);
+
+	for (int id = 0; id < OM_MAX && !err; id++)
+		err = family_print(mb, id, samplev, samplec);
+
+	err |= mbuf_write_str(mb, "# EOF\n");
+
+	return err;
+}
+
+
+/**
+ * Allocate an OpenMetrics encoder
+ *
+ * @param omp Pointer to allocated encoder
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int openmetrics_alloc(struct openmetrics **omp)
+{
+	struct openmetrics *om;
+
+	if (!omp)
+		return EINVAL;
+
+	om = mem_zalloc(sizeof(*om), destructor);
+	if (!om)
+		return ENOMEM;
+
+	*omp = om;
+
+	return 0;
+}
+
+
+/**
+ * Encode the statistics of all calls and media streams as OpenMetrics
+ *
+ * @param om OpenMetrics encoder
+ * @param mb Buffer to encode into, the content is replaced
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int openmetrics_encode(struct openmetrics *om, struct mbuf *mb)
+{
+	uint32_t callc, estabc;
+	size_t samplec = 0;
+	int err;
+
+	if (!om || !mb)
+		return EINVAL;
+
+	mbuf_rewind(mb);
+
+	err = collect(om, &samplec, &callc, &estabc);
+	if (err)
+		return err;
+
+	return openmetrics_print(mb, om->samplev, samplec, callc, estabc);
+}
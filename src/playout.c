@@ -0,0 +1,449 @@
+/**
+ * @file src/playout.c  Timestamp-aware adaptive audio playout
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * Adaptive playout with time-stretching
+ *
+ * The transit time of every decoded frame (arrival time minus RTP
+ * timestamp) is measured relative to the fastest frame seen in the last
+ * two windows. A histogram of these relative delays gives the jitter
+ * percentile, which plus one packet time is the target latency of the
+ * audio buffer.
+ *
+ * The buffer converges towards the target by WSOLA-style time-stretching
+ * of single frames: one pitch period is removed (accelerate) or repeated
+ * (decelerate) with a cross-fade, instead of dropping or inserting whole
+ * frames.
+ *
+ \verbatim
+
+	accelerate:  |  T  |  T  | rest |  ->  | xfade | rest |
+
+	decelerate:  |  T  |  T  | rest |  ->  |  T  | xfade |  T  | rest |
+
+ \endverbatim
+ */
+
+
+enum {
+	WINDOW      = 250,   /**< Frames per delay window               */
+	HIST_MAX    = 1000,  /**< Histogram size [ms]                   */
+	PERCENTILE  = 95,    /**< Jitter percentile for target latency  */
+	PITCH_MIN   = 2500,  /**< Shortest pitch period [us]            */
+	PITCH_MAX   = 12500, /**< Longest pitch period [us]             */
+	HYSTERESIS  = 5,     /**< Minimum deviation from target [ms]    */
+	RESET_DELAY = 2000,  /**< Transit jump which resets stats [ms]  */
+	LEVEL_EMA   = 8,     /**< Buffer level EMA coefficient          */
+	MIN_DELAYS  = 50,    /**< Delays measured before adapting       */
+};
+
+#define CORR_MIN      0.9   /* Min. correlation for voiced signals */
+#define SILENCE_RMS   100.0 /* RMS threshold for silence (S16)     */
+
+
+struct playout {
+	struct range buffer;          /**< Buffer limits [ms]                */
+	uint32_t ptime;               /**< Packet time [ms]                  */
+
+	int64_t base;                 /**< Min. transit time [us]            */
+	int64_t min_cur;              /**< Min. transit current window       */
+	int64_t min_prev;             /**< Min. transit previous window      */
+	uint32_t nwin;                /**< Frames in current window          */
+	bool started;                 /**< First frame seen                  */
+
+	uint16_t delayv[WINDOW];      /**< Relative delays [ms], ring buffer */
+	uint32_t delayc;              /**< Number of valid delays            */
+	uint32_t delayi;              /**< Next write position               */
+	uint16_t hist[HIST_MAX];      /**< Histogram of delayv               */
+
+	uint32_t target;              /**< Target latency [ms]               */
+	int32_t level;                /**< Smoothed buffer level [ms * 16]   */
+
+	void *buf;                    /**< Output buffer                     */
+	size_t bufsz;                 /**< Output buffer size [bytes]        */
+
+	struct playout_stat stat;
+};
+
+
+static void destructor(void *arg)
+{
+	struct playout *po = arg;
+
+	mem_deref(po->buf);
+}
+
+
+/**
+ * Allocate a playout controller
+ *
+ * @param pop    Pointer to allocated playout controller
+ * @param buffer Audio buffer limits [ms]
+ * @param ptime  Packet time [ms]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int playout_alloc(struct playout **pop, const struct range *buffer,
+		  uint32_t ptime)
+{
+	struct playout *po;
+
+	if (!pop || !buffer || !ptime)
+		return EINVAL;
+
+	po = mem_zalloc(sizeof(*po), destructor);
+	if (!po)
+		return ENOMEM;
+
+	po->buffer = *buffer;
+	po->ptime  = ptime;
+	po->target = buffer->min;
+
+	*pop = po;
+
+	return 0;
+}
+
+
+static void hist_reset(struct playout *po)
+{
+	memset(po->hist, 0, sizeof(po->hist));
+	po->delayc = 0;
+	po->delayi = 0;
+	po->nwin   = 0;
+	po->started = false;
+}
+
+
+static void hist_add(struct playout *po, uint32_t d)
+{
+	if (d >= HIST_MAX)
+		d = HIST_MAX - 1;
+
+	if (po->delayc == WINDOW)
+		--po->hist[po->delayv[po->delayi]];
+	else
+		++po->delayc;
+
+	po->delayv[po->delayi] = (uint16_t)d;
+	++po->hist[d];
+
+	po->delayi = (po->delayi + 1) % WINDOW;
+}
+
+
+static uint32_t hist_percentile(const struct playout *po, uint32_t pct)
+{
+	uint32_t n = 0;
+	uint32_t lim = (po->delayc * pct + 99) / 100;
+
+	for (uint32_t i = 0; i < HIST_MAX; i++) {
+		n += po->hist[i];
+		if (n >= lim)
+			return i;
+	}
+
+	return HIST_MAX - 1;
+}
+
+
+static void update_delay(struct playout *po, uint64_t arrival,
+			 uint64_t timestamp)
+{
+	int64_t transit = (int64_t)(arrival - timestamp);
+	int64_t d;
+	uint32_t target;
+
+	if (!po->started) {
+		po->base = po->min_cur = po->min_prev = transit;
+		po->started = true;
+	}
+
+	/* SSRC change, timestamp jump or clock step */
+	if (transit - po->base > RESET_DELAY * 1000LL ||
+	    po->base - transit > RESET_DELAY * 1000LL) {
+		++po->stat.n_reset;
+		hist_reset(po);
+		po->base = po->min_cur = po->min_prev = transit;
+		po->started = true;
+	}
+
+	/* base follows the fastest frame of the last two windows */
+	if (transit < po->min_cur)
+		po->min_cur = transit;
+
+	if (++po->nwin >= WINDOW) {
+		po->min_prev = po->min_cur;
+		po->min_cur  = transit;
+		po->nwin     = 0;
+	}
+
+	po->base = min(po->min_cur, po->min_prev);
+
+	d = (transit - po->base) / 1000;
+	hist_add(po, (uint32_t)max(d, 0));
+
+	po->stat.jitter = hist_percentile(po, PERCENTILE);
+
+	target = po->stat.jitter + po->ptime;
+	po->target = min(max(target, po->buffer.min), po->buffer.max);
+}
+
+
+static float sample_get(const void *sampv, enum aufmt fmt, size_t i)
+{
+	if (fmt == AUFMT_FLOAT)
+		return ((const float *)sampv)[i] * 32768.0f;
+	else
+		return ((const int16_t *)sampv)[i];
+}
+
+
+static void sample_set(void *sampv, enum aufmt fmt, size_t i, float v)
+{
+	if (fmt == AUFMT_FLOAT) {
+		((float *)sampv)[i] = v / 32768.0f;
+	}
+	else {
+		if (v > 32767.0f)
+			v = 32767.0f;
+		else if (v < -32768.0f)
+			v = -32768.0f;
+
+		((int16_t *)sampv)[i] = (int16_t)(v < 0 ? v - 0.5f : v + 0.5f);
+	}
+}
+
+
+/*
+ * Find the pitch period with best normalized correlation (channel 0).
+ * Squared values are used to avoid sqrt() on the audio path.
+ */
+static size_t find_period(const struct auframe *af, size_t tmin, size_t tmax,
+			  double *corr2p, double *pow_p)
+{
+	const size_t n = af->sampc / af->ch;
+	size_t best = 0;
+	double best_corr = -1.0;
+	double energy = 0.0;
+
+	for (size_t i = 0; i < n; i++) {
+		float v = sample_get(af->sampv, af->fmt, i * af->ch);
+		energy += (double)v * v;
+	}
+
+	for (size_t t = tmin; t <= tmax && 2 * t <= n; t++) {
+		double xy = 0.0, xx = 0.0, yy = 0.0, c;
+
+		for (size_t i = 0; i < t; i++) {
+			float x = sample_get(af->sampv, af->fmt, i * af->ch);
+			float y = sample_get(af->sampv, af->fmt,
+					     (i + t) * af->ch);
+			xy += (double)x * y;
+			xx += (double)x * x;
+			yy += (double)y * y;
+		}
+
+		/* squared correlation with the sign of xy */
+		if (xx > 0.0 && yy > 0.0)
+			c = xy * (xy < 0 ? -xy : xy) / (xx * yy);
+		else
+			c = 0.0;
+
+		if (c > best_corr) {
+			best_corr = c;
+			best = t;
+		}
+	}
+
+	*corr2p = best_corr;
+	*pow_p  = n ? energy / n : 0.0;
+
+	return best;
+}
+
+
+/* Cross-fade from segment a to segment b, both T samples per channel */
+static void crossfade(void *dst, size_t dpos, const struct auframe *af,
+		      size_t apos, size_t bpos, size_t t)
+{
+	for (size_t i = 0; i < t; i++) {
+		float w = (float)(i + 1) / (float)(t + 1);
+
+		for (size_t c = 0; c < af->ch; c++) {
+			float a = sample_get(af->sampv, af->fmt,
+					     (apos + i) * af->ch + c);
+			float b = sample_get(af->sampv, af->fmt,
+					     (bpos + i) * af->ch + c);
+
+			sample_set(dst, af->fmt, (dpos + i) * af->ch + c,
+				   a * (1.0f - w) + b * w);
+		}
+	}
+}
+
+
+static int stretch(struct playout *po, struct auframe *af, bool accel)
+{
+	const size_t ssz = aufmt_sample_size(af->fmt);
+	const size_t n = af->sampc / af->ch;
+	const size_t fsz = ssz * af->ch;
+	size_t tmin, tmax, t, outn;
+	double corr2, power;
+	uint8_t *out;
+
+	tmin = (size_t)af->srate * PITCH_MIN / 1000000;
+	tmax = (size_t)af->srate * PITCH_MAX / 1000000;
+	if (2 * tmin > n)
+		return ENOENT;
+
+	t = find_period(af, tmin, tmax, &corr2, &power);
+	if (!t)
+		return ENOENT;
+
+	/* only stretch voiced or silent segments */
+	if (corr2 < CORR_MIN * CORR_MIN && power > SILENCE_RMS * SILENCE_RMS)
+		return ENOENT;
+
+	outn = accel ? n - t : n + t;
+
+	if (po->bufsz < outn * fsz) {
+		void *buf = mem_realloc(po->buf, (n + tmax) * fsz);
+		if (!buf)
+			return ENOMEM;
+
+		po->buf   = buf;
+		po->bufsz = (n + tmax) * fsz;
+	}
+
+	out = po->buf;
+
+	if (accel) {
+		crossfade(out, 0, af, 0, t, t);
+		memcpy(out + t * fsz, (uint8_t *)af->sampv + 2 * t * fsz,
+		       (n - 2 * t) * fsz);
+
+		++po->stat.n_accel;
+		po->stat.samp_removed += t;
+	}
+	else {
+		memcpy(out, af->sampv, t * fsz);
+		crossfade(out, t, af, t, 0, t);
+		memcpy(out + 2 * t * fsz, (uint8_t *)af->sampv + t * fsz,
+		       (n - t) * fsz);
+
+		++po->stat.n_decel;
+		po->stat.samp_inserted += t;
+	}
+
+	af->sampv = out;
+	af->sampc = outn * af->ch;
+
+	return 0;
+}
+
+
+/**
+ * Process a decoded audio frame before it is written to the audio buffer
+ *
+ * The frame may be replaced with a time-stretched version, which is
+ * valid until the next call.
+ *
+ * @param po      Playout controller
+ * @param af      Audio frame (in/out)
+ * @param arrival Arrival time [us]
+ * @param cur     Current audio buffer level [ms]
+ */
+void playout_process(struct playout *po, struct auframe *af,
+		     uint64_t arrival, uint32_t cur)
+{
+	int32_t level, d;
+	uint32_t hyst;
+	size_t n;
+	bool accel;
+
+	if (!po || !af || !af->sampc || !af->ch)
+		return;
+
+	if (af->fmt != AUFMT_S16LE && af->fmt != AUFMT_FLOAT)
+		return;
+
+	update_delay(po, arrival, af->timestamp);
+
+	if (!po->level)
+		po->level = (int32_t)cur * 16;
+	else
+		po->level += ((int32_t)cur * 16 - po->level) / LEVEL_EMA;
+
+	level = po->level / 16;
+	hyst  = max(HYSTERESIS, po->ptime / 2);
+	po->stat.target = po->target;
+	po->stat.level  = (uint32_t)max(level, 0);
+
+	if (po->delayc < MIN_DELAYS)
+		return;
+
+	if (level > (int32_t)(po->target + hyst))
+		accel = true;
+	else if (level + (int32_t)hyst < (int32_t)po->target)
+		accel = false;
+	else
+		return;
+
+	n = af->sampc;
+	if (stretch(po, af, accel))
+		return;
+
+	/* account for the stretch, to avoid acting on stale levels */
+	d = ((int32_t)af->sampc - (int32_t)n) / af->ch;
+	po->level += d * 16 * 1000 / (int32_t)af->srate;
+}
+
+
+/**
+ * Get playout statistics
+ *
+ * @param po Playout controller
+ *
+ * @return Playout statistics, NULL if not set
+ */
+const struct playout_stat *playout_stat(const struct playout *po)
+{
+	return po ? &po->stat : NULL;
+}
+
+
+void playout_reset(struct playout *po)
+{
+	if (!po)
+		return;
+
+	hist_reset(po);
+	po->level = 0;
+	po->target = po->buffer.min;
+}
+
+
+int playout_debug(struct re_printf *pf, const struct playout *po)
+{
+	if (!po)
+		return 0;
+
+	return re_hprintf(pf, "target %ums, level %ums, jitter p%u %ums,"
+			  " accel %llu (-%llu), decel %llu (+%llu),"
+			  " reset %llu",
+			  po->stat.target, po->stat.level, PERCENTILE,
+			  po->stat.jitter,
+			  po->stat.n_accel, po->stat.samp_removed,
+			  po->stat.n_decel, po->stat.samp_inserted,
+			  po->stat.n_reset);
+}
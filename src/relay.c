@@ -0,0 +1,377 @@
+/**
+ * @file src/relay.c  RTP-to-RTP relay between two media streams
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * RTP relay
+ *
+ * Forwards RTP packets from the receiver of one stream directly to the
+ * sender of another stream, without jitter buffer, decoding or encoding.
+ * The payload is not touched and the payload type is mapped by codec
+ * name.
+ *
+ * The relayed packets are sent with an SSRC of their own, which is
+ * registered on the destination stream for RTCP sender reports. The
+ * sequence number and timestamp are the incoming ones plus a fixed
+ * offset, so upstream loss and reordering stay visible and a
+ * retransmitted packet keeps its sequence number. The offsets are only
+ * changed when the incoming SSRC changes, the outgoing sequence number
+ * and timestamp continue from the last packet then.
+ *
+ * RTCP feedback (PLI, FIR and Generic NACK) received on the destination
+ * stream is passed back to the source, with NACK sequence numbers mapped
+ * back by the offset.
+ *
+ \verbatim
+
+   src stream                                         dst stream
+   .----------.                                      .----------.
+   |  rtprecv |---- RTP ----> relay ---- RTP ------->|  sender  |
+   |          |<--- PLI/FIR/NACK ---- <---- RTCP ----|          |
+   '----------'                                      '----------'
+
+ \endverbatim
+ */
+
+
+struct stream_relay {
+	struct stream *src;           /**< Source stream (receiver)          */
+	struct stream *dst;           /**< Destination stream (sender)       */
+	mtx_t *mtx;                   /**< Protects all fields below         */
+
+	uint32_t ssrc_in;             /**< Incoming SSRC                     */
+	uint32_t ssrc_out;            /**< Outgoing SSRC                     */
+	bool started;                 /**< First packet forwarded            */
+	uint16_t seq_delta;           /**< Outgoing minus incoming seq       */
+	uint32_t ts_delta;            /**< Outgoing minus incoming timestamp */
+	uint16_t seq_last;            /**< Highest outgoing seq              */
+	uint32_t ts_last;             /**< Last outgoing timestamp           */
+	uint64_t jfs_last;            /**< Time of last packet [ms]          */
+
+	int pt_in;                    /**< Incoming payload type             */
+	int pt_out;                   /**< Outgoing payload type or -1       */
+	uint32_t srate;               /**< Clock rate of current format      */
+
+	struct {
+		uint64_t n_fwd;       /**< Forwarded packets                 */
+		uint64_t n_drop;      /**< Dropped packets                   */
+		uint64_t n_fb;        /**< Forwarded RTCP feedback           */
+	} stats;
+};
+
+
+static void destructor(void *arg)
+{
+	struct stream_relay *relay = arg;
+
+	mem_deref(relay->mtx);
+}
+
+
+/**
+ * Allocate an RTP relay
+ *
+ * @param relayp Pointer to allocated relay
+ * @param src    Source stream
+ * @param dst    Destination stream
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int relay_alloc(struct stream_relay **relayp, struct stream *src,
+		struct stream *dst)
+{
+	struct stream_relay *relay;
+	int err;
+
+	if (!relayp || !src || !dst || src == dst)
+		return EINVAL;
+
+	if (stream_type(src) != stream_type(dst))
+		return EINVAL;
+
+	relay = mem_zalloc(sizeof(*relay), destructor);
+	if (!relay)
+		return ENOMEM;
+
+	relay->src      = src;
+	relay->dst      = dst;
+	relay->ssrc_out = rand_u32();
+	relay->pt_in    = -1;
+	relay->pt_out   = -1;
+
+	err = mutex_alloc(&relay->mtx);
+	if (err)
+		mem_deref(relay);
+	else
+		*relayp = relay;
+
+	return err;
+}
+
+
+/**
+ * Detach the relay from its streams
+ *
+ * Packets that are in flight on another thread are dropped
+ *
+ * @param relay RTP relay
+ */
+void relay_close(struct stream_relay *relay)
+{
+	if (!relay)
+		return;
+
+	mtx_lock(relay->mtx);
+	relay->src = NULL;
+	relay->dst = NULL;
+	mtx_unlock(relay->mtx);
+}
+
+
+struct stream *relay_src(const struct stream_relay *relay)
+{
+	return relay ? relay->src : NULL;
+}
+
+
+struct stream *relay_dst(const struct stream_relay *relay)
+{
+	return relay ? relay->dst : NULL;
+}
+
+
+uint32_t relay_ssrc(const struct stream_relay *relay)
+{
+	return relay ? relay->ssrc_out : 0;
+}
+
+
+/* Find the payload type of the same format in the destination stream */
+static int map_pt(struct stream_relay *relay, uint8_t pt)
+{
+	const struct sdp_format *lc, *rc;
+
+	relay->pt_in  = pt;
+	relay->pt_out = -1;
+
+	lc = sdp_media_lformat(stream_sdpmedia(relay->src), pt);
+	if (!lc) {
+		warning("relay: unknown incoming payload type %u\n", pt);
+		return ENOENT;
+	}
+
+	rc = sdp_media_rformat(stream_sdpmedia(relay->dst), lc->name);
+	if (!rc || rc->srate != lc->srate || rc->ch != lc->ch) {
+		warning("relay: %s/%u/%u not supported by %s peer\n",
+			lc->name, lc->srate, lc->ch,
+			stream_name(relay->dst));
+		return ENOTSUP;
+	}
+
+	debug("relay: %s: payload type %u -> %d (%s)\n",
+	      stream_name(relay->dst), pt, rc->pt, rc->name);
+
+	relay->pt_out = rc->pt;
+	relay->srate  = rc->srate;
+
+	return 0;
+}
+
+
+static void map_start(struct stream_relay *relay,
+		      const struct rtp_header *hdr, uint64_t now)
+{
+	if (!relay->started) {
+		relay->seq_delta = rand_u16() - hdr->seq;
+		relay->ts_delta  = rand_u32() - hdr->ts;
+		relay->started   = true;
+	}
+	else {
+		/* continue from the last packet plus the elapsed time */
+		const uint32_t ts = relay->ts_last + (uint32_t)
+			((now - relay->jfs_last) * relay->srate / 1000);
+
+		relay->seq_delta = (uint16_t)(relay->seq_last + 1) - hdr->seq;
+		relay->ts_delta  = ts - hdr->ts;
+	}
+
+	relay->ssrc_in  = hdr->ssrc;
+	relay->seq_last = hdr->seq + relay->seq_delta - 1;
+}
+
+
+/**
+ * Forward one incoming RTP packet
+ *
+ * @note This function may be called from the RX thread
+ *
+ * @param relay RTP relay
+ * @param hdr   RTP header of incoming packet
+ * @param mb    RTP payload, with the RTP header in the headroom
+ */
+void relay_forward(struct stream_relay *relay, const struct rtp_header *hdr,
+		   struct mbuf *mb)
+{
+	const uint64_t now = tmr_jiffies();
+	struct rtp_header ohdr;
+	size_t pos;
+	int err;
+
+	if (!relay || !hdr || !mb)
+		return;
+
+	mtx_lock(relay->mtx);
+
+	if (!relay->dst)
+		goto drop;
+
+	if (hdr->pt != relay->pt_in && map_pt(relay, hdr->pt))
+		goto drop;
+
+	if (relay->pt_out < 0)
+		goto drop;
+
+	if (!relay->started || hdr->ssrc != relay->ssrc_in)
+		map_start(relay, hdr, now);
+
+	memset(&ohdr, 0, sizeof(ohdr));
+	ohdr.ver  = RTP_VERSION;
+	ohdr.m    = hdr->m;
+	ohdr.pt   = relay->pt_out;
+	ohdr.seq  = hdr->seq + relay->seq_delta;
+	ohdr.ts   = hdr->ts + relay->ts_delta;
+	ohdr.ssrc = relay->ssrc_out;
+
+	pos = mb->pos;
+	err = stream_relay_send(relay->dst, &ohdr, mb);
+	mb->pos = pos;
+	if (err)
+		goto drop;
+
+	if ((int16_t)(ohdr.seq - relay->seq_last) > 0) {
+		relay->seq_last = ohdr.seq;
+		relay->ts_last  = ohdr.ts;
+		relay->jfs_last = now;
+	}
+
+	++relay->stats.n_fwd;
+
+	mtx_unlock(relay->mtx);
+	return;
+
+ drop:
+	++relay->stats.n_drop;
+	mtx_unlock(relay->mtx);
+}
+
+
+/* The outgoing sequence numbers map back by the fixed offset */
+static void forward_nack(struct stream_relay *relay, struct rtp_sock *rtp,
+			 const struct gnack *gnack)
+{
+	(void)rtcp_send_nack(rtp, gnack->pid - relay->seq_delta, gnack->blp);
+}
+
+
+/*
+ * Feedback for the SSRC that the destination stream used before the
+ * relay was started can not be serviced by the source
+ */
+static bool fb_match(const struct stream_relay *relay,
+		     const struct rtcp_msg *msg)
+{
+	const uint32_t ssrc = msg->r.fb.ssrc_media;
+
+	if (ssrc == relay->ssrc_out)
+		return true;
+
+	return ssrc != rtp_sess_ssrc(stream_rtp_sock(relay->dst));
+}
+
+
+/**
+ * Pass RTCP feedback from the destination peer back to the source peer
+ *
+ * @param relay RTP relay
+ * @param msg   RTCP message received on the destination stream
+ */
+void relay_feedback(struct stream_relay *relay, const struct rtcp_msg *msg)
+{
+	struct rtp_sock *rtp;
+
+	if (!relay || !msg)
+		return;
+
+	mtx_lock(relay->mtx);
+
+	if (!relay->src || !relay->started)
+		goto out;
+
+	rtp = stream_rtp_sock(relay->src);
+
+	switch (msg->hdr.pt) {
+
+	case RTCP_FIR:
+		(void)rtcp_send_fir(rtp, rtp_sess_ssrc(rtp));
+		++relay->stats.n_fb;
+		break;
+
+	case RTCP_PSFB:
+		if (!fb_match(relay, msg))
+			break;
+
+		if (msg->hdr.count == RTCP_PSFB_PLI) {
+			(void)rtcp_send_pli(rtp, relay->ssrc_in);
+			++relay->stats.n_fb;
+		}
+		break;
+
+	case RTCP_RTPFB:
+		if (!fb_match(relay, msg))
+			break;
+
+		if (msg->hdr.count != RTCP_RTPFB_GNACK ||
+		    !msg->r.fb.fci.gnackv)
+			break;
+
+		for (uint32_t i = 0; i < msg->r.fb.n; i++)
+			forward_nack(relay, rtp, &msg->r.fb.fci.gnackv[i]);
+
+		++relay->stats.n_fb;
+		break;
+
+	default:
+		break;
+	}
+
+ out:
+	mtx_unlock(relay->mtx);
+}
+
+
+int relay_debug(struct re_printf *pf, const struct stream_relay *relay)
+{
+	int err;
+
+	if (!relay)
+		return 0;
+
+	mtx_lock(relay->mtx);
+	err = re_hprintf(pf, " relay: %s -> %s ssrc=%08x pt=%d/%d"
+			 " fwd=%llu drop=%llu feedback=%llu\n",
+			 relay->src ? stream_peer(relay->src) : "?",
+			 relay->dst ? stream_peer(relay->dst) : "?",
+			 relay->ssrc_out, relay->pt_in, relay->pt_out,
+			 relay->stats.n_fwd, relay->stats.n_drop,
+			 relay->stats.n_fb);
+	mtx_unlock(relay->mtx);
+
+	return err;
+}
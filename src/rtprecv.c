@@ -19,22 +19,49 @@ struct rtp_receiver {
 #ifndef RELEASE
 	uint32_t magic;                /**< Magic number for debugging       */
 #endif
-	/* Data protected by mtx */
-	char *name;                    /**< Media name                       */
-	struct metric *metric;         /**< Metrics for receiving            */
-	struct jbuf *jbuf;             /**< Jitter Buffer for incoming RTP   */
-	bool enabled;                  /**< True if enabled                  */
-	uint64_t ts_last;              /**< Timestamp of last recv RTP pkt   */
-	uint32_t ssrc;                 /**< Incoming synchronization source  */
-	bool ssrc_set;                 /**< Incoming SSRC is set             */
+	/* Data written only by the RX thread */
 	uint32_t pseq;                 /**< Sequence number for incoming RTP */
 	bool pseq_set;                 /**< True if sequence number is set   */
 	bool rtp_estab;                /**< True if RTP stream established   */
+	struct stream_relay *relay;    /**< RTP relay, bypasses decoding     */
+	struct twcc_recv *twcc;        /**< Transport-wide CC feedback       */
+	uint8_t extid_twcc;            /**< Transport-wide seq extension ID  */
+	struct fec_dec *fec;           /**< FEC decoder (optional)           */
+	int fec_pt;                    /**< Payload type for FEC             */
+	int red_pt;                    /**< Payload type for redundant audio */
+	uint16_t red_seq;              /**< Seq. of the last RED packet      */
+	uint32_t red_ts;               /**< Timestamp of the last RED packet */
+	uint32_t red_ival;             /**< Timestamps per RED packet        */
+	uint16_t seq_hi;               /**< Highest received sequence number */
+	unsigned gen;                  /**< Applied configuration generation */
+
+	/* Atomic data, also read by other threads */
+	RE_ATOMIC bool enabled;        /**< True if enabled                  */
+	RE_ATOMIC uint64_t ts_last;    /**< Timestamp of last recv RTP pkt   */
+	RE_ATOMIC uint32_t ssrc;       /**< Incoming synchronization source  */
+	RE_ATOMIC bool ssrc_set;       /**< Incoming SSRC is set             */
+	RE_ATOMIC uint32_t ssrc_fec;   /**< SSRC of the FEC stream, or 0     */
 	RE_ATOMIC bool run;            /**< True if RX thread is running     */
+	RE_ATOMIC unsigned pubgen;     /**< Published configuration gen.     */
+
+	/* Data protected by mtx */
+	char *name;                    /**< Media name                       */
+	struct metric *metric;         /**< Metrics for receiving            */
+	struct jbuf *jbuf;             /**< Jitter Buffer for incoming RTP   */
 	bool start_rtcp;               /**< Start RTCP flag                  */
 	char *cname;                   /**< Canonical Name for RTCP send     */
 	struct sa rtcp_peer;           /**< RTCP address of Peer             */
 	bool pinhole;                  /**< Open RTCP NAT pinhole flag       */
+
+	/* Control plane, taken over in rtprecv_sync() */
+	struct {
+		struct stream_relay *relay;  /**< RTP relay                  */
+		struct twcc_recv *twcc;      /**< Transport-wide CC feedback */
+		uint8_t extid_twcc;          /**< Transport-wide seq ext. ID */
+		int fec_pt;                  /**< Payload type for FEC       */
+		int red_pt;                  /**< Payload type for RED       */
+		unsigned gen;                /**< Configuration generation   */
+	} ctl;
 	mtx_t *mtx;                    /**< Mutex protects above fields      */
 
 	/* Unprotected data */
@@ -227,6 +254,13 @@ static int rtprecv_thread(void *arg)
 }
 
 
+/** Is x less than y? */
+static inline bool seq_less(uint16_t x, uint16_t y)
+{
+	return ((int16_t)(x - y)) < 0;
+}
+
+
 static int lostcalc(struct rtp_receiver *rx, uint16_t seq)
 {
 	const uint16_t delta = seq - rx->pseq;
@@ -369,49 +403,58 @@ static bool rtprecv_filter_pt(struct rtp_receiver *rx,
 }
 
 
-void rtprecv_decode(const struct sa *src, const struct rtp_header *hdr,
-		     struct mbuf *mb, void *arg)
+/* Publish a control plane update to the RX thread, called with mtx held */
+static void rtprecv_publish(struct rtp_receiver *rx)
 {
-	struct rtp_receiver *rx = arg;
-	uint32_t ssrc0;
-	bool flush = false;
-	bool first = false;
-	int err = 0;
+	re_atomic_rls_set(&rx->pubgen, ++rx->ctl.gen);
+}
 
-	if (!rx)
+
+/*
+ * Take over the control plane, if it was changed since the last packet.
+ * The RX thread holds its own references, so the mutex is only taken
+ * after a change.
+ */
+static void rtprecv_sync(struct rtp_receiver *rx)
+{
+	if (re_atomic_acq(&rx->pubgen) == rx->gen)
 		return;
 
-	MAGIC_CHECK(rx);
 	mtx_lock(rx->mtx);
-	if (!rx->enabled) {
-		mtx_unlock(rx->mtx);
-		return;
-	}
 
-	if (rtp_pt_is_rtcp(hdr->pt)) {
-		debug("stream: drop incoming RTCP packet on RTP port"
-		     " (pt=%u)\n", hdr->pt);
-		mtx_unlock(rx->mtx);
-		return;
-	}
+	mem_deref(rx->relay);
+	mem_deref(rx->twcc);
 
-	rx->ts_last = tmr_jiffies();
+	rx->relay      = mem_ref(rx->ctl.relay);
+	rx->twcc       = mem_ref(rx->ctl.twcc);
+	rx->extid_twcc = rx->ctl.extid_twcc;
+	rx->fec_pt     = rx->ctl.fec_pt;
+	rx->red_pt     = rx->ctl.red_pt;
+	rx->gen        = rx->ctl.gen;
 
-	metric_add_packet(rx->metric, mbuf_get_left(mb));
+	mtx_unlock(rx->mtx);
 
-	if (!rx->rtp_estab) {
-		if (rx->rtpestabh) {
-			debug("stream: incoming rtp for '%s' established, "
-			      "receiving from %J\n", rx->name, src);
-			rx->rtp_estab = true;
-			pass_rtpestab_work(rx);
-		}
-	}
+	/* the FEC decoder is only used by the RX thread */
+	if (rx->fec_pt < 0)
+		rx->fec = mem_deref(rx->fec);
+	else if (!rx->fec && fec_dec_alloc(&rx->fec))
+		rx->fec_pt = -1;
+}
+
+
+/* Handle a media packet, also a recovered or redundant one */
+static void rtprecv_media(struct rtp_receiver *rx, const struct sa *src,
+			  const struct rtp_header *hdr, struct mbuf *mb)
+{
+	uint32_t ssrc0;
+	bool flush = false;
+	bool first = false;
+	int err = 0;
 
-	ssrc0 = rx->ssrc;
+	ssrc0 = re_atomic_rlx(&rx->ssrc);
 	if (!rx->pseq_set) {
-		rx->ssrc = hdr->ssrc;
-		rx->ssrc_set = true;
+		re_atomic_rlx_set(&rx->ssrc, hdr->ssrc);
+		re_atomic_rls_set(&rx->ssrc_set, true);
 		rx->pseq = hdr->seq - 1;
 		rx->pseq_set = true;
 		first = true;
@@ -423,11 +466,29 @@ void rtprecv_decode(const struct sa *src, const struct rtp_header *hdr,
 		     rx->name, ssrc0, hdr->ssrc,
 		     mbuf_get_left(mb), src);
 
-		rx->ssrc = hdr->ssrc;
+		re_atomic_rlx_set(&rx->ssrc, hdr->ssrc);
 		rx->pseq = hdr->seq - 1;
 		flush = true;
 	}
-	mtx_unlock(rx->mtx);
+
+	if (first || flush || seq_less(rx->seq_hi, hdr->seq))
+		rx->seq_hi = hdr->seq;
+
+	if (rx->twcc) {
+		uint16_t tseq;
+
+		if (!twcc_ext_decode(hdr, mb, rx->extid_twcc, &tseq))
+			twcc_recv_packet(rx->twcc, rx->rtp, hdr->ssrc, tseq,
+					 tmr_jiffies_usec());
+	}
+
+	if (rx->relay) {
+		relay_forward(rx->relay, hdr, mb);
+		return;
+	}
+
+	if (rx->fec)
+		fec_dec_media(rx->fec, hdr, mb);
 
 	if (rtprecv_filter_pt(rx, hdr)) {
 		err = pass_pt_work(rx, hdr->pt, mb);
@@ -465,6 +526,161 @@ void rtprecv_decode(const struct sa *src, const struct rtp_header *hdr,
 }
 
 
+/* RFC 5109 -- recover a lost media packet before the jitter buffer */
+static void rtprecv_fec(struct rtp_receiver *rx, const struct sa *src,
+			const struct rtp_header *fhdr, struct mbuf *mb)
+{
+	const uint32_t ssrc_fec = re_atomic_rlx(&rx->ssrc_fec);
+	struct rtp_header hdr;
+	struct mbuf *rmb;
+
+	if (!rx->pseq_set)
+		return;
+
+	/* RFC 5956 -- the FEC stream signalled in the SDP */
+	if (ssrc_fec && fhdr->ssrc != ssrc_fec)
+		return;
+
+	if (fec_dec_fec(rx->fec, mb, re_atomic_rlx(&rx->ssrc), &hdr, &rmb))
+		return;
+
+	/* too late for the jitter buffer */
+	if (!seq_less(rx->pseq, hdr.seq) && rx->jbuf) {
+		mem_deref(rmb);
+		return;
+	}
+
+	rtprecv_media(rx, src, &hdr, rmb);
+	mem_deref(rmb);
+}
+
+
+/*
+ * RFC 2198 -- the redundant blocks of packets that were not received are
+ * passed on as packets of their own, before the primary block. The
+ * sequence number of a block is counted back from the primary block, so
+ * a block is only used if its timestamp is that many packet intervals
+ * back.
+ */
+static void rtprecv_red(struct rtp_receiver *rx, const struct sa *src,
+			const struct rtp_header *hdr, struct mbuf *mb)
+{
+	struct red_block blkv[RED_MAX + 1];
+	size_t blkc = RE_ARRAY_SIZE(blkv);
+	const struct red_block *prim;
+	struct rtp_header rhdr;
+	int err;
+
+	err = red_decode(blkv, &blkc, hdr->ts, mb);
+	if (err) {
+		metric_inc_err(rx->metric);
+		return;
+	}
+
+	/* packet interval of two consecutive RED packets */
+	if (rx->pseq_set && hdr->seq == (uint16_t)(rx->red_seq + 1))
+		rx->red_ival = hdr->ts - rx->red_ts;
+
+	rx->red_seq = hdr->seq;
+	rx->red_ts  = hdr->ts;
+
+	for (size_t i = 0; rx->pseq_set && i + 1 < blkc; i++) {
+		const uint32_t n = (uint32_t)(blkc - 1 - i);
+		const uint16_t seq = hdr->seq - (uint16_t)n;
+		struct mbuf *rmb;
+
+		if (!seq_less(rx->seq_hi, seq))
+			continue;
+
+		if (!rx->red_ival || hdr->ts - blkv[i].ts != n * rx->red_ival)
+			continue;
+
+		rmb = mbuf_alloc(blkv[i].len);
+		if (!rmb)
+			break;
+
+		(void)mbuf_write_mem(rmb, blkv[i].data, blkv[i].len);
+		rmb->pos = 0;
+
+		rhdr     = *hdr;
+		rhdr.ext = false;
+		rhdr.m   = false;
+		rhdr.pt  = blkv[i].pt;
+		rhdr.seq = seq;
+		rhdr.ts  = blkv[i].ts;
+
+		rtprecv_media(rx, src, &rhdr, rmb);
+		mem_deref(rmb);
+	}
+
+	/* move the primary block in place of the RED headers, so that the
+	 * header extensions are still in front of it */
+	prim = &blkv[blkc - 1];
+	memmove(mbuf_buf(mb), prim->data, prim->len);
+	mb->end = mb->pos + prim->len;
+
+	rhdr    = *hdr;
+	rhdr.pt = prim->pt;
+
+	rtprecv_media(rx, src, &rhdr, mb);
+}
+
+
+/*
+ * The receive fast path is lock-free, the mutex is only taken until the
+ * stream is established and after a control plane update.
+ */
+void rtprecv_decode(const struct sa *src, const struct rtp_header *hdr,
+		     struct mbuf *mb, void *arg)
+{
+	struct rtp_receiver *rx = arg;
+
+	if (!rx)
+		return;
+
+	MAGIC_CHECK(rx);
+	if (!re_atomic_rlx(&rx->enabled))
+		return;
+
+	if (rtp_pt_is_rtcp(hdr->pt)) {
+		debug("stream: drop incoming RTCP packet on RTP port"
+		     " (pt=%u)\n", hdr->pt);
+		return;
+	}
+
+	re_atomic_rlx_set(&rx->ts_last, tmr_jiffies());
+
+	metric_add_packet(rx->metric, mbuf_get_left(mb));
+	lattrace_mark(stream_lattrace(rx->strm, false), hdr->seq);
+
+	if (!rx->rtp_estab) {
+		mtx_lock(rx->mtx);
+		if (rx->rtpestabh) {
+			debug("stream: incoming rtp for '%s' established, "
+			      "receiving from %J\n", rx->name, src);
+			rx->rtp_estab = true;
+			pass_rtpestab_work(rx);
+		}
+		mtx_unlock(rx->mtx);
+	}
+
+	rtprecv_sync(rx);
+
+	/* the FEC stream has an SSRC of its own */
+	if (rx->fec && hdr->pt == rx->fec_pt) {
+		rtprecv_fec(rx, src, hdr, mb);
+		return;
+	}
+
+	if (rx->red_pt >= 0 && hdr->pt == rx->red_pt && !rx->relay) {
+		rtprecv_red(rx, src, hdr, mb);
+		return;
+	}
+
+	rtprecv_media(rx, src, hdr, mb);
+}
+
+
 void rtprecv_handle_rtcp(const struct sa *src, struct rtcp_msg *msg,
 			  void *arg)
 {
@@ -472,14 +688,10 @@ void rtprecv_handle_rtcp(const struct sa *src, struct rtcp_msg *msg,
 	(void)src;
 
 	MAGIC_CHECK(rx);
-	mtx_lock(rx->mtx);
-	if (!rx->enabled) {
-		mtx_unlock(rx->mtx);
+	if (!re_atomic_rlx(&rx->enabled))
 		return;
-	}
 
-	rx->ts_last = tmr_jiffies();
-	mtx_unlock(rx->mtx);
+	re_atomic_rlx_set(&rx->ts_last, tmr_jiffies());
 
 	pass_rtcp_work(rx, msg);
 }
@@ -536,35 +748,44 @@ void rtprecv_set_ssrc(struct rtp_receiver *rx, uint32_t ssrc)
 	if (!rx)
 		return;
 
-	mtx_lock(rx->mtx);
-	if (rx->ssrc_set) {
-		if (ssrc != rx->ssrc) {
+	if (re_atomic_acq(&rx->ssrc_set)) {
+		uint32_t ssrc0 = re_atomic_rlx(&rx->ssrc);
+
+		if (ssrc != ssrc0) {
 			debug("stream: receive: SSRC changed: %x -> %x\n",
-			     rx->ssrc, ssrc);
-			rx->ssrc = ssrc;
+			     ssrc0, ssrc);
+			re_atomic_rlx_set(&rx->ssrc, ssrc);
 		}
 	}
 	else {
 		debug("stream: receive: setting SSRC: %x\n", ssrc);
-		rx->ssrc = ssrc;
-		rx->ssrc_set = true;
+		re_atomic_rlx_set(&rx->ssrc, ssrc);
+		re_atomic_rls_set(&rx->ssrc_set, true);
 	}
-	mtx_unlock(rx->mtx);
 }
 
 
-uint64_t rtprecv_ts_last(struct rtp_receiver *rx)
+/**
+ * Set the SSRC of the FEC stream of the peer (RFC 5956)
+ *
+ * @param rx   RTP Receiver
+ * @param ssrc SSRC of the FEC stream, 0 if not signalled
+ */
+void rtprecv_set_ssrc_fec(struct rtp_receiver *rx, uint32_t ssrc)
 {
 	if (!rx)
-		return 0;
+		return;
 
-	uint64_t ts_last;
+	re_atomic_rlx_set(&rx->ssrc_fec, ssrc);
+}
 
-	mtx_lock(rx->mtx);
-	ts_last = rx->ts_last;
-	mtx_unlock(rx->mtx);
 
-	return ts_last;
+uint64_t rtprecv_ts_last(struct rtp_receiver *rx)
+{
+	if (!rx)
+		return 0;
+
+	return re_atomic_rlx(&rx->ts_last);
 }
 
 
@@ -573,9 +794,7 @@ void rtprecv_set_ts_last(struct rtp_receiver *rx, uint64_t ts_last)
 	if (!rx)
 		return;
 
-	mtx_lock(rx->mtx);
-	rx->ts_last = ts_last;
-	mtx_unlock(rx->mtx);
+	re_atomic_rlx_set(&rx->ts_last, ts_last);
 }
 
 
@@ -593,9 +812,7 @@ void rtprecv_enable(struct rtp_receiver *rx, bool enable)
 	if (!rx)
 		return;
 
-	mtx_lock(rx->mtx);
-	rx->enabled = enable;
-	mtx_unlock(rx->mtx);
+	re_atomic_rlx_set(&rx->enabled, enable);
 }
 
 
@@ -606,19 +823,34 @@ int rtprecv_get_ssrc(struct rtp_receiver *rx, uint32_t *ssrc)
 	if (!rx || !ssrc)
 		return EINVAL;
 
-	mtx_lock(rx->mtx);
-	if (rx->ssrc_set) {
-		*ssrc = rx->ssrc;
+	if (re_atomic_acq(&rx->ssrc_set)) {
+		*ssrc = re_atomic_rlx(&rx->ssrc);
 		err = 0;
 	}
 	else
 		err = ENOENT;
-	mtx_unlock(rx->mtx);
 
 	return err;
 }
 
 
+int rtprecv_get_ssrc_fec(struct rtp_receiver *rx, uint32_t *ssrc)
+{
+	uint32_t ssrc_fec;
+
+	if (!rx || !ssrc)
+		return EINVAL;
+
+	ssrc_fec = re_atomic_rlx(&rx->ssrc_fec);
+	if (!ssrc_fec)
+		return ENOENT;
+
+	*ssrc = ssrc_fec;
+
+	return 0;
+}
+
+
 struct jbuf *rtprecv_jbuf(struct rtp_receiver *rx)
 {
 	return rx ? rx->jbuf : NULL;
@@ -652,13 +884,15 @@ int rtprecv_debug(struct re_printf *pf, const struct rtp_receiver *rx)
 	if (!rx)
 		return 0;
 
-	mtx_lock(rx->mtx);
-	enabled = rx->enabled;
-	mtx_unlock(rx->mtx);
+	enabled = re_atomic_rlx(&rx->enabled);
 
 	err  = re_hprintf(pf, " rx.enabled: %s\n", enabled ? "yes" : "no");
 	err |= jbuf_debug(pf, rx->jbuf);
 
+	mtx_lock(rx->mtx);
+	err |= twcc_recv_debug(pf, rx->ctl.twcc);
+	mtx_unlock(rx->mtx);
+
 	return err;
 }
 
@@ -683,6 +917,11 @@ static void destructor(void *arg)
 	mem_deref(rx->mtx);
 	mem_deref(rx->jbuf);
 	mem_deref(rx->cname);
+	mem_deref(rx->relay);
+	mem_deref(rx->twcc);
+	mem_deref(rx->ctl.relay);
+	mem_deref(rx->ctl.twcc);
+	mem_deref(rx->fec);
 }
 
 
@@ -710,6 +949,8 @@ int rtprecv_alloc(struct rtp_receiver **rxp,
 	rx->arg    = arg;
 	rx->pseq   = -1;
 	rx->pt     = -1;
+	rx->fec_pt = rx->ctl.fec_pt = -1;
+	rx->red_pt = rx->ctl.red_pt = -1;
 	err  = str_dup(&rx->name, name);
 	err |= mutex_alloc(&rx->mtx);
 	if (err)
@@ -726,7 +967,8 @@ int rtprecv_alloc(struct rtp_receiver **rxp,
 
 	/* Video Jitter buffer */
 	if (stream_type(strm) == MEDIA_VIDEO &&
-	    cfg->video.jbtype != JBUF_OFF && cfg->video.jbuf_del.max) {
+	    cfg->video.jbtype != JBUF_OFF && cfg->video.jbtype != JBUF_FRAME &&
+	    cfg->video.jbuf_del.max) {
 
 		err = jbuf_alloc(&rx->jbuf, cfg->video.jbuf_del.min,
 				 cfg->video.jbuf_del.max);
@@ -802,6 +1044,79 @@ void rtprecv_set_handlers(struct rtp_receiver *rx,
 }
 
 
+/**
+ * Set an RTP relay for the receiver. While set, incoming RTP packets are
+ * forwarded by the relay and not passed to the jitter buffer and decoder.
+ *
+ * @param rx    RTP Receiver
+ * @param relay RTP relay or NULL to stop relaying
+ */
+void rtprecv_set_relay(struct rtp_receiver *rx, struct stream_relay *relay)
+{
+	if (!rx)
+		return;
+
+	mtx_lock(rx->mtx);
+	mem_deref(rx->ctl.relay);
+	rx->ctl.relay = mem_ref(relay);
+	rtprecv_publish(rx);
+	mtx_unlock(rx->mtx);
+
+	if (!relay && rx->jbuf)
+		jbuf_flush(rx->jbuf);
+}
+
+
+/**
+ * Enable Transport-wide Congestion Control feedback for the receiver
+ *
+ * @param rx    RTP Receiver
+ * @param extid RTP header extension ID of the transport-wide sequence number
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int rtprecv_enable_twcc(struct rtp_receiver *rx, uint8_t extid)
+{
+	int err = 0;
+
+	if (!rx || !extid)
+		return EINVAL;
+
+	mtx_lock(rx->mtx);
+	rx->ctl.extid_twcc = extid;
+	if (!rx->ctl.twcc)
+		err = twcc_recv_alloc(&rx->ctl.twcc);
+	rtprecv_publish(rx);
+	mtx_unlock(rx->mtx);
+
+	return err;
+}
+
+
+/**
+ * Set the payload types for Forward Error Correction (RFC 5109) and for
+ * redundant audio data (RFC 2198). Lost packets are recovered before the
+ * jitter buffer.
+ *
+ * @param rx     RTP Receiver
+ * @param fec_pt Payload type of the FEC stream, -1 to disable
+ * @param red_pt Payload type of redundant audio, -1 to disable
+ */
+void rtprecv_set_fec(struct rtp_receiver *rx, int fec_pt, int red_pt)
+{
+	if (!rx)
+		return;
+
+	mtx_lock(rx->mtx);
+	if (rx->ctl.fec_pt != fec_pt || rx->ctl.red_pt != red_pt) {
+		rx->ctl.fec_pt = fec_pt;
+		rx->ctl.red_pt = red_pt;
+		rtprecv_publish(rx);
+	}
+	mtx_unlock(rx->mtx);
+}
+
+
 struct metric *rtprecv_metric(struct rtp_receiver *rx)
 {
 	if (!rx)
@@ -71,6 +71,118 @@ bool sdp_media_has_media(const struct sdp_media *m)
 }
 
 
+struct extmap_val {
+	struct le le;
+	char *val;
+};
+
+struct extmap_state {
+	const char *uri;     /**< Extension URI                    */
+	uint8_t id;          /**< Wanted extension ID              */
+	bool found;          /**< URI with the wanted ID is set    */
+	bool changed;        /**< URI is set with another ID       */
+	struct list vall;    /**< Other local extmap values        */
+	int err;             /**< Allocation error                 */
+};
+
+
+static void extmap_val_destructor(void *arg)
+{
+	struct extmap_val *ev = arg;
+
+	list_unlink(&ev->le);
+	mem_deref(ev->val);
+}
+
+
+static bool extmap_state_handler(const char *name, const char *value,
+				 void *arg)
+{
+	struct extmap_state *st = arg;
+	struct sdp_extmap extmap;
+	struct extmap_val *ev;
+	(void)name;
+
+	if (sdp_extmap_decode(&extmap, value))
+		return false;
+
+	if (!pl_strcasecmp(&extmap.name, st->uri)) {
+		if (extmap.id == st->id)
+			st->found = true;
+		else
+			st->changed = true;
+
+		return false;
+	}
+
+	ev = mem_zalloc(sizeof(*ev), extmap_val_destructor);
+	if (!ev) {
+		st->err = ENOMEM;
+		return true;
+	}
+
+	list_append(&st->vall, &ev->le, ev);
+
+	st->err = str_dup(&ev->val, value);
+
+	return st->err != 0;
+}
+
+
+/**
+ * Set a local extmap attribute (RFC 8285), without replacing the
+ * extmap attributes of other header extensions
+ *
+ * @param m   SDP Media object
+ * @param id  Extension ID
+ * @param uri Extension URI
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int sdp_media_set_extmap(struct sdp_media *m, uint8_t id, const char *uri)
+{
+	struct extmap_state st;
+	struct le *le;
+	int err = 0;
+
+	if (!m || !uri)
+		return EINVAL;
+
+	memset(&st, 0, sizeof(st));
+	st.uri = uri;
+	st.id  = id;
+
+	(void)sdp_media_lattr_apply(m, "extmap", extmap_state_handler, &st);
+	if (st.err) {
+		err = st.err;
+		goto out;
+	}
+
+	if (!st.changed) {
+		if (!st.found)
+			err = sdp_media_set_lattr(m, false, "extmap", "%u %s",
+						  id, uri);
+		goto out;
+	}
+
+	/* the ID has changed, the other extensions keep theirs */
+	sdp_media_del_lattr(m, "extmap");
+
+	LIST_FOREACH(&st.vall, le) {
+		const struct extmap_val *ev = le->data;
+
+		err |= sdp_media_set_lattr(m, false, "extmap", "%s", ev->val);
+	}
+
+	err |= sdp_media_set_lattr(m, false, "extmap", "%u %s", id, uri);
+
+ out:
+	list_flush(&st.vall);
+
+	return err;
+}
+
+
 static void decode_part(const struct pl *part, struct mbuf *mb)
 {
 	struct pl hdrs, body;
@@ -20,6 +20,20 @@ enum {
 	RTP_RECV_SIZE = 8192,
 	RTP_CHECK_INTERVAL = 1000,  /* how often to check for RTP [ms] */
 	PORT_DISCARD = 9,
+	SR_INTERVAL = 5000,         /* RTCP SR of the other SSRCs [ms]  */
+};
+
+#define NTP_EPOCH_OFFSET 2208988800ULL  /* 1900 to 1970 [s] */
+
+
+/* Additional sending SSRC, e.g. a simulcast layer, FEC or an RTP relay */
+struct tx_ssrc {
+	struct le le;          /**< Member of sender SSRC list      */
+	uint32_t ssrc;         /**< Synchronization source          */
+	uint32_t psent;        /**< Packets sent                    */
+	uint32_t osent;        /**< Payload octets sent             */
+	uint32_t ts;           /**< RTP timestamp of last packet    */
+	uint64_t ts_usec;      /**< Realtime of last packet [us]    */
 };
 
 
@@ -30,6 +44,9 @@ struct sender {
 	struct sa raddr_rtcp;  /**< Remote RTCP address             */
 	int pt_enc;            /**< Payload type for encoding       */
 	RE_ATOMIC bool enabled;/**< True if enabled                 */
+	RE_ATOMIC bool relayed;/**< True if fed by an RTP relay     */
+	struct list ssrcl;     /**< Other SSRCs (struct tx_ssrc)    */
+	struct tmr tmr_sr;     /**< Sender reports of other SSRCs   */
 	mtx_t *lock;
 };
 
@@ -88,6 +105,13 @@ struct stream {
 
 	struct rtp_receiver *rx;
 	struct rxmain rxm;
+
+	struct stream_relay *relay;    /**< Relay from our receiver        */
+	struct stream_relay *relay_fb; /**< Relay to our sender            */
+	stream_relay_h *relayh;        /**< Relay started/stopped handler  */
+
+	struct lattrace *lat_tx;       /**< Latency trace, transmit        */
+	struct lattrace *lat_rx;       /**< Latency trace, receive         */
 };
 
 
@@ -133,6 +157,14 @@ static void stream_destructor(void *arg)
 	if (s->cfg.rtp_stats)
 		print_rtp_stats(s);
 
+	/* the media object is going away, do not restart its source */
+	s->relayh = NULL;
+	stream_relay_stop(s);
+	if (s->relay_fb)
+		stream_relay_stop(relay_src(s->relay_fb));
+
+	tmr_cancel(&s->tx.tmr_sr);
+	list_flush(&s->tx.ssrcl);
 	mem_deref(s->tx.metric);
 
 	tmr_cancel(&s->rxm.tmr_rtp);
@@ -150,6 +182,8 @@ static void stream_destructor(void *arg)
 	mem_deref(s->peer);
 	mem_deref(s->mid);
 	mem_deref(s->tx.lock);
+	mem_deref(s->lat_rx);
+	mem_deref(s->lat_tx);
 }
 
 
@@ -353,6 +387,9 @@ void stream_process_rtcp(struct stream *strm, struct rtcp_msg *msg)
 		(void)rtcp_stats(strm->rtp, msg->r.rr.ssrc, &strm->rtcp_stats);
 	}
 
+	if (strm->relay_fb)
+		relay_feedback(strm->relay_fb, msg);
+
 	if (strm->rtcph)
 		strm->rtcph(strm, msg, strm->arg);
 
@@ -523,6 +560,7 @@ static int sender_init(struct sender *tx)
 	err = metric_init(tx->metric);
 
 	tx->pt_enc = -1;
+	tmr_init(&tx->tmr_sr);
 
 	return err;
 }
@@ -571,6 +609,13 @@ int stream_alloc(struct stream **sp, struct list *streaml,
 	s->pinhole = true;
 	tmr_init(&s->tmr_natph);
 
+	if (cfg->lattrace) {
+		err  = lattrace_alloc(&s->lat_tx, media_name(type), true);
+		err |= lattrace_alloc(&s->lat_rx, media_name(type), false);
+		if (err)
+			goto out;
+	}
+
 	if (prm->use_rtp) {
 		err = rtprecv_alloc(&s->rx, s, media_name(type), cfg,
 			       rtph, pth, arg);
@@ -712,6 +757,23 @@ uint8_t stream_generate_extmap_id(struct stream *strm)
 }
 
 
+/**
+ * Get the latency trace of a stream direction
+ *
+ * @param strm Stream object
+ * @param tx   True for the transmit direction
+ *
+ * @return Latency trace, or NULL if latency tracing is disabled
+ */
+struct lattrace *stream_lattrace(const struct stream *strm, bool tx)
+{
+	if (!strm)
+		return NULL;
+
+	return tx ? strm->lat_tx : strm->lat_rx;
+}
+
+
 /**
  * Get the sdp object from the stream
  *
@@ -751,6 +813,10 @@ int stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 	if (re_atomic_rlx(&s->hold))
 		return 0;
 
+	/* the RTP relay owns the sender */
+	if (re_atomic_rlx(&s->tx.relayed))
+		return 0;
+
 	metric_add_packet(s->tx.metric, mbuf_get_left(mb));
 
 	if (pt < 0) {
@@ -772,6 +838,270 @@ int stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 }
 
 
+static struct tx_ssrc *tx_ssrc_find(const struct list *ssrcl, uint32_t ssrc)
+{
+	struct le *le;
+
+	LIST_FOREACH(ssrcl, le) {
+		struct tx_ssrc *txs = le->data;
+
+		if (txs->ssrc == ssrc)
+			return txs;
+	}
+
+	return NULL;
+}
+
+
+/* Encode the RTP header into the headroom and send the packet */
+static int send_hdr(struct stream *s, const struct rtp_header *hdr,
+		    struct mbuf *mb)
+{
+	const size_t len = mbuf_get_left(mb);
+	struct tx_ssrc *txs;
+	size_t pos;
+	int err;
+
+	if (mb->pos < RTP_HEADER_SIZE)
+		return EOVERFLOW;
+
+	metric_add_packet(s->tx.metric, len);
+
+	pos = mb->pos - RTP_HEADER_SIZE;
+	mb->pos = pos;
+
+	err = rtp_hdr_encode(mb, hdr);
+	if (err)
+		goto out;
+
+	mb->pos = pos;
+
+	mtx_lock(s->tx.lock);
+
+	err = udp_send(rtp_sock(s->rtp), &s->tx.raddr_rtp, mb);
+
+	txs = err ? NULL : tx_ssrc_find(&s->tx.ssrcl, hdr->ssrc);
+	if (txs) {
+		++txs->psent;
+		txs->osent  += (uint32_t)len;
+		txs->ts      = hdr->ts;
+		txs->ts_usec = tmr_jiffies_rt_usec();
+	}
+
+	mtx_unlock(s->tx.lock);
+
+ out:
+	if (err)
+		metric_inc_err(s->tx.metric);
+
+	return err;
+}
+
+
+/**
+ * Send an RTP packet with another SSRC than the RTP socket, for example
+ * a simulcast layer. The buffer must have headroom for the RTP header.
+ *
+ * @param s		Stream object
+ * @param ssrc		Synchronization source
+ * @param seq		Sequence number
+ * @param ext		Extension bit
+ * @param marker	Marker bit
+ * @param pt		Payload type
+ * @param ts		Timestamp
+ * @param mb		Payload buffer
+ *
+ * @return int	0 if success, errorcode otherwise
+ */
+int stream_send_ssrc(struct stream *s, uint32_t ssrc, uint16_t seq,
+		     bool ext, bool marker, int pt, uint32_t ts,
+		     struct mbuf *mb)
+{
+	struct rtp_header hdr;
+
+	if (!s || !mb || pt < 0)
+		return EINVAL;
+
+	if (!re_atomic_acq(&s->tx.enabled) || re_atomic_rlx(&s->hold))
+		return 0;
+
+	if (re_atomic_rlx(&s->tx.relayed))
+		return 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.ext  = ext;
+	hdr.m    = marker;
+	hdr.pt   = pt;
+	hdr.seq  = seq;
+	hdr.ts   = ts;
+	hdr.ssrc = ssrc;
+
+	return send_hdr(s, &hdr, mb);
+}
+
+
+/**
+ * Send a relayed RTP packet to the network. The header is written as
+ * given, the sequence number counter of the RTP socket is not used.
+ *
+ * @param s		Stream object
+ * @param hdr		RTP header of the outgoing packet
+ * @param mb		Payload buffer, with headroom for the RTP header
+ *
+ * @return int	0 if success, errorcode otherwise
+ */
+int stream_relay_send(struct stream *s, const struct rtp_header *hdr,
+		      struct mbuf *mb)
+{
+	if (!s || !hdr || !mb)
+		return EINVAL;
+
+	if (!re_atomic_acq(&s->tx.enabled) || re_atomic_rlx(&s->hold))
+		return ENOTCONN;
+
+	return send_hdr(s, hdr, mb);
+}
+
+
+struct sr_arg {
+	uint32_t ssrc;
+	const char *cname;
+};
+
+
+static int sdes_handler(struct mbuf *mb, void *arg)
+{
+	const struct sr_arg *sdes = arg;
+
+	return rtcp_sdes_encode(mb, sdes->ssrc, 1, RTCP_SDES_CNAME,
+				sdes->cname);
+}
+
+
+/*
+ * The RTCP session only reports the SSRC of the RTP socket. For the
+ * other SSRCs a compound packet of SR and SDES is sent here, the NTP
+ * and RTP timestamps of the SR are those of the last packet sent.
+ */
+static void tmr_sr_handler(void *arg)
+{
+	struct stream *s = arg;
+	struct mbuf *mb;
+	struct le *le;
+
+	tmr_start(&s->tx.tmr_sr, SR_INTERVAL, tmr_sr_handler, s);
+
+	if (!re_atomic_acq(&s->tx.enabled) || !s->rtp)
+		return;
+
+	mb = mbuf_alloc(256);
+	if (!mb)
+		return;
+
+	mtx_lock(s->tx.lock);
+
+	LIST_FOREACH(&s->tx.ssrcl, le) {
+		const struct tx_ssrc *txs = le->data;
+		struct sr_arg sdes = {txs->ssrc, s->cname};
+		const uint64_t usec = txs->ts_usec;
+		uint32_t ntp_sec, ntp_frac;
+		int err;
+
+		if (!txs->psent)
+			continue;
+
+		ntp_sec  = (uint32_t)(usec / 1000000 + NTP_EPOCH_OFFSET);
+		ntp_frac = (uint32_t)(((usec % 1000000) << 32) / 1000000);
+
+		mb->pos = mb->end = 0;
+
+		err  = rtcp_encode(mb, RTCP_SR, 0, txs->ssrc,
+				   ntp_sec, ntp_frac, txs->ts,
+				   txs->psent, txs->osent, NULL, NULL);
+		err |= rtcp_encode(mb, RTCP_SDES, 1, sdes_handler, &sdes);
+		if (err)
+			continue;
+
+		mb->pos = 0;
+		(void)rtcp_send(s->rtp, mb);
+	}
+
+	mtx_unlock(s->tx.lock);
+
+	mem_deref(mb);
+}
+
+
+/**
+ * Register an additional sending SSRC of the stream, RTCP sender reports
+ * are sent for it while it is sending
+ *
+ * @param s    Stream object
+ * @param ssrc Synchronization source
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_ssrc_add(struct stream *s, uint32_t ssrc)
+{
+	struct tx_ssrc *txs;
+
+	if (!s)
+		return EINVAL;
+
+	mtx_lock(s->tx.lock);
+
+	if (tx_ssrc_find(&s->tx.ssrcl, ssrc)) {
+		mtx_unlock(s->tx.lock);
+		return 0;
+	}
+
+	txs = mem_zalloc(sizeof(*txs), NULL);
+	if (!txs) {
+		mtx_unlock(s->tx.lock);
+		return ENOMEM;
+	}
+
+	txs->ssrc = ssrc;
+	list_append(&s->tx.ssrcl, &txs->le, txs);
+
+	mtx_unlock(s->tx.lock);
+
+	if (!tmr_isrunning(&s->tx.tmr_sr))
+		tmr_start(&s->tx.tmr_sr, SR_INTERVAL, tmr_sr_handler, s);
+
+	return 0;
+}
+
+
+/**
+ * Unregister a sending SSRC added with stream_ssrc_add()
+ *
+ * @param s    Stream object
+ * @param ssrc Synchronization source
+ */
+void stream_ssrc_remove(struct stream *s, uint32_t ssrc)
+{
+	struct tx_ssrc *txs;
+
+	if (!s)
+		return;
+
+	mtx_lock(s->tx.lock);
+
+	txs = tx_ssrc_find(&s->tx.ssrcl, ssrc);
+	if (txs) {
+		list_unlink(&txs->le);
+		mem_deref(txs);
+	}
+
+	mtx_unlock(s->tx.lock);
+
+	if (list_isempty(&s->tx.ssrcl))
+		tmr_cancel(&s->tx.tmr_sr);
+}
+
+
 /**
  * Write stream data to the network
  *
@@ -830,10 +1160,29 @@ static void update_remotes(struct list *streaml, const struct sa *raddr)
 }
 
 
+/* RFC 5956 -- the FEC stream of the peer */
+static bool ssrc_group_handler(const char *name, const char *value,
+			       void *arg)
+{
+	uint32_t *ssrcp = arg;
+	struct pl media, fec;
+	(void)name;
+
+	if (re_regex(value, str_len(value), "FEC-FR [0-9]+ [0-9]+",
+		     &media, &fec))
+		return false;
+
+	*ssrcp = pl_u32(&fec);
+
+	return true;
+}
+
+
 static void stream_remote_set(struct stream *s)
 {
 	const char *rmid, *rssrc;
 	const struct network *net = baresip_network();
+	uint32_t ssrc_fec = 0;
 
 	if (!s)
 		return;
@@ -847,6 +1196,10 @@ static void stream_remote_set(struct stream *s)
 			rtprecv_set_ssrc(s->rx, pl_u32(&num));
 	}
 
+	(void)sdp_media_rattr_apply(s->sdp, "ssrc-group", ssrc_group_handler,
+				    &ssrc_fec);
+	rtprecv_set_ssrc_fec(s->rx, ssrc_fec);
+
 	/* RFC 5761 */
 	if (s->cfg.rtcp_mux && sdp_media_rattr(s->sdp, "rtcp-mux")) {
 
@@ -898,6 +1251,22 @@ static void stream_remote_set(struct stream *s)
 }
 
 
+/*
+ * Local payload type of a protection format, if it was negotiated. The
+ * peer sends with our payload types.
+ */
+static int stream_fec_pt(const struct stream *s, const char *name)
+{
+	const struct sdp_format *lf;
+
+	lf = sdp_media_format(s->sdp, true, NULL, -1, name, -1, -1);
+	if (!lf || !sdp_media_format(s->sdp, false, NULL, -1, name, -1, -1))
+		return -1;
+
+	return lf->pt;
+}
+
+
 /**
  * Update the media stream
  *
@@ -940,6 +1309,9 @@ int stream_update(struct stream *s)
 		}
 	}
 
+	rtprecv_set_fec(s->rx, stream_fec_pt(s, "ulpfec"),
+			stream_fec_pt(s, "red"));
+
 	if (s->mencs && mnat_ready(s)) {
 
 		err = stream_start_mediaenc(s);
@@ -1611,6 +1983,23 @@ int stream_ssrc_rx(const struct stream *strm, uint32_t *ssrc)
 }
 
 
+/**
+ * Get the SSRC of the FEC stream of the peer, if it was signalled
+ *
+ * @param strm Stream object
+ * @param ssrc Returned SSRC
+ *
+ * @return 0 if success, ENOENT if not signalled, otherwise errorcode
+ */
+int stream_ssrc_rx_fec(const struct stream *strm, uint32_t *ssrc)
+{
+	if (!strm)
+		return EINVAL;
+
+	return rtprecv_get_ssrc_fec(strm->rx, ssrc);
+}
+
+
 void stream_mnat_attr(struct stream *strm, const char *name, const char *value)
 {
 	if (!strm)
@@ -1633,6 +2022,20 @@ struct bundle *stream_bundle(const struct stream *strm)
 }
 
 
+/**
+ * Check if the stream has media encryption, which works in place on the
+ * sent RTP packets
+ *
+ * @param strm Stream object
+ *
+ * @return True if media encryption is used, otherwise false
+ */
+bool stream_has_menc(const struct stream *strm)
+{
+	return strm && strm->menc;
+}
+
+
 static int mbuf_print_h(const char *p, size_t size, void *arg)
 {
 	struct mbuf *mb = arg;
@@ -1687,6 +2090,7 @@ int stream_debug(struct re_printf *pf, const struct stream *s)
 	err |= mbuf_printf(mb, " tx.enabled: %s\n",
 			   re_atomic_rlx(&s->tx.enabled) ? "yes" : "no");
 	err |= rtprecv_debug(&pfmb, s->rx);
+	err |= relay_debug(&pfmb, s->relay);
 	err |= rtp_debug(&pfmb, s->rtp);
 
 	if (s->bundle)
@@ -1703,6 +2107,162 @@ out:
 }
 
 
+/**
+ * Print the per-stage latency histograms of a stream
+ *
+ * @param pf Print function
+ * @param s  Stream object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_latency_debug(struct re_printf *pf, const struct stream *s)
+{
+	int err;
+
+	if (!s)
+		return 0;
+
+	if (!s->lat_tx && !s->lat_rx)
+		return re_hprintf(pf, "%s: latency tracing disabled"
+				  " (rtp_latency_trace)\n",
+				  media_name(s->type));
+
+	err  = lattrace_debug(pf, s->lat_tx);
+	err |= lattrace_debug(pf, s->lat_rx);
+
+	return err;
+}
+
+
+/**
+ * Reset the latency histograms of a stream
+ *
+ * @param s Stream object
+ */
+void stream_latency_reset(struct stream *s)
+{
+	if (!s)
+		return;
+
+	lattrace_reset(s->lat_tx);
+	lattrace_reset(s->lat_rx);
+}
+
+
+/**
+ * Start forwarding RTP from the receiver of one stream to the sender of
+ * another stream, without decoding and re-encoding
+ *
+ * Both streams must have negotiated the same codec. While relaying, the
+ * destination stream does not send its own media and RTCP feedback from
+ * the destination peer is passed back to the source peer.
+ *
+ * @param src Source stream
+ * @param dst Destination stream
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_relay_start(struct stream *src, struct stream *dst)
+{
+	struct stream_relay *relay;
+	int err;
+
+	if (!src || !dst)
+		return EINVAL;
+
+	if (src->relay || dst->relay_fb)
+		return EALREADY;
+
+	err = relay_alloc(&relay, src, dst);
+	if (err)
+		return err;
+
+	err = stream_ssrc_add(dst, relay_ssrc(relay));
+	if (err) {
+		mem_deref(relay);
+		return err;
+	}
+
+	info("stream: %s: relay RTP from %s to %s\n",
+	     media_name(src->type), src->peer, dst->peer);
+
+	src->relay    = relay;
+	dst->relay_fb = relay;
+	re_atomic_rlx_set(&dst->tx.relayed, true);
+	rtprecv_set_relay(src->rx, relay);
+
+	/* stop the source and encoder of the destination */
+	if (dst->relayh)
+		dst->relayh(true, dst->arg);
+
+	return 0;
+}
+
+
+/**
+ * Stop an RTP relay started with stream_relay_start()
+ *
+ * @param src Source stream
+ */
+void stream_relay_stop(struct stream *src)
+{
+	struct stream_relay *relay;
+	struct stream *dst;
+
+	if (!src || !src->relay)
+		return;
+
+	relay = src->relay;
+	dst = relay_dst(relay);
+
+	info("stream: %s: stop relay from %s\n",
+	     media_name(src->type), src->peer);
+
+	rtprecv_set_relay(src->rx, NULL);
+	relay_close(relay);
+
+	if (dst) {
+		stream_ssrc_remove(dst, relay_ssrc(relay));
+		re_atomic_rlx_set(&dst->tx.relayed, false);
+		dst->relay_fb = NULL;
+
+		if (dst->relayh)
+			dst->relayh(false, dst->arg);
+	}
+
+	src->relay = mem_deref(relay);
+}
+
+
+/**
+ * Set the handler that is called when an RTP relay starts or stops
+ * sending on this stream. The handler argument is the stream argument.
+ *
+ * @param strm   Stream object
+ * @param relayh Relay handler
+ */
+void stream_set_relay_handler(struct stream *strm, stream_relay_h *relayh)
+{
+	if (!strm)
+		return;
+
+	strm->relayh = relayh;
+}
+
+
+/**
+ * Check if the sender of the stream is fed by an RTP relay
+ *
+ * @param strm Stream object
+ *
+ * @return True if relayed, otherwise false
+ */
+bool stream_is_relayed(const struct stream *strm)
+{
+	return strm ? re_atomic_rlx(&strm->tx.relayed) : false;
+}
+
+
 int stream_print(struct re_printf *pf, const struct stream *s)
 {
 	if (!s)
@@ -1762,6 +2322,23 @@ void stream_enable_bundle(struct stream *strm, enum bundle_state st)
 }
 
 
+/**
+ * Enable Transport-wide Congestion Control feedback for incoming RTP
+ *
+ * @param strm  Stream object
+ * @param extid RTP header extension ID of the transport-wide sequence number
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_enable_twcc(struct stream *strm, uint8_t extid)
+{
+	if (!strm)
+		return EINVAL;
+
+	return rtprecv_enable_twcc(strm->rx, extid);
+}
+
+
 void stream_enable_natpinhole(struct stream *strm, bool enable)
 {
 	if (!strm)
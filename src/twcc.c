@@ -0,0 +1,435 @@
+/**
+ * @file twcc.c  Transport-wide Congestion Control feedback
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <re_atomic.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * draft-holmer-rmcat-transport-wide-cc-extensions-01
+ *
+ * The sender adds a transport-wide sequence number to every RTP packet.
+ * The receiver records the arrival time of every packet and sends it
+ * back periodically in an RTPFB message:
+ *
+ *  0                   1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |V=2|P|  FMT=15 |    PT=205     |           length              |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                     SSRC of packet sender                     |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                      SSRC of media source                     |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |      base sequence number     |      packet status count      |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                 reference time                | fb pkt. count |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |          packet chunk         |         packet chunk          |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |         recv delta            |  recv delta   | zero padding  |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+
+
+enum {
+	TWCC_FMT     = 15,        /**< RTPFB feedback message type       */
+	RECV_SIZE    = 1024,      /**< Arrival history, power of 2       */
+	FB_MAX       = 400,       /**< Max. packets per feedback         */
+	FB_INTERVAL  = 100000,    /**< Feedback interval [us]            */
+	DELTA_US     = 250,       /**< Receive delta resolution [us]     */
+	REFTIME_US   = 64000,     /**< Reference time resolution [us]    */
+};
+
+
+enum status {
+	ST_LOST  = 0,
+	ST_SMALL = 1,
+	ST_LARGE = 2,
+};
+
+
+/** Receiver side of Transport-wide Congestion Control */
+struct twcc_recv {
+	uint64_t arrv[RECV_SIZE];  /**< Arrival time [us] per seq        */
+	bool recv[RECV_SIZE];      /**< Packet received per seq          */
+	uint16_t seq_base;         /**< First seq of next feedback       */
+	uint16_t seq_hi;           /**< Highest seq received             */
+	bool started;              /**< First packet received            */
+	uint8_t fbcount;           /**< Feedback packet count            */
+	uint64_t ts_fb;            /**< Time of last feedback [us]       */
+
+	/* Snapshot for the debug output, which runs in another thread */
+	RE_ATOMIC uint64_t n_fb;   /**< Number of feedbacks sent         */
+	RE_ATOMIC unsigned seq_fb; /**< First seq of next feedback       */
+};
+
+
+/** Is x less than y? */
+static inline bool seq_less(uint16_t x, uint16_t y)
+{
+	return ((int16_t)(x - y)) < 0;
+}
+
+
+int twcc_recv_alloc(struct twcc_recv **twp)
+{
+	struct twcc_recv *tw;
+
+	if (!twp)
+		return EINVAL;
+
+	tw = mem_zalloc(sizeof(*tw), NULL);
+	if (!tw)
+		return ENOMEM;
+
+	*twp = tw;
+
+	return 0;
+}
+
+
+static int fb_encode(struct twcc_recv *tw, struct mbuf *mb, uint32_t ssrc,
+		     uint32_t ssrc_media, uint16_t base, uint16_t count)
+{
+	uint8_t stv[FB_MAX];
+	int16_t deltav[FB_MAX];
+	int64_t ref = -1, t = 0;
+	size_t start = mb->pos;
+	size_t len;
+	int err;
+
+	/* statuses and deltas relative to the previous received packet */
+	for (uint16_t i = 0; i < count; i++) {
+		const uint16_t ix = (uint16_t)(base + i) & (RECV_SIZE - 1);
+		int64_t d;
+
+		stv[i] = ST_LOST;
+
+		if (!tw->recv[ix])
+			continue;
+
+		if (ref < 0) {
+			ref = tw->arrv[ix] / REFTIME_US;
+			t   = ref * REFTIME_US;
+		}
+
+		d = ((int64_t)tw->arrv[ix] - t) / DELTA_US;
+		if (d < INT16_MIN)
+			d = INT16_MIN;
+		else if (d > INT16_MAX)
+			d = INT16_MAX;
+
+		stv[i]    = (d >= 0 && d <= 255) ? ST_SMALL : ST_LARGE;
+		deltav[i] = (int16_t)d;
+		t += d * DELTA_US;
+	}
+
+	if (ref < 0)
+		return ENOENT;
+
+	err  = mbuf_write_u8(mb, 0x80 | TWCC_FMT);
+	err |= mbuf_write_u8(mb, RTCP_RTPFB);
+	err |= mbuf_write_u16(mb, 0);  /* length, set below */
+	err |= mbuf_write_u32(mb, htonl(ssrc));
+	err |= mbuf_write_u32(mb, htonl(ssrc_media));
+	err |= mbuf_write_u16(mb, htons(base));
+	err |= mbuf_write_u16(mb, htons(count));
+	err |= mbuf_write_u32(mb, htonl((uint32_t)(ref & 0xffffff) << 8 |
+					tw->fbcount));
+
+	/* status vector chunks with 7 two-bit symbols */
+	for (uint16_t i = 0; i < count; i += 7) {
+		uint16_t chunk = 0xc000;
+
+		for (uint16_t j = 0; j < 7 && i + j < count; j++)
+			chunk |= (uint16_t)(stv[i + j] << (12 - 2 * j));
+
+		err |= mbuf_write_u16(mb, htons(chunk));
+	}
+
+	for (uint16_t i = 0; i < count; i++) {
+
+		if (stv[i] == ST_SMALL)
+			err |= mbuf_write_u8(mb, (uint8_t)deltav[i]);
+		else if (stv[i] == ST_LARGE)
+			err |= mbuf_write_u16(mb, htons((uint16_t)deltav[i]));
+	}
+
+	while ((mb->pos - start) & 0x3)
+		err |= mbuf_write_u8(mb, 0);
+
+	if (err)
+		return err;
+
+	len = mb->pos - start;
+	mb->pos = start + 2;
+	err = mbuf_write_u16(mb, htons((uint16_t)(len / 4 - 1)));
+	mb->pos = start + len;
+
+	return err;
+}
+
+
+static void fb_send(struct twcc_recv *tw, struct rtp_sock *rtp,
+		    uint32_t ssrc_media, uint64_t now)
+{
+	struct mbuf *mb;
+	uint16_t count;
+	int err;
+
+	mb = mbuf_alloc(512);
+	if (!mb)
+		return;
+
+	while (!seq_less(tw->seq_hi, tw->seq_base)) {
+
+		count = tw->seq_hi - tw->seq_base + 1;
+		if (count > FB_MAX)
+			count = FB_MAX;
+
+		mb->pos = mb->end = 0;
+		err = fb_encode(tw, mb, rtp_sess_ssrc(rtp), ssrc_media,
+				tw->seq_base, count);
+		if (!err) {
+			mb->pos = 0;
+			err = rtcp_send(rtp, mb);
+			if (err) {
+				warning("twcc: failed to send feedback (%m)\n",
+					err);
+			}
+
+			++tw->fbcount;
+			re_atomic_rlx_add(&tw->n_fb, 1);
+		}
+
+		for (uint16_t i = 0; i < count; i++) {
+			const uint16_t seq = tw->seq_base + i;
+
+			tw->recv[seq & (RECV_SIZE - 1)] = false;
+		}
+
+		tw->seq_base += count;
+	}
+
+	tw->ts_fb = now;
+	re_atomic_rlx_set(&tw->seq_fb, tw->seq_base);
+	mem_deref(mb);
+}
+
+
+/**
+ * Record the arrival of an RTP packet and send feedback if it is due
+ *
+ * @param tw   TWCC receiver
+ * @param rtp  RTP Socket for sending the feedback
+ * @param ssrc SSRC of the media source
+ * @param seq  Transport-wide sequence number
+ * @param now  Arrival time in [us]
+ */
+void twcc_recv_packet(struct twcc_recv *tw, struct rtp_sock *rtp,
+		      uint32_t ssrc, uint16_t seq, uint64_t now)
+{
+	if (!tw || !rtp)
+		return;
+
+	if (!tw->started) {
+		tw->seq_base = seq;
+		tw->seq_hi   = seq;
+		tw->ts_fb    = now;
+		tw->started  = true;
+	}
+
+	/* already reported as lost */
+	if (seq_less(seq, tw->seq_base))
+		return;
+
+	if ((uint16_t)(seq - tw->seq_base) >= RECV_SIZE) {
+
+		fb_send(tw, rtp, ssrc, now);
+
+		if ((uint16_t)(seq - tw->seq_base) >= RECV_SIZE)
+			tw->seq_base = seq;
+	}
+
+	tw->arrv[seq & (RECV_SIZE - 1)] = now;
+	tw->recv[seq & (RECV_SIZE - 1)] = true;
+
+	if (seq_less(tw->seq_hi, seq))
+		tw->seq_hi = seq;
+
+	if (now >= tw->ts_fb + FB_INTERVAL)
+		fb_send(tw, rtp, ssrc, now);
+}
+
+
+/**
+ * Find the transport-wide sequence number in the RTP header extensions
+ *
+ * @param hdr  RTP header
+ * @param mb   RTP payload, with the header extensions in the headroom
+ * @param id   Extension ID of the transport-wide sequence number
+ * @param seqp Returned transport-wide sequence number
+ *
+ * @return 0 if found, otherwise errorcode
+ */
+int twcc_ext_decode(const struct rtp_header *hdr, const struct mbuf *mb,
+		    uint8_t id, uint16_t *seqp)
+{
+	struct mbuf m;
+	size_t ext_len;
+
+	if (!hdr || !mb || !seqp || !id)
+		return EINVAL;
+
+	if (!hdr->ext || !hdr->x.len || hdr->x.type != RTPEXT_TYPE_MAGIC)
+		return ENOENT;
+
+	ext_len = hdr->x.len * sizeof(uint32_t);
+	if (mb->pos < ext_len)
+		return EBADMSG;
+
+	m = *mb;
+	m.pos = mb->pos - ext_len;
+	m.end = mb->pos;
+
+	while (mbuf_get_left(&m)) {
+		struct rtpext ext;
+		int err;
+
+		err = rtpext_decode(&ext, &m);
+		if (err)
+			return err;
+
+		if (ext.id == id && ext.len == 2) {
+			*seqp = (uint16_t)(ext.data[0] << 8 | ext.data[1]);
+			return 0;
+		}
+	}
+
+	return ENOENT;
+}
+
+
+static int status_decode(enum status st, uint16_t seq, int64_t *t,
+			 const struct mbuf *dmb, size_t *di,
+			 twcc_status_h *statush, void *arg)
+{
+	switch (st) {
+
+	case ST_SMALL:
+		if (*di + 1 > dmb->end)
+			return EBADMSG;
+
+		*t += (int64_t)dmb->buf[*di] * DELTA_US;
+		*di += 1;
+		break;
+
+	case ST_LARGE:
+		if (*di + 2 > dmb->end)
+			return EBADMSG;
+
+		*t += (int64_t)(int16_t)(dmb->buf[*di] << 8 |
+					 dmb->buf[*di + 1]) * DELTA_US;
+		*di += 2;
+		break;
+
+	default:
+		statush(seq, false, 0, arg);
+		return 0;
+	}
+
+	statush(seq, true, *t, arg);
+
+	return 0;
+}
+
+
+/**
+ * Decode a transport-wide feedback message
+ *
+ * The status handler is called for every reported packet, in sequence
+ * number order. Arrival times are given in [us] in the receiver clock.
+ *
+ * @param twcc    Transport-wide feedback, as decoded by RTCP
+ * @param statush Packet status handler
+ * @param arg     Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int twcc_decode(const struct twcc *twcc, twcc_status_h *statush, void *arg)
+{
+	const struct mbuf *cmb, *dmb;
+	uint16_t seq, left;
+	size_t ci = 0, di = 0;
+	int64_t t;
+	int err = 0;
+
+	if (!twcc || !statush || !twcc->chunks || !twcc->deltas)
+		return EINVAL;
+
+	cmb  = twcc->chunks;
+	dmb  = twcc->deltas;
+	seq  = twcc->seq;
+	left = twcc->count;
+
+	/* 24-bit signed reference time */
+	t = (int64_t)((int32_t)(twcc->reftime << 8) >> 8) * REFTIME_US;
+
+	while (left && ci + 2 <= cmb->end && !err) {
+
+		const uint16_t chunk = cmb->buf[ci] << 8 | cmb->buf[ci + 1];
+		ci += 2;
+
+		if (!(chunk & 0x8000)) {
+
+			/* run length chunk */
+			const enum status st = (chunk >> 13) & 0x3;
+			uint16_t run = chunk & 0x1fff;
+
+			for (; run && left && !err; --run, --left, ++seq)
+				err = status_decode(st, seq, &t, dmb, &di,
+						    statush, arg);
+		}
+		else if (!(chunk & 0x4000)) {
+
+			/* status vector chunk, 14 one-bit symbols */
+			for (int j = 13; j >= 0 && left && !err;
+			     --j, --left, ++seq) {
+				const enum status st = (chunk >> j) & 0x1;
+
+				err = status_decode(st, seq, &t, dmb, &di,
+						    statush, arg);
+			}
+		}
+		else {
+			/* status vector chunk, 7 two-bit symbols */
+			for (int j = 6; j >= 0 && left && !err;
+			     --j, --left, ++seq) {
+				const enum status st =
+					(chunk >> (2 * j)) & 0x3;
+
+				err = status_decode(st, seq, &t, dmb, &di,
+						    statush, arg);
+			}
+		}
+	}
+
+	return err;
+}
+
+
+int twcc_recv_debug(struct re_printf *pf, const struct twcc_recv *tw)
+{
+	if (!tw)
+		return 0;
+
+	return re_hprintf(pf, " twcc: feedback sent=%llu seq_base=%u\n",
+			  re_atomic_rlx(&tw->n_fb),
+			  re_atomic_rlx(&tw->seq_fb));
+}
@@ -0,0 +1,298 @@
+/**
+ * @file src/txshare.c  Shared encoder for calls with the same source
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * Shared encoder
+ *
+ * Calls that send the same source with the same codec and parameters
+ * subscribe to one encoder instead of running their own filter chain and
+ * encoder. The first leg is the leader: its source drives the encoder and
+ * each encoded packet is sent on all legs. The other legs do not open a
+ * source. The RTP header (SSRC, sequence
+ * number and timestamp offset) is written per leg by its own stream.
+ *
+ * Keyframe requests from all legs are coalesced into one keyframe per
+ * PICUP_MIN interval. When the leader leaves, the leader handler lets the
+ * next leg take over with its own source and encoder state, starting with
+ * a keyframe.
+ *
+ \verbatim
+
+	.--------.   .--------.   .---------.        .--------.
+	| source |-->| aufilt |-->| encoder |---+--->| leg 1  |---> RTP
+	'--------'   '--------'   '---------'   |    '--------'
+	 (leader)				+--->| leg 2  |---> RTP
+						|    '--------'
+						'--->| leg N  |---> RTP
+						     '--------'
+ \endverbatim
+ */
+
+
+enum {
+	PICUP_MIN = 200,  /**< Minimum interval between keyframes [ms] */
+};
+
+
+struct txshare {
+	struct le le;                 /**< Registry list element             */
+	char *key;                    /**< Source, codec and parameters      */
+	txshare_leader_h *leaderh;    /**< Leader change handler             */
+	mtx_t *mtx;                   /**< Protects all fields below         */
+
+	struct list legl;             /**< Legs, the first one is the leader */
+	bool picup;                   /**< Keyframe requested                */
+	uint64_t ts_picup;            /**< Time of last keyframe [ms]        */
+
+	struct {
+		uint64_t n_picup_req; /**< Keyframe requests from all legs   */
+		uint64_t n_picup;     /**< Keyframes sent                    */
+		uint64_t n_leader;    /**< Leader changes                    */
+	} stats;
+};
+
+
+/* Registry of all shared encoders, only used in the main thread */
+static struct list sharel;
+
+
+static void destructor(void *arg)
+{
+	struct txshare *sh = arg;
+
+	list_unlink(&sh->le);
+	mem_deref(sh->key);
+	mem_deref(sh->mtx);
+}
+
+
+static struct txshare *txshare_find(const char *key)
+{
+	struct le *le;
+
+	LIST_FOREACH(&sharel, le) {
+		struct txshare *sh = le->data;
+
+		if (!str_cmp(sh->key, key))
+			return sh;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Get the shared encoder for a key, it is allocated if it does not exist
+ *
+ * @note Must be called from the main thread
+ *
+ * @param shp     Pointer to shared encoder
+ * @param key     Source, codec and encoder parameters
+ * @param leaderh Leader change handler, called with the new leader
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int txshare_alloc(struct txshare **shp, const char *key,
+		  txshare_leader_h *leaderh)
+{
+	struct txshare *sh;
+	int err;
+
+	if (!shp || !str_isset(key))
+		return EINVAL;
+
+	sh = txshare_find(key);
+	if (sh) {
+		*shp = mem_ref(sh);
+		return 0;
+	}
+
+	sh = mem_zalloc(sizeof(*sh), destructor);
+	if (!sh)
+		return ENOMEM;
+
+	sh->leaderh = leaderh;
+
+	err  = str_dup(&sh->key, key);
+	err |= mutex_alloc(&sh->mtx);
+	if (err)
+		goto out;
+
+	list_append(&sharel, &sh->le, sh);
+
+	debug("txshare: new shared encoder (%s)\n", key);
+
+ out:
+	if (err)
+		mem_deref(sh);
+	else
+		*shp = sh;
+
+	return err;
+}
+
+
+/**
+ * Subscribe a leg to the shared encoder
+ *
+ * @param sh  Shared encoder
+ * @param le  List element of the leg
+ * @param leg Leg object
+ */
+void txshare_join(struct txshare *sh, struct le *le, void *leg)
+{
+	if (!sh || !le || !leg)
+		return;
+
+	mtx_lock(sh->mtx);
+	list_append(&sh->legl, le, leg);
+	mtx_unlock(sh->mtx);
+}
+
+
+/**
+ * Unsubscribe a leg from the shared encoder. If the leader leaves, the
+ * next leg takes over.
+ *
+ * @note Must be called from the main thread
+ *
+ * @param sh Shared encoder
+ * @param le List element of the leg
+ */
+void txshare_leave(struct txshare *sh, struct le *le)
+{
+	struct le *next = NULL;
+
+	if (!sh || !le)
+		return;
+
+	mtx_lock(sh->mtx);
+
+	if (le->list == &sh->legl && le == list_head(&sh->legl)) {
+		sh->picup = true;
+		++sh->stats.n_leader;
+		next = le->next;
+	}
+
+	list_unlink(le);
+	mtx_unlock(sh->mtx);
+
+	/* the leader handler opens the source, without the lock */
+	if (next && sh->leaderh)
+		sh->leaderh(next->data);
+}
+
+
+void txshare_lock(struct txshare *sh)
+{
+	mtx_lock(sh->mtx);
+}
+
+
+void txshare_unlock(struct txshare *sh)
+{
+	mtx_unlock(sh->mtx);
+}
+
+
+/**
+ * Check if a leg is the leader, which drives the encoder
+ *
+ * @param sh  Shared encoder
+ * @param leg Leg object
+ *
+ * @return True if leader, otherwise false
+ */
+bool txshare_leader(struct txshare *sh, const void *leg)
+{
+	struct le *le;
+
+	if (!sh)
+		return false;
+
+	mtx_lock(sh->mtx);
+	le = list_head(&sh->legl);
+	mtx_unlock(sh->mtx);
+
+	return le && le->data == leg;
+}
+
+
+/**
+ * Get the list of legs, must be called with the lock held
+ *
+ * @param sh Shared encoder
+ *
+ * @return List of legs
+ */
+struct list *txshare_legl(struct txshare *sh)
+{
+	return sh ? &sh->legl : NULL;
+}
+
+
+/**
+ * Request a keyframe from the shared encoder
+ *
+ * @param sh Shared encoder
+ */
+void txshare_picup_req(struct txshare *sh)
+{
+	if (!sh)
+		return;
+
+	mtx_lock(sh->mtx);
+	sh->picup = true;
+	++sh->stats.n_picup_req;
+	mtx_unlock(sh->mtx);
+}
+
+
+/**
+ * Check if the next frame must be a keyframe, must be called with the lock
+ * held. Requests within PICUP_MIN of the last keyframe are kept pending.
+ *
+ * @param sh  Shared encoder
+ * @param now Current time [ms]
+ *
+ * @return True to encode a keyframe, otherwise false
+ */
+bool txshare_picup(struct txshare *sh, uint64_t now)
+{
+	if (!sh || !sh->picup)
+		return false;
+
+	if (sh->ts_picup && now < sh->ts_picup + PICUP_MIN)
+		return false;
+
+	sh->picup    = false;
+	sh->ts_picup = now;
+	++sh->stats.n_picup;
+
+	return true;
+}
+
+
+int txshare_debug(struct re_printf *pf, const struct txshare *sh)
+{
+	int err;
+
+	if (!sh)
+		return 0;
+
+	mtx_lock(sh->mtx);
+	err = re_hprintf(pf, " txshare: legs=%u keyframes=%llu/%llu"
+			 " leader_changes=%llu\n",
+			 list_count(&sh->legl), sh->stats.n_picup,
+			 sh->stats.n_picup_req, sh->stats.n_leader);
+	mtx_unlock(sh->mtx);
+
+	return err;
+}
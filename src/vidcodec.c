@@ -4,8 +4,14 @@
  * Copyright (C) 2010 Alfred E. Heggestad
  */
 
+#include <re_atomic.h>
 #include <re.h>
 #include <baresip.h>
+#include "core.h"
+
+
+/* Encoder threads in use by all calls */
+static RE_ATOMIC unsigned enc_threads;
 
 
 /**
@@ -66,6 +72,10 @@ const struct vidcodec *vidcodec_find(const struct list *vidcodecl,
 		return vc;
 	}
 
+	/* try the deferred modules */
+	if (!module_lazy_load(name))
+		return vidcodec_find(vidcodecl, name, variant);
+
 	return NULL;
 }
 
@@ -124,3 +134,44 @@ const struct vidcodec *vidcodec_find_decoder(const struct list *vidcodecl,
 
 	return NULL;
 }
+
+
+/**
+ * Take encoder threads from the budget of all calls (video_enc_threads)
+ *
+ * An encoder gets at least one thread, also if the budget is used up.
+ *
+ * @param want Number of threads the encoder wants
+ *
+ * @return Number of threads the encoder may use
+ */
+unsigned videnc_threads_alloc(unsigned want)
+{
+	const struct config *cfg = conf_config();
+	const unsigned budget = cfg ? cfg->video.enc_threads : 0;
+	unsigned used, n;
+
+	want = max(want, 1u);
+
+	used = re_atomic_rlx_add(&enc_threads, want);
+	if (!budget || used + want <= budget)
+		return want;
+
+	n = used < budget ? budget - used : 1;
+
+	re_atomic_rlx_sub(&enc_threads, want - n);
+
+	return n;
+}
+
+
+/**
+ * Give encoder threads back to the budget
+ *
+ * @param n Number of threads from videnc_threads_alloc()
+ */
+void videnc_threads_free(unsigned n)
+{
+	if (n)
+		re_atomic_rlx_sub(&enc_threads, n);
+}
@@ -0,0 +1,264 @@
+/**
+ * @file viddiff.c  Video frame difference
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <stdlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * The luma plane is compared in blocks of 16 x 16 pixels, which is the
+ * macroblock size of the encoders with an active map. Only every second
+ * row is compared, a block has 8 rows of 16 pixels.
+ *
+ * The reference holds the rows of the last encoded frame. Only changed
+ * blocks are copied into it, so a slow change of a block is summed up
+ * until the block counts as changed.
+ */
+
+enum {
+	BLOCK    = VIDDIFF_BLOCK,
+	ROWSTEP  = 2,
+	SAD_MIN  = 2 * BLOCK * BLOCK / ROWSTEP,  /* 2 per compared pixel */
+};
+
+
+struct viddiff {
+	uint8_t *ref;         /**< Compared rows of the reference   */
+	uint8_t *map;         /**< Changed blocks, one byte each    */
+	struct vidsz size;    /**< Size of the reference            */
+	unsigned cols;        /**< Number of block columns          */
+	unsigned rows;        /**< Number of block rows             */
+	unsigned changed;     /**< Changed blocks of the last frame */
+	bool full;            /**< All blocks are marked changed    */
+};
+
+
+static void destructor(void *arg)
+{
+	struct viddiff *vd = arg;
+
+	mem_deref(vd->ref);
+	mem_deref(vd->map);
+}
+
+
+/**
+ * Allocate a video frame difference state
+ *
+ * @param vdp Pointer to allocated state
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int viddiff_alloc(struct viddiff **vdp)
+{
+	struct viddiff *vd;
+
+	if (!vdp)
+		return EINVAL;
+
+	vd = mem_zalloc(sizeof(*vd), destructor);
+	if (!vd)
+		return ENOMEM;
+
+	*vdp = vd;
+
+	return 0;
+}
+
+
+static int viddiff_resize(struct viddiff *vd, const struct vidsz *size)
+{
+	const unsigned cols = (size->w + BLOCK - 1) / BLOCK;
+	const unsigned rows = (size->h + BLOCK - 1) / BLOCK;
+
+	vd->ref = mem_deref(vd->ref);
+	vd->map = mem_deref(vd->map);
+
+	vd->ref = mem_zalloc((size_t)cols * BLOCK *
+			     rows * (BLOCK / ROWSTEP), NULL);
+	vd->map = mem_zalloc((size_t)cols * rows, NULL);
+	if (!vd->ref || !vd->map) {
+		vd->size.w = vd->size.h = 0;
+		return ENOMEM;
+	}
+
+	vd->size = *size;
+	vd->cols = cols;
+	vd->rows = rows;
+
+	return 0;
+}
+
+
+static inline uint32_t sad16(const uint8_t *a, const uint8_t *b)
+{
+#if defined(__SSE2__)
+	__m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i *)a),
+				   _mm_loadu_si128((const __m128i *)b));
+
+	return (uint32_t)(_mm_cvtsi128_si32(sad) +
+			  _mm_extract_epi16(sad, 4));
+#else
+	uint32_t sad = 0;
+
+	for (int i = 0; i < BLOCK; i++)
+		sad += (uint32_t)abs(a[i] - b[i]);
+
+	return sad;
+#endif
+}
+
+
+/*
+ * Compare one block and update its reference rows if it changed. Blocks
+ * at the right and bottom edge are padded with the last pixel.
+ */
+static bool block_update(struct viddiff *vd, const struct vidframe *frame,
+			 unsigned bx, unsigned by, bool full)
+{
+	const unsigned x0 = bx * BLOCK;
+	const unsigned w  = min(vd->size.w - x0, (unsigned)BLOCK);
+	uint8_t *ref = vd->ref + ((size_t)by * vd->cols + bx) *
+		BLOCK * (BLOCK / ROWSTEP);
+	uint8_t rowv[BLOCK / ROWSTEP][BLOCK];
+	uint32_t sad = 0;
+
+	for (unsigned r = 0; r < BLOCK / ROWSTEP; r++) {
+
+		const unsigned y = min(by * BLOCK + r * ROWSTEP,
+				       vd->size.h - 1);
+		const uint8_t *src = frame->data[0] +
+			(size_t)y * frame->linesize[0] + x0;
+
+		memcpy(rowv[r], src, w);
+		if (w < BLOCK)
+			memset(&rowv[r][w], src[w - 1], BLOCK - w);
+
+		sad += sad16(rowv[r], &ref[r * BLOCK]);
+	}
+
+	if (!full && sad < SAD_MIN)
+		return false;
+
+	memcpy(ref, rowv, sizeof(rowv));
+
+	return true;
+}
+
+
+/**
+ * Compare a frame with the reference and mark the changed blocks
+ *
+ * @param vd    Video frame difference state
+ * @param frame Video frame, planar YUV
+ * @param full  Mark all blocks changed and copy the whole frame
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int viddiff_update(struct viddiff *vd, const struct vidframe *frame,
+		   bool full)
+{
+	unsigned changed = 0;
+	int err;
+
+	if (!vd || !frame || !frame->data[0])
+		return EINVAL;
+
+	switch (frame->fmt) {
+
+	case VID_FMT_YUV420P:
+	case VID_FMT_YUV422P:
+	case VID_FMT_YUV444P:
+	case VID_FMT_NV12:
+	case VID_FMT_NV21:
+		break;
+
+	default:
+		return ENOTSUP;
+	}
+
+	if (!vidsz_cmp(&vd->size, &frame->size)) {
+
+		err = viddiff_resize(vd, &frame->size);
+		if (err)
+			return err;
+
+		full = true;
+	}
+
+	for (unsigned by = 0; by < vd->rows; by++) {
+		for (unsigned bx = 0; bx < vd->cols; bx++) {
+
+			const bool ch = block_update(vd, frame, bx, by, full);
+
+			vd->map[by * vd->cols + bx] = ch;
+			changed += ch;
+		}
+	}
+
+	vd->changed = changed;
+	vd->full    = full;
+
+	return 0;
+}
+
+
+/**
+ * Reset the reference, the next frame is marked changed
+ *
+ * @param vd Video frame difference state
+ */
+void viddiff_reset(struct viddiff *vd)
+{
+	if (!vd)
+		return;
+
+	vd->size.w = vd->size.h = 0;
+	vd->changed = 0;
+}
+
+
+/**
+ * Get the number of changed blocks of the last frame
+ *
+ * @param vd Video frame difference state
+ *
+ * @return Number of changed blocks
+ */
+unsigned viddiff_changed(const struct viddiff *vd)
+{
+	return vd ? vd->changed : 0;
+}
+
+
+/**
+ * Get the map of the changed blocks of the last frame
+ *
+ * @param vd  Video frame difference state
+ * @param map Returned active map, map->map is NULL if all blocks changed
+ */
+void viddiff_actmap(const struct viddiff *vd, struct vidactmap *map)
+{
+	if (!map)
+		return;
+
+	memset(map, 0, sizeof(*map));
+
+	if (!vd)
+		return;
+
+	map->cols = vd->cols;
+	map->rows = vd->rows;
+
+	if (!vd->full && vd->changed < vd->cols * vd->rows)
+		map->map = vd->map;
+}
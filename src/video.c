@@ -31,6 +31,29 @@ enum {
 	NACK_BLPSZ	= 16,		       /**< NACK bitmask size        */
 	NACK_QUEUE_TIME	= 500,		       /**< in [ms]                  */
 	PKT_SIZE	= 1280,		       /**< max. Packet size in bytes*/
+	BWE_MIN_BITRATE	= 64000,	       /**< min. BWE bitrate [bit/s] */
+	ENC_DOWN_TIME	= 500,		       /**< Encoder decrease [ms]    */
+	ENC_UP_TIME	= 2000,		       /**< Encoder increase [ms]    */
+	ENC_STEP_PCT	= 15,		       /**< Encoder update step [%]  */
+	SIMULCAST_MAX	= 3,		       /**< Max. simulcast layers    */
+	RID_SIZE	= 16,		       /**< Max. RTP stream ID + 1   */
+	FEC_GROUP_INIT	= 8,		       /**< Packets per FEC packet   */
+	STATIC_REFRESH	= 1000,		       /**< Full frame interval [ms] */
+};
+
+
+static const char *uri_twcc = "http://www.ietf.org/id/"
+	"draft-holmer-rmcat-transport-wide-cc-extensions-01";
+static const char *uri_rid = "urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id";
+
+/* Simulcast layers (RFC 8853), from the full resolution down */
+static const struct {
+	const char *rid;
+	unsigned scale;
+} layerdefv[SIMULCAST_MAX] = {
+	{"f", 1},
+	{"h", 2},
+	{"q", 4},
 };
 
 
@@ -62,6 +85,21 @@ enum {
  *</pre>
  */
 
+/** Simulcast layer, the first layer is the full resolution */
+struct vtx_layer {
+	struct videnc_state *enc;          /**< Encoder, except first     */
+	struct vidframe *frame;            /**< Downscaled frame          */
+	char rid[RID_SIZE];                /**< RTP stream identifier     */
+	unsigned scale;                    /**< Downscale factor          */
+	uint32_t bitrate;                  /**< Encoder bitrate [bit/s]   */
+	uint32_t ssrc;                     /**< SSRC, except first        */
+	uint16_t seq;                      /**< RTP sequence number       */
+	size_t sendq_bytes;                /**< Bytes in the Tx-Queue     */
+	bool picup;                        /**< Send picture update       */
+	uint64_t n_skip;                   /**< Frames skipped by pacer   */
+};
+
+
 /**
  * Video stream - transmitter/encoder direction
 
@@ -76,37 +114,93 @@ enum {
  '         '--------'   '- - - - -'   '---------'   '---------'
                          (optional)
  \endverbatim
+
+ The source thread converts the frame into a mailbox, which holds the
+ latest frame. The encode thread takes it from there, so that a slow
+ encoder does not block the source.
+
+ With simulcast, the filtered frame is also downscaled and encoded for
+ each layer. Each layer is sent with its own SSRC and RTP stream ID,
+ and has its own share of the pacing budget.
+
+ The layer configuration is protected by both lock_enc and lock_tx, the
+ encoder state of a layer by lock_enc and its send state by lock_tx.
  */
 struct vtx {
 	struct video *video;               /**< Parent                    */
 	const struct vidcodec *vc;         /**< Current Video encoder     */
 	struct videnc_state *enc;          /**< Video encoder state       */
 	struct vidsrc_prm vsrc_prm;        /**< Video source parameters   */
-	struct vidsz vsrc_size;            /**< Video source size         */
+	struct vidsz vsrc_size;            /**< Source size, lock_mbox    */
 	struct vidsrc *vs;                 /**< Video source module       */
 	struct vidsrc_st *vsrc;            /**< Video source              */
 	mtx_t *lock_enc;                   /**< Lock for encoder          */
-	struct vidframe *frame;            /**< Source frame              */
+	mtx_t *lock_mbox;                  /**< Protect the mailbox       */
+	struct vidframe *mbox_src;         /**< Frame written by source   */
+	struct vidframe *mbox;             /**< Latest source frame       */
+	struct vidframe *mbox_enc;         /**< Frame of encode thread    */
+	uint64_t mbox_ts;                  /**< Latest frame timestamp    */
+	uint64_t mbox_jfs;                 /**< Latest frame arrival [us] */
+	bool mbox_full;                    /**< Mailbox has a new frame   */
+	thrd_t thr_enc;                    /**< Encode thread             */
+	RE_ATOMIC bool run_enc;            /**< Encode thread is active   */
+	cnd_t wait_enc;                    /**< Encode thread wait        */
+	uint64_t enc_usec;                 /**< Average encode time [us]  */
 	mtx_t *lock_tx;                    /**< Protect the sendq         */
 	struct list sendq;                 /**< Tx-Queue (struct vidqent) */
 	struct list sendqnb;               /**< Tx-Queue NACK wait buffer */
-	unsigned skipc;                    /**< Number of frames skipped  */
+	unsigned sendqnbc;                 /**< Entries in NACK buffer    */
+	size_t sendq_bytes;                /**< Bytes in the Tx-Queue     */
+	struct list qpool;                 /**< Free Tx-Queue entries     */
+	unsigned qpoolc;                   /**< Number of free entries    */
+	uint64_t n_qalloc;                 /**< Entries allocated         */
+	struct mbuf *mb_send;              /**< Send copy, if encrypted   */
+	struct fec_enc *fec;               /**< FEC encoder (optional)    */
+	struct mbuf *mb_fec;               /**< Buffer for FEC packets    */
+	int fec_pt;                        /**< Payload type for FEC      */
+	uint32_t fec_ssrc;                 /**< SSRC of the FEC stream    */
+	uint16_t fec_seq;                  /**< Seq. of the FEC stream    */
+	unsigned fec_k;                    /**< Packets per FEC packet    */
+	bool fec_part0;                    /**< FEC group of partition 0  */
+	bool fec_vp8;                      /**< Protect VP8 partition 0   */
 	struct list filtl;                 /**< Filters in encoding order */
+	struct viddiff *diff;              /**< Frame difference (opt.)   */
+	uint64_t ts_full;                  /**< Last full frame [ms]      */
+	uint64_t n_static;                 /**< Static frames skipped     */
+	uint64_t n_partial;                /**< Frames with static blocks */
+	struct txshare *share;             /**< Shared encoder (optional) */
+	struct le le_share;                /**< Leg of the shared encoder */
 	enum vidfmt fmt;                   /**< Outgoing pixel format     */
 	char device[128];                  /**< Source device name        */
 	uint32_t ts_offset;                /**< Random timestamp offset   */
 	bool picup;                        /**< Send picture update       */
-	int frames;                        /**< Number of frames sent     */
+	int frames;                        /**< Source frames, lock_mbox  */
 	double efps;                       /**< Estimated frame-rate      */
 	uint64_t ts_base;                  /**< First RTP timestamp sent  */
 	uint64_t ts_last;                  /**< Last RTP timestamp sent   */
 	thrd_t thrd;                       /**< Tx-Thread                 */
 	RE_ATOMIC bool run;                /**< Tx-Thread is active       */
 	cnd_t wait;                        /**< Tx-Thread wait            */
-
-	/** Statistics */
+	char *params;                      /**< Encoder parameters        */
+	struct bwe *bwe;                   /**< Bandwidth estimator       */
+	uint8_t extid_twcc;                /**< Transport-wide seq ext ID */
+	RE_ATOMIC uint16_t twcc_seq;       /**< Transport-wide seq number */
+	RE_ATOMIC uint32_t pace_bitrate;   /**< Estimated pacing [bit/s]  */
+	uint32_t enc_bitrate;              /**< Current encoder [bit/s]   */
+	uint64_t ts_encupd;                /**< Last encoder update [ms]  */
+	struct vtx_layer layerv[SIMULCAST_MAX]; /**< Simulcast layers     */
+	unsigned layerc;                   /**< Number of active layers   */
+	unsigned layer;                    /**< Layer being encoded       */
+	uint8_t extid_rid;                 /**< RTP stream ID ext ID      */
+
+	/** Statistics, the source and encoder counters are protected by
+	 *  lock_mbox */
 	struct {
 		uint64_t src_frames;       /**< Total frames from vidsrc  */
+		uint64_t enc_frames;       /**< Frames encoded            */
+		uint64_t skip_mbox;        /**< Replaced by a newer frame */
+		uint64_t skip_pacer;       /**< Pacer queue too long      */
+		uint64_t skip_budget;      /**< Frame too old to encode   */
 	} stats;
 };
 
@@ -147,10 +241,15 @@ struct vrx {
 	unsigned n_intra;                  /**< Intra-frames decoded      */
 	unsigned n_picup;                  /**< Picture updates sent      */
 	struct timestamp_recv ts_recv;     /**< Receive timestamp state   */
+	struct vidjbuf *vjb;               /**< Frame jitter buffer       */
+	bool need_key;                     /**< Reference chain broken    */
 
 	/** Statistics */
 	struct {
 		uint64_t disp_frames;      /** Total frames displayed     */
+		uint64_t skip_frames;      /** Frames not displayed       */
+		uint64_t hw_frames;        /** Frames in HW surfaces      */
+		uint64_t hw_downloads;     /** HW frames downloaded       */
 	} stats;
 };
 
@@ -178,12 +277,22 @@ struct vidqent {
 	uint32_t ts;
 	uint64_t jfs_nack;
 	uint16_t seq;
+	uint32_t ssrc;
+	uint8_t layer;
+	uint8_t partid;
+	bool part_start;
+	bool part0;
+	size_t twcc_pos;
+	uint64_t ts_queue;
 	struct mbuf *mb;
 };
 
 
 static void request_picture_update(struct vrx *vrx);
 static void video_stop_source(struct video *v);
+static void vtx_enc_stop(struct vtx *vtx);
+static int  vtx_source_start(struct video *v);
+static void vtx_source_stop(struct video *v);
 
 
 static void vidqent_destructor(void *arg)
@@ -195,38 +304,120 @@ static void vidqent_destructor(void *arg)
 }
 
 
-static int vidqent_alloc(struct vidqent **qentp, struct stream *strm,
-			 bool marker, uint8_t pt, uint32_t ts,
+/*
+ * Return a Tx-Queue entry from the NACK wait buffer to the pool, so that
+ * no memory is allocated per packet. The pool is not larger than the NACK
+ * wait buffer, which holds the packets of NACK_QUEUE_TIME. Must be called
+ * with lock_tx held.
+ */
+static void vidqent_release(struct vtx *vtx, struct vidqent *qent)
+{
+	if (vtx->sendqnbc)
+		--vtx->sendqnbc;
+
+	if (vtx->qpoolc >= vtx->sendqnbc) {
+		mem_deref(qent);
+		return;
+	}
+
+	list_move(&qent->le, &vtx->qpool);
+	++vtx->qpoolc;
+}
+
+
+/* Flush the Tx-Queues and the pool, must be called with lock_tx held */
+static void vtx_sendq_flush(struct vtx *vtx)
+{
+	list_flush(&vtx->sendq);
+	list_flush(&vtx->sendqnb);
+	list_flush(&vtx->qpool);
+
+	vtx->sendqnbc    = 0;
+	vtx->qpoolc      = 0;
+	vtx->sendq_bytes = 0;
+
+	for (unsigned i = 0; i < SIMULCAST_MAX; i++)
+		vtx->layerv[i].sendq_bytes = 0;
+}
+
+
+/*
+ * Get the buffer to send. Media encryption works in place, so the packet
+ * is then sent from a copy and the original is kept for retransmission.
+ * The copy is one buffer of the TX thread, which is reused per packet.
+ */
+static struct mbuf *vidqent_sendbuf(struct vtx *vtx, struct vidqent *qent,
+				    bool encrypted)
+{
+	if (!encrypted)
+		return qent->mb;
+
+	if (!vtx->mb_send) {
+		vtx->mb_send = mbuf_alloc(qent->mb->size);
+		if (!vtx->mb_send)
+			return NULL;
+	}
+
+	mbuf_rewind(vtx->mb_send);
+
+	if (mbuf_write_mem(vtx->mb_send, qent->mb->buf, qent->mb->end))
+		return NULL;
+
+	vtx->mb_send->pos = qent->mb->pos;
+
+	return vtx->mb_send;
+}
+
+
+/* Initialize a Tx-Queue entry from the pool, or allocate a new one */
+static int vidqent_alloc(struct vidqent **qentp, struct vidqent *qent,
+			 struct stream *strm, bool marker, uint8_t pt,
+			 uint32_t ts,
+			 uint8_t extid_twcc,
+			 uint8_t extid_rid, const char *rid,
 			 const uint8_t *hdr, size_t hdr_len,
 			 const uint8_t *pld, size_t pld_len)
 {
 	struct bundle *bun = stream_bundle(strm);
-	struct vidqent *qent;
 	int err = 0;
 
-	if (!qentp || !pld)
+	if (!qentp || !pld) {
+		mem_deref(qent);
 		return EINVAL;
+	}
 
-	qent = mem_zalloc(sizeof(*qent), vidqent_destructor);
-	if (!qent)
-		return ENOMEM;
+	if (qent) {
+		struct mbuf *mb = qent->mb;
+
+		memset(qent, 0, sizeof(*qent));
+		qent->mb = mb;
+
+		mbuf_rewind(qent->mb);
+	}
+	else {
+		qent = mem_zalloc(sizeof(*qent), vidqent_destructor);
+		if (!qent)
+			return ENOMEM;
+
+		/* room for a full packet, the entry is reused */
+		qent->mb = mbuf_alloc(RTP_PRESZ + max(hdr_len + pld_len,
+						      PKT_SIZE + 64) +
+				      RTP_TRAILSZ);
+		if (!qent->mb) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
 
 	qent->ext    = false;
 	qent->marker = marker;
 	qent->pt     = pt;
 	qent->ts     = ts;
 
-	qent->mb = mbuf_alloc(RTP_PRESZ + hdr_len + pld_len + RTP_TRAILSZ);
-	if (!qent->mb) {
-		err = ENOMEM;
-		goto out;
-	}
-
 	qent->mb->pos = qent->mb->end = RTP_PRESZ;
 
-	if (bundle_state(bun) != BUNDLE_NONE) {
+	if (bundle_state(bun) != BUNDLE_NONE || extid_twcc || extid_rid) {
 
-		const char *mid = stream_mid(strm);
 		size_t ext_len = 0;
 		size_t start = qent->mb->pos;
 		size_t pos;
@@ -236,8 +427,26 @@ static int vidqent_alloc(struct vidqent **qentp, struct stream *strm,
 
 		pos = qent->mb->pos;
 
-		rtpext_encode(qent->mb, bundle_extmap_mid(bun),
-			      str_len(mid), (void *)mid);
+		if (bundle_state(bun) != BUNDLE_NONE) {
+			const char *mid = stream_mid(strm);
+
+			rtpext_encode(qent->mb, bundle_extmap_mid(bun),
+				      str_len(mid), (void *)mid);
+		}
+
+		/* sequence number is set by the TX thread */
+		if (extid_twcc) {
+			uint8_t tseq[2] = {0, 0};
+
+			qent->twcc_pos = qent->mb->pos + 1;
+			rtpext_encode(qent->mb, extid_twcc, sizeof(tseq),
+				      tseq);
+		}
+
+		if (extid_rid) {
+			rtpext_encode(qent->mb, extid_rid, str_len(rid),
+				      (const uint8_t *)rid);
+		}
 
 		ext_len = qent->mb->pos - pos;
 
@@ -271,33 +480,69 @@ static int vidqent_alloc(struct vidqent **qentp, struct stream *strm,
 }
 
 
+/* Unsubscribe from the shared encoder, called in the main thread */
+static void vtx_share_leave(struct vtx *vtx)
+{
+	struct txshare *share = vtx->share;
+
+	if (!share)
+		return;
+
+	txshare_leave(share, &vtx->le_share);
+
+	mtx_lock(vtx->lock_enc);
+	vtx->share = NULL;
+	mtx_unlock(vtx->lock_enc);
+
+	mem_deref(share);
+}
+
+
 static void video_destructor(void *arg)
 {
 	struct video *v = arg;
 	struct vtx *vtx = &v->vtx;
 	struct vrx *vrx = &v->vrx;
 
+	/* no more packets from the leader of a shared encoder */
+	vtx_share_leave(vtx);
+
 	stream_enable(v->strm, false);
 
 	/* transmit */
+	vtx_enc_stop(vtx);
+
 	if (re_atomic_rlx(&vtx->run)) {
 		re_atomic_rlx_set(&vtx->run, false);
 		cnd_signal(&vtx->wait);
 		thrd_join(vtx->thrd, NULL);
 	}
 	mtx_lock(vtx->lock_tx);
-	list_flush(&vtx->sendq);
-	list_flush(&vtx->sendqnb);
+	vtx_sendq_flush(vtx);
 	mtx_unlock(vtx->lock_tx);
 	mem_deref(vtx->lock_tx);
+	mem_deref(vtx->fec);
+	mem_deref(vtx->mb_fec);
+	mem_deref(vtx->mb_send);
 
 	mem_deref(vtx->vsrc);
+	mem_deref(vtx->mbox_src);
+	mem_deref(vtx->mbox);
+	mem_deref(vtx->mbox_enc);
+	mem_deref(vtx->lock_mbox);
+	cnd_destroy(&vtx->wait_enc);
 	mtx_lock(vtx->lock_enc);
-	mem_deref(vtx->frame);
 	mem_deref(vtx->enc);
+	for (unsigned i = 0; i < SIMULCAST_MAX; i++) {
+		mem_deref(vtx->layerv[i].enc);
+		mem_deref(vtx->layerv[i].frame);
+	}
 	list_flush(&vtx->filtl);
+	mem_deref(vtx->diff);
 	mtx_unlock(vtx->lock_enc);
 	mem_deref(vtx->lock_enc);
+	mem_deref(vtx->params);
+	mem_deref(vtx->bwe);
 
 	/* receive */
 	tmr_cancel(&vrx->tmr_picup);
@@ -310,6 +555,7 @@ static void video_destructor(void *arg)
 
 	tmr_cancel(&v->tmr);
 	mem_deref(v->strm);
+	mem_deref(vrx->vjb);
 	mem_deref(v->peer);
 }
 
@@ -328,37 +574,73 @@ static double get_fps(const struct video *v)
 }
 
 
-static int packet_handler(bool marker, uint64_t ts,
-			  const uint8_t *hdr, size_t hdr_len,
-			  const uint8_t *pld, size_t pld_len,
-			  const struct video *vid)
+/* Queue an encoded packet of a simulcast layer for sending on one leg */
+static int vtx_queue_packet(const struct video *vid, unsigned layer,
+			    bool marker, uint64_t ts,
+			    const uint8_t *hdr, size_t hdr_len,
+			    const uint8_t *pld, size_t pld_len)
 {
 	struct vtx *vtx = (struct vtx *)&vid->vtx;
 	struct stream *strm = vid->strm;
-	struct vidqent *qent;
+	struct vidqent *qent, *qfree;
+	const char *rid;
 	uint32_t rtp_ts;
+	uint8_t extid_twcc;
+	uint8_t extid_rid;
+	bool vp8;
 	int pt;
 	int err;
 
-	MAGIC_CHECK(vid);
-
 	mtx_lock(vtx->lock_tx);
+
+	/* a leg of a shared encoder without this layer */
+	if (layer && layer >= vtx->layerc) {
+		mtx_unlock(vtx->lock_tx);
+		return 0;
+	}
+
 	if (!vtx->ts_base)
 		vtx->ts_base = ts;
 	vtx->ts_last = ts;
 	pt = stream_pt_enc(strm);
+	extid_twcc = vtx->extid_twcc;
+	extid_rid  = vtx->layerc > 1 ? vtx->extid_rid : 0;
+	rid        = vtx->layerv[layer].rid;
+	vp8        = vtx->fec_vp8;
+
+	qfree = list_ledata(list_head(&vtx->qpool));
+	if (qfree) {
+		list_unlink(&qfree->le);
+		--vtx->qpoolc;
+	}
+	else {
+		++vtx->n_qalloc;
+	}
 	mtx_unlock(vtx->lock_tx);
 
 	/* add random timestamp offset */
 	rtp_ts = vtx->ts_offset + (ts & 0xffffffff);
 
-	err = vidqent_alloc(&qent, strm, marker, pt, rtp_ts,
-			    hdr, hdr_len, pld, pld_len);
+	err = vidqent_alloc(&qent, qfree, strm, marker, pt, rtp_ts,
+			    extid_twcc, extid_rid, rid, hdr, hdr_len,
+			    pld, pld_len);
 	if (err)
 		return err;
 
+	qent->layer    = layer;
+	qent->ts_queue = lattrace_now(stream_lattrace(strm, true));
+
+	/* RFC 7741 -- S bit and partition index of the VP8 descriptor */
+	if (vp8 && hdr_len) {
+		qent->part_start = (hdr[0] >> 4) & 0x1;
+		qent->partid     = hdr[0] & 0x7;
+		qent->part0      = qent->partid == 0;
+	}
+
 	mtx_lock(vtx->lock_tx);
 	list_append(&vtx->sendq, &qent->le, qent);
+	vtx->sendq_bytes += mbuf_get_left(qent->mb);
+	vtx->layerv[layer].sendq_bytes += mbuf_get_left(qent->mb);
 	mtx_unlock(vtx->lock_tx);
 
 	cnd_signal(&vtx->wait);
@@ -367,6 +649,228 @@ static int packet_handler(bool marker, uint64_t ts,
 }
 
 
+/*
+ * The leader of a shared encoder encodes with the lock of the shared
+ * encoder held, and each packet is queued on all legs. The layer is set
+ * while a simulcast layer is encoded, with lock_enc held.
+ */
+static int packet_handler(bool marker, uint64_t ts,
+			  const uint8_t *hdr, size_t hdr_len,
+			  const uint8_t *pld, size_t pld_len,
+			  const struct video *vid)
+{
+	struct txshare *share;
+	unsigned layer;
+	struct le *le;
+	int err = 0;
+
+	MAGIC_CHECK(vid);
+
+	layer = vid->vtx.layer;
+	share = vid->vtx.share;
+	if (!share)
+		return vtx_queue_packet(vid, layer, marker, ts, hdr, hdr_len,
+					pld, pld_len);
+
+	LIST_FOREACH(txshare_legl(share), le) {
+		err |= vtx_queue_packet(le->data, layer, marker, ts,
+					hdr, hdr_len, pld, pld_len);
+	}
+
+	return err;
+}
+
+
+/*
+ * Lock the shared encoder for the leader. Returns false for the other
+ * legs, which send the packets of the leader. Called with lock_enc held.
+ */
+static bool vtx_share_lock(struct vtx *vtx)
+{
+	struct le *le;
+
+	if (!vtx->share)
+		return true;
+
+	txshare_lock(vtx->share);
+
+	le = list_head(txshare_legl(vtx->share));
+	if (le && le->data == vtx->video)
+		return true;
+
+	txshare_unlock(vtx->share);
+
+	return false;
+}
+
+
+static void vtx_share_unlock(struct vtx *vtx)
+{
+	if (vtx->share)
+		txshare_unlock(vtx->share);
+}
+
+
+/* Pacing bitrate, follows the bandwidth estimate if enabled */
+static uint32_t vtx_pace_bitrate(struct vtx *vtx)
+{
+	uint32_t bitrate = re_atomic_rlx(&vtx->pace_bitrate);
+
+	if (bitrate)
+		return bitrate;
+
+	if (vtx->video->cfg.send_bitrate)
+		return vtx->video->cfg.send_bitrate;
+
+	return vtx->video->cfg.bitrate;
+}
+
+
+/*
+ * Check if a simulcast layer is skipped, called with lock_enc held. Each
+ * layer gets a share of the pacing bitrate in proportion to its encoder
+ * bitrate. If the queued packets of a layer need more than one frame
+ * period of its share, the frame is not encoded for this layer.
+ */
+static bool vtx_layer_skip(struct vtx *vtx, unsigned i)
+{
+	const uint64_t period = (uint64_t)(1000000.0 / get_fps(vtx->video));
+	struct vtx_layer *l = &vtx->layerv[i];
+	uint64_t total = 0, budget, drain;
+	size_t bytes;
+
+	if (vtx->layerc < 2)
+		return false;
+
+	for (unsigned j = 0; j < vtx->layerc; j++)
+		total += vtx->layerv[j].bitrate;
+
+	budget = total ? (uint64_t)vtx_pace_bitrate(vtx) * l->bitrate / total
+		       : 0;
+
+	mtx_lock(vtx->lock_tx);
+	bytes = l->sendq_bytes;
+	mtx_unlock(vtx->lock_tx);
+
+	drain = budget ? bytes * 8 * 1000000ULL / budget : 0;
+	if (drain <= period)
+		return false;
+
+	++l->n_skip;
+
+	return true;
+}
+
+
+/* Downscale and encode a simulcast layer, called with lock_enc held */
+static int vtx_layer_encode(struct vtx *vtx, unsigned i,
+			    const struct vidframe *src, uint64_t timestamp,
+			    bool picup)
+{
+	struct vtx_layer *l = &vtx->layerv[i];
+	struct vidsz sz;
+	int err;
+
+	sz.w = (src->size.w / l->scale) & ~1u;
+	sz.h = (src->size.h / l->scale) & ~1u;
+	if (!sz.w || !sz.h)
+		return 0;
+
+	if (vtx_layer_skip(vtx, i))
+		return 0;
+
+	if (!l->enc) {
+		struct videnc_param prm;
+
+		prm.bitrate = l->bitrate;
+		prm.pktsize = PKT_SIZE;
+		prm.fps     = get_fps(vtx->video);
+		prm.max_fs  = -1;
+
+		err = vtx->vc->encupdh(&l->enc, vtx->vc, &prm, vtx->params,
+				       packet_handler, vtx->video);
+		if (err)
+			return err;
+
+		/* a new encoder starts with a keyframe */
+		l->picup = true;
+	}
+
+	if (l->frame && (l->frame->fmt != src->fmt ||
+			 !vidsz_cmp(&l->frame->size, &sz)))
+		l->frame = mem_deref(l->frame);
+
+	if (!l->frame) {
+		err = vidframe_alloc(&l->frame, src->fmt, &sz);
+		if (err)
+			return err;
+	}
+
+	vidconv(l->frame, src, NULL);
+
+	vtx->layer = i;
+	err = vtx->vc->ench(l->enc, picup || l->picup, l->frame, timestamp);
+	vtx->layer = 0;
+	if (err)
+		return err;
+
+	l->picup = false;
+
+	return 0;
+}
+
+
+/*
+ * Content-adaptive encoding, called with lock_enc held. A frame which is
+ * equal to the last encoded frame is skipped, except for a full frame
+ * every STATIC_REFRESH ms. If only some blocks changed, the encoder is
+ * told to skip the static blocks.
+ *
+ * Keyframe intervals are counted in frames, so they get longer in time
+ * as well for static content.
+ *
+ * @return true if the frame is skipped
+ */
+static bool vtx_adapt(struct vtx *vtx, const struct vidframe *frame,
+		      bool picup)
+{
+	const uint64_t now = tmr_jiffies();
+	struct vidactmap map;
+	bool full;
+	int err;
+
+	if (!vtx->diff || !frame)
+		return false;
+
+	full = picup || now >= vtx->ts_full + STATIC_REFRESH;
+
+	err = viddiff_update(vtx->diff, frame, full);
+	if (err)
+		return false;
+
+	if (!full && !viddiff_changed(vtx->diff)) {
+		++vtx->n_static;
+		return true;
+	}
+
+	if (full)
+		vtx->ts_full = now;
+
+	if (!vtx->vc->actmaph)
+		return false;
+
+	viddiff_actmap(vtx->diff, &map);
+	if (map.map)
+		++vtx->n_partial;
+
+	err = vtx->vc->actmaph(vtx->enc, &map);
+	if (err)
+		debug("video: encoder active map: %m\n", err);
+
+	return false;
+}
+
+
 /**
  * Encode video and send via RTP stream
  *
@@ -379,20 +883,26 @@ static int packet_handler(bool marker, uint64_t ts,
 static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 			    struct vidpacket *packet, uint64_t timestamp)
 {
+	struct lattrace *lat = stream_lattrace(vtx->video->strm, true);
 	struct le *le;
+	uint64_t t;
 	int err = 0;
-	bool sendq_empty;
+	bool picup;
 
 	if (!vtx->enc)
 		return;
 
-	if (packet) {
-		mtx_lock(vtx->lock_enc);
+	mtx_lock(vtx->lock_enc);
+
+	/* the other legs of a shared encoder send the leader's packets */
+	if (!vtx_share_lock(vtx))
+		goto out;
 
+	if (packet) {
 		if (vtx->vc && vtx->vc->packetizeh) {
 			err = vtx->vc->packetizeh(vtx->enc, packet);
 			if (err)
-				goto out;
+				goto unlock;
 
 			vtx->picup = false;
 		}
@@ -400,69 +910,186 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 			warning("video: Skipping Packet as"
 				" Packetize Handler not initialized ..\n");
 		}
-		goto out;
+		goto unlock;
 	}
 
-	mtx_lock(vtx->lock_tx);
-	sendq_empty = (vtx->sendq.head == NULL);
+	t = lattrace_now(lat);
 
-	if (!sendq_empty) {
-		++vtx->skipc;
-		mtx_unlock(vtx->lock_tx);
-		return;
+	/* Process video frame through all Video Filters */
+	for (le = vtx->filtl.head; le; le = le->next) {
+
+		struct vidfilt_enc_st *st = le->data;
+
+		if (st->vf && st->vf->ench) {
+			err |= st->vf->ench(st, frame, &timestamp);
+			lattrace_stamp(lat, st->vf->name, &t);
+		}
 	}
-	mtx_unlock(vtx->lock_tx);
 
-	mtx_lock(vtx->lock_enc);
+	if (err)
+		goto unlock;
 
-	/* Convert image */
-	if (frame->fmt != (enum vidfmt)vtx->video->cfg.enc_fmt) {
+	if (frame)
+		vtx->fmt = frame->fmt;
 
-		vtx->vsrc_size = frame->size;
+	/* keyframe requests of all legs are coalesced */
+	picup = vtx->picup;
+	if (vtx->share)
+		picup |= txshare_picup(vtx->share, tmr_jiffies());
 
-		if (!vtx->frame) {
+	if (vtx_adapt(vtx, frame, picup))
+		goto unlock;
 
-			err = vidframe_alloc(&vtx->frame,
-					     vtx->video->cfg.enc_fmt,
-					     &vtx->vsrc_size);
-			if (err)
-				goto out;
+	/* Encode the whole picture frame */
+	if (!vtx_layer_skip(vtx, 0)) {
+		err = vtx->vc->ench(vtx->enc, picup, frame, timestamp);
+		if (err)
+			goto unlock;
+
+		lattrace_stamp(lat, "encode", &t);
+
+		vtx->picup = false;
+	}
+
+	/* Simulcast layers, downscaled from the filtered frame */
+	for (unsigned i = 1; i < vtx->layerc; i++) {
+
+		err = vtx_layer_encode(vtx, i, frame, timestamp, picup);
+		if (err) {
+			warning("video: simulcast layer %s: %m\n",
+				vtx->layerv[i].rid, err);
 		}
+	}
+
+	if (vtx->layerc > 1)
+		lattrace_stamp(lat, "simulcast", &t);
 
-		vidconv(vtx->frame, frame, 0);
-		frame = vtx->frame;
+ unlock:
+	vtx_share_unlock(vtx);
+ out:
+	mtx_unlock(vtx->lock_enc);
+}
+
+
+/*
+ * Check if the encode thread skips a frame, called with lock_mbox held.
+ *
+ * A frame is skipped if the pacer needs more than one frame period to
+ * send the queued packets, or if the frame waited longer than one frame
+ * period for the encoder. The frame rate then goes down evenly, instead
+ * of bursts of frames followed by skipped frames.
+ */
+static bool vtx_enc_skip(struct vtx *vtx, uint64_t now)
+{
+	const uint64_t period = (uint64_t)(1000000.0 / get_fps(vtx->video));
+	uint32_t bitrate = vtx_pace_bitrate(vtx);
+	uint64_t drain;
+
+	mtx_lock(vtx->lock_tx);
+	drain = bitrate ? vtx->sendq_bytes * 8 * 1000000ULL / bitrate : 0;
+	mtx_unlock(vtx->lock_tx);
+
+	if (drain > period) {
+		++vtx->stats.skip_pacer;
+		return true;
 	}
 
-	/* Process video frame through all Video Filters */
-	for (le = vtx->filtl.head; le; le = le->next) {
+	if (now > vtx->mbox_jfs + period) {
+		++vtx->stats.skip_budget;
+		return true;
+	}
 
-		struct vidfilt_enc_st *st = le->data;
+	return false;
+}
 
-		if (st->vf && st->vf->ench)
-			err |= st->vf->ench(st, frame, &timestamp);
+
+/* Encode thread, encodes the latest frame from the mailbox */
+static int vtx_enc_thread(void *arg)
+{
+	struct vtx *vtx = arg;
+
+	mtx_lock(vtx->lock_mbox);
+
+	while (re_atomic_rlx(&vtx->run_enc)) {
+		struct vidframe *frame;
+		uint64_t ts, t0;
+
+		if (!vtx->mbox_full) {
+			cnd_wait(&vtx->wait_enc, vtx->lock_mbox);
+			continue;
+		}
+
+		vtx->mbox_full = false;
+
+		t0 = tmr_jiffies_usec();
+		if (vtx_enc_skip(vtx, t0))
+			continue;
+
+		/* the source writes the next frame to the other buffer */
+		frame         = vtx->mbox;
+		vtx->mbox     = vtx->mbox_enc;
+		vtx->mbox_enc = frame;
+		ts            = vtx->mbox_ts;
+
+		mtx_unlock(vtx->lock_mbox);
+
+		encode_rtp_send(vtx, frame, NULL, ts);
+
+		mtx_lock(vtx->lock_mbox);
+
+		++vtx->stats.enc_frames;
+		vtx->enc_usec = (vtx->enc_usec * 7 +
+				 tmr_jiffies_usec() - t0) / 8;
 	}
 
-	if (err)
-		goto out;
+	mtx_unlock(vtx->lock_mbox);
 
-	if (frame)
-		vtx->fmt = frame->fmt;
+	return 0;
+}
 
-	/* Encode the whole picture frame */
-	err = vtx->vc->ench(vtx->enc, vtx->picup, frame, timestamp);
+
+/* Start the encode thread, before the source delivers frames */
+static int vtx_enc_start(struct vtx *vtx)
+{
+	int err;
+
+	if (re_atomic_rlx(&vtx->run_enc))
+		return 0;
+
+	re_atomic_rlx_set(&vtx->run_enc, true);
+
+	err = thread_create_name(&vtx->thr_enc, "Video Enc",
+				 vtx_enc_thread, vtx);
 	if (err)
-		goto out;
+		re_atomic_rlx_set(&vtx->run_enc, false);
+
+	return err;
+}
 
-	vtx->picup = false;
 
- out:
-	mtx_unlock(vtx->lock_enc);
+static void vtx_enc_stop(struct vtx *vtx)
+{
+	if (!re_atomic_rlx(&vtx->run_enc))
+		return;
+
+	re_atomic_rlx_set(&vtx->run_enc, false);
+
+	mtx_lock(vtx->lock_mbox);
+	cnd_signal(&vtx->wait_enc);
+	mtx_unlock(vtx->lock_mbox);
+
+	thrd_join(vtx->thr_enc, NULL);
 }
 
 
 /**
  * Read frames from video source
  *
+ * The frame is converted to the encoder format into a buffer of the
+ * source, which is then swapped with the mailbox. The lock is only held
+ * for the swap, and a frame which is not yet taken by the encode thread
+ * is replaced.
+ *
  * @param frame      Video frame
  * @param timestamp  Frame timestamp in VIDEO_TIMEBASE units
  * @param arg        Handler argument
@@ -473,16 +1100,57 @@ static void vidsrc_frame_handler(struct vidframe *frame, uint64_t timestamp,
 				 void *arg)
 {
 	struct vtx *vtx = arg;
+	struct lattrace *lat = stream_lattrace(vtx->video->strm, true);
+	const enum vidfmt fmt = vtx->video->cfg.enc_fmt;
+	struct vidframe *src;
+	uint64_t t;
+	int err;
 
 	MAGIC_CHECK(vtx->video);
 
-	mtx_lock(vtx->lock_enc);
+	/* only the source thread uses this buffer */
+	src = vtx->mbox_src;
+
+	if (src && (src->fmt != fmt || !vidsz_cmp(&src->size, &frame->size)))
+		src = mem_deref(src);
+
+	if (!src) {
+		err = vidframe_alloc(&src, fmt, &frame->size);
+		if (err) {
+			vtx->mbox_src = NULL;
+			return;
+		}
+	}
+
+	t = lattrace_now(lat);
+
+	if (frame->fmt != fmt) {
+		vidconv(src, frame, 0);
+		lattrace_stamp(lat, "vidconv", &t);
+	}
+	else {
+		vidframe_copy(src, frame);
+	}
+
+	/* the source never waits for the encoder, which holds lock_enc */
+	mtx_lock(vtx->lock_mbox);
+
 	++vtx->frames;
 	++vtx->stats.src_frames;
-	mtx_unlock(vtx->lock_enc);
+	vtx->vsrc_size = frame->size;
 
-	/* Encode and send */
-	encode_rtp_send(vtx, frame, NULL, timestamp);
+	if (vtx->mbox_full)
+		++vtx->stats.skip_mbox;
+
+	vtx->mbox_src  = vtx->mbox;
+	vtx->mbox      = src;
+	vtx->mbox_ts   = timestamp;
+	vtx->mbox_jfs  = tmr_jiffies_usec();
+	vtx->mbox_full = true;
+
+	cnd_signal(&vtx->wait_enc);
+
+	mtx_unlock(vtx->lock_mbox);
 }
 
 
@@ -492,43 +1160,188 @@ static void vidsrc_packet_handler(struct vidpacket *packet, void *arg)
 
 	MAGIC_CHECK(vtx->video);
 
-	/* Encode and send */
-	encode_rtp_send(vtx, NULL, packet, packet->timestamp);
-}
+	/* Encode and send */
+	encode_rtp_send(vtx, NULL, packet, packet->timestamp);
+}
+
+
+static void vidsrc_error_handler(int err, void *arg)
+{
+	struct vtx *vtx = arg;
+
+	MAGIC_CHECK(vtx->video);
+
+	warning("video: video-source error: %m\n", err);
+
+	vtx->vsrc = mem_deref(vtx->vsrc);
+}
+
+
+/*
+ * Write the next transport-wide sequence number into the packet. Each
+ * packet on the wire has its own number, also a retransmission, which is
+ * sent from the NACK handler.
+ */
+static void vtx_twcc_stamp(struct vtx *vtx, struct vidqent *qent)
+{
+	uint16_t tseq;
+
+	if (!qent->twcc_pos)
+		return;
+
+	tseq = re_atomic_rlx_add(&vtx->twcc_seq, 1);
+
+	qent->mb->buf[qent->twcc_pos]     = tseq >> 8;
+	qent->mb->buf[qent->twcc_pos + 1] = tseq & 0xff;
+
+	bwe_sent(vtx->bwe, tseq, mbuf_get_left(qent->mb) + RTP_HEADER_SIZE,
+		 tmr_jiffies_usec());
+}
+
+
+/* Send the FEC packet in mb_fec, returns the number of bytes sent */
+static size_t vtx_fec_out(struct vtx *vtx, uint32_t ts)
+{
+	struct mbuf *mb = vtx->mb_fec;
+	size_t len;
+
+	mb->pos = RTP_PRESZ;
+	len = mbuf_get_left(mb) + RTP_HEADER_SIZE;
+
+	if (stream_send_ssrc(vtx->video->strm, vtx->fec_ssrc,
+			     vtx->fec_seq++, false, false, vtx->fec_pt,
+			     ts, mb))
+		return 0;
+
+	return len;
+}
+
+
+/*
+ * Add a sent packet of the first layer to the FEC encoder, and send the
+ * FEC packet when the group is complete. The header extension is part of
+ * the protected packet. Called with lock_tx held.
+ *
+ * VP8 partition 0 holds the modes and motion vectors, without it the
+ * other partitions can not be decoded. It is protected in groups of its
+ * own, which are half as large.
+ *
+ * @return Number of FEC bytes sent, for the pacer
+ */
+static size_t vtx_fec_send(struct vtx *vtx, const struct vidqent *qent)
+{
+	struct mbuf *mb = vtx->mb_fec;
+	struct rtp_header hdr;
+	size_t len = 0;
+
+	mbuf_rewind(mb);
+	mb->pos = mb->end = RTP_PRESZ;
+
+	if (qent->part0 != vtx->fec_part0 ||
+	    (qent->part0 && qent->part_start)) {
+
+		if (!fec_enc_flush(vtx->fec, mb)) {
+			len += vtx_fec_out(vtx, qent->ts);
+			mbuf_rewind(mb);
+			mb->pos = mb->end = RTP_PRESZ;
+		}
+
+		vtx->fec_part0 = qent->part0;
+		fec_enc_set_group(vtx->fec, qent->part0 ?
+				  (vtx->fec_k + 1) / 2 : vtx->fec_k);
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ext = qent->ext;
+	hdr.m   = qent->marker;
+	hdr.pt  = qent->pt;
+	hdr.seq = qent->seq;
+	hdr.ts  = qent->ts;
+
+	if (fec_enc_packet(vtx->fec, mb, &hdr,
+			   qent->mb->buf + RTP_PRESZ,
+			   qent->mb->end - RTP_PRESZ))
+		return len;
+
+	return len + vtx_fec_out(vtx, qent->ts);
+}
+
+
+/*
+ * RFC 5109 -- send an FEC stream for the first layer, if the peer accepted
+ * it. The protection adapts to the loss in the RTCP reports. The FEC SSRC
+ * was announced in the SDP and gets Sender Reports of its own.
+ */
+static int vtx_fec_set(struct video *v)
+{
+	struct vtx *vtx = &v->vtx;
+	const struct sdp_format *rf = NULL;
+	int err = 0;
+
+	if (v->cfg.fec) {
+		rf = sdp_media_format(stream_sdpmedia(v->strm), false, NULL,
+				      -1, "ulpfec", 90000, -1);
+	}
+
+	if (rf)
+		err = stream_ssrc_add(v->strm, vtx->fec_ssrc);
+	else if (vtx->fec_ssrc)
+		stream_ssrc_remove(v->strm, vtx->fec_ssrc);
+
+	if (err)
+		return err;
+
+	mtx_lock(vtx->lock_tx);
+
+	if (!rf) {
+		vtx->fec    = mem_deref(vtx->fec);
+		vtx->fec_pt = -1;
+		goto out;
+	}
+
+	if (!vtx->mb_fec) {
+		vtx->mb_fec = mbuf_alloc(RTP_PRESZ + PKT_SIZE + 64 +
+					 RTP_TRAILSZ);
+		if (!vtx->mb_fec) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
 
+	if (!vtx->fec) {
+		err = fec_enc_alloc(&vtx->fec, FEC_GROUP_INIT);
+		if (err)
+			goto out;
 
-static void vidsrc_error_handler(int err, void *arg)
-{
-	struct vtx *vtx = arg;
+		vtx->fec_k     = FEC_GROUP_INIT;
+		vtx->fec_part0 = false;
+	}
 
-	MAGIC_CHECK(vtx->video);
+	vtx->fec_pt  = rf->pt;
+	vtx->fec_vp8 = vtx->vc && 0 == str_casecmp(vtx->vc->name, "VP8");
 
-	warning("video: video-source error: %m\n", err);
+ out:
+	mtx_unlock(vtx->lock_tx);
 
-	vtx->vsrc = mem_deref(vtx->vsrc);
+	return err;
 }
 
 
 static int vtx_thread(void *arg)
 {
 	struct vtx *vtx = arg;
+	struct lattrace *lat = stream_lattrace(vtx->video->strm, true);
 	uint64_t jfs;
 	uint64_t start_jfs  = tmr_jiffies_usec();
 	uint64_t target_jfs = tmr_jiffies_usec();
-	uint32_t bitrate;
-
-	if (vtx->video->cfg.send_bitrate)
-		bitrate = vtx->video->cfg.send_bitrate;
-	else
-		bitrate = vtx->video->cfg.bitrate;
-
-	const uint64_t max_delay = PKT_SIZE * 8 * 1000000LL / bitrate + 1;
-	const uint64_t max_burst =
-		vtx->video->cfg.burst_bits * 1000000LL / bitrate;
+	uint64_t max_delay = 0;
+	uint64_t max_burst = 0;
+	uint32_t bitrate = 0;
 
 	struct vidqent *qent = NULL;
-	struct mbuf *mbd;
+	struct mbuf *mb;
 	size_t sent = 0;
+	size_t pos, end;
 
 	while (re_atomic_rlx(&vtx->run)) {
 		mtx_lock(vtx->lock_tx);
@@ -539,8 +1352,30 @@ static int vtx_thread(void *arg)
 			continue;
 		}
 		qent = vtx->sendq.head->data;
+
+		/* the first layer has the SSRC of the RTP socket */
+		if (qent->layer) {
+			struct vtx_layer *l = &vtx->layerv[qent->layer];
+
+			qent->ssrc = l->ssrc;
+			qent->seq  = l->seq++;
+		}
+		else {
+			qent->ssrc = 0;
+		}
 		mtx_unlock(vtx->lock_tx);
 
+		if (vtx_pace_bitrate(vtx) != bitrate) {
+
+			/* continue from the current target time */
+			bitrate   = vtx_pace_bitrate(vtx);
+			max_delay = PKT_SIZE * 8 * 1000000LL / bitrate + 1;
+			max_burst = vtx->video->cfg.burst_bits * 1000000LL /
+				bitrate;
+			start_jfs = target_jfs;
+			sent	  = 0;
+		}
+
 		jfs = tmr_jiffies_usec();
 
 		if (jfs < target_jfs) {
@@ -562,19 +1397,53 @@ static int vtx_thread(void *arg)
 		sent += mbuf_get_left(qent->mb) * 8;
 		target_jfs = start_jfs + sent * 1000000 / bitrate;
 
-		mbd = mbuf_dup(qent->mb);
+		vtx_twcc_stamp(vtx, qent);
+
+		lattrace_stamp(lat, "pacing", &qent->ts_queue);
+
+		/* the RTP header is written in front of the payload, the
+		 * payload is kept as is for retransmission */
+		mb = vidqent_sendbuf(vtx, qent,
+				     stream_has_menc(vtx->video->strm));
+		if (mb) {
+			pos = mb->pos;
+			end = mb->end;
+
+			if (qent->ssrc) {
+				stream_send_ssrc(vtx->video->strm, qent->ssrc,
+						 qent->seq, qent->ext,
+						 qent->marker, qent->pt,
+						 qent->ts, mb);
+			}
+			else {
+				stream_send(vtx->video->strm, qent->ext,
+					    qent->marker, qent->pt, qent->ts,
+					    mb);
+			}
 
-		stream_send(vtx->video->strm, qent->ext, qent->marker,
-			    qent->pt, qent->ts, qent->mb);
+			mb->pos = pos;
+			mb->end = end;
+		}
 
-		mem_deref(qent->mb);
+		lattrace_stamp(lat, "send", &qent->ts_queue);
 
 		qent->jfs_nack = jfs + NACK_QUEUE_TIME * 1000;
-		qent->seq = rtp_sess_seq(stream_rtp_sock(vtx->video->strm));
-		qent->mb  = mbd;
+		if (!qent->ssrc) {
+			qent->seq = rtp_sess_seq(
+				stream_rtp_sock(vtx->video->strm));
+		}
 
 		mtx_lock(vtx->lock_tx);
+		if (vtx->fec && !qent->ssrc && mb)
+			sent += vtx_fec_send(vtx, qent) * 8;
+
+		vtx->sendq_bytes -= min(vtx->sendq_bytes,
+					mbuf_get_left(qent->mb));
+		vtx->layerv[qent->layer].sendq_bytes -=
+			min(vtx->layerv[qent->layer].sendq_bytes,
+			    mbuf_get_left(qent->mb));
 		list_move(&qent->le, &vtx->sendqnb);
+		++vtx->sendqnbc;
 
 		/* Delayed NACK queue cleanup */
 		struct le *le = vtx->sendqnb.head;
@@ -584,7 +1453,7 @@ static int vtx_thread(void *arg)
 			le = le->next;
 
 			if (jfs > qent->jfs_nack)
-				mem_deref(qent);
+				vidqent_release(vtx, qent);
 			else
 				break; /* Assuming list is sorted by time */
 		}
@@ -607,7 +1476,12 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 	if (err)
 		return err;
 
+	err = mutex_alloc(&vtx->lock_mbox);
+	if (err)
+		return err;
+
 	err |= cnd_init(&vtx->wait) != thrd_success;
+	err |= cnd_init(&vtx->wait_enc) != thrd_success;
 	if (err)
 		return ENOMEM;
 
@@ -620,10 +1494,70 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 
 	vtx->fmt = (enum vidfmt)-1;
 
+	for (unsigned i = 0; i < SIMULCAST_MAX; i++) {
+		struct vtx_layer *l = &vtx->layerv[i];
+		const unsigned scale = layerdefv[i].scale;
+
+		str_ncpy(l->rid, layerdefv[i].rid, sizeof(l->rid));
+		l->scale   = scale;
+		l->bitrate = video->cfg.bitrate / (scale * scale);
+		l->ssrc    = i ? rand_u32() : 0;
+		l->seq     = rand_u16();
+	}
+
+	vtx->layerc = 1;
+
+	if (video->cfg.adaptive) {
+		err = viddiff_alloc(&vtx->diff);
+		if (err)
+			return err;
+	}
+
 	return 0;
 }
 
 
+/*
+ * Set the simulcast layers with the RTP stream IDs of the peer, called in
+ * the main thread. RTCP sender reports are sent for the SSRC of each
+ * layer, the first one has the SSRC of the RTP socket.
+ */
+static int vtx_simulcast_set(struct vtx *vtx, unsigned n, uint8_t extid,
+			     char ridv[][RID_SIZE])
+{
+	struct stream *strm = vtx->video->strm;
+	int err = 0;
+
+	n = min(max(n, 1u), (unsigned)SIMULCAST_MAX);
+
+	mtx_lock(vtx->lock_enc);
+	mtx_lock(vtx->lock_tx);
+
+	for (unsigned i = 0; ridv && i < n; i++)
+		str_ncpy(vtx->layerv[i].rid, ridv[i], RID_SIZE);
+
+	for (unsigned i = n; i < SIMULCAST_MAX; i++) {
+		vtx->layerv[i].enc   = mem_deref(vtx->layerv[i].enc);
+		vtx->layerv[i].frame = mem_deref(vtx->layerv[i].frame);
+	}
+
+	vtx->layerc    = n;
+	vtx->extid_rid = extid;
+
+	mtx_unlock(vtx->lock_tx);
+	mtx_unlock(vtx->lock_enc);
+
+	for (unsigned i = 1; i < SIMULCAST_MAX; i++) {
+		if (i < n)
+			err |= stream_ssrc_add(strm, vtx->layerv[i].ssrc);
+		else
+			stream_ssrc_remove(strm, vtx->layerv[i].ssrc);
+	}
+
+	return err;
+}
+
+
 static int vrx_alloc(struct vrx *vrx, struct video *video)
 {
 	int err;
@@ -733,6 +1667,60 @@ static void vidframe_clear(struct vidframe *frame)
 }
 
 
+/*
+ * Hardware frames are only requested from the decoder if the display can
+ * take them and no filter in the chain needs the pixels in system memory
+ */
+static bool vrx_hw_accept(const struct vrx *vrx)
+{
+	struct le *le;
+
+	if (!vrx->vd || !vrx->vd->disphwh || !vrx->vidisp)
+		return false;
+
+	for (le = vrx->filtl.head; le; le = le->next) {
+
+		const struct vidfilt_dec_st *st = le->data;
+
+		if (st->vf && st->vf->dech && !st->vf->dechwh)
+			return false;
+	}
+
+	return true;
+}
+
+
+static int vrx_display(struct vrx *vrx, const char *title,
+		       const struct vidframe *frame,
+		       const struct vidframe_hw *hw, uint64_t timestamp)
+{
+	struct vidframe *frame_dl = NULL;
+	int err;
+
+	if (hw) {
+		err = vrx->vd->disphwh(vrx->vidisp, title, hw, timestamp);
+		if (err != ENOTSUP)
+			return err;
+
+		/* the display cannot use this surface */
+		err = vidframe_hw_download(&frame_dl, hw);
+		if (err)
+			return err;
+
+		++vrx->stats.hw_downloads;
+		frame = frame_dl;
+	}
+
+	err = 0;
+	if (vrx->vd->disph)
+		err = vrx->vd->disph(vrx->vidisp, title, frame, timestamp);
+
+	mem_deref(frame_dl);
+
+	return err;
+}
+
+
 /**
  * Decode incoming RTP packets using the Video decoder
  *
@@ -751,12 +1739,18 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	struct vidframe *frame_filt = NULL;
 	struct vidframe frame_store, *frame = &frame_store;
 	struct viddec_packet pkt = {.mb = mb, .hdr = hdr};
+	struct vidframe_hw hw;
+	struct lattrace *lat = stream_lattrace(v->strm, false);
 	struct le *le;
+	uint64_t t0, t;
 	int err = 0;
 
 	if (!hdr || !mbuf_get_left(mb))
 		return 0;
 
+	t0 = lattrace_marked(lat, hdr->seq);
+	t  = lattrace_now(lat);
+
 	mtx_lock(&vrx->lock);
 
 	/* No decoder set */
@@ -773,6 +1767,10 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 						  vrx->ts_recv.last));
 
 	vidframe_clear(frame);
+	memset(&hw, 0, sizeof(hw));
+
+	if (vrx_hw_accept(vrx))
+		pkt.hw = &hw;
 
 	err = vrx->vc->dech(vrx->dec, frame, &pkt);
 	if (err) {
@@ -792,13 +1790,30 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 
 	if (pkt.intra) {
 		tmr_cancel(&vrx->tmr_picup);
+		vrx->need_key = false;
 		++vrx->n_intra;
 	}
 
 	/* Got a full picture-frame? */
-	if (!vidframe_isvalid(frame))
+	if (hw.surface) {
+		frame->size = hw.size;
+		frame->fmt  = hw.fmt;
+	}
+	else if (!vidframe_isvalid(frame))
 		goto out;
 
+	/* the packet which completed the frame */
+	if (t0)
+		lattrace_add(lat, "jbuf", t > t0 ? t - t0 : 0);
+
+	lattrace_stamp(lat, "decode", &t);
+
+	/* A frame was lost, do not display until the next keyframe */
+	if (vrx->need_key) {
+		++vrx->stats.skip_frames;
+		goto out;
+	}
+
 	if (!vrx->size.w) {
 		info("video: receiving with resolution %u x %u"
 		     " and format '%s'\n",
@@ -809,31 +1824,55 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	vrx->size = frame->size;
 	vrx->fmt  = frame->fmt;
 
-	if (!list_isempty(&vrx->filtl)) {
+	if (hw.surface) {
 
-		err = vidframe_alloc(&frame_filt, frame->fmt, &frame->size);
-		if (err)
-			goto out;
+		++vrx->stats.hw_frames;
+
+		/* The surface stays on the GPU, see vrx_hw_accept() */
+		for (le = vrx->filtl.head; le; le = le->next) {
 
-		vidframe_copy(frame_filt, frame);
+			struct vidfilt_dec_st *st = le->data;
 
-		frame = frame_filt;
+			if (st->vf && st->vf->dechwh) {
+				err |= st->vf->dechwh(st, &hw, &pkt.timestamp);
+				lattrace_stamp(lat, st->vf->name, &t);
+			}
+		}
 	}
+	else {
+		if (!list_isempty(&vrx->filtl)) {
 
-	/* Process video frame through all Video Filters */
-	for (le = vrx->filtl.head; le; le = le->next) {
+			err = vidframe_alloc(&frame_filt, frame->fmt,
+					     &frame->size);
+			if (err)
+				goto out;
 
-		struct vidfilt_dec_st *st = le->data;
+			vidframe_copy(frame_filt, frame);
 
-		if (st->vf && st->vf->dech)
-			err |= st->vf->dech(st, frame, &pkt.timestamp);
+			frame = frame_filt;
+		}
+
+		/* Process video frame through all Video Filters */
+		for (le = vrx->filtl.head; le; le = le->next) {
+
+			struct vidfilt_dec_st *st = le->data;
+
+			if (st->vf && st->vf->dech) {
+				err |= st->vf->dech(st, frame, &pkt.timestamp);
+				lattrace_stamp(lat, st->vf->name, &t);
+			}
+		}
 	}
 
 	++vrx->stats.disp_frames;
 
-	if (vrx->vd && vrx->vd->disph && vrx->vidisp)
-		err = vrx->vd->disph(vrx->vidisp, v->peer, frame,
-				     pkt.timestamp);
+	if (vrx->vd && vrx->vidisp)
+		err = vrx_display(vrx, v->peer, frame,
+				  hw.surface ? &hw : NULL, pkt.timestamp);
+
+	lattrace_stamp(lat, "vidisp", &t);
+	if (t0)
+		lattrace_add(lat, "total", t - t0);
 
 	frame_filt = mem_deref(frame_filt);
 	if (err == ENODEV) {
@@ -881,6 +1920,52 @@ static int stream_pt_handler(uint8_t pt, struct mbuf *mb, void *arg)
 }
 
 
+static void vidjbuf_nack_handler(uint16_t pid, uint16_t blp, void *arg)
+{
+	struct video *v = arg;
+	int err;
+
+	if (!v->nack_pli)
+		return;
+
+	err = rtcp_send_nack(stream_rtp_sock(v->strm), pid, blp);
+	if (err)
+		warning("video: failed to send RTCP NACK: %m\n", err);
+}
+
+
+/*
+ * Frame jitter buffer -- lost packets are requested with NACK, and a
+ * picture update is only requested if a frame had to be given up
+ */
+static void vidjbuf_decode(struct vrx *vrx, const struct rtp_header *hdr,
+			   struct mbuf *mb)
+{
+	struct rtp_header hdr2;
+	struct mbuf *mb2;
+	bool lost;
+
+	if (!mbuf_get_left(mb))
+		return;
+
+	(void)vidjbuf_put(vrx->vjb, hdr, mb);
+
+	while (0 == vidjbuf_get(vrx->vjb, &hdr2, &mb2, &lost)) {
+
+		if (lost) {
+			mtx_lock(&vrx->lock);
+			vrx->need_key = true;
+			mtx_unlock(&vrx->lock);
+
+			request_picture_update(vrx);
+		}
+
+		(void)video_stream_decode(vrx, &hdr2, mb2);
+		mem_deref(mb2);
+	}
+}
+
+
 /* Handle incoming stream data from the network */
 static void stream_recv_handler(const struct rtp_header *hdr,
 				struct rtpext *extv, size_t extc,
@@ -894,6 +1979,11 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 
 	MAGIC_CHECK(v);
 
+	if (v->vrx.vjb) {
+		vidjbuf_decode(&v->vrx, hdr, mb);
+		return;
+	}
+
 	/* in case of packet loss, we need to receive a new keyframe */
 	if (lostc)
 		request_picture_update(&v->vrx);
@@ -907,12 +1997,18 @@ static void rtcp_nack_handler(struct vtx *vtx, struct rtcp_msg *msg)
 	uint16_t nack_pid;
 	uint16_t nack_blp;
 	uint16_t pids[NACK_BLPSZ + 1];
+	uint32_t ssrc;
 	struct le *le;
 
 	if (!msg || msg->hdr.count != RTCP_RTPFB_GNACK ||
 	    !msg->r.fb.fci.gnackv)
 		return;
 
+	/* the packets of the first layer are stored with SSRC 0 */
+	ssrc = msg->r.fb.ssrc_media;
+	if (ssrc == rtp_sess_ssrc(stream_rtp_sock(vtx->video->strm)))
+		ssrc = 0;
+
 	nack_pid = msg->r.fb.fci.gnackv->pid;
 	nack_blp = msg->r.fb.fci.gnackv->blp;
 	pids[0]	 = nack_pid;
@@ -929,26 +2025,211 @@ static void rtcp_nack_handler(struct vtx *vtx, struct rtcp_msg *msg)
 	LIST_FOREACH(&vtx->sendqnb, le) {
 		struct vidqent *qent = le->data;
 
-		if (qent->seq == nack_pid)
-			break;
+		if (qent->ssrc == ssrc && qent->seq == nack_pid)
+			break;
+	}
+
+	for (int i = 0; i < NACK_BLPSZ + 1 && le;) {
+		struct vidqent *qent = le->data;
+
+		le = le->next;
+
+		/* packets of the other simulcast layers */
+		if (qent->ssrc != ssrc)
+			continue;
+
+		if (qent->seq != pids[i++])
+			continue;
+
+		debug("NACK resend rtp seq: %u\n", qent->seq);
+
+		vtx_twcc_stamp(vtx, qent);
+
+		if (ssrc) {
+			stream_send_ssrc(vtx->video->strm, ssrc, qent->seq,
+					 qent->ext, qent->marker, qent->pt,
+					 qent->ts, qent->mb);
+		}
+		else {
+			stream_resend(vtx->video->strm, qent->seq, qent->ext,
+				      qent->marker, qent->pt, qent->ts,
+				      qent->mb);
+		}
+
+		/* sent only once */
+		vidqent_release(vtx, qent);
+	}
+
+	mtx_unlock(vtx->lock_tx);
+}
+
+
+static void twcc_status_handler(uint16_t seq, bool received, int64_t arrival,
+				void *arg)
+{
+	struct vtx *vtx = arg;
+
+	bwe_feedback(vtx->bwe, seq, received, arrival);
+}
+
+
+/*
+ * Follow the bandwidth estimate with the encoder. The steps are coarse
+ * and rate-limited, since most encoders are re-initialized when the
+ * bitrate is changed.
+ */
+static void vtx_encoder_update(struct vtx *vtx, uint32_t bitrate)
+{
+	struct video *v = vtx->video;
+	struct videnc_param prm;
+	const uint64_t now = tmr_jiffies();
+	uint64_t cur;
+	bool update = false;
+	int err;
+
+	if (bitrate > v->cfg.bitrate)
+		bitrate = v->cfg.bitrate;
+
+	mtx_lock(vtx->lock_enc);
+
+	/* a shared encoder keeps the configured bitrate */
+	if (!vtx->vc || !vtx->enc || vtx->share)
+		goto out;
+
+	cur = vtx->enc_bitrate;
+
+	if (bitrate * 100ULL <= cur * (100 - ENC_STEP_PCT))
+		update = now >= vtx->ts_encupd + ENC_DOWN_TIME;
+	else if (bitrate * 100ULL >= cur * (100 + ENC_STEP_PCT) ||
+		 (bitrate == v->cfg.bitrate && bitrate > cur))
+		update = now >= vtx->ts_encupd + ENC_UP_TIME;
+
+	if (!update)
+		goto out;
+
+	prm.bitrate = bitrate;
+	prm.pktsize = PKT_SIZE;
+	prm.fps     = get_fps(v);
+	prm.max_fs  = -1;
+
+	debug("video: encoder bitrate %llu -> %u bit/s\n", cur, bitrate);
+
+	err = vtx->vc->encupdh(&vtx->enc, vtx->vc, &prm, vtx->params,
+			       packet_handler, v);
+	if (err) {
+		warning("video: encoder update: %m\n", err);
+		goto out;
+	}
+
+	vtx->enc_bitrate = bitrate;
+	vtx->ts_encupd   = now;
+
+ out:
+	mtx_unlock(vtx->lock_enc);
+}
+
+
+/*
+ * Request a keyframe for the simulcast layer with the SSRC, or for all
+ * layers if the SSRC is 0. A shared encoder coalesces the requests of
+ * all legs.
+ */
+static void vtx_picup(struct vtx *vtx, uint32_t ssrc)
+{
+	mtx_lock(vtx->lock_enc);
+
+	/* a keyframe for one simulcast layer */
+	for (unsigned i = 1; ssrc && i < vtx->layerc; i++) {
+		if (vtx->layerv[i].ssrc == ssrc) {
+			vtx->layerv[i].picup = true;
+			goto out;
+		}
+	}
+
+	if (vtx->share) {
+		txshare_picup_req(vtx->share);
+	}
+	else {
+		vtx->picup = true;
+
+		/* all layers, if the SSRC is not known */
+		for (unsigned i = 1; !ssrc && i < vtx->layerc; i++)
+			vtx->layerv[i].picup = true;
+	}
+
+ out:
+	mtx_unlock(vtx->lock_enc);
+}
+
+
+/*
+ * The FEC stream is sent within the bitrate, the encoder gets the rest.
+ * There is one FEC packet per group of k media packets.
+ */
+static uint32_t vtx_media_bitrate(struct vtx *vtx, uint32_t bitrate)
+{
+	unsigned k;
+
+	mtx_lock(vtx->lock_tx);
+	k = vtx->fec ? vtx->fec_k : 0;
+	mtx_unlock(vtx->lock_tx);
+
+	if (!k)
+		return bitrate;
+
+	return (uint32_t)((uint64_t)bitrate * k / (k + 1));
+}
+
+
+static void vtx_fec_update(struct vtx *vtx, const struct rtcp_msg *msg)
+{
+	struct stream *strm = vtx->video->strm;
+	double loss;
+
+	if (fec_rtcp_loss(msg, rtp_sess_ssrc(stream_rtp_sock(strm)), &loss))
+		return;
+
+	mtx_lock(vtx->lock_tx);
+	vtx->fec_k = fec_group(loss);
+	fec_enc_set_group(vtx->fec, vtx->fec_part0 ?
+			  (vtx->fec_k + 1) / 2 : vtx->fec_k);
+	mtx_unlock(vtx->lock_tx);
+
+	/* with BWE, the encoder follows the next feedback */
+	if (!vtx->bwe) {
+		vtx_encoder_update(vtx, vtx_media_bitrate(vtx,
+					  vtx->video->cfg.bitrate));
+	}
+}
+
+
+static void rtcp_twcc_handler(struct vtx *vtx, const struct rtcp_msg *msg)
+{
+	const struct config_video *cfg = &vtx->video->cfg;
+	uint32_t target;
+	uint32_t pace;
+	int err;
+
+	if (!vtx->bwe || !msg->r.fb.fci.twccv)
+		return;
+
+	err = twcc_decode(msg->r.fb.fci.twccv, twcc_status_handler, vtx);
+	if (err) {
+		debug("video: transport-wide feedback: %m\n", err);
+		return;
 	}
 
-	for (int i = 0; i < NACK_BLPSZ + 1 && le; i++) {
-		struct vidqent *qent = le->data;
-
-		le = le->next;
-		if (qent->seq != pids[i])
-			continue;
+	target = bwe_update(vtx->bwe, tmr_jiffies_usec());
 
-		debug("NACK resend rtp seq: %u\n", pids[i]);
-		stream_resend(vtx->video->strm, qent->seq, qent->ext,
-			      qent->marker, qent->pt, qent->ts, qent->mb);
+	/* keep the configured headroom of the sender */
+	pace = target;
+	if (cfg->send_bitrate > cfg->bitrate)
+		pace = (uint32_t)((uint64_t)target * cfg->send_bitrate /
+				  cfg->bitrate);
 
-		/* sent only once */
-		mem_deref(qent);
-	}
+	re_atomic_rlx_set(&vtx->pace_bitrate, pace);
 
-	mtx_unlock(vtx->lock_tx);
+	vtx_encoder_update(vtx, vtx_media_bitrate(vtx, target));
 }
 
 
@@ -963,22 +2244,26 @@ static void rtcp_handler(struct stream *strm, struct rtcp_msg *msg, void *arg)
 	switch (msg->hdr.pt) {
 
 	case RTCP_FIR:
-		mtx_lock(vtx->lock_enc);
-		vtx->picup = true;
-		mtx_unlock(vtx->lock_enc);
+		vtx_picup(vtx, msg->r.fir.ssrc);
 		break;
 
 	case RTCP_PSFB:
 		if (msg->hdr.count == RTCP_PSFB_PLI) {
 			debug("video: recv Picture Loss Indication (PLI)\n");
-			mtx_lock(vtx->lock_enc);
-			vtx->picup = true;
-			mtx_unlock(vtx->lock_enc);
+			vtx_picup(vtx, msg->r.fb.ssrc_media);
 		}
 		break;
 
 	case RTCP_RTPFB:
-		rtcp_nack_handler(vtx, msg);
+		if (msg->hdr.count == RTCP_RTPFB_TWCC)
+			rtcp_twcc_handler(vtx, msg);
+		else
+			rtcp_nack_handler(vtx, msg);
+		break;
+
+	case RTCP_SR:
+	case RTCP_RR:
+		vtx_fec_update(vtx, msg);
 		break;
 
 	default:
@@ -1043,6 +2328,53 @@ static int vrx_print_pipeline(struct re_printf *pf, const struct vrx *vrx)
 }
 
 
+/*
+ * Local SDP attributes of the simulcast layers (RFC 8853). The extmap of
+ * the RTP stream ID is only added if the ID is set.
+ */
+static int simulcast_sdp_encode(struct video *v, uint8_t extid, unsigned n)
+{
+	struct sdp_media *m = stream_sdpmedia(v->strm);
+	char list[SIMULCAST_MAX * RID_SIZE] = "";
+	int err = 0;
+
+	n = min(n, (unsigned)SIMULCAST_MAX);
+
+	if (extid)
+		err |= sdp_media_set_extmap(m, extid, uri_rid);
+
+	for (unsigned i = 0; i < n; i++) {
+		const size_t len = str_len(list);
+
+		const char *rid = v->vtx.layerv[i].rid;
+
+		err |= sdp_media_set_lattr(m, i == 0, "rid", "%s send", rid);
+
+		(void)re_snprintf(list + len, sizeof(list) - len, "%s%s",
+				  i ? ";" : "", rid);
+	}
+
+	err |= sdp_media_set_lattr(m, true, "simulcast", "send %s", list);
+
+	return err;
+}
+
+
+/*
+ * An RTP relay sends on the stream instead of the encoder, so the source
+ * and the encode thread are stopped while it is active
+ */
+static void stream_relay_handler(bool relayed, void *arg)
+{
+	struct video *v = arg;
+
+	if (relayed)
+		vtx_source_stop(v);
+	else if (re_atomic_rlx(&v->vtx.run))
+		(void)vtx_source_start(v);
+}
+
+
 /**
  * Allocate a video stream
  *
@@ -1099,6 +2431,23 @@ int video_alloc(struct video **vp, struct list *streaml,
 
 	tmr_init(&v->tmr);
 
+	if (cfg->avt.video.jbtype == JBUF_FRAME) {
+		err = vidjbuf_alloc(&v->vrx.vjb, cfg->avt.video.jbuf_del.max,
+				    vidjbuf_nack_handler, v);
+		if (err)
+			goto out;
+	}
+
+	if (v->cfg.bwe) {
+		uint32_t min = v->cfg.bitrate < BWE_MIN_BITRATE ?
+			v->cfg.bitrate : BWE_MIN_BITRATE;
+
+		err = bwe_alloc(&v->vtx.bwe, min, v->cfg.bitrate,
+				v->cfg.bitrate);
+		if (err)
+			goto out;
+	}
+
 	err = stream_alloc(&v->strm, streaml, stream_prm,
 			   &cfg->avt, sdp_sess, MEDIA_VIDEO,
 			   mnat, mnat_sess, menc, menc_sess, offerer,
@@ -1107,6 +2456,8 @@ int video_alloc(struct video **vp, struct list *streaml,
 	if (err)
 		goto out;
 
+	stream_set_relay_handler(v->strm, stream_relay_handler);
+
 	if (vidisp_find(baresip_vidispl(), NULL) == NULL)
 		stream_set_ldir(v->strm, SDP_SENDONLY);
 
@@ -1129,6 +2480,26 @@ int video_alloc(struct video **vp, struct list *streaml,
 	err |= sdp_media_set_lattr(stream_sdpmedia(v->strm), false,
 				   "rtcp-fb", "* nack pli");
 
+	/* Transport-wide Congestion Control */
+	if (v->cfg.bwe) {
+		err |= sdp_media_set_lattr(stream_sdpmedia(v->strm), false,
+					   "rtcp-fb", "* transport-cc");
+
+		if (offerer) {
+			uint8_t id = stream_generate_extmap_id(v->strm);
+
+			err |= sdp_media_set_extmap(stream_sdpmedia(v->strm),
+						    id, uri_twcc);
+		}
+	}
+
+	/* Simulcast (RFC 8853) */
+	if (offerer && v->cfg.simulcast > 1) {
+		uint8_t id = stream_generate_extmap_id(v->strm);
+
+		err |= simulcast_sdp_encode(v, id, v->cfg.simulcast);
+	}
+
 	/* RFC 4796 */
 	if (content) {
 		err |= sdp_media_set_lattr(stream_sdpmedia(v->strm), true,
@@ -1150,6 +2521,28 @@ int video_alloc(struct video **vp, struct list *streaml,
 				      "%s", vc->fmtp);
 	}
 
+	/* RFC 5109, RFC 5956 */
+	if (v->cfg.fec && !list_isempty(vidcodecl)) {
+		struct sdp_media *m = stream_sdpmedia(v->strm);
+		const uint32_t ssrc = rtp_sess_ssrc(stream_rtp_sock(v->strm));
+
+		do {
+			v->vtx.fec_ssrc = rand_u32();
+		} while (!v->vtx.fec_ssrc || v->vtx.fec_ssrc == ssrc);
+
+		v->vtx.fec_seq = rand_u16();
+
+		err |= sdp_format_add(NULL, m, false,
+				      NULL, "ulpfec", 90000, 1,
+				      NULL, NULL, NULL, false, NULL);
+		err |= sdp_media_set_lattr(m, false, "ssrc", "%u cname:%s",
+					   v->vtx.fec_ssrc,
+					   stream_prm->cname);
+		err |= sdp_media_set_lattr(m, false, "ssrc-group",
+					   "FEC-FR %u %u",
+					   ssrc, v->vtx.fec_ssrc);
+	}
+
 	/* Video filters */
 	for (le = list_head(vidfiltl); le; le = le->next) {
 		struct vidfilt *vf = le->data;
@@ -1232,17 +2625,16 @@ static void tmr_handler(void *arg)
 
 	tmr_start(&v->tmr, TMR_INTERVAL * 1000, tmr_handler, v);
 
-	/* protect vtx.frames */
-	mtx_lock(v->vtx.lock_enc);
-
 	/* Estimate framerates */
+	mtx_lock(v->vtx.lock_mbox);
 	v->vtx.efps = (double)v->vtx.frames / (double)TMR_INTERVAL;
-	v->vrx.efps = (double)v->vrx.frames / (double)TMR_INTERVAL;
-
 	v->vtx.frames = 0;
-	v->vrx.frames = 0;
+	mtx_unlock(v->vtx.lock_mbox);
 
-	mtx_unlock(v->vtx.lock_enc);
+	mtx_lock(&v->vrx.lock);
+	v->vrx.efps = (double)v->vrx.frames / (double)TMR_INTERVAL;
+	v->vrx.frames = 0;
+	mtx_unlock(&v->vrx.lock);
 }
 
 
@@ -1314,27 +2706,102 @@ int video_update(struct video *v, const char *peer)
 }
 
 
-/**
- * Start the video source
- *
- * @param v   Video object
- *
- * @return 0 if success, otherwise errorcode
+/*
+ * Start the encode thread and open the video source, which delivers the
+ * frames to the mailbox. A source which fails to open is only logged.
  */
-int video_start_source(struct video *v)
+static int vtx_vsrc_open(struct vtx *vtx)
 {
 	struct vidsz size;
 	int err;
 
-	if (!v)
-		return EINVAL;
+	err = vtx_enc_start(vtx);
+	if (err)
+		return err;
+
+	/* the source thread might already write the size */
+	mtx_lock(vtx->lock_mbox);
+	size = vtx->vsrc_size;
+	mtx_unlock(vtx->lock_mbox);
+
+	err = vtx->vs->alloch(&vtx->vsrc, vtx->vs, &vtx->vsrc_prm,
+			      &size, NULL, vtx->device,
+			      vidsrc_frame_handler, vidsrc_packet_handler,
+			      vidsrc_error_handler, vtx);
+	if (err) {
+		warning("video: could not set source to [%u x %u] %m\n",
+			size.w, size.h, err);
+	}
+
+	return 0;
+}
+
+
+/* The next leg of the shared encoder takes over with its own source */
+static void vtx_share_leader_handler(void *leg)
+{
+	struct video *v = leg;
+	int err;
+
+	if (v->vtx.vsrc || !v->vtx.vs || stream_is_relayed(v->strm))
+		return;
+
+	err = vtx_vsrc_open(&v->vtx);
+	if (err)
+		warning("video: shared encoder takeover failed (%m)\n", err);
+}
+
+
+/*
+ * Subscribe to the shared encoder of all calls with the same source,
+ * codec and encoder parameters, called in the main thread
+ */
+static int vtx_share_join(struct vtx *vtx)
+{
+	const struct video *v = vtx->video;
+	struct txshare *share = NULL;
+	char *key = NULL;
+	int err;
+
+	vtx_share_leave(vtx);
 
-	if (v->vtx.vsrc)
+	if (!v->cfg.txshare || !vtx->vc)
 		return 0;
 
+	err = re_sdprintf(&key, "video:%s;%s;%s,%s;%ux%u;%u;%.2f;%s",
+			  vtx->vc->name, vtx->params,
+			  v->cfg.src_mod, vtx->device,
+			  v->cfg.width, v->cfg.height, v->cfg.bitrate,
+			  get_fps(v), vidfmt_name(v->cfg.enc_fmt));
+	if (err)
+		return err;
+
+	err = txshare_alloc(&share, key, vtx_share_leader_handler);
+	if (err)
+		goto out;
+
+	mtx_lock(vtx->lock_enc);
+	vtx->share = share;
+	mtx_unlock(vtx->lock_enc);
+
+	txshare_join(share, &vtx->le_share, vtx->video);
+
+ out:
+	mem_deref(key);
+
+	return err;
+}
+
+
+/* Start the encode thread and the source, not while an RTP relay sends */
+static int vtx_source_start(struct video *v)
+{
 	struct vtx *vtx = &v->vtx;
+	struct vidsz size;
+	int err;
 
-	debug("video: start source\n");
+	if (stream_is_relayed(v->strm))
+		return 0;
 
 	if (vidsrc_find(baresip_vidsrcl(), NULL)) {
 		struct vidsrc *vs;
@@ -1350,23 +2817,28 @@ int video_start_source(struct video *v)
 		size.w = v->cfg.width;
 		size.h = v->cfg.height;
 
-		vtx->vsrc_size       = size;
+		mtx_lock(vtx->lock_mbox);
+		vtx->vsrc_size = size;
+		mtx_unlock(vtx->lock_mbox);
+
 		vtx->vsrc_prm.fps    = get_fps(v);
 		vtx->vsrc_prm.fmt    = v->cfg.enc_fmt;
 
 		vtx->vsrc = mem_deref(vtx->vsrc);
+		vtx->vs   = vs;
 
-		err = vs->alloch(&vtx->vsrc, vs, &vtx->vsrc_prm,
-				 &vtx->vsrc_size, NULL, v->vtx.device,
-				 vidsrc_frame_handler, vidsrc_packet_handler,
-				 vidsrc_error_handler, vtx);
-		if (err) {
-			warning("video: could not set source to"
-				" [%u x %u] %m\n",
-				size.w, size.h, err);
+		/* before the source, which might start sending */
+		err = vtx_share_join(vtx);
+		if (err)
+			return err;
+
+		/* the other legs send the packets of the leader */
+		if (!vtx->share || txshare_leader(vtx->share, v)) {
+			err = vtx_vsrc_open(vtx);
+			if (err)
+				return err;
 		}
 
-		vtx->vs = vs;
 		if (v->vtx.vc)
 			info("%H", vtx_print_pipeline, &v->vtx);
 	}
@@ -1374,6 +2846,47 @@ int video_start_source(struct video *v)
 		info("video: no video source\n");
 	}
 
+	return 0;
+}
+
+
+static void vtx_source_stop(struct video *v)
+{
+	vtx_share_leave(&v->vtx);
+
+	v->vtx.vsrc = mem_deref(v->vtx.vsrc);
+
+	vtx_enc_stop(&v->vtx);
+}
+
+
+/**
+ * Start the video source
+ *
+ * @param v   Video object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int video_start_source(struct video *v)
+{
+	struct vtx *vtx;
+	int err;
+
+	if (!v)
+		return EINVAL;
+
+	/* a leg of a shared encoder runs without a source of its own */
+	if (v->vtx.vsrc || v->vtx.share)
+		return 0;
+
+	vtx = &v->vtx;
+
+	debug("video: start source\n");
+
+	err = vtx_source_start(v);
+	if (err)
+		return err;
+
 	if (!re_atomic_rlx(&vtx->run)) {
 		re_atomic_rlx_set(&vtx->run, true);
 		thread_create_name(&vtx->thrd, "Video TX", vtx_thread, vtx);
@@ -1448,7 +2961,7 @@ static void video_stop_source(struct video *v)
 	debug("video: stopping video source ..\n");
 
 	stream_enable_tx(v->strm, false);
-	v->vtx.vsrc = mem_deref(v->vtx.vsrc);
+	vtx_source_stop(v);
 
 	if (re_atomic_rlx(&v->vtx.run)) {
 		re_atomic_rlx_set(&v->vtx.run, false);
@@ -1457,8 +2970,7 @@ static void video_stop_source(struct video *v)
 	}
 
 	mtx_lock(v->vtx.lock_tx);
-	list_flush(&v->vtx.sendq);
-	list_flush(&v->vtx.sendqnb);
+	vtx_sendq_flush(&v->vtx);
 	mtx_unlock(v->vtx.lock_tx);
 }
 
@@ -1565,7 +3077,8 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 
 		struct videnc_param prm;
 
-		prm.bitrate = v->cfg.bitrate;
+		prm.bitrate = vtx->enc_bitrate ? vtx->enc_bitrate :
+			v->cfg.bitrate;
 		prm.pktsize = PKT_SIZE;
 		prm.fps     = get_fps(v);
 		prm.max_fs  = -1;
@@ -1573,6 +3086,13 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 		info("Set video encoder: %s %s (%u bit/s, %.2f fps)\n",
 		     vc->name, vc->variant, prm.bitrate, prm.fps);
 
+		vtx->params = mem_deref(vtx->params);
+		if (params) {
+			err = str_dup(&vtx->params, params);
+			if (err)
+				goto out;
+		}
+
 		vtx->enc = mem_deref(vtx->enc);
 		err = vc->encupdh(&vtx->enc, vc, &prm, params,
 				  packet_handler, v);
@@ -1581,11 +3101,23 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 			goto out;
 		}
 
+		/* the simulcast layers are allocated with the next frame */
+		for (unsigned i = 1; i < SIMULCAST_MAX; i++)
+			vtx->layerv[i].enc = mem_deref(vtx->layerv[i].enc);
+
+		/* the new encoder starts with a full frame */
+		viddiff_reset(vtx->diff);
+		vtx->ts_full = 0;
+
 		vtx->vc = vc;
+		vtx->enc_bitrate = prm.bitrate;
 	}
 
 	stream_update_encoder(v->strm, pt_tx);
 
+	if (vtx_fec_set(v))
+		warning("video: could not enable FEC\n");
+
  out:
 	mtx_unlock(vtx->lock_enc);
 
@@ -1680,6 +3212,148 @@ static bool nack_handler(const char *name, const char *value, void *arg)
 }
 
 
+static bool extmap_handler(const char *name, const char *value, void *arg)
+{
+	struct video *v = arg;
+	struct sdp_extmap extmap;
+	int err;
+	(void)name;
+
+	MAGIC_CHECK(v);
+
+	err = sdp_extmap_decode(&extmap, value);
+	if (err) {
+		warning("video: sdp_extmap_decode error (%m)\n", err);
+		return false;
+	}
+
+	if (pl_strcasecmp(&extmap.name, uri_twcc))
+		return false;
+
+	if (extmap.id < RTPEXT_ID_MIN || extmap.id > RTPEXT_ID_MAX) {
+		warning("video: extmap id out of range (%u)\n", extmap.id);
+		return true;
+	}
+
+	err  = sdp_media_set_extmap(stream_sdpmedia(v->strm), extmap.id,
+				    uri_twcc);
+	err |= stream_enable_twcc(v->strm, extmap.id);
+	if (err)
+		return true;
+
+	mtx_lock(v->vtx.lock_tx);
+	v->vtx.extid_twcc = extmap.id;
+	mtx_unlock(v->vtx.lock_tx);
+
+	info("video: transport-wide congestion control enabled\n");
+
+	return true;
+}
+
+
+static bool rid_extmap_handler(const char *name, const char *value,
+			       void *arg)
+{
+	uint8_t *idp = arg;
+	struct sdp_extmap extmap;
+	(void)name;
+
+	if (sdp_extmap_decode(&extmap, value))
+		return false;
+
+	if (pl_strcasecmp(&extmap.name, uri_rid))
+		return false;
+
+	if (extmap.id < RTPEXT_ID_MIN || extmap.id > RTPEXT_ID_MAX)
+		return false;
+
+	*idp = extmap.id;
+
+	return true;
+}
+
+
+static bool rid_recv_handler(const char *name, const char *value, void *arg)
+{
+	const struct pl *id = arg;
+	struct pl rid, dir;
+	(void)name;
+
+	if (re_regex(value, str_len(value), "[^ ]+ [a-z]+", &rid, &dir))
+		return false;
+
+	return !pl_cmp(&rid, id) && !pl_strcmp(&dir, "recv");
+}
+
+
+/*
+ * RTP stream IDs the peer receives, e.g. "recv f;h;q", in the order of
+ * the peer. Of alternative IDs the first one is used, paused streams are
+ * skipped and each ID must have an "a=rid:<id> recv" line.
+ */
+static unsigned simulcast_rids_decode(const struct sdp_media *m,
+				      char ridv[][RID_SIZE], unsigned ridc)
+{
+	const char *value = sdp_media_rattr(m, "simulcast");
+	struct pl list;
+	unsigned n = 0;
+
+	if (re_regex(value, str_len(value), "recv [^ ]+", &list))
+		return 0;
+
+	while (list.l && n < ridc) {
+		const char *sep = pl_strchr(&list, ';');
+		struct pl id;
+
+		id.p = list.p;
+		id.l = sep ? (size_t)(sep - list.p) : list.l;
+		pl_advance(&list, sep ? id.l + 1 : id.l);
+
+		sep = pl_strchr(&id, ',');
+		if (sep)
+			id.l = sep - id.p;
+
+		if (!id.l || id.l >= RID_SIZE || id.p[0] == '~')
+			continue;
+
+		if (!sdp_media_rattr_apply(m, "rid", rid_recv_handler, &id))
+			continue;
+
+		(void)pl_strcpy(&id, ridv[n++], RID_SIZE);
+	}
+
+	return n;
+}
+
+
+static void simulcast_decode(struct video *v)
+{
+	struct sdp_media *m = stream_sdpmedia(v->strm);
+	char ridv[SIMULCAST_MAX][RID_SIZE];
+	uint8_t extid = 0;
+	unsigned n;
+	int err;
+
+	n = simulcast_rids_decode(m, ridv, min(v->cfg.simulcast,
+					       (unsigned)SIMULCAST_MAX));
+	sdp_media_rattr_apply(m, "extmap", rid_extmap_handler, &extid);
+
+	if (n < 2 || !extid) {
+		(void)vtx_simulcast_set(&v->vtx, 1, 0, NULL);
+		return;
+	}
+
+	err  = vtx_simulcast_set(&v->vtx, n, extid, ridv);
+	err |= simulcast_sdp_encode(v, extid, n);
+	if (err) {
+		warning("video: simulcast: %m\n", err);
+		return;
+	}
+
+	info("video: simulcast with %u layers\n", n);
+}
+
+
 void video_sdp_attr_decode(struct video *v)
 {
 	if (!v)
@@ -1689,6 +3363,16 @@ void video_sdp_attr_decode(struct video *v)
 	if (sdp_media_rattr_apply(stream_sdpmedia(v->strm), "rtcp-fb",
 				  nack_handler, 0))
 		v->nack_pli = true;
+
+	/* Transport-wide Congestion Control */
+	if (v->cfg.bwe) {
+		sdp_media_rattr_apply(stream_sdpmedia(v->strm), "extmap",
+				      extmap_handler, v);
+	}
+
+	/* Simulcast (RFC 8853), after the TWCC extmap */
+	if (v->cfg.simulcast > 1)
+		simulcast_decode(v);
 }
 
 
@@ -1700,18 +3384,59 @@ static int vtx_debug(struct re_printf *pf, const struct vtx *vtx)
 			  vtx->vc ? vtx->vc->name : "none",
 			  vidfmt_name(vtx->fmt));
 
-	mtx_lock(vtx->lock_enc);
+	mtx_lock(vtx->lock_mbox);
 	err |= re_hprintf(pf, "     source: %s %u x %u, fps=%.2f"
 			  " frames=%llu\n",
 			  vtx->vs ? vtx->vs->name : "none",
 			  vtx->vsrc_size.w,
 			  vtx->vsrc_size.h, vtx->vsrc_prm.fps,
 			  vtx->stats.src_frames);
+	mtx_unlock(vtx->lock_mbox);
+
+	mtx_lock(vtx->lock_enc);
+	err |= txshare_debug(pf, vtx->share);
+
+	for (unsigned i = 0; vtx->layerc > 1 && i < vtx->layerc; i++) {
+		const struct vtx_layer *l = &vtx->layerv[i];
+
+		err |= re_hprintf(pf, "     simulcast %s: 1/%u"
+				  " ssrc=0x%08x %u bit/s skipped=%llu\n",
+				  l->rid, l->scale, l->ssrc, l->bitrate,
+				  l->n_skip);
+	}
+
+	if (vtx->vc && vtx->vc->encdebugh && vtx->enc)
+		err |= vtx->vc->encdebugh(pf, vtx->enc);
+
+	if (vtx->diff) {
+		err |= re_hprintf(pf, "     adaptive: static=%llu"
+				  " partial=%llu\n",
+				  vtx->n_static, vtx->n_partial);
+	}
 	mtx_unlock(vtx->lock_enc);
 
+	mtx_lock(vtx->lock_mbox);
+	err |= re_hprintf(pf, "     encoded=%llu (%llu usec)"
+			  " skipped: mailbox=%llu pacer=%llu budget=%llu\n",
+			  vtx->stats.enc_frames, vtx->enc_usec,
+			  vtx->stats.skip_mbox, vtx->stats.skip_pacer,
+			  vtx->stats.skip_budget);
+	mtx_unlock(vtx->lock_mbox);
+
 	mtx_lock(vtx->lock_tx);
-	err |= re_hprintf(pf, "     skipc=%u sendq=%u\n",
-			  vtx->skipc, list_count(&vtx->sendq));
+	err |= re_hprintf(pf, "     sendq=%u (%zu bytes)"
+			  " nack=%u pool=%u alloc=%llu\n",
+			  list_count(&vtx->sendq), vtx->sendq_bytes,
+			  vtx->sendqnbc, vtx->qpoolc, vtx->n_qalloc);
+	err |= fec_enc_debug(pf, vtx->fec);
+
+	if (vtx->bwe) {
+		err |= re_hprintf(pf, "     encoder=%u kbit/s"
+				  " pacing=%u kbit/s\n",
+				  vtx->enc_bitrate / 1000,
+				  re_atomic_rlx(&vtx->pace_bitrate) / 1000);
+		err |= bwe_debug(pf, vtx->bwe);
+	}
 
 	if (vtx->ts_base) {
 		err |= re_hprintf(pf, "     time = %.3f sec\n",
@@ -1737,8 +3462,15 @@ static int vrx_debug(struct re_printf *pf, const struct vrx *vrx)
 			  vrx->vd ? vrx->vd->name : "none",
 			  vrx->size.w, vrx->size.h,
 			  vrx->stats.disp_frames);
-	err |= re_hprintf(pf, "     n_keyframes=%u, n_picup=%u\n",
-			  vrx->n_intra, vrx->n_picup);
+	err |= re_hprintf(pf, "     n_keyframes=%u, n_picup=%u,"
+			  " skipped=%llu\n",
+			  vrx->n_intra, vrx->n_picup, vrx->stats.skip_frames);
+	if (vrx->stats.hw_frames) {
+		err |= re_hprintf(pf, "     hw_frames=%llu, downloaded=%llu\n",
+				  vrx->stats.hw_frames,
+				  vrx->stats.hw_downloads);
+	}
+	err |= vidjbuf_debug(pf, vrx->vjb);
 
 	if (vrx->ts_recv.is_set) {
 		err |= re_hprintf(pf, "     time = %.3f sec\n",
@@ -1817,6 +3549,7 @@ int video_set_source(struct video *v, const char *name, const char *dev)
 	struct vidsrc *vs = (struct vidsrc *)vidsrc_find(baresip_vidsrcl(),
 							 name);
 	struct vtx *vtx;
+	struct vidsz size;
 	int err;
 
 	if (!v)
@@ -1829,8 +3562,16 @@ int video_set_source(struct video *v, const char *name, const char *dev)
 
 	vtx->vsrc = mem_deref(vtx->vsrc);
 
+	err = vtx_enc_start(vtx);
+	if (err)
+		return err;
+
+	mtx_lock(vtx->lock_mbox);
+	size = vtx->vsrc_size;
+	mtx_unlock(vtx->lock_mbox);
+
 	err = vs->alloch(&vtx->vsrc, vs, &vtx->vsrc_prm,
-			 &vtx->vsrc_size, NULL, dev,
+			 &size, NULL, dev,
 			 vidsrc_frame_handler, vidsrc_packet_handler,
 			 vidsrc_error_handler, vtx);
 	if (err)
@@ -1918,7 +3659,5 @@ void video_req_keyframe(struct video *vid)
 	if (!vid)
 		return;
 
-	mtx_lock(vid->vtx.lock_enc);
-	vid->vtx.picup = true;
-	mtx_unlock(vid->vtx.lock_enc);
+	vtx_picup(&vid->vtx, 0);
 }
@@ -71,6 +71,10 @@ const struct vidisp *vidisp_find(const struct list *vidispl, const char *name)
 		return vd;
 	}
 
+	/* try the deferred modules */
+	if (!module_lazy_load(str_isset(name) ? name : NULL))
+		return vidisp_find(vidispl, name);
+
 	return NULL;
 }
 
@@ -0,0 +1,640 @@
+/**
+ * @file vidjbuf.c  Frame-aware video jitter buffer
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * Video jitter buffer
+ *
+ * Incoming RTP packets are sorted by sequence number and grouped into
+ * frames by RTP timestamp. A frame starts right after the marker packet
+ * of the previous frame and ends with its own marker packet, so a frame
+ * is complete when all sequence numbers in between are present.
+ *
+ * Only complete frames are released, in order. Missing packets are
+ * requested with Generic NACK (RFC 4585) as soon as a gap is detected,
+ * and again every NACK_RETRY ms. The oldest frame is given up when
+ * max_frames complete frames are waiting behind it, or when it has been
+ * waiting for longer than WAIT_MAX ms. The next released frame is then
+ * flagged as lost, so that the caller knows that the reference chain is
+ * broken and a keyframe is needed.
+ *
+ * The start of the first frame is not known. Until it is released, an
+ * earlier packet of up to REORDER_MAX packets moves the start back, and
+ * the complete first frame is held until a packet behind it arrives or
+ * REORDER_WAIT ms have passed.
+ */
+
+
+enum {
+	PKT_MAX      = 512,  /**< Maximum number of buffered packets     */
+	MISS_MAX     = 128,  /**< Maximum gap size that is NACKed        */
+	NACK_RETRY   = 50,   /**< NACK retransmission interval [ms]      */
+	NACK_MAX     = 3,    /**< Maximum number of NACKs per packet     */
+	WAIT_MAX     = 500,  /**< Maximum wait for an incomplete frame   */
+	REORDER_MAX  = 16,   /**< Reordering accepted before first frame */
+	REORDER_WAIT = 50,   /**< Maximum hold of the first frame [ms]   */
+};
+
+
+/** Buffered RTP packet */
+struct vpkt {
+	struct le le;              /**< Linked list element              */
+	struct rtp_header hdr;     /**< RTP Header                       */
+	struct mbuf *mb;           /**< RTP payload                      */
+};
+
+
+/** Missing RTP packet */
+struct vmiss {
+	struct le le;              /**< Linked list element              */
+	uint16_t seq;              /**< Sequence number                  */
+	unsigned nackc;            /**< Number of NACKs sent             */
+	uint64_t jfs;              /**< Time of last NACK [ms]           */
+};
+
+
+/** Defines a frame-aware video jitter buffer */
+struct vidjbuf {
+	struct list pktl;          /**< Packets, sorted by seq           */
+	struct list missl;         /**< Missing packets, sorted by seq   */
+	uint32_t n;                /**< Number of buffered packets       */
+	uint32_t max_frames;       /**< Frames to wait for a lost packet */
+	uint32_t ssrc;             /**< Current SSRC                     */
+	uint16_t seq_next;         /**< First seq of next frame          */
+	uint16_t seq_hi;           /**< Highest seq received             */
+	uint32_t rel_left;         /**< Packets left of released frame   */
+	uint64_t jfs_wait;         /**< Head frame waiting since [ms]    */
+	bool running;              /**< Received first packet            */
+	bool released;             /**< Released first frame             */
+	bool lost;                 /**< A frame was given up             */
+	vidjbuf_nack_h *nackh;     /**< NACK handler                     */
+	void *arg;                 /**< Handler argument                 */
+	mtx_t *mtx;                /**< Protects all fields              */
+	struct vidjbuf_stat stat;  /**< Statistics                       */
+};
+
+
+/** Is x less than y? */
+static inline bool seq_less(uint16_t x, uint16_t y)
+{
+	return ((int16_t)(x - y)) < 0;
+}
+
+
+static void vpkt_destructor(void *arg)
+{
+	struct vpkt *p = arg;
+
+	list_unlink(&p->le);
+	mem_deref(p->mb);
+}
+
+
+static void vmiss_destructor(void *arg)
+{
+	struct vmiss *m = arg;
+
+	list_unlink(&m->le);
+}
+
+
+static void destructor(void *arg)
+{
+	struct vidjbuf *vjb = arg;
+
+	list_flush(&vjb->pktl);
+	list_flush(&vjb->missl);
+	mem_deref(vjb->mtx);
+}
+
+
+/**
+ * Allocate a frame-aware video jitter buffer
+ *
+ * @param vjbp       Pointer to allocated video jitter buffer
+ * @param max_frames Number of complete frames to wait for a missing packet
+ * @param nackh      Optional handler for sending NACK
+ * @param arg        Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidjbuf_alloc(struct vidjbuf **vjbp, uint32_t max_frames,
+		  vidjbuf_nack_h *nackh, void *arg)
+{
+	struct vidjbuf *vjb;
+	int err;
+
+	if (!vjbp || !max_frames)
+		return EINVAL;
+
+	vjb = mem_zalloc(sizeof(*vjb), destructor);
+	if (!vjb)
+		return ENOMEM;
+
+	vjb->max_frames = max_frames;
+	vjb->nackh      = nackh;
+	vjb->arg        = arg;
+
+	err = mutex_alloc(&vjb->mtx);
+	if (err)
+		mem_deref(vjb);
+	else
+		*vjbp = vjb;
+
+	return err;
+}
+
+
+static void flush(struct vidjbuf *vjb)
+{
+	list_flush(&vjb->pktl);
+	list_flush(&vjb->missl);
+
+	vjb->n        = 0;
+	vjb->rel_left = 0;
+	vjb->jfs_wait = 0;
+	vjb->running  = false;
+	vjb->released = false;
+	vjb->lost     = false;
+}
+
+
+/* Remove missing entries before seq, they will never be released */
+static void miss_trim(struct vidjbuf *vjb, uint16_t seq)
+{
+	struct le *le = vjb->missl.head;
+
+	while (le) {
+		struct vmiss *m = le->data;
+		le = le->next;
+
+		if (!seq_less(m->seq, seq))
+			break;
+
+		mem_deref(m);
+	}
+}
+
+
+static bool miss_remove(struct vidjbuf *vjb, uint16_t seq)
+{
+	struct le *le;
+
+	for (le = vjb->missl.head; le; le = le->next) {
+		struct vmiss *m = le->data;
+
+		if (m->seq == seq) {
+			mem_deref(m);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static int miss_add(struct vidjbuf *vjb, uint16_t first, uint16_t last)
+{
+	const uint16_t gap = last - first + 1;
+	struct le *head = vjb->missl.head;
+
+	if (gap > MISS_MAX) {
+		debug("vidjbuf: gap of %u packets not requested\n", gap);
+		return E2BIG;
+	}
+
+	for (uint16_t seq = first; seq != (uint16_t)(last + 1); seq++) {
+		struct vmiss *m = mem_zalloc(sizeof(*m), vmiss_destructor);
+		if (!m)
+			return ENOMEM;
+
+		m->seq = seq;
+
+		/* a gap in front of the first frame goes to the head */
+		if (head && seq_less(seq, ((struct vmiss *)head->data)->seq))
+			list_insert_before(&vjb->missl, head, &m->le, m);
+		else
+			list_append(&vjb->missl, &m->le, m);
+	}
+
+	return 0;
+}
+
+
+/* Send NACK for new and overdue missing packets, grouped as PID + BLP */
+static void send_nacks(struct vidjbuf *vjb, uint64_t now)
+{
+	uint16_t pid = 0, blp = 0;
+	bool pending = false;
+	struct le *le;
+
+	if (!vjb->nackh)
+		return;
+
+	for (le = vjb->missl.head; le; le = le->next) {
+		struct vmiss *m = le->data;
+
+		if (m->nackc >= NACK_MAX)
+			continue;
+
+		if (m->nackc && now < m->jfs + NACK_RETRY)
+			continue;
+
+		++m->nackc;
+		m->jfs = now;
+		++vjb->stat.n_nack;
+
+		if (pending) {
+			uint16_t d = m->seq - pid;
+
+			if (d >= 1 && d <= 16) {
+				blp |= 1 << (d - 1);
+				continue;
+			}
+
+			vjb->nackh(pid, blp, vjb->arg);
+		}
+
+		pid = m->seq;
+		blp = 0;
+		pending = true;
+	}
+
+	if (pending)
+		vjb->nackh(pid, blp, vjb->arg);
+}
+
+
+/**
+ * Put one RTP packet into the video jitter buffer
+ *
+ * @note The NACK handler may be called from this function
+ *
+ * @param vjb Video jitter buffer
+ * @param hdr RTP Header
+ * @param mb  RTP payload, will be referenced
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidjbuf_put(struct vidjbuf *vjb, const struct rtp_header *hdr,
+		struct mbuf *mb)
+{
+	const uint64_t now = tmr_jiffies();
+	struct vpkt *p;
+	struct le *le;
+	int err = 0;
+
+	if (!vjb || !hdr || !mb)
+		return EINVAL;
+
+	mtx_lock(vjb->mtx);
+
+	if (vjb->running && hdr->ssrc != vjb->ssrc) {
+		debug("vidjbuf: ssrc changed 0x%08x -> 0x%08x\n",
+		      vjb->ssrc, hdr->ssrc);
+		flush(vjb);
+		++vjb->stat.n_flush;
+	}
+
+	if (!vjb->running) {
+		vjb->ssrc     = hdr->ssrc;
+		vjb->seq_next = hdr->seq;
+		vjb->seq_hi   = hdr->seq - 1;
+		vjb->running  = true;
+	}
+
+	/* Reordered packet in front of the first frame */
+	if (!vjb->released && seq_less(hdr->seq, vjb->seq_next) &&
+	    (uint16_t)(vjb->seq_next - hdr->seq) <= REORDER_MAX) {
+
+		if ((uint16_t)(hdr->seq + 1) != vjb->seq_next)
+			(void)miss_add(vjb, hdr->seq + 1, vjb->seq_next - 1);
+
+		vjb->seq_next = hdr->seq;
+	}
+
+	/* Frame was already released or given up */
+	if (seq_less(hdr->seq, vjb->seq_next)) {
+		++vjb->stat.n_late;
+		err = ETIMEDOUT;
+		goto out;
+	}
+
+	/* Find position, most packets are appended at the tail */
+	for (le = vjb->pktl.tail; le; le = le->prev) {
+		const struct vpkt *q = le->data;
+
+		if (q->hdr.seq == hdr->seq) {
+			++vjb->stat.n_dups;
+			err = EALREADY;
+			goto out;
+		}
+
+		if (seq_less(q->hdr.seq, hdr->seq))
+			break;
+	}
+
+	p = mem_zalloc(sizeof(*p), vpkt_destructor);
+	if (!p) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	p->hdr = *hdr;
+	p->mb  = mem_ref(mb);
+
+	if (le)
+		list_insert_after(&vjb->pktl, le, &p->le, p);
+	else
+		list_prepend(&vjb->pktl, &p->le, p);
+
+	++vjb->n;
+	++vjb->stat.n_put;
+
+	if (seq_less(vjb->seq_hi, hdr->seq)) {
+
+		if ((uint16_t)(vjb->seq_hi + 1) != hdr->seq)
+			(void)miss_add(vjb, vjb->seq_hi + 1, hdr->seq - 1);
+
+		vjb->seq_hi = hdr->seq;
+	}
+	else if (miss_remove(vjb, hdr->seq)) {
+		++vjb->stat.n_recovered;
+	}
+
+	send_nacks(vjb, now);
+
+ out:
+	mtx_unlock(vjb->mtx);
+	return err;
+}
+
+
+/* Number of packets of the head frame if it is complete, otherwise 0 */
+static uint32_t head_complete(const struct vidjbuf *vjb)
+{
+	const struct vpkt *head;
+	uint16_t seq;
+	uint32_t k = 0;
+	struct le *le;
+
+	le = vjb->pktl.head;
+	if (!le)
+		return 0;
+
+	head = le->data;
+	if (head->hdr.seq != vjb->seq_next)
+		return 0;
+
+	for (seq = vjb->seq_next; le; le = le->next, ++seq) {
+		const struct vpkt *p = le->data;
+
+		if (p->hdr.seq != seq)
+			return 0;
+
+		/* marker bit lost, next frame started without gap */
+		if (p->hdr.ts != head->hdr.ts)
+			return k;
+
+		++k;
+
+		if (p->hdr.m)
+			return k;
+	}
+
+	return 0;
+}
+
+
+/* Number of complete frames buffered after the head frame */
+static uint32_t frames_behind(const struct vidjbuf *vjb)
+{
+	const struct vpkt *head;
+	uint32_t n = 0;
+	struct le *le;
+
+	le = vjb->pktl.head;
+	if (!le)
+		return 0;
+
+	head = le->data;
+
+	for (; le; le = le->next) {
+		const struct vpkt *p = le->data;
+
+		if (p->hdr.m && p->hdr.ts != head->hdr.ts)
+			++n;
+	}
+
+	return n;
+}
+
+
+/* Skip the head frame, or the missing packets in front of it */
+static void give_up(struct vidjbuf *vjb)
+{
+	struct vpkt *head = vjb->pktl.head->data;
+	const uint32_t ts = head->hdr.ts;
+	struct le *le;
+
+	if (head->hdr.seq != vjb->seq_next) {
+
+		/* start of the head frame is not known, release it anyway
+		 * and let the decoder find out */
+		vjb->seq_next = head->hdr.seq;
+	}
+	else {
+		le = vjb->pktl.head;
+		while (le) {
+			struct vpkt *p = le->data;
+			le = le->next;
+
+			if (p->hdr.ts != ts)
+				break;
+
+			vjb->seq_next = p->hdr.seq + 1;
+			--vjb->n;
+			mem_deref(p);
+		}
+
+		/* the following packets belong to the next frame */
+		if (le)
+			vjb->seq_next = ((struct vpkt *)le->data)->hdr.seq;
+	}
+
+	miss_trim(vjb, vjb->seq_next);
+
+	vjb->jfs_wait = 0;
+	vjb->lost = true;
+	++vjb->stat.n_skipped;
+}
+
+
+static struct mbuf *pop(struct vidjbuf *vjb, struct rtp_header *hdr)
+{
+	struct vpkt *p = vjb->pktl.head->data;
+	struct mbuf *mb = mem_ref(p->mb);
+
+	*hdr = p->hdr;
+	--vjb->n;
+	--vjb->rel_left;
+	mem_deref(p);
+
+	return mb;
+}
+
+
+/**
+ * Get one RTP packet of the next complete frame
+ *
+ * @param vjb   Video jitter buffer
+ * @param hdr   Returned RTP Header
+ * @param mbp   Returned RTP payload, referenced on success
+ * @param lostp Set to true if frames were given up before this packet
+ *
+ * @return 0 if success, ENOENT if no complete frame, otherwise errorcode
+ */
+int vidjbuf_get(struct vidjbuf *vjb, struct rtp_header *hdr,
+		struct mbuf **mbp, bool *lostp)
+{
+	const uint64_t now = tmr_jiffies();
+	uint32_t k = 0;
+	int err = 0;
+
+	if (!vjb || !hdr || !mbp)
+		return EINVAL;
+
+	mtx_lock(vjb->mtx);
+
+	if (lostp)
+		*lostp = false;
+
+	/* continue with the current frame */
+	if (vjb->rel_left && vjb->pktl.head) {
+		*mbp = pop(vjb, hdr);
+		goto out;
+	}
+
+	while (vjb->pktl.head) {
+
+		k = head_complete(vjb);
+		if (k)
+			break;
+
+		if (!vjb->jfs_wait)
+			vjb->jfs_wait = now;
+
+		if (frames_behind(vjb) < vjb->max_frames &&
+		    now < vjb->jfs_wait + WAIT_MAX && vjb->n < PKT_MAX) {
+			err = ENOENT;
+			goto out;
+		}
+
+		give_up(vjb);
+	}
+
+	if (!vjb->pktl.head) {
+		err = ENOENT;
+		goto out;
+	}
+
+	/* an earlier packet of the first frame may still arrive */
+	if (!vjb->released && vjb->n <= k) {
+
+		if (!vjb->jfs_wait)
+			vjb->jfs_wait = now;
+
+		if (now < vjb->jfs_wait + REORDER_WAIT) {
+			err = ENOENT;
+			goto out;
+		}
+	}
+
+	vjb->released = true;
+	vjb->rel_left = k;
+	vjb->seq_next += (uint16_t)k;
+	vjb->jfs_wait = 0;
+	miss_trim(vjb, vjb->seq_next);
+	++vjb->stat.n_frames;
+
+	if (lostp)
+		*lostp = vjb->lost;
+	vjb->lost = false;
+
+	*mbp = pop(vjb, hdr);
+
+ out:
+	mtx_unlock(vjb->mtx);
+	return err;
+}
+
+
+/**
+ * Flush all packets in the video jitter buffer
+ *
+ * @param vjb Video jitter buffer
+ */
+void vidjbuf_flush(struct vidjbuf *vjb)
+{
+	if (!vjb)
+		return;
+
+	mtx_lock(vjb->mtx);
+	flush(vjb);
+	++vjb->stat.n_flush;
+	mtx_unlock(vjb->mtx);
+}
+
+
+/**
+ * Get video jitter buffer statistics
+ *
+ * @param vjb  Video jitter buffer
+ * @param stat Pointer to statistics storage
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidjbuf_stats(const struct vidjbuf *vjb, struct vidjbuf_stat *stat)
+{
+	if (!vjb || !stat)
+		return EINVAL;
+
+	mtx_lock(vjb->mtx);
+	*stat = vjb->stat;
+	mtx_unlock(vjb->mtx);
+
+	return 0;
+}
+
+
+int vidjbuf_debug(struct re_printf *pf, const struct vidjbuf *vjb)
+{
+	int err;
+
+	if (!vjb)
+		return 0;
+
+	mtx_lock(vjb->mtx);
+	err  = re_hprintf(pf, "--- video jitter buffer ---\n");
+	err |= re_hprintf(pf, " packets=%u missing=%u max_frames=%u"
+			  " seq_next=%u\n",
+			  vjb->n, list_count(&vjb->missl), vjb->max_frames,
+			  vjb->seq_next);
+	err |= re_hprintf(pf, " put=%llu frames=%llu skipped=%llu"
+			  " nack=%llu recovered=%llu late=%llu dup=%llu"
+			  " flush=%llu\n",
+			  vjb->stat.n_put, vjb->stat.n_frames,
+			  vjb->stat.n_skipped, vjb->stat.n_nack,
+			  vjb->stat.n_recovered, vjb->stat.n_late,
+			  vjb->stat.n_dups, vjb->stat.n_flush);
+	mtx_unlock(vjb->mtx);
+
+	return err;
+}
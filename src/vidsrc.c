@@ -78,6 +78,10 @@ const struct vidsrc *vidsrc_find(const struct list *vidsrcl, const char *name)
 		return vs;
 	}
 
+	/* try the deferred modules */
+	if (!module_lazy_load(str_isset(name) ? name : NULL))
+		return vidsrc_find(vidsrcl, name);
+
 	return NULL;
 }
 
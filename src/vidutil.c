@@ -69,3 +69,34 @@ uint64_t video_calc_timebase_timestamp(uint64_t rtp_ts)
 {
 	return rtp_ts * VIDEO_TIMEBASE / VIDEO_SRATE;
 }
+
+
+/**
+ * Download a hardware frame into a new frame in system memory
+ *
+ * @param framep Pointer to allocated video frame
+ * @param hw     Hardware frame
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidframe_hw_download(struct vidframe **framep,
+			 const struct vidframe_hw *hw)
+{
+	struct vidframe *frame;
+	int err;
+
+	if (!framep || !hw || !hw->surface || !hw->downloadh)
+		return EINVAL;
+
+	err = vidframe_alloc(&frame, hw->fmt, &hw->size);
+	if (err)
+		return err;
+
+	err = hw->downloadh(frame, hw);
+	if (err)
+		mem_deref(frame);
+	else
+		*framep = frame;
+
+	return err;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file test/auarena.c  Audio frame arena testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	SRATE  = 48000,
+	CH     = 2,
+	PTIME  = 20,
+	SAMPC  = SRATE * CH * PTIME / 1000,
+	WARMUP = 3,
+	FRAMES = 50,
+};
+
+
+int test_auarena(void)
+{
+	struct auarena *ar = NULL;
+	void *a, *b;
+	int err;
+
+	err = auarena_alloc(&ar, 100, 2);
+	TEST_ERR(err);
+
+	ASSERT_TRUE(128 == auarena_slotsz(ar));
+
+	a = auarena_get(ar, 100);
+	b = auarena_get(ar, 128);
+	ASSERT_TRUE(a != NULL);
+	ASSERT_TRUE(b != NULL);
+	ASSERT_TRUE(a != b);
+	ASSERT_TRUE(0 == (uintptr_t)a % 64);
+	ASSERT_TRUE(0 == (uintptr_t)b % 64);
+
+	/* exhausted */
+	ASSERT_TRUE(NULL == auarena_get(ar, 1));
+	ASSERT_TRUE(1 == auarena_misses(ar));
+
+	/* the same memory is handed out again after a reset */
+	auarena_reset(ar);
+	ASSERT_TRUE(a == auarena_get(ar, 1));
+
+	/* too large */
+	ASSERT_TRUE(NULL == auarena_get(ar, 129));
+	ASSERT_TRUE(2 == auarena_misses(ar));
+
+ out:
+	mem_deref(ar);
+
+	return err;
+}
+
+
+/* Memory blocks in use, or false if the memory statistics are disabled */
+static bool mem_blocks(size_t *blocks, size_t *peak)
+{
+	struct memstat mstat;
+
+	if (mem_get_stat(&mstat))
+		return false;
+
+	*blocks = mstat.blocks_cur;
+	*peak   = mstat.blocks_peak;
+
+	return true;
+}
+
+
+/*
+ * Run the encode filter chain auconv -> auresamp from a 48 kHz stereo
+ * float source to an 8 kHz mono s16 encoder, and verify that no memory
+ * is allocated after the warm-up frames.
+ *
+ * The number of blocks is checked after every filter of every frame, so
+ * that a buffer which is allocated by one filter and released on the
+ * next frame is found. A short allocation within a filter would raise
+ * the peak number of blocks.
+ */
+int test_auarena_filters(void)
+{
+	struct list filtl = LIST_INIT;
+	struct auarena *arena = NULL;
+	struct aufilt_prm prm;
+	size_t blocks = 0, peak = 0;
+	unsigned n_alloc = 0;
+	bool have_stat = false;
+	void *outv = NULL;
+	float *srcv;
+	struct le *le;
+	int err;
+
+	srcv = mem_zalloc(SAMPC * sizeof(float), NULL);
+	if (!srcv)
+		return ENOMEM;
+
+	for (size_t i = 0; i < SAMPC; i++)
+		srcv[i] = (float)((i % 48) - 24) / 48.0f;
+
+	err = module_load(".", "auconv");
+	TEST_ERR(err);
+
+	err = module_load(".", "auresamp");
+	TEST_ERR(err);
+
+	err = auarena_alloc(&arena, SAMPC * sizeof(float), 4);
+	TEST_ERR(err);
+
+	prm.srate = 8000;
+	prm.ch    = 1;
+	prm.fmt   = AUFMT_S16LE;
+	prm.arena = arena;
+
+	LIST_FOREACH(baresip_aufiltl(), le) {
+		struct aufilt *af = le->data;
+		struct aufilt_enc_st *st = NULL;
+		void *ctx = NULL;
+
+		if (!af->encupdh)
+			continue;
+
+		err = af->encupdh(&st, &ctx, af, &prm, NULL);
+		TEST_ERR(err);
+
+		st->af = af;
+		list_append(&filtl, &st->le, st);
+	}
+
+	ASSERT_EQ(2, list_count(&filtl));
+
+	for (int i = 0; i < FRAMES; i++) {
+		struct auframe af;
+
+		if (i == WARMUP)
+			have_stat = mem_blocks(&blocks, &peak);
+
+		auarena_reset(arena);
+		auframe_init(&af, AUFMT_FLOAT, srcv, SAMPC, SRATE, CH);
+
+		LIST_FOREACH(&filtl, le) {
+			struct aufilt_enc_st *st = le->data;
+			size_t b, p;
+
+			err = st->af->ench(st, &af);
+			TEST_ERR(err);
+
+			if (i < WARMUP || !have_stat)
+				continue;
+
+			(void)mem_blocks(&b, &p);
+			if (b != blocks || p != peak)
+				++n_alloc;
+		}
+
+		ASSERT_EQ(AUFMT_S16LE, af.fmt);
+		ASSERT_EQ(8000, af.srate);
+		ASSERT_EQ(1, af.ch);
+		ASSERT_EQ(160, (int)af.sampc);
+
+		if (i == WARMUP)
+			outv = af.sampv;
+		else if (i > WARMUP)
+			ASSERT_TRUE(af.sampv == outv);
+	}
+
+	/* every buffer came from the arena */
+	ASSERT_TRUE(0 == auarena_misses(arena));
+
+	/* no filter of the steady-state frames allocated memory */
+	ASSERT_EQ(0, n_alloc);
+
+ out:
+	list_flush(&filtl);
+	mem_deref(arena);
+	mem_deref(srcv);
+	module_unload("auresamp");
+	module_unload("auconv");
+
+	return err;
+}
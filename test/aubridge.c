@@ -0,0 +1,150 @@
+/**
+ * @file test/aubridge.c  Audio bridge conference bus testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <re_atomic.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+struct leg {
+	struct auplay_st *play;
+	struct ausrc_st *src;
+	int16_t level;                 /**< Constant level of the player */
+	RE_ATOMIC int rx_level;        /**< Last level heard             */
+	RE_ATOMIC unsigned rx_frames;  /**< Frames heard                 */
+	RE_ATOMIC bool rx_flat;        /**< All frames were constant     */
+};
+
+
+static void write_handler(struct auframe *af, void *arg)
+{
+	struct leg *leg = arg;
+	int16_t *sampv = af->sampv;
+
+	for (size_t i = 0; i < af->sampc; i++)
+		sampv[i] = leg->level;
+}
+
+
+static void read_handler(struct auframe *af, void *arg)
+{
+	struct leg *leg = arg;
+	const int16_t *sampv = af->sampv;
+
+	for (size_t i = 1; i < af->sampc; i++) {
+		if (sampv[i] != sampv[0])
+			re_atomic_rlx_set(&leg->rx_flat, false);
+	}
+
+	re_atomic_rlx_set(&leg->rx_level, sampv[0]);
+	re_atomic_rlx_add(&leg->rx_frames, 1);
+}
+
+
+static void leg_reset(struct leg *leg)
+{
+	re_atomic_rlx_set(&leg->rx_level, 0);
+	re_atomic_rlx_set(&leg->rx_frames, 0);
+	re_atomic_rlx_set(&leg->rx_flat, true);
+}
+
+
+/* Wait until every source has heard two complete mixes */
+static int legs_wait(struct leg *legv, size_t legc)
+{
+	for (int i = 0; i < 100; i++) {
+		bool done = true;
+
+		for (size_t j = 0; j < legc; j++) {
+			if (legv[j].src &&
+			    re_atomic_rlx(&legv[j].rx_frames) < 2)
+				done = false;
+		}
+
+		if (done)
+			return 0;
+
+		(void)sys_msleep(10);
+	}
+
+	return ETIMEDOUT;
+}
+
+
+int test_aubridge_bus(void)
+{
+	struct auplay_prm pprm = {8000, 1, 20, AUFMT_S16LE};
+	struct ausrc_prm sprm = {8000, 1, 20, AUFMT_S16LE, 0};
+	struct leg legv[3];
+	struct leg *a = &legv[0], *b = &legv[1], *mon = &legv[2];
+	int err;
+
+	memset(legv, 0, sizeof(legv));
+
+	a->level = 100;
+	b->level = 1000;
+
+	err = module_load(".", "aubridge");
+	TEST_ERR(err);
+
+	/* a starts its source first, b its player first */
+	err  = ausrc_alloc(&a->src, baresip_ausrcl(), "aubridge", &sprm,
+			   "bus:conf1/a", read_handler, NULL, a);
+	err |= auplay_alloc(&b->play, baresip_auplayl(), "aubridge", &pprm,
+			    "bus:conf1/b", write_handler, b);
+	err |= auplay_alloc(&a->play, baresip_auplayl(), "aubridge", &pprm,
+			    "bus:conf1/a", write_handler, a);
+	err |= ausrc_alloc(&b->src, baresip_ausrcl(), "aubridge", &sprm,
+			   "bus:conf1/b", read_handler, NULL, b);
+	err |= ausrc_alloc(&mon->src, baresip_ausrcl(), "aubridge", &sprm,
+			   "bus:conf1", read_handler, NULL, mon);
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(legv); i++)
+		leg_reset(&legv[i]);
+
+	err = legs_wait(legv, RE_ARRAY_SIZE(legv));
+	TEST_ERR(err);
+
+	/* mix-minus: each leg hears only the other leg */
+	ASSERT_EQ(1000, re_atomic_rlx(&a->rx_level));
+	ASSERT_EQ(100, re_atomic_rlx(&b->rx_level));
+
+	/* without a key the source hears the full mix */
+	ASSERT_EQ(1100, re_atomic_rlx(&mon->rx_level));
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(legv); i++)
+		ASSERT_TRUE(re_atomic_rlx(&legv[i].rx_flat));
+
+	/* a restarted source is paired again by its key */
+	a->src = mem_deref(a->src);
+
+	err = ausrc_alloc(&a->src, baresip_ausrcl(), "aubridge", &sprm,
+			  "bus:conf1/a", read_handler, NULL, a);
+	TEST_ERR(err);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(legv); i++)
+		leg_reset(&legv[i]);
+
+	err = legs_wait(legv, RE_ARRAY_SIZE(legv));
+	TEST_ERR(err);
+
+	ASSERT_EQ(1000, re_atomic_rlx(&a->rx_level));
+	ASSERT_EQ(100, re_atomic_rlx(&b->rx_level));
+	ASSERT_EQ(1100, re_atomic_rlx(&mon->rx_level));
+
+ out:
+	for (size_t i = 0; i < RE_ARRAY_SIZE(legv); i++) {
+		mem_deref(legv[i].src);
+		mem_deref(legv[i].play);
+	}
+
+	module_unload("aubridge");
+
+	return err;
+}
@@ -0,0 +1,265 @@
+/**
+ * @file test/aufilt.c  Audio filter sample format testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+enum {
+	SAMPC  = 320,
+	FRAMES = 10,
+};
+
+
+int test_aufmt_convert(void)
+{
+	static const uint8_t s24v[] = {
+		0x00, 0x00, 0x80,   /* -8388608 */
+		0xff, 0xff, 0x7f,   /*  8388607 */
+		0x00, 0x00, 0x00,
+	};
+	int16_t *s16 = NULL, *s16b = NULL;
+	float *flt = NULL;
+	float *planev[3];
+	float fv[3];
+	uint8_t s24[3*3];
+	int err;
+
+	s16  = mem_alloc(65536 * sizeof(*s16), NULL);
+	s16b = mem_alloc(65536 * sizeof(*s16b), NULL);
+	flt  = mem_alloc(65536 * sizeof(*flt), NULL);
+	if (!s16 || !s16b || !flt) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* s16 -> float -> s16 is lossless */
+	for (int i = 0; i < 65536; i++)
+		s16[i] = (int16_t)(i - 32768);
+
+	err = aufmt_convert(AUFMT_FLOAT, flt, AUFMT_S16LE, s16, 65536);
+	TEST_ERR(err);
+	ASSERT_DOUBLE_EQ(-1.0, flt[0], 1e-9);
+	ASSERT_DOUBLE_EQ(0.0, flt[32768], 1e-9);
+
+	err = aufmt_convert(AUFMT_S16LE, s16b, AUFMT_FLOAT, flt, 65536);
+	TEST_ERR(err);
+	TEST_MEMCMP(s16, 65536 * sizeof(*s16), s16b, 65536 * sizeof(*s16b));
+
+	/* float is saturated */
+	flt[0] = 2.0f;
+	flt[1] = -2.0f;
+	err = aufmt_convert(AUFMT_S16LE, s16b, AUFMT_FLOAT, flt, 2);
+	TEST_ERR(err);
+	ASSERT_EQ(32767, s16b[0]);
+	ASSERT_EQ(-32768, s16b[1]);
+
+	/* s24 */
+	err = aufmt_convert(AUFMT_FLOAT, fv, AUFMT_S24_3LE, s24v, 3);
+	TEST_ERR(err);
+	ASSERT_DOUBLE_EQ(-1.0, fv[0], 1e-9);
+	ASSERT_DOUBLE_EQ(8388607.0 / 8388608.0, fv[1], 1e-9);
+	ASSERT_DOUBLE_EQ(0.0, fv[2], 1e-9);
+
+	err = aufmt_convert(AUFMT_S24_3LE, s24, AUFMT_FLOAT, fv, 3);
+	TEST_ERR(err);
+	TEST_MEMCMP(s24v, sizeof(s24v), s24, sizeof(s24));
+
+	err = aufmt_convert(AUFMT_S16LE, s16b, AUFMT_S24_3LE, s24v, 3);
+	TEST_ERR(err);
+	ASSERT_EQ(-32768, s16b[0]);
+	ASSERT_EQ(32767, s16b[1]);
+	ASSERT_EQ(0, s16b[2]);
+
+	ASSERT_EQ(ENOTSUP, aufmt_convert(AUFMT_S16LE, s16b,
+					 AUFMT_ALAW, s24v, 3));
+
+	/* interleave and de-interleave 2 and 3 channels */
+	for (uint8_t ch = 2; ch <= 3; ch++) {
+		const size_t frames = 100;
+
+		for (size_t i = 0; i < frames * ch; i++)
+			flt[i] = (float)i;
+
+		for (uint8_t c = 0; c < ch; c++)
+			planev[c] = &flt[1000 + c * frames];
+
+		aufmt_deinterleave(planev, flt, ch, frames);
+
+		ASSERT_DOUBLE_EQ(ch, planev[0][1], 1e-9);
+		ASSERT_DOUBLE_EQ(ch + 1, planev[1][1], 1e-9);
+
+		aufmt_interleave(&flt[2000], planev, ch, frames);
+
+		TEST_MEMCMP(flt, frames * ch * sizeof(float),
+			    &flt[2000], frames * ch * sizeof(float));
+	}
+
+ out:
+	mem_deref(s16);
+	mem_deref(s16b);
+	mem_deref(flt);
+
+	return err;
+}
+
+
+/* Fails if the frame is not in one of the native formats */
+static int check_encode(struct aufilt_enc_st *st, struct auframe *af)
+{
+	if (st->af->fmts && !(st->af->fmts & AUFILT_FMT(af->fmt)))
+		return EPROTO;
+
+	return 0;
+}
+
+
+static int check_decode(struct aufilt_dec_st *st, struct auframe *af)
+{
+	if (st->af->fmts && !(st->af->fmts & AUFILT_FMT(af->fmt)))
+		return EPROTO;
+
+	return 0;
+}
+
+
+static struct aufilt filt_s16 = {
+	.name = "s16", .ench = check_encode, .dech = check_decode,
+	.fmts = AUFILT_FMT(AUFMT_S16LE)
+};
+
+static struct aufilt filt_float = {
+	.name = "float", .ench = check_encode, .dech = check_decode,
+	.fmts = AUFILT_FMT(AUFMT_FLOAT)
+};
+
+static struct aufilt filt_any = {
+	.name = "any", .ench = check_encode, .dech = check_decode,
+};
+
+
+static int chain_alloc(struct list *encl, struct list *decl,
+		       const char *chain)
+{
+	for (const char *p = chain; *p; p++) {
+		struct aufilt_enc_st *enc;
+		struct aufilt_dec_st *dec;
+		const struct aufilt *af;
+
+		switch (*p) {
+
+		case 's': af = &filt_s16;   break;
+		case 'f': af = &filt_float; break;
+		default:  af = &filt_any;   break;
+		}
+
+		enc = mem_zalloc(sizeof(*enc), NULL);
+		dec = mem_zalloc(sizeof(*dec), NULL);
+		if (!enc || !dec) {
+			mem_deref(enc);
+			mem_deref(dec);
+			return ENOMEM;
+		}
+
+		enc->af = af;
+		dec->af = af;
+
+		list_append(encl, &enc->le, enc);
+		list_prepend(decl, &dec->le, dec);
+	}
+
+	return 0;
+}
+
+
+/*
+ * Count the sample format conversions per frame for common filter chains,
+ * e.g. "fa" is webrtc_aec followed by vumeter, and "s" is auresamp.
+ */
+int test_aufilt_fmt(void)
+{
+	static const struct {
+		enum aufmt src_fmt;
+		const char *chain;
+		enum aufmt enc_fmt;
+		unsigned convc;
+	} testv[] = {
+		{AUFMT_S16LE, "aa",  AUFMT_S16LE, 0},
+		{AUFMT_S16LE, "s",   AUFMT_S16LE, 0},
+		{AUFMT_FLOAT, "s",   AUFMT_FLOAT, 2},
+		{AUFMT_FLOAT, "faf", AUFMT_FLOAT, 0},
+		{AUFMT_S16LE, "fa",  AUFMT_FLOAT, 1},
+		{AUFMT_S16LE, "fa",  AUFMT_S16LE, 2},
+		{AUFMT_FLOAT, "fs",  AUFMT_FLOAT, 2},
+		{AUFMT_S16LE, "fsf", AUFMT_S16LE, 4},
+		{AUFMT_S24_3LE, "f", AUFMT_S16LE, 2},
+	};
+	struct list encl = LIST_INIT, decl = LIST_INIT;
+	struct auarena *arena = NULL;
+	void *sampv = NULL;
+	int err = 0;
+
+	sampv = mem_zalloc(SAMPC * sizeof(float), NULL);
+	if (!sampv)
+		return ENOMEM;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(testv); i++) {
+		const size_t n = str_len(testv[i].chain);
+		uint64_t enc_convc = 0, dec_convc = 0;
+
+		err = auarena_alloc(&arena, SAMPC * sizeof(float), n + 1);
+		TEST_ERR(err);
+
+		err = chain_alloc(&encl, &decl, testv[i].chain);
+		TEST_ERR(err);
+
+		for (int j = 0; j < FRAMES; j++) {
+			struct auframe af;
+
+			auarena_reset(arena);
+			auframe_init(&af, testv[i].src_fmt, sampv, SAMPC,
+				     8000, 1);
+
+			err = aufilt_encode(&encl, &af, testv[i].enc_fmt,
+					    arena, NULL, NULL, &enc_convc);
+			TEST_ERR(err);
+			ASSERT_EQ(testv[i].enc_fmt, af.fmt);
+
+			/* decode the other way round */
+			auarena_reset(arena);
+			auframe_init(&af, testv[i].enc_fmt, sampv, SAMPC,
+				     8000, 1);
+
+			err = aufilt_decode(&decl, &af, testv[i].src_fmt,
+					    arena, NULL, NULL, &dec_convc);
+			TEST_ERR(err);
+			ASSERT_EQ(testv[i].src_fmt, af.fmt);
+		}
+
+		info("aufilt: %-6s %s -> %s: %.1f conversions per frame\n",
+		     testv[i].chain, aufmt_name(testv[i].src_fmt),
+		     aufmt_name(testv[i].enc_fmt),
+		     (double)enc_convc / FRAMES);
+
+		ASSERT_TRUE(testv[i].convc * FRAMES == enc_convc);
+		ASSERT_TRUE(testv[i].convc * FRAMES == dec_convc);
+
+		list_flush(&encl);
+		list_flush(&decl);
+		arena = mem_deref(arena);
+	}
+
+ out:
+	list_flush(&encl);
+	list_flush(&decl);
+	mem_deref(arena);
+	mem_deref(sampv);
+
+	return err;
+}
@@ -0,0 +1,251 @@
+/**
+ * @file test/aupoly.c  Polyphase audio resampler testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	PTIME  = 20,
+	FRAMES = 50,
+	FREQ   = 1000,
+};
+
+static const double PI = 3.14159265358979323846264338328;
+
+
+/*
+ * THD+N of a sine with known frequency, as the power of the residual after
+ * a least-squares fit of the sine, relative to the power of the sine.
+ */
+static double thdn_db(const float *sampv, size_t sampc, double freq,
+		      uint32_t srate)
+{
+	double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0, a, b, det;
+	double sig = 0, res = 0;
+
+	for (size_t i = 0; i < sampc; i++) {
+		double s = sin(2 * PI * freq * i / srate);
+		double c = cos(2 * PI * freq * i / srate);
+
+		ss += s * s;
+		cc += c * c;
+		sc += s * c;
+		ys += sampv[i] * s;
+		yc += sampv[i] * c;
+	}
+
+	det = ss * cc - sc * sc;
+	a = (ys * cc - yc * sc) / det;
+	b = (yc * ss - ys * sc) / det;
+
+	for (size_t i = 0; i < sampc; i++) {
+		double m = a * sin(2 * PI * freq * i / srate) +
+			   b * cos(2 * PI * freq * i / srate);
+
+		sig += m * m;
+		res += (sampv[i] - m) * (sampv[i] - m);
+	}
+
+	return 10 * log10(res / sig);
+}
+
+
+/* Resample FRAMES frames of a sine, and return the output in outv */
+static int resample_sine(float *outv, size_t *outc, double freq,
+			 uint32_t irate, uint32_t orate, uint64_t *usec)
+{
+	const size_t inc  = irate * PTIME / 1000;
+	const size_t frmc = orate * PTIME / 1000;
+	struct aupoly *rs = NULL;
+	float *inv;
+	size_t n = 0;
+	uint64_t t0;
+	int err;
+
+	inv = mem_zalloc(inc * sizeof(float), NULL);
+	if (!inv)
+		return ENOMEM;
+
+	err = aupoly_alloc(&rs, irate, 1, orate, 1);
+	TEST_ERR(err);
+
+	*usec = 0;
+
+	for (int f = 0; f < FRAMES; f++) {
+		size_t oc = *outc - n;
+
+		for (size_t i = 0; i < inc; i++)
+			inv[i] = 0.5f * (float)sin(2 * PI * freq *
+						   (f * inc + i) / irate);
+
+		t0 = tmr_jiffies_usec();
+
+		err = aupoly_process(rs, &outv[n], &oc, inv, inc,
+				     AUFMT_FLOAT);
+		TEST_ERR(err);
+
+		*usec += tmr_jiffies_usec() - t0;
+
+		/* 20 ms in gives 20 ms out, for all ratios */
+		ASSERT_TRUE(frmc == oc);
+		n += oc;
+	}
+
+	*outc = n;
+
+ out:
+	mem_deref(rs);
+	mem_deref(inv);
+
+	return err;
+}
+
+
+/*
+ * Quality and throughput benchmark for the common ratios. The first
+ * 100 ms are skipped, to leave out the filter delay.
+ */
+int test_aupoly(void)
+{
+	static const struct {
+		uint32_t irate;
+		uint32_t orate;
+	} testv[] = {
+		{48000,  8000},
+		{ 8000, 48000},
+		{16000,  8000},
+		{ 8000, 16000},
+		{44100, 48000},
+		{48000, 44100},
+		{44100,  8000},
+		{48000, 16000},
+	};
+	float *outv = NULL;
+	size_t sz = 48000 * PTIME / 1000 * FRAMES;
+	int err = 0;
+
+	outv = mem_zalloc(sz * sizeof(float), NULL);
+	if (!outv)
+		return ENOMEM;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(testv); i++) {
+		const uint32_t orate = testv[i].orate;
+		size_t outc = sz, skip = orate / 10;
+		uint64_t usec;
+		double thdn;
+
+		err = resample_sine(outv, &outc, FREQ, testv[i].irate, orate,
+				    &usec);
+		TEST_ERR(err);
+
+		thdn = thdn_db(&outv[skip], outc - skip, FREQ, orate);
+
+		info("aupoly: %5u -> %5u Hz: THD+N %.1f dB,"
+		     " %.1f samples/us\n",
+		     testv[i].irate, orate, thdn,
+		     usec ? (double)outc / usec : 0.0);
+
+		ASSERT_TRUE(thdn < -80.0);
+	}
+
+	/* a 6 kHz tone is above the 4 kHz Nyquist frequency of 8 kHz */
+	{
+		size_t outc = sz, skip = 800;
+		uint64_t usec;
+		double pwr = 0;
+
+		err = resample_sine(outv, &outc, 6000, 48000, 8000, &usec);
+		TEST_ERR(err);
+
+		for (size_t i = skip; i < outc; i++)
+			pwr += outv[i] * outv[i];
+
+		pwr /= (outc - skip);
+
+		/* relative to a sine with amplitude 0.5 */
+		ASSERT_TRUE(10 * log10(pwr / 0.125) < -70.0);
+	}
+
+ out:
+	mem_deref(outv);
+
+	return err;
+}
+
+
+/*
+ * The output of a stream does not depend on how the input is split into
+ * frames, also for 44.1 kHz stereo to 8 kHz mono in s16le
+ */
+int test_aupoly_stream(void)
+{
+	static const size_t framev[] = {882, 100, 7, 2000, 1};
+	const size_t inc = 44100 * 2;
+	struct aupoly *rs1 = NULL, *rs2 = NULL;
+	int16_t *inv = NULL, *outv1 = NULL, *outv2 = NULL;
+	size_t outc1 = 8000, outc2 = 0;
+	int err;
+
+	inv   = mem_zalloc(inc * sizeof(int16_t), NULL);
+	outv1 = mem_zalloc(8000 * sizeof(int16_t), NULL);
+	outv2 = mem_zalloc(8000 * sizeof(int16_t), NULL);
+	if (!inv || !outv1 || !outv2) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (size_t i = 0; i < inc; i++)
+		inv[i] = (int16_t)(10000 * sin(i * 0.01));
+
+	err = aupoly_alloc(&rs1, 44100, 2, 8000, 1);
+	TEST_ERR(err);
+
+	err = aupoly_alloc(&rs2, 44100, 2, 8000, 1);
+	TEST_ERR(err);
+
+	/* one second in one frame */
+	err = aupoly_process(rs1, outv1, &outc1, inv, inc, AUFMT_S16LE);
+	TEST_ERR(err);
+	ASSERT_EQ(8000, (int)outc1);
+
+	/* one second in frames of different size */
+	for (size_t pos = 0, f = 0; pos < inc / 2; f++) {
+		size_t n = min(framev[f % RE_ARRAY_SIZE(framev)],
+			       inc / 2 - pos);
+		size_t oc = 8000 - outc2;
+
+		err = aupoly_process(rs2, &outv2[outc2], &oc, &inv[pos * 2],
+				     n * 2, AUFMT_S16LE);
+		TEST_ERR(err);
+
+		outc2 += oc;
+		pos   += n;
+	}
+
+	TEST_MEMCMP(outv1, outc1 * sizeof(int16_t),
+		    outv2, outc2 * sizeof(int16_t));
+
+	/* output buffer too small */
+	outc1 = 10;
+	ASSERT_EQ(ENOMEM, aupoly_process(rs1, outv1, &outc1, inv, 882,
+					 AUFMT_S16LE));
+
+	ASSERT_EQ(ENOTSUP, aupoly_process(rs1, outv1, &outc1, inv, 882,
+					  AUFMT_S24_3LE));
+
+ out:
+	mem_deref(rs2);
+	mem_deref(rs1);
+	mem_deref(outv2);
+	mem_deref(outv1);
+	mem_deref(inv);
+
+	return err;
+}
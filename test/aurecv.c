@@ -0,0 +1,307 @@
+/**
+ * @file test/aurecv.c  Audio receiver testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <re_atomic.h>
+#include <rem.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+enum {
+	SRATE   = 8000,
+	PTIME   = 20,
+	SAMPC   = SRATE * PTIME / 1000,
+	PACKETS = 200,
+	PT      = 96,
+	UPDATES = 1000,
+};
+
+
+struct audec_state {
+	int dummy;
+};
+
+
+static RE_ATOMIC int n_dec;  /* Decoder states in use */
+
+
+/* raw s16le payload */
+static int decode(struct audec_state *ads, int fmt, void *sampv,
+		  size_t *sampc, bool marker, const uint8_t *buf, size_t len)
+{
+	(void)ads;
+	(void)marker;
+
+	if (fmt != AUFMT_S16LE)
+		return ENOTSUP;
+
+	if (*sampc * sizeof(int16_t) < len)
+		return ENOMEM;
+
+	memcpy(sampv, buf, len);
+	*sampc = len / sizeof(int16_t);
+
+	return 0;
+}
+
+
+static struct aucodec rawcodec = {
+	.name  = "raw",
+	.srate = SRATE,
+	.crate = SRATE,
+	.ch    = 1,
+	.pch   = 1,
+	.dech  = decode,
+};
+
+
+static void dec_destructor(void *arg)
+{
+	(void)arg;
+
+	re_atomic_rlx_add(&n_dec, -1);
+}
+
+
+static int dec_update(struct audec_state **adsp, const struct aucodec *ac,
+		      const char *fmtp)
+{
+	(void)ac;
+	(void)fmtp;
+
+	if (*adsp)
+		return 0;
+
+	*adsp = mem_zalloc(sizeof(**adsp), dec_destructor);
+	if (!*adsp)
+		return ENOMEM;
+
+	re_atomic_rlx_add(&n_dec, 1);
+
+	return 0;
+}
+
+
+static struct aucodec statecodecv[2] = {
+	{
+		.name    = "raw1",
+		.srate   = SRATE,
+		.crate   = SRATE,
+		.ch      = 1,
+		.pch     = 1,
+		.decupdh = dec_update,
+		.dech    = decode,
+	},
+	{
+		.name    = "raw2",
+		.srate   = SRATE,
+		.crate   = SRATE,
+		.ch      = 1,
+		.pch     = 1,
+		.decupdh = dec_update,
+		.dech    = decode,
+	},
+};
+
+
+struct rx_thread {
+	struct audio_recv *ar;
+	struct mbuf *mb;
+	RE_ATOMIC bool run;
+	unsigned n;
+};
+
+
+static int rx_thread(void *arg)
+{
+	struct rx_thread *rx = arg;
+	struct rtp_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.pt   = PT;
+	hdr.ssrc = 0x11223344;
+
+	while (re_atomic_rlx(&rx->run)) {
+		bool ignore = false;
+
+		hdr.seq = (uint16_t)rx->n;
+		hdr.ts  = rx->n * SAMPC;
+		rx->mb->pos = 0;
+
+		aurecv_receive(rx->ar, &hdr, NULL, 0, rx->mb, 0, &ignore);
+		++rx->n;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Receive path, from the RTP packet to the audio buffer. The control
+ * plane is updated while packets are received. See baresip-aurecv-bench
+ * for the timing of the receive path.
+ */
+int test_aurecv_receive(void)
+{
+	struct config_audio cfg;
+	struct audio_recv *ar = NULL;
+	struct mbuf *mb = NULL;
+	struct rtp_header hdr;
+	int err;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.srate_play    = SRATE;
+	cfg.channels_play = 1;
+	cfg.dec_fmt       = AUFMT_S16LE;
+	cfg.play_fmt      = AUFMT_S16LE;
+	cfg.buffer.min    = 20;
+	cfg.buffer.max    = 160;
+
+	mb = mbuf_alloc(SAMPC * sizeof(int16_t));
+	if (!mb)
+		return ENOMEM;
+
+	for (size_t i = 0; i < SAMPC; i++) {
+		err = mbuf_write_u16(mb, (uint16_t)(i * 100));
+		TEST_ERR(err);
+	}
+
+	err = aurecv_alloc(&ar, &cfg, SAMPC, PTIME);
+	TEST_ERR(err);
+
+	err = aurecv_decoder_set(ar, &rawcodec, PT, NULL);
+	TEST_ERR(err);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.pt   = PT;
+	hdr.ssrc = 0x11223344;
+
+	for (unsigned i = 0; i < PACKETS; i++) {
+		bool ignore = false;
+
+		/* a control plane update now and then */
+		if (i % 50 == 25)
+			aurecv_set_extmap(ar, 1);
+
+		hdr.seq = (uint16_t)i;
+		hdr.ts  = i * SAMPC;
+		mb->pos = 0;
+
+		aurecv_receive(ar, &hdr, NULL, 0, mb, 0, &ignore);
+
+		ASSERT_TRUE(!ignore);
+	}
+
+	ASSERT_TRUE(aurecv_codec(ar) == &rawcodec);
+	ASSERT_EQ(PT, aurecv_payload_type(ar));
+	ASSERT_TRUE(aurecv_latency(ar) > 0);
+
+	/* a packet with another payload type is ignored */
+	{
+		bool ignore = false;
+
+		hdr.pt  = PT + 1;
+		mb->pos = 0;
+		aurecv_receive(ar, &hdr, NULL, 0, mb, 0, &ignore);
+		ASSERT_TRUE(ignore);
+	}
+
+ out:
+	mem_deref(ar);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/*
+ * The decoder is replaced by the control thread while the RX thread
+ * receives packets. A replaced decoder state must be released by the
+ * control thread when the RX thread is idle, not on the next packet.
+ */
+int test_aurecv_threads(void)
+{
+	struct config_audio cfg;
+	struct rx_thread rx;
+	thrd_t thr;
+	bool running = false;
+	int err;
+
+	memset(&rx, 0, sizeof(rx));
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.srate_play    = SRATE;
+	cfg.channels_play = 1;
+	cfg.dec_fmt       = AUFMT_S16LE;
+	cfg.play_fmt      = AUFMT_S16LE;
+	cfg.buffer.min    = 20;
+	cfg.buffer.max    = 160;
+
+	re_atomic_rlx_set(&n_dec, 0);
+
+	rx.mb = mbuf_alloc(SAMPC * sizeof(int16_t));
+	if (!rx.mb)
+		return ENOMEM;
+
+	err = mbuf_fill(rx.mb, 0, SAMPC * sizeof(int16_t));
+	TEST_ERR(err);
+
+	err = aurecv_alloc(&rx.ar, &cfg, SAMPC, PTIME);
+	TEST_ERR(err);
+
+	/* the RX thread is idle, the update is taken over right away */
+	err = aurecv_decoder_set(rx.ar, &statecodecv[0], PT, NULL);
+	TEST_ERR(err);
+	ASSERT_EQ(1, re_atomic_rlx(&n_dec));
+
+	re_atomic_rlx_set(&rx.run, true);
+	err = thread_create_name(&thr, "aurecv test", rx_thread, &rx);
+	TEST_ERR(err);
+	running = true;
+
+	for (unsigned i = 1; i <= UPDATES; i++) {
+
+		err = aurecv_decoder_set(rx.ar, &statecodecv[i % 2], PT,
+					 NULL);
+		TEST_ERR(err);
+
+		/* the state in use and the one not taken over yet */
+		ASSERT_TRUE(re_atomic_rlx(&n_dec) <= 2);
+
+		if (i % 100 == 0)
+			aurecv_set_extmap(rx.ar, (uint8_t)(i / 100));
+	}
+
+	re_atomic_rlx_set(&rx.run, false);
+	thrd_join(thr, NULL);
+	running = false;
+
+	ASSERT_TRUE(rx.n > 0);
+
+	/* the last update was taken over before the RX thread went idle */
+	ASSERT_EQ(1, re_atomic_rlx(&n_dec));
+	ASSERT_TRUE(aurecv_codec(rx.ar) == &statecodecv[UPDATES % 2]);
+
+	err = aurecv_decoder_set(rx.ar, &statecodecv[1], PT, NULL);
+	TEST_ERR(err);
+	ASSERT_EQ(1, re_atomic_rlx(&n_dec));
+
+	/* the decoder state is released on stop */
+	aurecv_stop(rx.ar);
+	ASSERT_EQ(0, re_atomic_rlx(&n_dec));
+
+ out:
+	if (running) {
+		re_atomic_rlx_set(&rx.run, false);
+		thrd_join(thr, NULL);
+	}
+
+	mem_deref(rx.ar);
+	mem_deref(rx.mb);
+
+	return err;
+}
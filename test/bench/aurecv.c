@@ -0,0 +1,225 @@
+/**
+ * @file bench/aurecv.c  Audio receive path benchmark
+ *
+ * Feeds RTP packets through aurecv_receive(), from the RTP packet to
+ * the audio buffer, and reports the time per packet as JSON on stdout
+ * for two paths:
+ *
+ *   steady  No control-plane update is pending, the receive path does
+ *           not take the mutex.
+ *   update  A control-plane update is published before every packet,
+ *           so the mutex is taken and the new state is applied once per
+ *           packet, as the receive path did before the lock-free
+ *           handoff.
+ *
+ * Usage:
+ *
+ *     baresip-aurecv-bench -n 100000 > result.json
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_GETOPT
+#include <getopt.h>
+#endif
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "../../src/core.h"
+
+
+enum {
+	SRATE           = 8000,
+	PTIME           = 20,
+	SAMPC           = SRATE * PTIME / 1000,
+	PT              = 96,
+	DEFAULT_PACKETS = 20000,
+};
+
+
+/* raw s16le payload */
+static int decode(struct audec_state *ads, int fmt, void *sampv,
+		  size_t *sampc, bool marker, const uint8_t *buf, size_t len)
+{
+	(void)ads;
+	(void)marker;
+
+	if (fmt != AUFMT_S16LE)
+		return ENOTSUP;
+
+	if (*sampc * sizeof(int16_t) < len)
+		return ENOMEM;
+
+	memcpy(sampv, buf, len);
+	*sampc = len / sizeof(int16_t);
+
+	return 0;
+}
+
+
+static struct aucodec rawcodec = {
+	.name  = "raw",
+	.srate = SRATE,
+	.crate = SRATE,
+	.ch    = 1,
+	.pch   = 1,
+	.dech  = decode,
+};
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr,
+			 "Usage: baresip-aurecv-bench [options]\n"
+			 "options:\n"
+			 "\t-n <packets>     Number of packets per path "
+			 "(default %u)\n",
+			 DEFAULT_PACKETS);
+}
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	(void)arg;
+
+	return fwrite(p, 1, size, stdout) == size ? 0 : EIO;
+}
+
+
+/* Receive n packets, return the time per packet in [ns] */
+static int bench_path(double *nsp, unsigned n, bool update)
+{
+	struct config_audio cfg;
+	struct audio_recv *ar = NULL;
+	struct mbuf *mb = NULL;
+	struct rtp_header hdr;
+	uint64_t t0, usec = 0;
+	int err;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.srate_play    = SRATE;
+	cfg.channels_play = 1;
+	cfg.dec_fmt       = AUFMT_S16LE;
+	cfg.play_fmt      = AUFMT_S16LE;
+	cfg.buffer.min    = 20;
+	cfg.buffer.max    = 160;
+
+	mb = mbuf_alloc(SAMPC * sizeof(int16_t));
+	if (!mb)
+		return ENOMEM;
+
+	for (size_t i = 0; i < SAMPC; i++) {
+		err = mbuf_write_u16(mb, (uint16_t)(i * 100));
+		if (err)
+			goto out;
+	}
+
+	err = aurecv_alloc(&ar, &cfg, SAMPC, PTIME);
+	if (err)
+		goto out;
+
+	err = aurecv_decoder_set(ar, &rawcodec, PT, NULL);
+	if (err)
+		goto out;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.pt   = PT;
+	hdr.ssrc = 0x11223344;
+
+	for (unsigned i = 0; i < n; i++) {
+		bool ignore = false;
+
+		hdr.seq = (uint16_t)i;
+		hdr.ts  = i * SAMPC;
+		mb->pos = 0;
+
+		t0 = tmr_jiffies_usec();
+
+		if (update)
+			aurecv_set_extmap(ar, (uint8_t)(1 + i % 14));
+
+		aurecv_receive(ar, &hdr, NULL, 0, mb, 0, &ignore);
+
+		usec += tmr_jiffies_usec() - t0;
+
+		if (ignore) {
+			err = EPROTO;
+			goto out;
+		}
+	}
+
+	*nsp = 1000.0 * (double)usec / n;
+
+ out:
+	mem_deref(ar);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct re_printf pf_stdout = {print_handler, NULL};
+	unsigned packets = DEFAULT_PACKETS;
+	double steady = 0.0, update = 0.0;
+	int err;
+
+	err = libre_init();
+	if (err)
+		return err;
+
+	log_enable_info(false);
+
+#ifdef HAVE_GETOPT
+	for (;;) {
+		const int c = getopt(argc, argv, "hn:");
+		if (0 > c)
+			break;
+
+		switch (c) {
+
+		case 'n':
+			packets = atoi(optarg);
+			break;
+
+		case '?':
+		case 'h':
+		default:
+			usage();
+			return -2;
+		}
+	}
+#else
+	(void)argc;
+	(void)argv;
+#endif
+
+	if (!packets) {
+		usage();
+		return -2;
+	}
+
+	err  = bench_path(&steady, packets, false);
+	err |= bench_path(&update, packets, true);
+	if (err)
+		goto out;
+
+	err = re_hprintf(&pf_stdout, "{\n"
+			 "  \"packets\": %u,\n"
+			 "  \"steady_ns_per_packet\": %.1f,\n"
+			 "  \"update_ns_per_packet\": %.1f\n"
+			 "}\n",
+			 packets, steady, update);
+
+ out:
+	if (err)
+		re_fprintf(stderr, "baresip-aurecv-bench: failed (%m)\n",
+			   err);
+
+	libre_close();
+
+	return err;
+}
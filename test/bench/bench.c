@@ -0,0 +1,749 @@
+/**
+ * @file bench/bench.c  Call-setup benchmark and load generator
+ *
+ * Runs N concurrent UA pairs over loopback and reports the results
+ * as JSON on stdout. The callee UAs register with the mock SIP server,
+ * audio is generated by ausine, encoded with G.711 and played out by
+ * the mock audio-player. No network access is needed.
+ *
+ * Usage:
+ *
+ *     baresip-bench -n 100 -t 30 > result.json
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_GETOPT
+#include <getopt.h>
+#endif
+#include <sys/resource.h>
+#include <unistd.h>
+#include <re.h>
+#include <baresip.h>
+#include "../test.h"
+#include "../sip/sipsrv.h"
+
+
+enum {
+	DEFAULT_CALLS    = 10,
+	DEFAULT_DURATION = 10,
+	REGISTER_TIMEOUT = 10000,
+	SETUP_TIMEOUT    = 30000,
+	TEARDOWN_TIMEOUT = 30000,
+};
+
+enum phase {
+	PHASE_REGISTER = 0,
+	PHASE_SETUP,
+	PHASE_STEADY,
+	PHASE_TEARDOWN,
+};
+
+
+struct pair {
+	struct ua *ua_a;          /**< Caller                            */
+	struct ua *ua_b;          /**< Callee, registered with SIP server */
+	bool registered;          /**< Callee registration is done       */
+	bool estab_a;             /**< Caller is established             */
+	bool estab_b;             /**< Callee is established             */
+	bool failed;              /**< Call setup failed                 */
+	bool closed;              /**< Callee has closed the call        */
+	uint64_t ts_invite;       /**< Call setup started [us]           */
+	uint64_t ts_estab;        /**< Both sides established [us]       */
+	uint64_t ts_hangup;       /**< Hangup started [us]               */
+	uint64_t ts_closed;       /**< Callee closed [us]                */
+};
+
+
+struct rtp_count {
+	uint64_t tx_packets;
+	uint64_t tx_bytes;
+	uint64_t rx_packets;
+	uint64_t rx_bytes;
+};
+
+
+struct bench {
+	struct sip_server *srv;   /**< Mock SIP server                   */
+	struct pair *pairv;       /**< UA pairs                          */
+	unsigned pairc;           /**< Number of UA pairs                */
+	unsigned duration;        /**< Steady-state duration [s]         */
+	enum phase phase;         /**< Current phase                     */
+	unsigned n_registered;    /**< Number of registered callees      */
+	unsigned n_estab;         /**< Number of established calls       */
+	unsigned n_failed;        /**< Number of failed calls            */
+	unsigned n_closed;        /**< Number of closed calls            */
+	struct sa laddr;          /**< Local SIP address                 */
+	int err;
+};
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr,
+			 "Usage: baresip-bench [options]\n"
+			 "options:\n"
+			 "\t-n <calls>       Number of concurrent calls "
+			 "(default %u)\n"
+			 "\t-t <seconds>     Steady-state duration "
+			 "(default %u)\n"
+			 "\t-r <rxmode>      RTP RX processing mode "
+			 "[main, thread]\n"
+			 "\t-v               Verbose output (INFO level)\n",
+			 DEFAULT_CALLS, DEFAULT_DURATION);
+}
+
+
+static struct pair *pair_lookup(struct bench *b, const struct ua *ua,
+				bool *callee)
+{
+	for (unsigned i = 0; i < b->pairc; i++) {
+		struct pair *p = &b->pairv[i];
+
+		if (ua == p->ua_a || ua == p->ua_b) {
+			*callee = ua == p->ua_b;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	(void)arg;
+
+	return fwrite(p, 1, size, stdout) == size ? 0 : EIO;
+}
+
+
+static void bench_abort(struct bench *b, int err)
+{
+	b->err = err;
+	re_cancel();
+}
+
+
+static void event_handler(struct ua *ua, enum ua_event ev,
+			  struct call *call, const char *prm, void *arg)
+{
+	struct bench *b = arg;
+	struct pair *p;
+	bool callee = false;
+	int err;
+	(void)prm;
+
+	p = pair_lookup(b, ua, &callee);
+	if (!p)
+		return;
+
+	switch (ev) {
+
+	case UA_EVENT_REGISTER_OK:
+		if (b->phase != PHASE_REGISTER || p->registered)
+			break;
+
+		p->registered = true;
+		if (++b->n_registered == b->pairc)
+			re_cancel();
+		break;
+
+	case UA_EVENT_REGISTER_FAIL:
+		if (b->phase == PHASE_REGISTER)
+			bench_abort(b, EPROTO);
+		break;
+
+	case UA_EVENT_CALL_INCOMING:
+		err = ua_answer(ua, call, VIDMODE_OFF);
+		if (err) {
+			warning("bench: ua_answer failed (%m)\n", err);
+			bench_abort(b, err);
+		}
+		break;
+
+	case UA_EVENT_CALL_ESTABLISHED:
+		if (callee)
+			p->estab_b = true;
+		else
+			p->estab_a = true;
+
+		if (!p->estab_a || !p->estab_b || p->ts_estab)
+			break;
+
+		p->ts_estab = tmr_jiffies_usec();
+
+		if (++b->n_estab + b->n_failed == b->pairc)
+			re_cancel();
+		break;
+
+	case UA_EVENT_CALL_CLOSED:
+		if (b->phase == PHASE_SETUP && !p->ts_estab && !p->failed) {
+
+			p->failed = true;
+
+			if (b->n_estab + ++b->n_failed == b->pairc)
+				re_cancel();
+			break;
+		}
+
+		if (b->phase != PHASE_TEARDOWN || !callee || p->closed)
+			break;
+
+		p->closed = true;
+		p->ts_closed = tmr_jiffies_usec();
+
+		if (++b->n_closed == b->n_estab)
+			re_cancel();
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static void steady_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+static uint64_t cpu_usec(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru))
+		return 0;
+
+	return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+		+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+
+/* Resident set size [KiB], 0 if not available */
+static uint64_t rss_kb(void)
+{
+	unsigned long size, resident;
+	FILE *f;
+	int n;
+
+	f = fopen("/proc/self/statm", "r");
+	if (!f)
+		return 0;
+
+	n = fscanf(f, "%lu %lu", &size, &resident);
+	fclose(f);
+	if (n != 2)
+		return 0;
+
+	return (uint64_t)resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+/* Heap usage [bytes] of the libre allocator, 0 without MEM_DEBUG */
+static uint64_t heap_bytes(void)
+{
+	struct memstat mstat;
+
+	if (mem_get_stat(&mstat))
+		return 0;
+
+	return mstat.bytes_cur;
+}
+
+
+static void rtp_count_call(struct rtp_count *rc, const struct call *call)
+{
+	struct le *le;
+
+	LIST_FOREACH(call_streaml(call), le) {
+		const struct stream *strm = le->data;
+
+		rc->tx_packets += stream_metric_get_tx_n_packets(strm);
+		rc->tx_bytes   += stream_metric_get_tx_n_bytes(strm);
+		rc->rx_packets += stream_metric_get_rx_n_packets(strm);
+		rc->rx_bytes   += stream_metric_get_rx_n_bytes(strm);
+	}
+}
+
+
+static void rtp_count(struct rtp_count *rc, const struct bench *b)
+{
+	memset(rc, 0, sizeof(*rc));
+
+	for (unsigned i = 0; i < b->pairc; i++) {
+		const struct pair *p = &b->pairv[i];
+
+		if (!p->ts_estab)
+			continue;
+
+		rtp_count_call(rc, ua_call(p->ua_a));
+		rtp_count_call(rc, ua_call(p->ua_b));
+	}
+}
+
+
+static int u64_cmp(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+struct dist {
+	double p50;
+	double p99;
+	double max;
+};
+
+
+/* Percentiles [ms] of a set of durations [us], sorts the input */
+static void dist_calc(struct dist *d, uint64_t *v, size_t n)
+{
+	memset(d, 0, sizeof(*d));
+
+	if (!n)
+		return;
+
+	qsort(v, n, sizeof(*v), u64_cmp);
+
+	d->p50 = v[(n - 1) * 50 / 100] / 1000.0;
+	d->p99 = v[(n - 1) * 99 / 100] / 1000.0;
+	d->max = v[n - 1] / 1000.0;
+}
+
+
+static int bench_register(struct bench *b)
+{
+	char aor[256];
+	struct sa srv;
+	int err;
+
+	err = sip_transp_laddr(b->srv->sip, &srv, SIP_TRANSP_UDP, NULL);
+	if (err)
+		return err;
+
+	for (unsigned i = 0; i < b->pairc; i++) {
+		struct pair *p = &b->pairv[i];
+
+		re_snprintf(aor, sizeof(aor),
+			    "A <sip:a%u@127.0.0.1>;regint=0"
+			    ";audio_source=ausine,440"
+			    ";audio_player=mock-auplay,a", i);
+		err = ua_alloc(&p->ua_a, aor);
+		if (err)
+			return err;
+
+		re_snprintf(aor, sizeof(aor),
+			    "B <sip:b%u@%J>;regint=3600"
+			    ";audio_source=ausine,440"
+			    ";audio_player=mock-auplay,b", i, &srv);
+		err = ua_alloc(&p->ua_b, aor);
+		if (err)
+			return err;
+
+		err = ua_register(p->ua_b);
+		if (err)
+			return err;
+	}
+
+	b->phase = PHASE_REGISTER;
+
+	err = re_main_timeout(REGISTER_TIMEOUT);
+	if (err)
+		return err;
+
+	return b->err;
+}
+
+
+static int bench_setup(struct bench *b)
+{
+	char uri[256];
+	int err;
+
+	b->phase = PHASE_SETUP;
+
+	for (unsigned i = 0; i < b->pairc; i++) {
+		struct pair *p = &b->pairv[i];
+
+		re_snprintf(uri, sizeof(uri), "sip:b%u@%J", i, &b->laddr);
+
+		p->ts_invite = tmr_jiffies_usec();
+
+		err = ua_connect(p->ua_a, NULL, NULL, uri, VIDMODE_OFF);
+		if (err)
+			return err;
+	}
+
+	err = re_main_timeout(SETUP_TIMEOUT);
+	if (err == ETIMEDOUT && b->n_estab)
+		err = 0;
+	if (err)
+		return err;
+
+	return b->err;
+}
+
+
+static int bench_steady(struct bench *b)
+{
+	struct tmr tmr;
+	int err;
+
+	b->phase = PHASE_STEADY;
+
+	tmr_init(&tmr);
+	tmr_start(&tmr, b->duration * 1000, steady_handler, NULL);
+
+	err = re_main_timeout(b->duration * 1000 + 5000);
+
+	tmr_cancel(&tmr);
+
+	if (err)
+		return err;
+
+	return b->err;
+}
+
+
+static int bench_teardown(struct bench *b)
+{
+	int err;
+
+	b->phase = PHASE_TEARDOWN;
+
+	for (unsigned i = 0; i < b->pairc; i++) {
+		struct pair *p = &b->pairv[i];
+
+		if (!p->ts_estab)
+			continue;
+
+		p->ts_hangup = tmr_jiffies_usec();
+		ua_hangup(p->ua_a, NULL, 0, NULL);
+	}
+
+	err = re_main_timeout(TEARDOWN_TIMEOUT);
+	if (err == ETIMEDOUT && b->n_closed)
+		err = 0;
+	if (err)
+		return err;
+
+	return b->err;
+}
+
+
+static int bench_run(struct bench *b, struct re_printf *pf)
+{
+	uint64_t *setupv = NULL, *teardownv = NULL;
+	struct rtp_count rtp0, rtp1;
+	uint64_t rss0, heap0, rss1, heap1, cpu0, cpu1, t0, t1;
+	uint64_t ts_first = 0, ts_last = 0, ts_close = 0;
+	struct dist setup, teardown;
+	size_t n_setup = 0, n_teardown = 0;
+	double wall, cpu, rate = 0.0;
+	int err;
+
+	setupv    = mem_zalloc(b->pairc * sizeof(*setupv), NULL);
+	teardownv = mem_zalloc(b->pairc * sizeof(*teardownv), NULL);
+	if (!setupv || !teardownv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = bench_register(b);
+	if (err) {
+		warning("bench: registration failed (%m)\n", err);
+		goto out;
+	}
+
+	rss0  = rss_kb();
+	heap0 = heap_bytes();
+
+	err = bench_setup(b);
+	if (err) {
+		warning("bench: call setup failed (%m)\n", err);
+		goto out;
+	}
+
+	rss1  = rss_kb();
+	heap1 = heap_bytes();
+
+	rtp_count(&rtp0, b);
+	cpu0 = cpu_usec();
+	t0   = tmr_jiffies_usec();
+
+	err = bench_steady(b);
+	if (err)
+		goto out;
+
+	rtp_count(&rtp1, b);
+	cpu1 = cpu_usec();
+	t1   = tmr_jiffies_usec();
+
+	err = bench_teardown(b);
+	if (err) {
+		warning("bench: teardown failed (%m)\n", err);
+		goto out;
+	}
+
+	for (unsigned i = 0; i < b->pairc; i++) {
+		const struct pair *p = &b->pairv[i];
+
+		if (!p->ts_estab)
+			continue;
+
+		setupv[n_setup++] = p->ts_estab - p->ts_invite;
+
+		if (!ts_first || p->ts_invite < ts_first)
+			ts_first = p->ts_invite;
+		if (p->ts_estab > ts_last)
+			ts_last = p->ts_estab;
+
+		if (!p->closed)
+			continue;
+
+		teardownv[n_teardown++] = p->ts_closed - p->ts_hangup;
+
+		if (p->ts_closed > ts_close)
+			ts_close = p->ts_closed;
+	}
+
+	dist_calc(&setup, setupv, n_setup);
+	dist_calc(&teardown, teardownv, n_teardown);
+
+	if (ts_last > ts_first)
+		rate = n_setup * 1e6 / (double)(ts_last - ts_first);
+
+	wall = (double)(t1 - t0) / 1e6;
+	cpu  = wall > 0 ? 100.0 * (cpu1 - cpu0) / 1e6 / wall : 0.0;
+
+	err  = re_hprintf(pf, "{\n");
+	err |= re_hprintf(pf, "  \"version\": \"%s\",\n", BARESIP_VERSION);
+	err |= re_hprintf(pf, "  \"calls\": %u,\n", b->pairc);
+	err |= re_hprintf(pf, "  \"duration\": %.3f,\n", wall);
+	err |= re_hprintf(pf, "  \"rxmode\": \"%s\",\n",
+			  rtp_receive_mode_str(conf_config()->avt.rxmode));
+	err |= re_hprintf(pf, "  \"setup\": {\n"
+			  "    \"established\": %zu,\n"
+			  "    \"failed\": %u,\n"
+			  "    \"rate\": %.1f,\n"
+			  "    \"p50_ms\": %.3f,\n"
+			  "    \"p99_ms\": %.3f,\n"
+			  "    \"max_ms\": %.3f\n"
+			  "  },\n",
+			  n_setup, b->pairc - (unsigned)n_setup, rate,
+			  setup.p50, setup.p99, setup.max);
+	err |= re_hprintf(pf, "  \"cpu\": {\n"
+			  "    \"percent\": %.2f,\n"
+			  "    \"percent_per_call\": %.4f\n"
+			  "  },\n",
+			  cpu, n_setup ? cpu / n_setup : 0.0);
+	err |= re_hprintf(pf, "  \"rtp\": {\n"
+			  "    \"tx_pps\": %.1f,\n"
+			  "    \"rx_pps\": %.1f,\n"
+			  "    \"tx_kbps\": %.1f,\n"
+			  "    \"rx_kbps\": %.1f\n"
+			  "  },\n",
+			  (rtp1.tx_packets - rtp0.tx_packets) / wall,
+			  (rtp1.rx_packets - rtp0.rx_packets) / wall,
+			  (rtp1.tx_bytes - rtp0.tx_bytes) * 8 / wall / 1000,
+			  (rtp1.rx_bytes - rtp0.rx_bytes) * 8 / wall / 1000);
+	err |= re_hprintf(pf, "  \"memory\": {\n"
+			  "    \"rss_per_call_kb\": %.1f,\n"
+			  "    \"heap_per_call_bytes\": %.1f\n"
+			  "  },\n",
+			  n_setup ? ((double)rss1 - rss0) / n_setup : 0.0,
+			  n_setup ? ((double)heap1 - heap0) / n_setup : 0.0);
+	err |= re_hprintf(pf, "  \"teardown\": {\n"
+			  "    \"closed\": %zu,\n"
+			  "    \"total_ms\": %.3f,\n"
+			  "    \"p50_ms\": %.3f,\n"
+			  "    \"p99_ms\": %.3f,\n"
+			  "    \"max_ms\": %.3f\n"
+			  "  }\n",
+			  n_teardown,
+			  n_teardown ? (ts_close - t1) / 1000.0 : 0.0,
+			  teardown.p50, teardown.p99, teardown.max);
+	err |= re_hprintf(pf, "}\n");
+
+ out:
+	mem_deref(teardownv);
+	mem_deref(setupv);
+
+	return err;
+}
+
+
+static void bench_close(struct bench *b)
+{
+	if (b->pairv) {
+		for (unsigned i = 0; i < b->pairc; i++) {
+			mem_deref(b->pairv[i].ua_b);
+			mem_deref(b->pairv[i].ua_a);
+		}
+	}
+
+	b->pairv = mem_deref(b->pairv);
+	b->srv   = mem_deref(b->srv);
+}
+
+
+static const char *modconfig =
+	"ausrc_format    s16\n";
+
+
+int main(int argc, char *argv[])
+{
+	struct bench bench, *b = &bench;
+	struct re_printf pf_stdout = {print_handler, NULL};
+	struct auplay *auplay = NULL;
+	struct pl rxmode = PL_INIT;
+	struct config *config;
+	struct sa sa;
+	bool verbose = false;
+	int err;
+
+	memset(b, 0, sizeof(*b));
+	b->pairc    = DEFAULT_CALLS;
+	b->duration = DEFAULT_DURATION;
+
+	err = libre_init();
+	if (err)
+		return err;
+
+	log_enable_info(false);
+
+#ifdef HAVE_GETOPT
+	for (;;) {
+		const int c = getopt(argc, argv, "hn:t:r:v");
+		if (0 > c)
+			break;
+
+		switch (c) {
+
+		case 'n':
+			b->pairc = atoi(optarg);
+			break;
+
+		case 't':
+			b->duration = atoi(optarg);
+			break;
+
+		case 'r':
+			pl_set_str(&rxmode, optarg);
+			break;
+
+		case 'v':
+			log_enable_info(true);
+			verbose = true;
+			break;
+
+		case '?':
+		case 'h':
+		default:
+			usage();
+			return -2;
+		}
+	}
+#else
+	(void)argc;
+	(void)argv;
+#endif
+
+	if (!b->pairc || !b->duration) {
+		usage();
+		return -2;
+	}
+
+	/* JSON goes to stdout, keep it clean */
+	if (!verbose)
+		log_enable_stdout(false);
+
+	err = conf_configure_buf((uint8_t *)modconfig, str_len(modconfig));
+	if (err)
+		goto out;
+
+	config = conf_config();
+	if (!config) {
+		err = ENOENT;
+		goto out;
+	}
+
+	if (pl_isset(&rxmode))
+		config->avt.rxmode = resolve_receive_mode(&rxmode);
+
+	/* note: run all traffic on localhost */
+	err = baresip_init(config);
+	if (err)
+		goto out;
+
+	err = sa_set_str(&sa, "127.0.0.1", 0);
+	err |= net_add_address(baresip_network(), &sa);
+	if (err)
+		goto out;
+
+	str_ncpy(config->sip.local, "127.0.0.1:0", sizeof(config->sip.local));
+	config->call.max_calls = 0;
+
+	err = ua_init("baresip-bench", true, false, false);
+	if (err)
+		goto out;
+
+	err = sip_transp_laddr(uag_sip(), &b->laddr, SIP_TRANSP_UDP, NULL);
+	if (err)
+		goto out;
+
+	err  = module_load(".", "g711");
+	err |= module_load(".", "ausine");
+	if (err)
+		goto out;
+
+	err = mock_auplay_register(&auplay, baresip_auplayl(), NULL, NULL);
+	if (err)
+		goto out;
+
+	err = sip_server_alloc(&b->srv, NULL, NULL);
+	if (err)
+		goto out;
+
+	b->pairv = mem_zalloc(b->pairc * sizeof(*b->pairv), NULL);
+	if (!b->pairv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = uag_event_register(event_handler, b);
+	if (err)
+		goto out;
+
+	err = bench_run(b, &pf_stdout);
+
+ out:
+	if (err)
+		re_fprintf(stderr, "baresip-bench: failed (%m)\n", err);
+
+	uag_event_unregister(event_handler);
+	bench_close(b);
+
+	ua_stop_all(true);
+	ua_close();
+
+	mem_deref(auplay);
+	module_unload("ausine");
+	module_unload("g711");
+
+	conf_close();
+	baresip_close();
+
+	libre_close();
+
+	return err;
+}
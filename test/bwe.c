@@ -0,0 +1,100 @@
+/**
+ * @file test/bwe.c  Bandwidth estimation testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+enum {
+	PKT_SIZE     = 1200,      /* 960 kbit/s with one packet per 10 ms */
+	PKT_INTERVAL = 10000,
+	MIN_RATE     = 64000,
+	MAX_RATE     = 2000000,
+};
+
+
+struct sim {
+	uint64_t now;             /* Sender clock [us]                   */
+	int64_t delay;            /* One-way delay [us]                  */
+	uint16_t seq;             /* Transport-wide sequence number      */
+};
+
+
+/*
+ * Send n packets with immediate feedback. The one-way delay grows by
+ * growth [us] per packet, every loss-th packet is lost.
+ */
+static uint32_t simulate(struct bwe *bwe, struct sim *sim, unsigned n,
+			 int64_t growth, unsigned loss)
+{
+	uint32_t target = 0;
+
+	for (unsigned i = 0; i < n; i++) {
+		const uint16_t seq = sim->seq++;
+		const bool received = !loss || (i % loss) != 0;
+
+		bwe_sent(bwe, seq, PKT_SIZE, sim->now);
+
+		sim->delay += growth;
+		bwe_feedback(bwe, seq, received,
+			     (int64_t)sim->now + sim->delay);
+
+		sim->now += PKT_INTERVAL;
+
+		if (i % 10 == 9)
+			target = bwe_update(bwe, sim->now);
+	}
+
+	return target;
+}
+
+
+int test_bwe(void)
+{
+	struct sim sim = {1000000, 20000, 0};
+	struct bwe *bwe = NULL;
+	uint32_t target;
+	int err;
+
+	/* Steady delay, the estimate increases */
+	err = bwe_alloc(&bwe, MIN_RATE, 500000, MAX_RATE);
+	TEST_ERR(err);
+	ASSERT_EQ(500000, bwe_target(bwe));
+
+	target = simulate(bwe, &sim, 500, 0, 0);
+	ASSERT_TRUE(target > 500000);
+	ASSERT_TRUE(target <= MAX_RATE);
+	ASSERT_TRUE(bwe_usage(bwe) != BWE_OVERUSE);
+
+	/* Growing delay, queue is building up */
+	bwe = mem_deref(bwe);
+	err = bwe_alloc(&bwe, MIN_RATE, 1000000, MAX_RATE);
+	TEST_ERR(err);
+
+	target = simulate(bwe, &sim, 300, 1000, 0);
+	ASSERT_TRUE(target < 1000000);
+	ASSERT_TRUE(target >= MIN_RATE);
+
+	/* Heavy loss, 20% */
+	bwe = mem_deref(bwe);
+	err = bwe_alloc(&bwe, MIN_RATE, 1000000, MAX_RATE);
+	TEST_ERR(err);
+
+	target = simulate(bwe, &sim, 300, 0, 5);
+	ASSERT_TRUE(target < 500000);
+
+	/* Invalid range */
+	bwe = mem_deref(bwe);
+	err = bwe_alloc(&bwe, MAX_RATE, 1000000, MIN_RATE);
+	ASSERT_EQ(EINVAL, err);
+	err = 0;
+
+ out:
+	mem_deref(bwe);
+	return err;
+}
@@ -1351,6 +1351,72 @@ int test_call_video(void)
 }
 
 
+/*
+ * The Tx-Queue entries of the video sender are reused from a pool, which
+ * is not larger than the NACK wait buffer
+ */
+int test_call_video_pool(void)
+{
+	struct fixture fix, *f = &fix;
+	struct vidisp *vidisp = NULL;
+	struct cancel_rule *cr;
+	struct video *vid;
+	char *debug = NULL;
+	struct pl nack, pool, alloc;
+	uint32_t n_tx;
+	int err = 0;
+
+	conf_config()->video.fps = 100;
+	conf_config()->video.enc_fmt = VID_FMT_YUV420P;
+
+	fixture_init(f);
+	cancel_rule_new(UA_EVENT_CUSTOM, f->b.ua, 1, 0, 1);
+	cr->prm = "vidframe";
+	cr->n_vidframe = 200;
+
+	mock_vidcodec_register();
+
+	err = mock_vidisp_register(&vidisp, mock_vidisp_handler, f);
+	TEST_ERR(err);
+
+	err = module_load(".", "fakevideo");
+	TEST_ERR(err);
+
+	f->behaviour = BEHAVIOUR_ANSWER;
+	f->estab_action = ACTION_NOTHING;
+
+	err = ua_connect(f->a.ua, 0, NULL, f->buri, VIDMODE_ON);
+	TEST_ERR(err);
+
+	err = re_main_timeout(10000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+
+	vid  = call_video(ua_call(f->a.ua));
+	n_tx = stream_metric_get_tx_n_packets(video_strm(vid));
+
+	err = re_sdprintf(&debug, "%H", video_debug, vid);
+	TEST_ERR(err);
+
+	err = re_regex(debug, str_len(debug),
+		       "nack=[0-9]+ pool=[0-9]+ alloc=[0-9]+",
+		       &nack, &pool, &alloc);
+	TEST_ERR(err);
+
+	ASSERT_TRUE(pl_u32(&pool) <= pl_u32(&nack));
+	ASSERT_TRUE(pl_u32(&alloc) < n_tx);
+
+ out:
+	mem_deref(debug);
+	fixture_close(f);
+	mem_deref(vidisp);
+	module_unload("fakevideo");
+	mock_vidcodec_unregister();
+
+	return err;
+}
+
+
 int test_call_change_videodir(void)
 {
 	struct fixture fix, *f = &fix;
@@ -3261,6 +3327,126 @@ out:
 }
 
 
+struct txshare_test {
+	struct fixture *fix;
+	struct tmr tmr;
+	unsigned n_src;     /* sources opened by A */
+	uint32_t n_rx;      /* packets to receive on each leg of B */
+};
+
+
+static void txshare_ausrc_handler(const char *dev, void *arg)
+{
+	struct txshare_test *t = arg;
+
+	if (!str_cmp(dev, "a"))
+		++t->n_src;
+}
+
+
+static uint32_t txshare_rx_min(struct ua *ua)
+{
+	uint32_t n_min = UINT32_MAX;
+	struct le *le;
+
+	LIST_FOREACH(ua_calls(ua), le) {
+		const struct stream *strm = audio_strm(call_audio(le->data));
+
+		n_min = min(n_min, stream_metric_get_rx_n_packets(strm));
+	}
+
+	return n_min;
+}
+
+
+static void txshare_tmr_handler(void *arg)
+{
+	struct txshare_test *t = arg;
+
+	if (txshare_rx_min(t->fix->b.ua) >= t->n_rx) {
+		re_cancel();
+		return;
+	}
+
+	tmr_start(&t->tmr, 10, txshare_tmr_handler, t);
+}
+
+
+int test_call_txshare(void)
+{
+	struct fixture fix, *f = &fix;
+	struct txshare_test t;
+	struct ausrc *ausrc = NULL;
+	int err = 0;
+
+	memset(&t, 0, sizeof(t));
+	t.fix = f;
+
+	fixture_init_prm(f, ";audio_source=mock-ausrc,a");
+	mem_deref(f->b.ua);
+	err = ua_alloc(&f->b.ua, "B <sip:b@127.0.0.1>"
+		       ";regint=0;audio_source=mock-ausrc,b");
+	TEST_ERR(err);
+
+	err = mock_ausrc_register(&ausrc, baresip_ausrcl(),
+				  txshare_ausrc_handler, &t);
+	TEST_ERR(err);
+
+	conf_config()->audio.txshare = true;
+	conf_config()->call.max_calls = 4;
+
+	f->behaviour = BEHAVIOUR_ANSWER;
+	f->exp_estab = 2;
+
+	/* Make two calls from A to B with the same source and codec */
+	for (unsigned i = 0; i < 2; i++) {
+		err = ua_connect(f->a.ua, 0, NULL, f->buri, VIDMODE_OFF);
+		TEST_ERR(err);
+	}
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+	ASSERT_EQ(2, list_count(ua_calls(f->b.ua)));
+
+	/* both legs of B receive the packets of one encoder */
+	t.n_rx = 10;
+	tmr_start(&t.tmr, 10, txshare_tmr_handler, &t);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	ASSERT_EQ(1, t.n_src);
+
+	/* the remaining leg keeps sending when the other call ends */
+	f->exp_closed = 1;
+	ua_hangup(f->a.ua, list_ledata(list_head(ua_calls(f->a.ua))), 0, 0);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+	ASSERT_EQ(1, list_count(ua_calls(f->b.ua)));
+
+	t.n_rx = txshare_rx_min(f->b.ua) + 10;
+	tmr_start(&t.tmr, 10, txshare_tmr_handler, &t);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	ASSERT_TRUE(t.n_src <= 2);
+
+ out:
+	if (err)
+		failure_debug(f, false);
+
+	conf_config()->audio.txshare = false;
+
+	tmr_cancel(&t.tmr);
+	fixture_close(f);
+	mem_deref(ausrc);
+
+	return err;
+}
+
+
 #ifdef USE_TLS
 int test_call_sni(void)
 {
@@ -0,0 +1,288 @@
+/**
+ * @file test/fec.c  Forward Error Correction testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+static int test_fec_ulpfec(void)
+{
+	static const char *pldv[] = {"one", "packet two", "3", "four"};
+	struct fec_enc *enc = NULL;
+	struct fec_dec *dec = NULL;
+	struct mbuf *mbv[4] = {NULL};
+	struct mbuf *fmb = NULL, *rmb = NULL;
+	struct rtp_header hdr, rhdr;
+	int err;
+
+	err  = fec_enc_alloc(&enc, 4);
+	err |= fec_dec_alloc(&dec);
+	TEST_ERR(err);
+
+	fmb = mbuf_alloc(64);
+	ASSERT_TRUE(fmb != NULL);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.pt   = 96;
+	hdr.ssrc = 0x1234;
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(pldv); i++) {
+		const size_t len = str_len(pldv[i]);
+
+		hdr.seq = 65534 + (uint16_t)i;
+		hdr.ts  = 90000 + 3000 * (uint32_t)(i / 2);
+		hdr.m   = i == 1 || i == 3;
+
+		mbv[i] = mbuf_alloc(len);
+		ASSERT_TRUE(mbv[i] != NULL);
+		err = mbuf_write_str(mbv[i], pldv[i]);
+		TEST_ERR(err);
+		mbv[i]->pos = 0;
+
+		/* the marker of the first frame does not end the group */
+		err = fec_enc_packet(enc, fmb, &hdr,
+				     (const uint8_t *)pldv[i], len);
+		if (i == 1) {
+			ASSERT_EQ(0, err);
+			fmb->pos = fmb->end = 0;
+			fec_enc_set_group(enc, 2);
+			continue;
+		}
+
+		ASSERT_EQ(i == 3 ? 0 : ENOENT, err);
+
+		/* the third packet is lost */
+		if (i != 2)
+			fec_dec_media(dec, &hdr, mbv[i]);
+	}
+
+	fmb->pos = 0;
+	err = fec_dec_fec(dec, fmb, 0x1234, &rhdr, &rmb);
+	TEST_ERR(err);
+
+	ASSERT_EQ(0, rhdr.seq);
+	ASSERT_EQ(93000, rhdr.ts);
+	ASSERT_EQ(96, rhdr.pt);
+	ASSERT_TRUE(!rhdr.m);
+	ASSERT_EQ(0x1234, rhdr.ssrc);
+	TEST_MEMCMP(pldv[2], str_len(pldv[2]), mbuf_buf(rmb),
+		    mbuf_get_left(rmb));
+
+	/* nothing left to recover */
+	rmb = mem_deref(rmb);
+	ASSERT_EQ(ENOENT, fec_dec_fec(dec, fmb, 0x1234, &rhdr, &rmb));
+
+	fmb->pos = 0;
+	fmb->buf[0] = 0x40;
+	ASSERT_EQ(ENOTSUP, fec_dec_fec(dec, fmb, 0x1234, &rhdr, &rmb));
+
+	ASSERT_EQ(0, fec_group(0.0));
+	ASSERT_EQ(2, fec_group(0.25));
+
+ out:
+	for (size_t i = 0; i < RE_ARRAY_SIZE(mbv); i++)
+		mem_deref(mbv[i]);
+	mem_deref(rmb);
+	mem_deref(fmb);
+	mem_deref(dec);
+	mem_deref(enc);
+
+	return err;
+}
+
+
+/* The header extension is protected, the lost packet is recovered with it */
+static int test_fec_ulpfec_ext(void)
+{
+	static const uint8_t pkt_ext[] = {
+		0xbe, 0xde, 0x00, 0x01,  0x10, 0xaa, 0x00, 0x00,
+		'a', 'b', 'c'
+	};
+	static const uint8_t pkt[] = {'d', 'e', 'f', 'g', 'h'};
+	struct fec_enc *enc = NULL;
+	struct fec_dec *dec = NULL;
+	struct mbuf *mb = NULL;
+	struct mbuf *fmb = NULL, *rmb = NULL;
+	struct rtp_header hdr, rhdr;
+	int err;
+
+	err  = fec_enc_alloc(&enc, 2);
+	err |= fec_dec_alloc(&dec);
+	TEST_ERR(err);
+
+	fmb = mbuf_alloc(64);
+	mb  = mbuf_alloc(sizeof(pkt));
+	ASSERT_TRUE(fmb != NULL && mb != NULL);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.pt   = 96;
+	hdr.ssrc = 0x1234;
+	hdr.seq  = 100;
+	hdr.ts   = 3000;
+	hdr.ext  = true;
+
+	err = fec_enc_packet(enc, fmb, &hdr, pkt_ext, sizeof(pkt_ext));
+	ASSERT_EQ(ENOENT, err);
+
+	/* the second packet is received */
+	hdr.seq = 101;
+	hdr.ext = false;
+	hdr.m   = true;
+
+	err = fec_enc_packet(enc, fmb, &hdr, pkt, sizeof(pkt));
+	TEST_ERR(err);
+
+	err = mbuf_write_mem(mb, pkt, sizeof(pkt));
+	TEST_ERR(err);
+	mb->pos = 0;
+	fec_dec_media(dec, &hdr, mb);
+
+	fmb->pos = 0;
+	err = fec_dec_fec(dec, fmb, 0x1234, &rhdr, &rmb);
+	TEST_ERR(err);
+
+	ASSERT_EQ(100, rhdr.seq);
+	ASSERT_EQ(3000, rhdr.ts);
+	ASSERT_TRUE(!rhdr.m);
+	ASSERT_TRUE(rhdr.ext);
+	ASSERT_EQ(0, rhdr.cc);
+	ASSERT_EQ(0xbede, rhdr.x.type);
+	ASSERT_EQ(1, rhdr.x.len);
+	ASSERT_EQ(8, rmb->pos);
+	TEST_MEMCMP(pkt_ext, sizeof(pkt_ext), rmb->buf, rmb->end);
+
+	/* a partial group is completed by a flush */
+	ASSERT_EQ(ENOENT, fec_enc_flush(enc, fmb));
+
+	hdr.seq = 102;
+	hdr.m   = false;
+	err = fec_enc_packet(enc, fmb, &hdr, pkt, sizeof(pkt));
+	ASSERT_EQ(ENOENT, err);
+
+	fmb->pos = fmb->end = 0;
+	err = fec_enc_flush(enc, fmb);
+	TEST_ERR(err);
+	ASSERT_EQ(14 + sizeof(pkt), fmb->end);
+
+ out:
+	mem_deref(rmb);
+	mem_deref(mb);
+	mem_deref(fmb);
+	mem_deref(dec);
+	mem_deref(enc);
+
+	return err;
+}
+
+
+static int test_fec_red(void)
+{
+	static const char *pldv[] = {"first", "second", "third"};
+	struct red_block blkv[RED_MAX + 1];
+	struct red_enc *enc = NULL;
+	struct mbuf *mb = NULL;
+	size_t blkc;
+	int err;
+
+	err = red_enc_alloc(&enc, 2);
+	TEST_ERR(err);
+
+	mb = mbuf_alloc(64);
+	ASSERT_TRUE(mb != NULL);
+
+	for (size_t i = 0; i < RE_ARRAY_SIZE(pldv); i++) {
+
+		mb->pos = mb->end = 0;
+
+		err = red_enc_packet(enc, mb, 111, 960 * (uint32_t)i,
+				     (const uint8_t *)pldv[i],
+				     str_len(pldv[i]));
+		TEST_ERR(err);
+	}
+
+	mb->pos = 0;
+	blkc = RE_ARRAY_SIZE(blkv);
+	err = red_decode(blkv, &blkc, 1920, mb);
+	TEST_ERR(err);
+
+	ASSERT_EQ(3, (int)blkc);
+
+	for (size_t i = 0; i < blkc; i++) {
+		ASSERT_EQ(111, blkv[i].pt);
+		ASSERT_EQ(960 * (uint32_t)i, blkv[i].ts);
+		TEST_MEMCMP(pldv[i], str_len(pldv[i]),
+			    blkv[i].data, blkv[i].len);
+	}
+
+	/* primary block only, the previous packets are dropped */
+	red_enc_set_distance(enc, 0);
+	mb->pos = mb->end = 0;
+	err = red_enc_packet(enc, mb, 111, 2880, (const uint8_t *)"x", 1);
+	TEST_ERR(err);
+
+	mb->pos = 0;
+	blkc = RE_ARRAY_SIZE(blkv);
+	err = red_decode(blkv, &blkc, 2880, mb);
+	TEST_ERR(err);
+	ASSERT_EQ(1, (int)blkc);
+	ASSERT_EQ(1, (int)blkv[0].len);
+
+	red_enc_set_distance(enc, 2);
+	mb->pos = mb->end = 0;
+	err = red_enc_packet(enc, mb, 111, 3840, (const uint8_t *)"y", 1);
+	TEST_ERR(err);
+
+	mb->pos = 0;
+	blkc = RE_ARRAY_SIZE(blkv);
+	err = red_decode(blkv, &blkc, 3840, mb);
+	TEST_ERR(err);
+	ASSERT_EQ(2, (int)blkc);
+	ASSERT_EQ(2880, blkv[0].ts);
+
+	/* no block with a timestamp offset that is too large */
+	mb->pos = mb->end = 0;
+	err = red_enc_packet(enc, mb, 111, 3840 + 20000,
+			     (const uint8_t *)"z", 1);
+	TEST_ERR(err);
+
+	mb->pos = 0;
+	blkc = RE_ARRAY_SIZE(blkv);
+	err = red_decode(blkv, &blkc, 3840 + 20000, mb);
+	TEST_ERR(err);
+	ASSERT_EQ(1, (int)blkc);
+
+	/* truncated */
+	mb->pos = 0;
+	mb->end = 0;
+	blkc = RE_ARRAY_SIZE(blkv);
+	ASSERT_EQ(EBADMSG, red_decode(blkv, &blkc, 0, mb));
+
+ out:
+	mem_deref(mb);
+	mem_deref(enc);
+
+	return err;
+}
+
+
+int test_fec(void)
+{
+	int err;
+
+	err = test_fec_ulpfec();
+	TEST_ERR(err);
+
+	err = test_fec_ulpfec_ext();
+	TEST_ERR(err);
+
+	err = test_fec_red();
+	TEST_ERR(err);
+
+ out:
+	return err;
+}
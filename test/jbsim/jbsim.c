@@ -0,0 +1,1030 @@
+/**
+ * @file jbsim/jbsim.c  Offline jitter buffer and playout simulator
+ *
+ * Replays recorded RTP arrival traces through the jitter buffer and the
+ * audio playout path on a virtual clock, and reports late, lost, underrun
+ * and overrun counts and the mouth-to-ear delay as JSON lines on stdout,
+ * one line per trace and parameter set.
+ *
+ * A trace is either a pcap file (the RTP stream is detected on the first
+ * packet, or selected with -s), or a CSV file with one packet per line:
+ *
+ *     seq,rtp_timestamp,arrival_us[,send_us]
+ *
+ * Without send times the delay is given relative to the fastest packet.
+ *
+ * The audio buffer is modelled by its fill level in samples. Playback
+ * starts when the minimum is reached, a read from an under-filled buffer
+ * is an underrun and restarts filling, and writes beyond the maximum drop
+ * the oldest frames. With mode "stretch" the frames pass the time-
+ * stretching playout stage first.
+ *
+ * Usage:
+ *
+ *     baresip-jbsim -j fixed,adaptive -d 1-5,2-10 -a 20-160 trace.pcap
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_GETOPT
+#include <getopt.h>
+#endif
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "../../src/core.h"
+
+
+enum {
+	DEFAULT_SRATE = 8000,
+	DEFAULT_PTIME = 20,
+	MAX_PARAMS    = 16,
+	PCAP_HDR      = 24,
+	PCAP_REC      = 16,
+};
+
+enum {
+	DLT_NULL      = 0,
+	DLT_EN10MB    = 1,
+	DLT_RAW       = 101,
+	DLT_LINUX_SLL = 113,
+	DLT_IPV4      = 228,
+	DLT_IPV6      = 229,
+	DLT_SLL2      = 276,
+};
+
+
+/** One recorded RTP packet */
+struct pkt {
+	uint64_t arrival;       /**< Arrival time [us]                 */
+	uint64_t send;          /**< Send time [us]                    */
+	uint64_t tsx;           /**< Extended RTP timestamp            */
+	uint32_t ts;            /**< RTP timestamp                     */
+	uint32_t ssrc;          /**< Synchronization source            */
+	uint16_t seq;           /**< Sequence number                   */
+	bool m;                 /**< Marker bit                        */
+};
+
+/** Recorded RTP arrival trace */
+struct trace {
+	const char *name;       /**< File name                         */
+	struct pkt *pktv;       /**< Packets in arrival order          */
+	size_t pktc;            /**< Number of packets                 */
+	size_t pktn;            /**< Allocated number of packets       */
+	bool has_send;          /**< Send times are known              */
+};
+
+/** Simulation parameters */
+struct param {
+	enum jbuf_type jbtype;  /**< Jitter buffer type                */
+	struct range jbuf_del;  /**< Jitter buffer delay [frames]      */
+	struct range buffer;    /**< Audio buffer [ms]                 */
+	bool stretch;           /**< Time-stretching playout           */
+};
+
+/** Frame in the audio buffer */
+struct frame {
+	uint64_t send;          /**< Send time of first sample [us]    */
+	uint32_t sampc;         /**< Samples in frame                  */
+	uint32_t pos;           /**< Samples already played            */
+};
+
+/** Simulation results */
+struct result {
+	uint32_t written;       /**< Frames written to audio buffer    */
+	uint32_t played;        /**< Frames played                     */
+	uint32_t late;          /**< Packets too late for jbuf         */
+	uint32_t dups;          /**< Duplicate packets                 */
+	uint32_t lost;          /**< Sequence gaps at the audio buffer */
+	uint32_t underrun;      /**< Audio buffer underruns            */
+	uint32_t overrun;       /**< Frames dropped on overrun         */
+	uint64_t accel;         /**< Accelerated frames                */
+	uint64_t decel;         /**< Decelerated frames                */
+	uint32_t *delayv;       /**< Mouth-to-ear delays [us]          */
+};
+
+/** One simulation run */
+struct sim {
+	const struct trace *tr; /**< Trace                             */
+	const struct param *prm;/**< Parameters                        */
+	uint32_t srate;         /**< Sampling rate [Hz]                */
+	uint32_t ptime;         /**< Packet time [ms]                  */
+	uint32_t psamp;         /**< Samples per packet                */
+
+	uint64_t now;           /**< Virtual clock [us]                */
+	struct jbuf *jb;        /**< Jitter buffer (optional)          */
+	struct playout *po;     /**< Playout stage (optional)          */
+	int16_t *sampv;         /**< Silent frame for the playout      */
+
+	struct frame *framev;   /**< Audio buffer, ring of frames      */
+	size_t framen;          /**< Ring size                         */
+	size_t head;            /**< Oldest frame                      */
+	size_t framec;          /**< Frames in audio buffer            */
+	uint32_t level;         /**< Audio buffer level [samples]      */
+	uint32_t min_sz;        /**< Audio buffer minimum [samples]    */
+	uint32_t max_sz;        /**< Audio buffer maximum [samples]    */
+	bool filling;           /**< Waiting for the minimum level     */
+	bool started;           /**< First frame written               */
+	uint16_t seq;           /**< Last written sequence number      */
+
+	struct result res;      /**< Results                           */
+};
+
+
+static const char *jbuf_type_str(enum jbuf_type jbtype)
+{
+	switch (jbtype) {
+
+	case JBUF_OFF:      return "off";
+	case JBUF_FIXED:    return "fixed";
+	case JBUF_ADAPTIVE: return "adaptive";
+	case JBUF_FRAME:    return "frame";
+	default:            return "?";
+	}
+}
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr,
+			 "Usage: baresip-jbsim [options] <trace>...\n"
+			 "options:\n"
+			 "\t-j <types>       Jitter buffer types "
+			 "(default fixed,adaptive)\n"
+			 "\t-d <ranges>      Jitter buffer delays [frames] "
+			 "(default 5-10)\n"
+			 "\t-a <ranges>      Audio buffers [ms] "
+			 "(default 20-160)\n"
+			 "\t-m <modes>       Audio buffer modes "
+			 "[fixed, stretch] (default fixed)\n"
+			 "\t-r <srate>       Sampling rate [Hz] "
+			 "(default %u)\n"
+			 "\t-p <ptime>       Packet time [ms] "
+			 "(default %u)\n"
+			 "\t-s <ssrc>        Select RTP stream of pcap\n"
+			 "\n"
+			 "Lists are comma separated, all combinations "
+			 "are simulated.\n",
+			 DEFAULT_SRATE, DEFAULT_PTIME);
+}
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	(void)arg;
+
+	return fwrite(p, 1, size, stdout) == size ? 0 : EIO;
+}
+
+
+/*
+ * Trace loading
+ */
+
+
+static int trace_add(struct trace *tr, const struct pkt *pkt)
+{
+	if (tr->pktc >= tr->pktn) {
+		size_t n = tr->pktn ? tr->pktn * 2 : 1024;
+		struct pkt *v;
+
+		v = mem_realloc(tr->pktv, n * sizeof(*v));
+		if (!v)
+			return ENOMEM;
+
+		tr->pktv = v;
+		tr->pktn = n;
+	}
+
+	tr->pktv[tr->pktc++] = *pkt;
+
+	return 0;
+}
+
+
+static uint16_t rd16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+
+static uint32_t rd32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+		(uint32_t)p[2] << 8 | p[3];
+}
+
+
+static uint32_t rd32_le(const uint8_t *p, bool swap)
+{
+	uint32_t v = (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 |
+		(uint32_t)p[1] << 8 | p[0];
+
+	return swap ? rd32(p) : v;
+}
+
+
+/* Find the IP payload of a captured frame, returns the ethertype */
+static uint16_t link_strip(uint32_t linktype, const uint8_t **pp,
+			   size_t *lenp)
+{
+	const uint8_t *p = *pp;
+	size_t len = *lenp;
+	uint16_t proto = 0;
+	size_t hl = 0;
+
+	switch (linktype) {
+
+	case DLT_NULL:
+		if (len < 4)
+			return 0;
+
+		hl = 4;
+		proto = (p[0] == 2 || p[3] == 2) ? 0x0800 : 0x86dd;
+		break;
+
+	case DLT_EN10MB:
+		if (len < 14)
+			return 0;
+
+		hl = 14;
+		proto = rd16(p + 12);
+		while ((proto == 0x8100 || proto == 0x88a8) &&
+		       len >= hl + 4) {
+			proto = rd16(p + hl + 2);
+			hl += 4;
+		}
+		break;
+
+	case DLT_LINUX_SLL:
+		if (len < 16)
+			return 0;
+
+		hl = 16;
+		proto = rd16(p + 14);
+		break;
+
+	case DLT_SLL2:
+		if (len < 20)
+			return 0;
+
+		hl = 20;
+		proto = rd16(p);
+		break;
+
+	case DLT_RAW:
+	case DLT_IPV4:
+	case DLT_IPV6:
+		if (len < 1)
+			return 0;
+
+		proto = (p[0] >> 4) == 4 ? 0x0800 : 0x86dd;
+		break;
+
+	default:
+		return 0;
+	}
+
+	*pp   = p + hl;
+	*lenp = len - hl;
+
+	return proto;
+}
+
+
+/* Find the UDP payload of an IP packet */
+static bool udp_strip(uint16_t proto, const uint8_t **pp, size_t *lenp)
+{
+	const uint8_t *p = *pp;
+	size_t len = *lenp;
+	size_t hl;
+
+	if (proto == 0x0800) {
+		if (len < 20 || (p[0] >> 4) != 4 || p[9] != IPPROTO_UDP)
+			return false;
+
+		/* fragments are not supported */
+		if (rd16(p + 6) & 0x1fff)
+			return false;
+
+		hl = (size_t)(p[0] & 0x0f) * 4;
+		if (hl < 20)
+			return false;
+	}
+	else if (proto == 0x86dd) {
+		if (len < 40 || (p[0] >> 4) != 6 || p[6] != IPPROTO_UDP)
+			return false;
+
+		hl = 40;
+	}
+	else {
+		return false;
+	}
+
+	if (len < hl + 8)
+		return false;
+
+	*pp   = p + hl + 8;
+	*lenp = len - hl - 8;
+
+	return true;
+}
+
+
+static int pcap_load(struct trace *tr, const uint8_t *buf, size_t len,
+		     uint32_t ssrc)
+{
+	uint32_t magic, linktype;
+	bool swap, nsec;
+	bool locked = ssrc != 0;
+	size_t pos = PCAP_HDR;
+	int err = 0;
+
+	magic = rd32_le(buf, false);
+	swap  = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+	nsec  = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+
+	linktype = rd32_le(buf + 20, swap);
+
+	while (pos + PCAP_REC <= len) {
+		const uint32_t sec  = rd32_le(buf + pos, swap);
+		const uint32_t frac = rd32_le(buf + pos + 4, swap);
+		size_t caplen = rd32_le(buf + pos + 8, swap);
+		const uint8_t *p = buf + pos + PCAP_REC;
+		struct pkt pkt;
+		uint16_t proto;
+		uint8_t pt;
+
+		pos += PCAP_REC + caplen;
+		if (pos > len)
+			break;
+
+		proto = link_strip(linktype, &p, &caplen);
+		if (!udp_strip(proto, &p, &caplen))
+			continue;
+
+		/* RTP version 2, no RTCP */
+		if (caplen < 12 || (p[0] >> 6) != 2)
+			continue;
+
+		pt = p[1] & 0x7f;
+		if (pt >= 72 && pt <= 76)
+			continue;
+
+		memset(&pkt, 0, sizeof(pkt));
+		pkt.arrival = (uint64_t)sec * 1000000 +
+			(nsec ? frac / 1000 : frac);
+		pkt.m    = (p[1] >> 7) != 0;
+		pkt.seq  = rd16(p + 2);
+		pkt.ts   = rd32(p + 4);
+		pkt.ssrc = rd32(p + 8);
+
+		if (!locked) {
+			ssrc   = pkt.ssrc;
+			locked = true;
+		}
+
+		if (pkt.ssrc != ssrc)
+			continue;
+
+		err = trace_add(tr, &pkt);
+		if (err)
+			break;
+	}
+
+	return err;
+}
+
+
+static int csv_load(struct trace *tr, char *buf)
+{
+	char *line, *save = NULL;
+	int err = 0;
+
+	tr->has_send = true;
+
+	for (line = strtok_r(buf, "\r\n", &save); line;
+	     line = strtok_r(NULL, "\r\n", &save)) {
+
+		unsigned long long arrival, send;
+		unsigned seq, ts;
+		struct pkt pkt;
+		int n;
+
+		/* comments and header lines */
+		n = sscanf(line, "%u,%u,%llu,%llu", &seq, &ts, &arrival,
+			   &send);
+		if (n < 3)
+			continue;
+
+		memset(&pkt, 0, sizeof(pkt));
+		pkt.seq     = (uint16_t)seq;
+		pkt.ts      = (uint32_t)ts;
+		pkt.arrival = arrival;
+		pkt.send    = n > 3 ? send : 0;
+
+		if (n < 4)
+			tr->has_send = false;
+
+		err = trace_add(tr, &pkt);
+		if (err)
+			break;
+	}
+
+	return err;
+}
+
+
+/* Unwrap the RTP timestamps and derive missing send times */
+static void trace_prepare(struct trace *tr, uint32_t srate)
+{
+	uint64_t tsx = 0;
+	int64_t offset = INT64_MAX;
+
+	for (size_t i = 0; i < tr->pktc; i++) {
+		struct pkt *pkt = &tr->pktv[i];
+
+		if (i)
+			tsx += (int32_t)(pkt->ts - tr->pktv[i-1].ts);
+		else
+			tsx = (uint64_t)1 << 32;
+
+		pkt->tsx = tsx;
+	}
+
+	if (tr->has_send)
+		return;
+
+	for (size_t i = 0; i < tr->pktc; i++) {
+		struct pkt *pkt = &tr->pktv[i];
+
+		pkt->send = pkt->tsx * 1000000 / srate;
+		offset = min(offset, (int64_t)(pkt->arrival - pkt->send));
+	}
+
+	for (size_t i = 0; i < tr->pktc; i++)
+		tr->pktv[i].send += offset;
+}
+
+
+static int trace_load(struct trace *tr, const char *name, uint32_t srate,
+		      uint32_t ssrc)
+{
+	uint8_t *buf = NULL;
+	size_t len = 0;
+	long sz;
+	FILE *f;
+	int err = 0;
+
+	memset(tr, 0, sizeof(*tr));
+	tr->name = name;
+
+	f = fopen(name, "rb");
+	if (!f)
+		return errno;
+
+	if (fseek(f, 0, SEEK_END) || (sz = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET)) {
+		err = errno;
+		goto out;
+	}
+
+	buf = mem_alloc((size_t)sz + 1, NULL);
+	if (!buf) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	len = fread(buf, 1, (size_t)sz, f);
+	buf[len] = '\0';
+
+	if (len >= PCAP_HDR &&
+	    (rd32_le(buf, false) == 0xa1b2c3d4 ||
+	     rd32_le(buf, true)  == 0xa1b2c3d4 ||
+	     rd32_le(buf, false) == 0xa1b23c4d ||
+	     rd32_le(buf, true)  == 0xa1b23c4d))
+		err = pcap_load(tr, buf, len, ssrc);
+	else
+		err = csv_load(tr, (char *)buf);
+
+	if (err)
+		goto out;
+
+	if (!tr->pktc) {
+		warning("jbsim: %s: no RTP packets\n", name);
+		err = ENOENT;
+		goto out;
+	}
+
+	trace_prepare(tr, srate);
+
+ out:
+	mem_deref(buf);
+	fclose(f);
+
+	return err;
+}
+
+
+/*
+ * Simulation
+ */
+
+
+static uint64_t clock_handler(void *arg)
+{
+	const struct sim *sim = arg;
+
+	return sim->now / 1000;
+}
+
+
+static void aubuf_drop(struct sim *sim)
+{
+	struct frame *fr = &sim->framev[sim->head];
+
+	sim->level -= fr->sampc - fr->pos;
+	sim->head = (sim->head + 1) % sim->framen;
+	--sim->framec;
+}
+
+
+static void aubuf_write(struct sim *sim, const struct pkt *pkt)
+{
+	struct frame *fr;
+	struct auframe af;
+
+	if (sim->started) {
+		int16_t d = (int16_t)(pkt->seq - sim->seq);
+
+		if (d > 1)
+			sim->res.lost += d - 1;
+	}
+
+	sim->started = true;
+	sim->seq     = pkt->seq;
+
+	auframe_init(&af, AUFMT_S16LE, sim->sampv, sim->psamp, sim->srate, 1);
+	af.timestamp = pkt->tsx * 1000000 / sim->srate;
+
+	if (sim->po)
+		playout_process(sim->po, &af, sim->now,
+				sim->level * 1000 / sim->srate);
+
+	if (sim->framec == sim->framen) {
+		aubuf_drop(sim);
+		++sim->res.overrun;
+	}
+
+	fr = &sim->framev[(sim->head + sim->framec) % sim->framen];
+	fr->send  = pkt->send;
+	fr->sampc = (uint32_t)af.sampc;
+	fr->pos   = 0;
+
+	++sim->framec;
+	sim->level += fr->sampc;
+	++sim->res.written;
+
+	while (sim->level > sim->max_sz && sim->framec > 1) {
+		aubuf_drop(sim);
+		++sim->res.overrun;
+	}
+}
+
+
+/* The audio player reads one packet time from the audio buffer */
+static void aubuf_read(struct sim *sim)
+{
+	uint32_t need = sim->psamp;
+	uint32_t off = 0;
+
+	if (sim->filling) {
+		if (sim->level < sim->min_sz)
+			return;
+
+		sim->filling = false;
+	}
+
+	if (sim->level < need) {
+		++sim->res.underrun;
+		sim->filling = true;
+		return;
+	}
+
+	while (need) {
+		struct frame *fr = &sim->framev[sim->head];
+		uint32_t n = min(need, fr->sampc - fr->pos);
+
+		if (!fr->pos) {
+			uint64_t t = sim->now + (uint64_t)off * 1000000 /
+				sim->srate;
+
+			sim->res.delayv[sim->res.played++] =
+				(uint32_t)(t > fr->send ? t - fr->send : 0);
+		}
+
+		fr->pos     += n;
+		sim->level  -= n;
+		off         += n;
+		need        -= n;
+
+		if (fr->pos == fr->sampc) {
+			sim->head = (sim->head + 1) % sim->framen;
+			--sim->framec;
+		}
+	}
+}
+
+
+static void packet_handler(struct sim *sim, const struct pkt *pkt)
+{
+	struct rtp_header hdr;
+	struct pkt *mem;
+	uint32_t n;
+	int err;
+
+	if (!sim->jb) {
+		aubuf_write(sim, pkt);
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.m    = pkt->m;
+	hdr.seq  = pkt->seq;
+	hdr.ts   = pkt->ts;
+	hdr.ssrc = pkt->ssrc ? pkt->ssrc : 1;
+
+	mem = mem_alloc(sizeof(*mem), NULL);
+	if (!mem)
+		return;
+
+	*mem = *pkt;
+
+	err = jbuf_put(sim->jb, &hdr, mem);
+	mem_deref(mem);
+	if (err == ETIMEDOUT)
+		++sim->res.late;
+	else if (err == EALREADY)
+		++sim->res.dups;
+
+	/* decode as the RTP receiver does */
+	n = jbuf_packets(sim->jb);
+	while (n--) {
+		void *p = NULL;
+
+		err = jbuf_get(sim->jb, &hdr, &p);
+		if (err && err != EAGAIN)
+			break;
+
+		aubuf_write(sim, p);
+		mem_deref(p);
+
+		if (err != EAGAIN)
+			break;
+	}
+}
+
+
+static int sim_run(struct sim *sim)
+{
+	const struct trace *tr = sim->tr;
+	const struct param *prm = sim->prm;
+	const uint64_t step = (uint64_t)sim->ptime * 1000;
+	uint64_t tick;
+	size_t i = 0;
+	int err = 0;
+
+	sim->psamp  = sim->srate * sim->ptime / 1000;
+	sim->min_sz = prm->buffer.min * sim->srate / 1000;
+	sim->max_sz = prm->buffer.max * sim->srate / 1000;
+	sim->framen = 2 * (prm->buffer.max / sim->ptime) + 4;
+	sim->filling = true;
+
+	sim->framev = mem_zalloc(sim->framen * sizeof(*sim->framev), NULL);
+	sim->sampv  = mem_zalloc(sim->psamp * sizeof(int16_t), NULL);
+	sim->res.delayv = mem_zalloc(2 * tr->pktc * sizeof(uint32_t), NULL);
+	if (!sim->framev || !sim->sampv || !sim->res.delayv)
+		return ENOMEM;
+
+	if (prm->jbtype != JBUF_OFF) {
+		err = jbuf_alloc(&sim->jb, prm->jbuf_del.min,
+				 prm->jbuf_del.max);
+		if (err)
+			return err;
+
+		jbuf_set_type(sim->jb, prm->jbtype);
+		jbuf_set_clock(sim->jb, clock_handler, sim);
+	}
+
+	if (prm->stretch) {
+		err = playout_alloc(&sim->po, &prm->buffer, sim->ptime);
+		if (err)
+			return err;
+	}
+
+	tick = tr->pktv[0].arrival;
+
+	for (;;) {
+		if (i < tr->pktc && tr->pktv[i].arrival <= tick) {
+			sim->now = tr->pktv[i].arrival;
+			packet_handler(sim, &tr->pktv[i]);
+			++i;
+			continue;
+		}
+
+		/* stop when the trace is played out */
+		if (i == tr->pktc &&
+		    sim->level < (sim->filling ? sim->min_sz : sim->psamp))
+			break;
+
+		sim->now = tick;
+		aubuf_read(sim);
+		tick += step;
+	}
+
+	if (sim->po) {
+		const struct playout_stat *st = playout_stat(sim->po);
+
+		sim->res.accel = st->n_accel;
+		sim->res.decel = st->n_decel;
+	}
+
+	return 0;
+}
+
+
+static void sim_close(struct sim *sim)
+{
+	mem_deref(sim->jb);
+	mem_deref(sim->po);
+	mem_deref(sim->sampv);
+	mem_deref(sim->framev);
+	mem_deref(sim->res.delayv);
+}
+
+
+static int u32_cmp(const void *a, const void *b)
+{
+	const uint32_t x = *(const uint32_t *)a;
+	const uint32_t y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+static int sim_print(struct re_printf *pf, struct sim *sim)
+{
+	const struct param *prm = sim->prm;
+	struct result *res = &sim->res;
+	const size_t n = res->played;
+	double mean = 0.0, p50 = 0.0, p95 = 0.0, dmax = 0.0;
+
+	if (n) {
+		uint64_t sum = 0;
+
+		qsort(res->delayv, n, sizeof(*res->delayv), u32_cmp);
+
+		for (size_t i = 0; i < n; i++)
+			sum += res->delayv[i];
+
+		mean = sum / (double)n / 1000.0;
+		p50  = res->delayv[(n - 1) * 50 / 100] / 1000.0;
+		p95  = res->delayv[(n - 1) * 95 / 100] / 1000.0;
+		dmax = res->delayv[n - 1] / 1000.0;
+	}
+
+	return re_hprintf(pf,
+			  "{\"trace\":\"%s\","
+			  "\"jbuf_type\":\"%s\","
+			  "\"jbuf_delay\":\"%u-%u\","
+			  "\"audio_buffer\":\"%u-%u\","
+			  "\"mode\":\"%s\","
+			  "\"packets\":%zu,"
+			  "\"written\":%u,"
+			  "\"played\":%u,"
+			  "\"late\":%u,"
+			  "\"dups\":%u,"
+			  "\"lost\":%u,"
+			  "\"underrun\":%u,"
+			  "\"overrun\":%u,"
+			  "\"accel\":%llu,"
+			  "\"decel\":%llu,"
+			  "\"delay_ms\":{\"base\":\"%s\","
+			  "\"mean\":%.1f,\"p50\":%.1f,"
+			  "\"p95\":%.1f,\"max\":%.1f}}\n",
+			  sim->tr->name,
+			  jbuf_type_str(prm->jbtype),
+			  prm->jbuf_del.min, prm->jbuf_del.max,
+			  prm->buffer.min, prm->buffer.max,
+			  prm->stretch ? "stretch" : "fixed",
+			  sim->tr->pktc,
+			  res->written, res->played,
+			  res->late, res->dups, res->lost,
+			  res->underrun, res->overrun,
+			  res->accel, res->decel,
+			  sim->tr->has_send ? "send" : "fastest",
+			  mean, p50, p95, dmax);
+}
+
+
+/*
+ * Command line
+ */
+
+
+static int range_parse(struct range *rng, const char *str)
+{
+	unsigned a, b;
+
+	if (2 != sscanf(str, "%u-%u", &a, &b) || a > b)
+		return EINVAL;
+
+	rng->min = a;
+	rng->max = b;
+
+	return 0;
+}
+
+
+/* Split a comma separated list, returns the number of items */
+static size_t list_split(char *str, char **itemv, size_t itemn)
+{
+	char *save = NULL;
+	size_t n = 0;
+
+	for (char *s = strtok_r(str, ",", &save); s && n < itemn;
+	     s = strtok_r(NULL, ",", &save))
+		itemv[n++] = s;
+
+	return n;
+}
+
+
+static int param_decode(struct param *prm, const char *jbtype,
+			const char *del, const char *buf, const char *mode)
+{
+	struct pl pl;
+
+	memset(prm, 0, sizeof(*prm));
+
+	pl_set_str(&pl, jbtype);
+	prm->jbtype  = conf_get_jbuf_type(&pl);
+	prm->stretch = 0 == str_casecmp(mode, "stretch");
+
+	if (prm->jbtype == JBUF_FRAME)
+		return ENOTSUP;
+
+	if (!prm->stretch && str_casecmp(mode, "fixed"))
+		return ENOTSUP;
+
+	if (range_parse(&prm->jbuf_del, del) ||
+	    range_parse(&prm->buffer, buf) || !prm->buffer.min)
+		return EINVAL;
+
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct re_printf pf_stdout = {print_handler, NULL};
+	char jbarg[256]   = "fixed,adaptive";
+	char delarg[256]  = "5-10";
+	char bufarg[256]  = "20-160";
+	char modearg[256] = "fixed";
+	char *jbv[MAX_PARAMS], *delv[MAX_PARAMS];
+	char *bufv[MAX_PARAMS], *modev[MAX_PARAMS];
+	size_t jbc, delc, bufc, modec;
+	uint32_t srate = DEFAULT_SRATE;
+	uint32_t ptime = DEFAULT_PTIME;
+	uint32_t ssrc = 0;
+	struct trace tr;
+	int err;
+
+	memset(&tr, 0, sizeof(tr));
+
+	err = libre_init();
+	if (err)
+		return err;
+
+#ifdef HAVE_GETOPT
+	for (;;) {
+		const int c = getopt(argc, argv, "hj:d:a:m:r:p:s:");
+		if (0 > c)
+			break;
+
+		switch (c) {
+
+		case 'j':
+			str_ncpy(jbarg, optarg, sizeof(jbarg));
+			break;
+
+		case 'd':
+			str_ncpy(delarg, optarg, sizeof(delarg));
+			break;
+
+		case 'a':
+			str_ncpy(bufarg, optarg, sizeof(bufarg));
+			break;
+
+		case 'm':
+			str_ncpy(modearg, optarg, sizeof(modearg));
+			break;
+
+		case 'r':
+			srate = atoi(optarg);
+			break;
+
+		case 'p':
+			ptime = atoi(optarg);
+			break;
+
+		case 's':
+			ssrc = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+
+		case '?':
+		case 'h':
+		default:
+			usage();
+			return -2;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+#else
+	--argc;
+	++argv;
+#endif
+
+	jbc   = list_split(jbarg, jbv, RE_ARRAY_SIZE(jbv));
+	delc  = list_split(delarg, delv, RE_ARRAY_SIZE(delv));
+	bufc  = list_split(bufarg, bufv, RE_ARRAY_SIZE(bufv));
+	modec = list_split(modearg, modev, RE_ARRAY_SIZE(modev));
+
+	if (argc < 1 || !srate || !ptime ||
+	    !jbc || !delc || !bufc || !modec) {
+		usage();
+		return -2;
+	}
+
+	for (int t = 0; t < argc; t++) {
+
+		err = trace_load(&tr, argv[t], srate, ssrc);
+		if (err) {
+			re_fprintf(stderr, "%s: could not load trace (%m)\n",
+				   argv[t], err);
+			goto out;
+		}
+
+		/* all combinations of the parameter lists */
+		for (size_t k = 0; k < jbc * delc * bufc * modec; k++) {
+			const size_t j = k / (delc * bufc * modec);
+			const size_t d = k / (bufc * modec) % delc;
+			const size_t b = k / modec % bufc;
+			const size_t m = k % modec;
+			struct param prm;
+			struct sim sim;
+
+			err = param_decode(&prm, jbv[j], delv[d], bufv[b],
+					   modev[m]);
+			if (err) {
+				re_fprintf(stderr, "invalid parameters"
+					   " %s %s %s %s (%m)\n",
+					   jbv[j], delv[d], bufv[b], modev[m],
+					   err);
+				goto out;
+			}
+
+			memset(&sim, 0, sizeof(sim));
+			sim.tr    = &tr;
+			sim.prm   = &prm;
+			sim.srate = srate;
+			sim.ptime = ptime;
+
+			err = sim_run(&sim);
+			if (!err)
+				err = sim_print(&pf_stdout, &sim);
+
+			sim_close(&sim);
+			if (err)
+				goto out;
+		}
+
+		tr.pktv = mem_deref(tr.pktv);
+	}
+
+ out:
+	if (err)
+		re_fprintf(stderr, "baresip-jbsim: failed (%m)\n", err);
+
+	mem_deref(tr.pktv);
+
+	libre_close();
+
+	return err;
+}
@@ -385,3 +385,59 @@ int test_jbuf_adaptive_video(void)
 
 	return err;
 }
+
+
+static uint64_t clock_handler(void *arg)
+{
+	return *(uint64_t *)arg;
+}
+
+
+int test_jbuf_clock(void)
+{
+	struct rtp_header hdr;
+	struct jbuf *jb = NULL;
+	uint64_t now = 1000;
+	char *mem;
+	int err;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ssrc = 1;
+
+	mem = mem_zalloc(32, NULL);
+	if (!mem)
+		return ENOMEM;
+
+	err = jbuf_alloc(&jb, 1, 10);
+	TEST_ERR(err);
+
+	jbuf_set_clock(jb, clock_handler, &now);
+
+	hdr.seq = 1;
+	hdr.ts  = 160;
+	err = jbuf_put(jb, &hdr, mem);
+	TEST_ERR(err);
+
+	/* 20 ms later, marker is ignored */
+	now += 20;
+	hdr.seq = 2;
+	hdr.ts  = 320;
+	hdr.m   = true;
+	err = jbuf_put(jb, &hdr, mem);
+	TEST_ERR(err);
+	ASSERT_EQ(2, jbuf_packets(jb));
+
+	/* put timeout on the virtual clock, marker flushes the buffer */
+	now += 1000;
+	hdr.seq = 3;
+	hdr.ts  = 8320;
+	err = jbuf_put(jb, &hdr, mem);
+	TEST_ERR(err);
+	ASSERT_EQ(1, jbuf_packets(jb));
+
+ out:
+	mem_deref(jb);
+	mem_deref(mem);
+
+	return err;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file test/lattrace.c  Latency tracing testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+int test_lattrace(void)
+{
+	struct lattrace *lt = NULL;
+	uint64_t t, v;
+	int err;
+
+	err = lattrace_alloc(&lt, "audio", true);
+	TEST_ERR(err);
+
+	/* No samples */
+	ASSERT_EQ(0, lattrace_percentile(lt, "encode", 50));
+
+	/* 1..1000 us, the histogram has a relative error of ~6% */
+	for (unsigned i = 1; i <= 1000; i++)
+		lattrace_add(lt, "encode", i);
+
+	v = lattrace_percentile(lt, "encode", 50);
+	ASSERT_TRUE(v >= 500 && v <= 530);
+
+	v = lattrace_percentile(lt, "encode", 99);
+	ASSERT_TRUE(v >= 990 && v <= 1000);
+
+	ASSERT_EQ(1000, lattrace_percentile(lt, "encode", 100));
+
+	/* Large values are clamped to the maximum */
+	lattrace_add(lt, "aubuf", 5000000000ULL);
+	v = lattrace_percentile(lt, "aubuf", 50);
+	ASSERT_TRUE(v >= 2000000000ULL);
+
+	/* The stage name is copied */
+	{
+		char name[] = "filter";
+
+		lattrace_add(lt, name, 100);
+		name[0] = 'x';
+		ASSERT_EQ(100, lattrace_percentile(lt, "filter", 50));
+		ASSERT_EQ(0, lattrace_percentile(lt, "xilter", 50));
+	}
+
+	/* Stamps advance the frame timestamp */
+	t = lattrace_now(lt);
+	ASSERT_TRUE(t != 0);
+	lattrace_stamp(lt, "send", &t);
+	ASSERT_TRUE(t != 0);
+	ASSERT_TRUE(lattrace_percentile(lt, "send", 50) < 1000000);
+
+	/* Arrival times */
+	ASSERT_EQ(0, lattrace_marked(lt, 42));
+	lattrace_mark(lt, 42);
+	ASSERT_TRUE(lattrace_marked(lt, 42) != 0);
+	ASSERT_EQ(0, lattrace_marked(lt, 42 + 512));
+
+	lattrace_reset(lt);
+	ASSERT_EQ(0, lattrace_percentile(lt, "encode", 50));
+
+	/* Disabled tracing */
+	ASSERT_EQ(0, lattrace_now(NULL));
+	lattrace_add(NULL, "encode", 1);
+
+ out:
+	mem_deref(lt);
+	return err;
+}
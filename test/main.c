@@ -24,6 +24,16 @@ struct test {
 static const struct test tests[] = {
 	TEST(test_account),
 	TEST(test_account_uri_complete),
+	TEST(test_auarena),
+	TEST(test_auarena_filters),
+	TEST(test_aubridge_bus),
+	TEST(test_aufilt_fmt),
+	TEST(test_aufmt_convert),
+	TEST(test_aupoly),
+	TEST(test_aupoly_stream),
+	TEST(test_aurecv_receive),
+	TEST(test_aurecv_threads),
+	TEST(test_bwe),
 	TEST(test_call_answer),
 	TEST(test_call_answer_hangup_a),
 	TEST(test_call_answer_hangup_b),
@@ -45,6 +55,7 @@ static const struct test tests[] = {
 	TEST(test_call_transfer_fail),
 	TEST(test_call_attended_transfer),
 	TEST(test_call_video),
+	TEST(test_call_video_pool),
 	TEST(test_call_change_videodir),
 	TEST(test_call_webrtc),
 	TEST(test_call_bundle),
@@ -53,6 +64,7 @@ static const struct test tests[] = {
 	TEST(test_call_100rel_video),
 	TEST(test_call_hold_resume),
 	TEST(test_call_srtp_tx_rekey),
+	TEST(test_call_txshare),
 #ifdef USE_TLS
 	TEST(test_call_sni),
 #endif
@@ -60,13 +72,23 @@ static const struct test tests[] = {
 	TEST(test_cmd_long),
 	TEST(test_contact),
 	TEST(test_event),
+	TEST(test_fec),
 	TEST(test_jbuf),
 	TEST(test_jbuf_adaptive),
 	TEST(test_jbuf_adaptive_video),
+	TEST(test_jbuf_clock),
+	TEST(test_lattrace),
 	TEST(test_message),
+	TEST(test_module_lazy),
 	TEST(test_network),
+	TEST(test_openmetrics),
+	TEST(test_openmetrics_scale),
 	TEST(test_play),
+	TEST(test_playout),
+	TEST(test_relay),
+	TEST(test_simulcast),
 	TEST(test_stunuri),
+	TEST(test_txshare),
 	TEST(test_ua_alloc),
 	TEST(test_ua_options),
 	TEST(test_ua_refer),
@@ -75,7 +97,9 @@ static const struct test tests[] = {
 	TEST(test_ua_register_auth_dns),
 	TEST(test_ua_register_dns),
 	TEST(test_uag_find_param),
+	TEST(test_viddiff),
 	TEST(test_video),
+	TEST(test_vidjbuf),
 	TEST(test_clean_number),
 	TEST(test_clean_number_only_numeric),
 };
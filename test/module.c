@@ -0,0 +1,44 @@
+/**
+ * @file test/module.c  Module loading testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+int test_module_lazy(void)
+{
+	static const char buf[] =
+		"module_path\t\t.\n"
+		"module_lazy\t\tausine" MOD_EXT "\n";
+	struct conf *conf = NULL;
+	const struct ausrc *as;
+	int err;
+
+	err = conf_alloc_buf(&conf, (const uint8_t *)buf, str_len(buf));
+	TEST_ERR(err);
+
+	err = module_init(conf);
+	TEST_ERR(err);
+
+	/* deferred until the first lookup */
+	ASSERT_TRUE(NULL == mod_find("ausine" MOD_EXT));
+
+	as = ausrc_find(baresip_ausrcl(), "ausine");
+	ASSERT_TRUE(as != NULL);
+	ASSERT_TRUE(NULL != mod_find("ausine" MOD_EXT));
+
+	/* loaded only once */
+	ASSERT_EQ(ENOENT, module_lazy_load("ausine"));
+
+ out:
+	module_unload("ausine");
+	module_lazy_flush();
+	mem_deref(conf);
+
+	return err;
+}
@@ -0,0 +1,263 @@
+/**
+ * @file test/openmetrics.c  OpenMetrics encoder testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+enum {
+	STREAMS = 2000,
+};
+
+
+/*
+ * Check the OpenMetrics shape: every family starts with a TYPE and a
+ * HELP line before its samples, counter samples and only those have the
+ * "_total" suffix, and the exposition ends with "# EOF".
+ */
+static int check_shape(const char *str, size_t *samplec)
+{
+	char name[64] = "";
+	bool counter = false;
+	bool help = false;
+	bool eof = false;
+	size_t n = 0;
+	int err = 0;
+
+	while (*str) {
+		const char *end = strchr(str, '\n');
+		struct pl line, fname, ftype, sname;
+
+		ASSERT_TRUE(end != NULL);
+		ASSERT_TRUE(!eof);
+
+		line.p = str;
+		line.l = end - str;
+
+		if (0 == re_regex(line.p, line.l, "# TYPE [^ ]+ [a-z]+",
+				  &fname, &ftype)) {
+			ASSERT_TRUE(!help);
+			ASSERT_TRUE(fname.l < sizeof(name));
+
+			pl_strcpy(&fname, name, sizeof(name));
+			counter = 0 == pl_strcmp(&ftype, "counter");
+			help = true;
+		}
+		else if (0 == re_regex(line.p, line.l, "# HELP [^ ]+ ",
+				       &fname)) {
+			ASSERT_TRUE(help);
+			ASSERT_EQ(0, pl_strcmp(&fname, name));
+			help = false;
+		}
+		else if (0 == pl_strcmp(&line, "# EOF")) {
+			eof = true;
+		}
+		else {
+			ASSERT_TRUE(!help);
+			ASSERT_TRUE(str_isset(name));
+			ASSERT_EQ(0, re_regex(line.p, line.l,
+					      "[^ {]+[^ ]* [0-9.]+", &sname,
+					      NULL, NULL));
+
+			ASSERT_EQ(0, pl_strncmp(&sname, name, str_len(name)));
+			sname.p += str_len(name);
+			sname.l -= str_len(name);
+
+			if (counter) {
+				ASSERT_EQ(0, pl_strcmp(&sname, "_total"));
+			}
+			else {
+				ASSERT_TRUE(0 == sname.l);
+			}
+
+			++n;
+		}
+
+		str = end + 1;
+	}
+
+	ASSERT_TRUE(eof);
+
+	*samplec = n;
+
+ out:
+	return err;
+}
+
+
+static int print_str(struct mbuf *mb, char **strp,
+		     const struct openmetrics_sample *samplev,
+		     size_t samplec, uint32_t callc)
+{
+	int err;
+
+	mbuf_rewind(mb);
+
+	err = openmetrics_print(mb, samplev, samplec, callc, callc);
+	if (err)
+		return err;
+
+	mbuf_set_pos(mb, 0);
+
+	return mbuf_strdup(mb, strp, mbuf_get_left(mb));
+}
+
+
+int test_openmetrics(void)
+{
+	static const char video[] = "{call=\"6f2a@host\",media=\"video\"}";
+	struct openmetrics_sample samplev[2];
+	struct mbuf *mb;
+	char *str = NULL;
+	const char *p;
+	size_t samplec;
+	int n, err;
+
+	memset(samplev, 0, sizeof(samplev));
+
+	/* all sources, a Call-ID that must be escaped */
+	samplev[0].callid = "a\"b\\c@host";
+	samplev[0].media  = "audio";
+	samplev[0].src    = OM_SRC_STREAM | OM_SRC_RTCP | OM_SRC_JBUF |
+		OM_SRC_AUDIO;
+	samplev[0].v[OM_RX_PACKETS]       = 1234;
+	samplev[0].v[OM_RTCP_RTT]         = 25000;
+	samplev[0].v[OM_AUDIO_RX_LATENCY] = 60;
+
+	/* only the stream counters */
+	samplev[1].callid = "6f2a@host";
+	samplev[1].media  = "video";
+	samplev[1].src    = OM_SRC_STREAM;
+	samplev[1].v[OM_TX_BITRATE] = 512000;
+
+	mb = mbuf_alloc(4096);
+	if (!mb)
+		return ENOMEM;
+
+	err = print_str(mb, &str, samplev, RE_ARRAY_SIZE(samplev), 1);
+	TEST_ERR(err);
+
+	err = check_shape(str, &samplec);
+	TEST_ERR(err);
+
+	/* 3 call gauges, all families of the first and 8 of the second */
+	ASSERT_EQ(3 + OM_MAX + 8, (int)samplec);
+
+	ASSERT_TRUE(0 == strncmp(str, "# TYPE baresip_calls gauge\n", 27));
+	ASSERT_TRUE(NULL != strstr(str, "\nbaresip_streams 2\n"));
+
+	ASSERT_TRUE(NULL != strstr(str,
+		"\nbaresip_rtp_rx_packets_total"
+		"{call=\"a\\\"b\\\\c@host\",media=\"audio\"} 1234\n"));
+	ASSERT_TRUE(NULL != strstr(str,
+		"\nbaresip_rtp_tx_bitrate"
+		"{call=\"6f2a@host\",media=\"video\"} 512000\n"));
+
+	/* scaled to the base unit */
+	ASSERT_TRUE(NULL != strstr(str,
+		"\nbaresip_rtcp_rtt_seconds"
+		"{call=\"a\\\"b\\\\c@host\",media=\"audio\"} 0.025000\n"));
+	ASSERT_TRUE(NULL != strstr(str,
+		"\nbaresip_audio_rx_latency_seconds"
+		"{call=\"a\\\"b\\\\c@host\",media=\"audio\"} 0.060000\n"));
+
+	/* no samples of missing sources */
+	n = 0;
+	for (p = strstr(str, video); p; p = strstr(p + 1, video))
+		++n;
+	ASSERT_EQ(8, n);
+
+	/* nothing after the end marker */
+	ASSERT_EQ(0, strcmp(str + str_len(str) - 6, "# EOF\n"));
+
+ out:
+	mem_deref(str);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/*
+ * Encoding of 2000 streams. The output buffer is kept between scrapes,
+ * so that the second one does not allocate.
+ */
+int test_openmetrics_scale(void)
+{
+	struct openmetrics_sample *samplev;
+	struct mbuf *mb = NULL;
+	char (*callid)[24];
+	char *str = NULL;
+	size_t samplec, size;
+	uint64_t t0, usec;
+	int err = 0;
+
+	samplev = mem_zalloc(STREAMS * sizeof(*samplev), NULL);
+	callid  = mem_zalloc(STREAMS * sizeof(*callid), NULL);
+	if (!samplev || !callid) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (size_t i = 0; i < STREAMS; i++) {
+		struct openmetrics_sample *s = &samplev[i];
+
+		re_snprintf(callid[i], sizeof(callid[i]), "%08x@host",
+			    (unsigned)i);
+
+		s->callid = callid[i];
+		s->media  = i % 2 ? "video" : "audio";
+		s->src    = OM_SRC_STREAM | OM_SRC_RTCP | OM_SRC_JBUF;
+		if (!(i % 2))
+			s->src |= OM_SRC_AUDIO;
+
+		for (int id = 0; id < OM_MAX; id++)
+			s->v[id] = i * 1000 + id;
+	}
+
+	mb = mbuf_alloc(8192);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = print_str(mb, &str, samplev, STREAMS, STREAMS / 2);
+	TEST_ERR(err);
+
+	err = check_shape(str, &samplec);
+	TEST_ERR(err);
+
+	/* the audio families only for every second stream */
+	ASSERT_EQ(3 + (OM_MAX - 5) * STREAMS + 5 * STREAMS / 2,
+		  (int)samplec);
+
+	/* second scrape into the grown buffer */
+	size = mb->size;
+
+	mbuf_rewind(mb);
+
+	t0 = tmr_jiffies_usec();
+	err = openmetrics_print(mb, samplev, STREAMS, STREAMS / 2,
+				STREAMS / 2);
+	usec = tmr_jiffies_usec() - t0;
+	TEST_ERR(err);
+
+	ASSERT_TRUE(mb->size == size);
+	ASSERT_TRUE(mb->end == str_len(str));
+
+	info("openmetrics: %u streams, %zu bytes in %llu usec\n",
+	     STREAMS, mb->end, usec);
+
+ out:
+	mem_deref(str);
+	mem_deref(mb);
+	mem_deref(callid);
+	mem_deref(samplev);
+
+	return err;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file test/playout.c  Audio playout testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+enum {
+	SRATE = 8000,
+	PTIME = 20,
+	SAMPC = SRATE * PTIME / 1000,
+};
+
+
+/* 200 Hz triangle wave */
+static void wave_fill(int16_t *sampv, size_t sampc, size_t offset)
+{
+	const int period = SRATE / 200;
+
+	for (size_t i = 0; i < sampc; i++) {
+		int p = (int)((offset + i) % period);
+		int v = p < period / 2 ? p : period - p;
+
+		sampv[i] = (int16_t)((v - period / 4) * 400);
+	}
+}
+
+
+static int process_frames(struct playout *po, int16_t *sampv,
+			  unsigned n, uint32_t jitter, uint32_t cur,
+			  size_t *sampcp)
+{
+	struct auframe af;
+
+	for (unsigned i = 0; i < n; i++) {
+		uint64_t ts = (uint64_t)i * PTIME * 1000;
+		uint64_t arrival = ts + 50000 + ((i % 2) ? jitter * 1000 : 0);
+
+		wave_fill(sampv, SAMPC, i * SAMPC);
+		auframe_init(&af, AUFMT_S16LE, sampv, SAMPC, SRATE, 1);
+		af.timestamp = ts;
+
+		playout_process(po, &af, arrival, cur);
+
+		*sampcp = af.sampc;
+	}
+
+	return 0;
+}
+
+
+int test_playout(void)
+{
+	struct range buffer = {20, 160};
+	struct playout *po = NULL;
+	const struct playout_stat *stat;
+	int16_t sampv[SAMPC];
+	size_t sampc = 0;
+	int err;
+
+	/* Buffer level above target -- accelerate */
+	err = playout_alloc(&po, &buffer, PTIME);
+	TEST_ERR(err);
+
+	err = process_frames(po, sampv, 100, 0, 100, &sampc);
+	TEST_ERR(err);
+
+	stat = playout_stat(po);
+	ASSERT_EQ(20, stat->target);
+	ASSERT_TRUE(stat->n_accel > 0);
+	ASSERT_EQ(0, stat->n_decel);
+	ASSERT_TRUE(sampc < SAMPC);
+	ASSERT_TRUE(stat->samp_removed >= SAMPC - sampc);
+
+	po = mem_deref(po);
+
+	/* Buffer level below target -- decelerate */
+	err = playout_alloc(&po, &buffer, PTIME);
+	TEST_ERR(err);
+
+	err = process_frames(po, sampv, 100, 0, 0, &sampc);
+	TEST_ERR(err);
+
+	stat = playout_stat(po);
+	ASSERT_EQ(0, stat->n_accel);
+	ASSERT_TRUE(stat->n_decel > 0);
+	ASSERT_TRUE(sampc > SAMPC);
+	ASSERT_TRUE(stat->samp_inserted >= sampc - SAMPC);
+
+	po = mem_deref(po);
+
+	/* Target follows the jitter percentile, no stretch within range */
+	err = playout_alloc(&po, &buffer, PTIME);
+	TEST_ERR(err);
+
+	err = process_frames(po, sampv, 100, 40, 60, &sampc);
+	TEST_ERR(err);
+
+	stat = playout_stat(po);
+	ASSERT_EQ(40, stat->jitter);
+	ASSERT_EQ(60, stat->target);
+	ASSERT_EQ(0, stat->n_accel);
+	ASSERT_EQ(0, stat->n_decel);
+	ASSERT_EQ(SAMPC, sampc);
+
+ out:
+	mem_deref(po);
+	return err;
+}
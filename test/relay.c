@@ -0,0 +1,278 @@
+/**
+ * @file test/relay.c  RTP relay testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+enum {
+	SSRC_IN = 0x1111,
+	NPKT    = 4,
+};
+
+
+struct peer {
+	struct list streaml;
+	struct sdp_session *sdp;
+	struct stream *strm;
+
+	struct rtp_header hdrv[NPKT];
+	unsigned n_rtp;
+	unsigned n_rtp_exp;
+
+	uint16_t nack_pid;
+	unsigned n_nack;
+};
+
+
+static void rtp_handler(const struct rtp_header *hdr,
+			struct rtpext *extv, size_t extc,
+			struct mbuf *mb, unsigned lostc, bool *ignore,
+			void *arg)
+{
+	struct peer *p = arg;
+	(void)extv;
+	(void)extc;
+	(void)mb;
+	(void)lostc;
+	(void)ignore;
+
+	if (p->n_rtp < NPKT)
+		p->hdrv[p->n_rtp] = *hdr;
+
+	if (++p->n_rtp == p->n_rtp_exp)
+		re_cancel();
+}
+
+
+static void rtcp_handler(struct stream *strm, struct rtcp_msg *msg,
+			 void *arg)
+{
+	struct peer *p = arg;
+	(void)strm;
+
+	if (msg->hdr.pt != RTCP_RTPFB || msg->hdr.count != RTCP_RTPFB_GNACK)
+		return;
+
+	if (!msg->r.fb.n || !msg->r.fb.fci.gnackv)
+		return;
+
+	p->nack_pid = msg->r.fb.fci.gnackv[0].pid;
+	++p->n_nack;
+
+	re_cancel();
+}
+
+
+static int pt_handler(uint8_t pt, struct mbuf *mb, void *arg)
+{
+	(void)pt;
+	(void)mb;
+	(void)arg;
+
+	return 0;
+}
+
+
+static void peer_reset(struct peer *p)
+{
+	mem_deref(p->strm);
+	mem_deref(p->sdp);
+}
+
+
+static int peer_init(struct peer *p, const char *name)
+{
+	struct config_avt cfg = conf_config()->avt;
+	struct stream_param prm;
+	struct sa laddr;
+	int err;
+
+	memset(p, 0, sizeof(*p));
+
+	memset(&prm, 0, sizeof(prm));
+	prm.use_rtp = true;
+	prm.af      = AF_INET;
+	prm.cname   = name;
+	prm.peer    = name;
+
+	/* packets go straight to the RTP handler */
+	cfg.rxmode       = RECEIVE_MODE_MAIN;
+	cfg.audio.jbtype = JBUF_OFF;
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	if (err)
+		return err;
+
+	err = sdp_session_alloc(&p->sdp, &laddr);
+	if (err)
+		return err;
+
+	err = stream_alloc(&p->strm, &p->streaml, &prm, &cfg, p->sdp,
+			   MEDIA_AUDIO, NULL, NULL, NULL, NULL, true,
+			   rtp_handler, rtcp_handler, pt_handler, p);
+	if (err)
+		return err;
+
+	return sdp_format_add(NULL, stream_sdpmedia(p->strm), false,
+			      "0", "PCMU", 8000, 1, NULL, NULL, NULL, false,
+			      NULL);
+}
+
+
+static int peer_connect(struct peer *offerer, struct peer *answerer)
+{
+	struct mbuf *mb = NULL;
+	int err;
+
+	err = sdp_encode(&mb, offerer->sdp, true);
+	if (err)
+		goto out;
+
+	err = sdp_decode(answerer->sdp, mb, true);
+	if (err)
+		goto out;
+
+	mb = mem_deref(mb);
+
+	err = sdp_encode(&mb, answerer->sdp, false);
+	if (err)
+		goto out;
+
+	err = sdp_decode(offerer->sdp, mb, false);
+	if (err)
+		goto out;
+
+	err  = stream_update(offerer->strm);
+	err |= stream_update(answerer->strm);
+	err |= stream_start_rtcp(offerer->strm);
+	err |= stream_start_rtcp(answerer->strm);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int send_packet(struct peer *p, uint32_t ssrc, uint16_t seq,
+		       uint32_t ts)
+{
+	struct mbuf *mb = mbuf_alloc(STREAM_PRESZ + 160);
+	int err;
+
+	if (!mb)
+		return ENOMEM;
+
+	mb->pos = mb->end = STREAM_PRESZ;
+	err  = mbuf_fill(mb, 0xff, 160);
+	mb->pos = STREAM_PRESZ;
+	err |= stream_send_ssrc(p->strm, ssrc, seq, false, false, 0, ts, mb);
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/*
+ * Peer A sends to stream X, which is relayed to stream Y and from there
+ * to peer B:
+ *
+ *   A ---> X ==relay==> Y ---> B
+ */
+int test_relay(void)
+{
+	struct peer a, x, y, b;
+	uint32_t ssrc_out = 0;
+	uint16_t seq0;
+	uint32_t ts0;
+	int err;
+
+	err  = peer_init(&a, "a");
+	err |= peer_init(&x, "x");
+	err |= peer_init(&y, "y");
+	err |= peer_init(&b, "b");
+	TEST_ERR(err);
+
+	err  = peer_connect(&a, &x);
+	err |= peer_connect(&y, &b);
+	TEST_ERR(err);
+
+	err = stream_relay_start(x.strm, y.strm);
+	TEST_ERR(err);
+	ASSERT_TRUE(stream_is_relayed(y.strm));
+	ASSERT_EQ(EALREADY, stream_relay_start(x.strm, y.strm));
+
+	/* the destination does not send media of its own while relayed */
+	err = send_packet(&y, 0x2222, 1, 0);
+	TEST_ERR(err);
+
+	/* seq 102 is lost upstream */
+	b.n_rtp_exp = 3;
+	err  = send_packet(&a, SSRC_IN, 100, 1000);
+	err |= send_packet(&a, SSRC_IN, 101, 1160);
+	err |= send_packet(&a, SSRC_IN, 103, 1480);
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	ASSERT_EQ(3, b.n_rtp);
+
+	err = stream_ssrc_rx(b.strm, &ssrc_out);
+	TEST_ERR(err);
+
+	/* the relay sends with an SSRC of its own */
+	ASSERT_TRUE(ssrc_out != SSRC_IN);
+	ASSERT_TRUE(ssrc_out != rtp_sess_ssrc(stream_rtp_sock(y.strm)));
+
+	seq0 = b.hdrv[0].seq;
+	ts0  = b.hdrv[0].ts;
+
+	/* a fixed offset keeps the loss visible */
+	for (unsigned i = 0; i < 3; i++) {
+		ASSERT_EQ(ssrc_out, b.hdrv[i].ssrc);
+		ASSERT_EQ(0, b.hdrv[i].pt);
+	}
+
+	ASSERT_EQ((uint16_t)(seq0 + 1), b.hdrv[1].seq);
+	ASSERT_EQ((uint16_t)(seq0 + 3), b.hdrv[2].seq);
+	ASSERT_EQ(ts0 + 160, b.hdrv[1].ts);
+	ASSERT_EQ(ts0 + 480, b.hdrv[2].ts);
+
+	/* the late packet fills the gap */
+	b.n_rtp_exp = 4;
+	err = send_packet(&a, SSRC_IN, 102, 1320);
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	ASSERT_EQ(4, b.n_rtp);
+	ASSERT_EQ((uint16_t)(seq0 + 2), b.hdrv[3].seq);
+	ASSERT_EQ(ts0 + 320, b.hdrv[3].ts);
+
+	/* a NACK from B reaches A with the incoming sequence number */
+	err = rtcp_send_nack(stream_rtp_sock(b.strm), seq0 + 3, 0);
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	ASSERT_EQ(1, a.n_nack);
+	ASSERT_EQ(103, a.nack_pid);
+
+	stream_relay_stop(x.strm);
+	ASSERT_TRUE(!stream_is_relayed(y.strm));
+
+ out:
+	peer_reset(&b);
+	peer_reset(&y);
+	peer_reset(&x);
+	peer_reset(&a);
+
+	return err;
+}
@@ -0,0 +1,418 @@
+/**
+ * @file test/simulcast.c  Simulcast testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+enum {
+	NPKT = 10,
+};
+
+
+static const char *uri_rid = "urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id";
+static const char *uri_twcc = "http://www.ietf.org/id/"
+	"draft-holmer-rmcat-transport-wide-cc-extensions-01";
+static const char *uri_mid = "urn:ietf:params:rtp-hdrext:sdes:mid";
+
+
+/* A peer like an SFU, which receives two layers */
+struct sfu {
+	struct list streaml;
+	struct sdp_session *sdp;
+	struct stream *strm;
+	uint8_t extid_rid;
+
+	struct {
+		uint32_t ssrc;
+		char rid[16];
+		uint16_t seq;
+		unsigned n_rtp;
+	} layerv[3];
+	unsigned layerc;
+
+	uint32_t nack_ssrc;
+	uint16_t nack_seq;
+	unsigned n_resent;
+};
+
+
+static bool layers_received(const struct sfu *p)
+{
+	if (p->layerc < 2)
+		return false;
+
+	for (unsigned i = 0; i < p->layerc; i++) {
+		if (p->layerv[i].n_rtp < NPKT)
+			return false;
+	}
+
+	return true;
+}
+
+
+static void rtp_handler(const struct rtp_header *hdr,
+			struct rtpext *extv, size_t extc,
+			struct mbuf *mb, unsigned lostc, bool *ignore,
+			void *arg)
+{
+	struct sfu *p = arg;
+	unsigned i;
+	(void)mb;
+	(void)lostc;
+	(void)ignore;
+
+	if (p->nack_ssrc) {
+		if (hdr->ssrc == p->nack_ssrc && hdr->seq == p->nack_seq) {
+			++p->n_resent;
+			re_cancel();
+		}
+		return;
+	}
+
+	for (i = 0; i < p->layerc; i++) {
+		if (p->layerv[i].ssrc == hdr->ssrc)
+			break;
+	}
+
+	if (i == p->layerc) {
+		if (p->layerc == RE_ARRAY_SIZE(p->layerv))
+			return;
+
+		p->layerv[p->layerc++].ssrc = hdr->ssrc;
+	}
+
+	for (size_t j = 0; j < extc; j++) {
+		if (extv[j].id != p->extid_rid)
+			continue;
+
+		(void)re_snprintf(p->layerv[i].rid, sizeof(p->layerv[i].rid),
+				  "%b", (const char *)extv[j].data,
+				  (size_t)extv[j].len);
+	}
+
+	p->layerv[i].seq = hdr->seq;
+	++p->layerv[i].n_rtp;
+
+	if (layers_received(p))
+		re_cancel();
+}
+
+
+static void rtcp_handler(struct stream *strm, struct rtcp_msg *msg,
+			 void *arg)
+{
+	(void)strm;
+	(void)msg;
+	(void)arg;
+}
+
+
+static int pt_handler(uint8_t pt, struct mbuf *mb, void *arg)
+{
+	(void)pt;
+	(void)mb;
+	(void)arg;
+
+	return 0;
+}
+
+
+static bool attr_match(const char *name, const char *value, void *arg)
+{
+	(void)name;
+
+	return !str_cmp(value, arg);
+}
+
+
+static bool extmap_find(const char *name, const char *value, void *arg)
+{
+	struct sdp_extmap *extmap = arg;
+	struct sdp_extmap e;
+	(void)name;
+
+	if (sdp_extmap_decode(&e, value))
+		return false;
+
+	if (pl_cmp(&e.name, &extmap->name))
+		return false;
+
+	extmap->id = e.id;
+
+	return true;
+}
+
+
+/* Extmap ID of an URI, 0 if not found */
+static uint8_t extmap_id(const struct sdp_media *m, bool local,
+			 const char *uri)
+{
+	struct sdp_extmap extmap;
+
+	memset(&extmap, 0, sizeof(extmap));
+	pl_set_str(&extmap.name, uri);
+
+	if (local)
+		(void)sdp_media_lattr_apply(m, "extmap", extmap_find, &extmap);
+	else
+		(void)sdp_media_rattr_apply(m, "extmap", extmap_find, &extmap);
+
+	return extmap.id;
+}
+
+
+static bool extmap_copy(const char *name, const char *value, void *arg)
+{
+	struct sdp_media *m = arg;
+
+	return 0 != sdp_media_set_lattr(m, false, name, "%s", value);
+}
+
+
+static int sfu_init(struct sfu *p, const struct config *cfg)
+{
+	struct stream_param prm;
+	struct sa laddr;
+	int err;
+
+	memset(p, 0, sizeof(*p));
+
+	memset(&prm, 0, sizeof(prm));
+	prm.use_rtp = true;
+	prm.af      = AF_INET;
+	prm.cname   = "sfu";
+	prm.peer    = "sfu";
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	if (err)
+		return err;
+
+	err = sdp_session_alloc(&p->sdp, &laddr);
+	if (err)
+		return err;
+
+	err = stream_alloc(&p->strm, &p->streaml, &prm, &cfg->avt, p->sdp,
+			   MEDIA_VIDEO, NULL, NULL, NULL, NULL, false,
+			   rtp_handler, rtcp_handler, pt_handler, p);
+	if (err)
+		return err;
+
+	stream_set_ldir(p->strm, SDP_RECVONLY);
+
+	return sdp_format_add(NULL, stream_sdpmedia(p->strm), false,
+			      NULL, "H266", 90000, 1, NULL, NULL, NULL, false,
+			      NULL);
+}
+
+
+/* The answer of the SFU receives two layers with its own IDs */
+static int sfu_answer(struct sfu *p, struct sdp_session *sdp_offerer)
+{
+	struct sdp_media *m = stream_sdpmedia(p->strm);
+	struct mbuf *mb = NULL;
+	int err;
+
+	err = sdp_encode(&mb, sdp_offerer, true);
+	if (err)
+		goto out;
+
+	err = sdp_decode(p->sdp, mb, true);
+	if (err)
+		goto out;
+
+	p->extid_rid = extmap_id(m, false, uri_rid);
+
+	if (sdp_media_rattr_apply(m, "extmap", extmap_copy, m)) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = sdp_media_set_lattr(m, false, "rid", "hi recv");
+	err |= sdp_media_set_lattr(m, false, "rid", "lo recv");
+	err |= sdp_media_set_lattr(m, false, "simulcast", "recv hi;~mid;lo");
+	if (err)
+		goto out;
+
+	mb = mem_deref(mb);
+
+	err = sdp_encode(&mb, p->sdp, false);
+	if (err)
+		goto out;
+
+	err = sdp_decode(sdp_offerer, mb, false);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int gnack_encode(struct mbuf *mb, void *arg)
+{
+	const uint16_t *pid = arg;
+	int err;
+
+	err  = mbuf_write_u16(mb, htons(*pid));
+	err |= mbuf_write_u16(mb, 0);
+
+	return err;
+}
+
+
+static int sfu_send_nack(struct sfu *p, uint32_t ssrc_media, uint16_t pid)
+{
+	struct rtp_sock *rtp = stream_rtp_sock(p->strm);
+	struct mbuf *mb = mbuf_alloc(64);
+	int err;
+
+	if (!mb)
+		return ENOMEM;
+
+	err = rtcp_encode(mb, RTCP_RTPFB, RTCP_RTPFB_GNACK,
+			  rtp_sess_ssrc(rtp), ssrc_media, gnack_encode, &pid);
+	if (!err) {
+		mb->pos = 0;
+		err = rtcp_send(rtp, mb);
+	}
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+/*
+ * The offer with three layers is answered by an SFU, which receives two
+ * of them with its own RTP stream IDs. The RID extmap is kept next to the
+ * TWCC and BUNDLE extmaps.
+ */
+int test_simulcast(void)
+{
+	struct config cfg = *conf_config();
+	struct list streaml = LIST_INIT;
+	struct sdp_session *sdp = NULL;
+	struct stream_param prm;
+	struct video *v = NULL;
+	struct sdp_media *m;
+	struct sfu p;
+	uint8_t id_rid, id_twcc, id_mid;
+	struct sa laddr;
+	unsigned hi, lo;
+	int err;
+
+	memset(&p, 0, sizeof(p));
+
+	mock_vidcodec_register();
+
+	err = module_load(".", "fakevideo");
+	TEST_ERR(err);
+
+	cfg.avt.rxmode       = RECEIVE_MODE_MAIN;
+	cfg.avt.video.jbtype = JBUF_OFF;
+	cfg.video.bwe        = true;
+	cfg.video.simulcast  = 3;
+	cfg.video.fps        = 100;
+	str_ncpy(cfg.video.src_mod, "fakevideo", sizeof(cfg.video.src_mod));
+
+	memset(&prm, 0, sizeof(prm));
+	prm.use_rtp = true;
+	prm.af      = AF_INET;
+	prm.cname   = "a";
+	prm.peer    = "sfu";
+
+	err = sa_set_str(&laddr, "127.0.0.1", 0);
+	TEST_ERR(err);
+
+	err = sdp_session_alloc(&sdp, &laddr);
+	TEST_ERR(err);
+
+	err = video_alloc(&v, &streaml, &prm, &cfg, sdp, NULL, NULL, NULL,
+			  NULL, NULL, baresip_vidcodecl(), NULL, true,
+			  NULL, NULL);
+	TEST_ERR(err);
+
+	err = stream_bundle_init(video_strm(v), true);
+	TEST_ERR(err);
+
+	err = sfu_init(&p, &cfg);
+	TEST_ERR(err);
+
+	err = sfu_answer(&p, sdp);
+	TEST_ERR(err);
+
+	/* the offer has three layers and distinct extmap IDs */
+	m = stream_sdpmedia(p.strm);
+	ASSERT_STREQ("send f;h;q", sdp_media_rattr(m, "simulcast"));
+	ASSERT_TRUE(NULL != sdp_media_rattr_apply(m, "rid", attr_match,
+						  "q send"));
+
+	id_rid  = extmap_id(m, false, uri_rid);
+	id_twcc = extmap_id(m, false, uri_twcc);
+	id_mid  = extmap_id(m, false, uri_mid);
+	ASSERT_TRUE(id_rid && id_twcc && id_mid);
+	ASSERT_TRUE(id_rid != id_twcc && id_rid != id_mid);
+
+	err  = stream_update(video_strm(v));
+	err |= stream_update(p.strm);
+	TEST_ERR(err);
+
+	video_sdp_attr_decode(v);
+
+	/* the extmaps survive the answer, the layers get the peer's IDs */
+	m = stream_sdpmedia(video_strm(v));
+	ASSERT_EQ(id_rid,  extmap_id(m, true, uri_rid));
+	ASSERT_EQ(id_twcc, extmap_id(m, true, uri_twcc));
+	ASSERT_EQ(id_mid,  extmap_id(m, true, uri_mid));
+	ASSERT_STREQ("send hi;lo", sdp_media_lattr(m, "simulcast"));
+	ASSERT_TRUE(NULL != sdp_media_lattr_apply(m, "rid", attr_match,
+						  "lo send"));
+	ASSERT_TRUE(NULL == sdp_media_lattr_apply(m, "rid", attr_match,
+						  "q send"));
+
+	err  = stream_start_rtcp(video_strm(v));
+	err |= stream_start_rtcp(p.strm);
+	err |= video_update(v, "sfu");
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	/* two layers, each with its own SSRC and RTP stream ID */
+	ASSERT_EQ(2, p.layerc);
+
+	hi = str_cmp(p.layerv[0].rid, "hi") ? 1 : 0;
+	lo = 1 - hi;
+	ASSERT_STREQ("hi", p.layerv[hi].rid);
+	ASSERT_STREQ("lo", p.layerv[lo].rid);
+	ASSERT_EQ(rtp_sess_ssrc(stream_rtp_sock(video_strm(v))),
+		  p.layerv[hi].ssrc);
+
+	/* a NACK for the second layer is matched by its SSRC */
+	p.nack_seq  = p.layerv[lo].seq;
+	p.nack_ssrc = p.layerv[lo].ssrc;
+
+	err = sfu_send_nack(&p, p.nack_ssrc, p.nack_seq);
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+	ASSERT_EQ(1, p.n_resent);
+
+ out:
+	mem_deref(v);
+	mem_deref(sdp);
+	mem_deref(p.strm);
+	mem_deref(p.sdp);
+
+	module_unload("fakevideo");
+	mock_vidcodec_unregister();
+
+	return err;
+}
@@ -163,6 +163,18 @@ int mock_auplay_register(struct auplay **auplayp, struct list *auplayl,
 			 mock_sample_h *sampleh, void *arg);
 
 
+/*
+ * Mock Audio-source
+ */
+
+struct ausrc;
+
+typedef void (mock_ausrc_h)(const char *dev, void *arg);
+
+int mock_ausrc_register(struct ausrc **ausrcp, struct list *ausrcl,
+			mock_ausrc_h *alloch, void *arg);
+
+
 /*
  * Mock Media NAT-traversal
  */
@@ -197,7 +209,17 @@ int mock_vidisp_register(struct vidisp **vidispp,
 
 int test_account(void);
 int test_account_uri_complete(void);
+int test_auarena(void);
+int test_auarena_filters(void);
+int test_aubridge_bus(void);
+int test_aufilt_fmt(void);
+int test_aufmt_convert(void);
+int test_aupoly(void);
+int test_aupoly_stream(void);
+int test_aurecv_receive(void);
+int test_aurecv_threads(void);
 int test_aulevel(void);
+int test_bwe(void);
 int test_call_answer(void);
 int test_call_answer_hangup_a(void);
 int test_call_answer_hangup_b(void);
@@ -219,6 +241,7 @@ int test_call_transfer(void);
 int test_call_transfer_fail(void);
 int test_call_attended_transfer(void);
 int test_call_video(void);
+int test_call_video_pool(void);
 int test_call_change_videodir(void);
 int test_call_webrtc(void);
 int test_call_bundle(void);
@@ -227,6 +250,7 @@ int test_call_100rel_audio(void);
 int test_call_100rel_video(void);
 int test_call_hold_resume(void);
 int test_call_srtp_tx_rekey(void);
+int test_call_txshare(void);
 #ifdef USE_TLS
 int test_call_sni(void);
 #endif
@@ -234,13 +258,23 @@ int test_cmd(void);
 int test_cmd_long(void);
 int test_contact(void);
 int test_event(void);
+int test_fec(void);
 int test_jbuf(void);
 int test_jbuf_adaptive(void);
 int test_jbuf_adaptive_video(void);
+int test_jbuf_clock(void);
+int test_lattrace(void);
 int test_message(void);
+int test_module_lazy(void);
 int test_network(void);
+int test_openmetrics(void);
+int test_openmetrics_scale(void);
 int test_play(void);
+int test_playout(void);
+int test_relay(void);
+int test_simulcast(void);
 int test_stunuri(void);
+int test_txshare(void);
 int test_ua_alloc(void);
 int test_ua_options(void);
 int test_ua_refer(void);
@@ -249,6 +283,8 @@ int test_ua_register_auth(void);
 int test_ua_register_auth_dns(void);
 int test_ua_register_dns(void);
 int test_uag_find_param(void);
+int test_viddiff(void);
 int test_video(void);
+int test_vidjbuf(void);
 int test_clean_number(void);
 int test_clean_number_only_numeric(void);
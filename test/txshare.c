@@ -0,0 +1,100 @@
+/**
+ * @file test/txshare.c  Shared encoder testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+static void *leader;
+
+
+static void leader_handler(void *leg)
+{
+	leader = leg;
+}
+
+
+int test_txshare(void)
+{
+	struct txshare *sh1 = NULL, *sh2 = NULL, *sh3 = NULL;
+	struct le le1 = LE_INIT, le2 = LE_INIT;
+	struct le le3 = LE_INIT;
+	int leg1, leg2, leg3;
+	int err;
+
+	leader = NULL;
+
+	err = txshare_alloc(&sh1, "video:vp8;;fakevideo,;320x240;500000",
+			    leader_handler);
+	TEST_ERR(err);
+
+	/* same key gives the same shared encoder */
+	err = txshare_alloc(&sh2, "video:vp8;;fakevideo,;320x240;500000",
+			    leader_handler);
+	TEST_ERR(err);
+	ASSERT_TRUE(sh1 == sh2);
+
+	err = txshare_alloc(&sh3, "video:vp8;;fakevideo,;640x480;500000",
+			    leader_handler);
+	TEST_ERR(err);
+	ASSERT_TRUE(sh1 != sh3);
+
+	ASSERT_EQ(EINVAL, txshare_alloc(&sh3, NULL, NULL));
+
+	/* the first leg is the leader */
+	txshare_join(sh1, &le1, &leg1);
+	txshare_join(sh2, &le2, &leg2);
+	ASSERT_TRUE(txshare_leader(sh1, &leg1));
+	ASSERT_TRUE(!txshare_leader(sh1, &leg2));
+
+	/* keyframe requests are coalesced */
+	txshare_picup_req(sh1);
+	txshare_picup_req(sh2);
+
+	txshare_lock(sh1);
+	ASSERT_EQ(2, list_count(txshare_legl(sh1)));
+	ASSERT_TRUE(txshare_picup(sh1, 1000));
+	ASSERT_TRUE(!txshare_picup(sh1, 1000));
+	txshare_unlock(sh1);
+
+	/* within the minimum interval the request is kept pending */
+	txshare_picup_req(sh2);
+
+	txshare_lock(sh1);
+	ASSERT_TRUE(!txshare_picup(sh1, 1100));
+	ASSERT_TRUE(txshare_picup(sh1, 1200));
+	txshare_unlock(sh1);
+
+	/* a follower leaving does not change the leader */
+	txshare_join(sh1, &le3, &leg3);
+	txshare_leave(sh1, &le3);
+	ASSERT_TRUE(leader == NULL);
+	ASSERT_TRUE(txshare_leader(sh1, &leg1));
+
+	/* the next leg takes over, starting with a keyframe */
+	txshare_leave(sh1, &le1);
+	ASSERT_TRUE(leader == &leg2);
+	ASSERT_TRUE(txshare_leader(sh2, &leg2));
+
+	txshare_lock(sh2);
+	ASSERT_EQ(1, list_count(txshare_legl(sh2)));
+	ASSERT_TRUE(txshare_picup(sh2, 2000));
+	txshare_unlock(sh2);
+
+	/* the last leg leaves without a new leader */
+	leader = NULL;
+	txshare_leave(sh2, &le2);
+	ASSERT_TRUE(leader == NULL);
+	ASSERT_TRUE(!txshare_leader(sh2, &leg2));
+
+ out:
+	mem_deref(sh3);
+	mem_deref(sh2);
+	mem_deref(sh1);
+
+	return err;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file test/viddiff.c  Video frame difference testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+static void fill_block(struct vidframe *frame, unsigned bx, unsigned by,
+		       uint8_t val)
+{
+	for (unsigned y = 0; y < VIDDIFF_BLOCK; y++) {
+
+		uint8_t *p = frame->data[0] +
+			(by * VIDDIFF_BLOCK + y) * frame->linesize[0] +
+			bx * VIDDIFF_BLOCK;
+
+		memset(p, val, VIDDIFF_BLOCK);
+	}
+}
+
+
+int test_viddiff(void)
+{
+	struct vidsz sz = {64, 48};
+	struct vidframe *frame = NULL, *rgb = NULL;
+	struct viddiff *vd = NULL;
+	struct vidactmap map;
+	int err;
+
+	err  = viddiff_alloc(&vd);
+	err |= vidframe_alloc(&frame, VID_FMT_YUV420P, &sz);
+	err |= vidframe_alloc(&rgb, VID_FMT_RGB32, &sz);
+	TEST_ERR(err);
+
+	vidframe_fill_color(frame, 0x40, 0x40, 0x40);
+
+	/* the first frame is a full frame */
+	err = viddiff_update(vd, frame, false);
+	TEST_ERR(err);
+	ASSERT_EQ(12, viddiff_changed(vd));
+
+	viddiff_actmap(vd, &map);
+	ASSERT_EQ(4, map.cols);
+	ASSERT_EQ(3, map.rows);
+	ASSERT_TRUE(map.map == NULL);
+
+	/* static frame */
+	err = viddiff_update(vd, frame, false);
+	TEST_ERR(err);
+	ASSERT_EQ(0, viddiff_changed(vd));
+
+	/* noise below the threshold */
+	for (unsigned i = 0; i < frame->linesize[0] * sz.h; i++)
+		++frame->data[0][i];
+
+	err = viddiff_update(vd, frame, false);
+	TEST_ERR(err);
+	ASSERT_EQ(0, viddiff_changed(vd));
+
+	/* one changed block */
+	fill_block(frame, 1, 1, 0xc0);
+
+	err = viddiff_update(vd, frame, false);
+	TEST_ERR(err);
+	ASSERT_EQ(1, viddiff_changed(vd));
+
+	viddiff_actmap(vd, &map);
+	ASSERT_TRUE(map.map != NULL);
+	ASSERT_EQ(0, map.map[0]);
+	ASSERT_EQ(1, map.map[1 * map.cols + 1]);
+
+	/* the changed block is the new reference */
+	err = viddiff_update(vd, frame, false);
+	TEST_ERR(err);
+	ASSERT_EQ(0, viddiff_changed(vd));
+
+	err = viddiff_update(vd, frame, true);
+	TEST_ERR(err);
+	ASSERT_EQ(12, viddiff_changed(vd));
+
+	viddiff_reset(vd);
+	err = viddiff_update(vd, frame, false);
+	TEST_ERR(err);
+	ASSERT_EQ(12, viddiff_changed(vd));
+
+	ASSERT_EQ(ENOTSUP, viddiff_update(vd, rgb, false));
+
+ out:
+	mem_deref(rgb);
+	mem_deref(frame);
+	mem_deref(vd);
+
+	return err;
+}
@@ -4,7 +4,9 @@
  * Copyright (C) 2010 - 2017 Alfred E. Heggestad
  */
 
+#include <string.h>
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 #include "test.h"
 
@@ -14,6 +16,83 @@
 #include <re_dbg.h>
 
 
+static int fake_download(struct vidframe *dst, const struct vidframe_hw *hw)
+{
+	const uint8_t *luma = hw->surface;
+
+	dst->data[0][0] = *luma;
+
+	return 0;
+}
+
+
+static int test_video_hw_download(void)
+{
+	struct vidframe *frame = NULL;
+	struct vidframe_hw hw;
+	uint8_t surface = 0x42;
+	int err;
+
+	memset(&hw, 0, sizeof(hw));
+	hw.size.w = 4;
+	hw.size.h = 2;
+	hw.fmt    = VID_FMT_YUV420P;
+
+	ASSERT_EQ(EINVAL, vidframe_hw_download(&frame, &hw));
+
+	hw.surface   = &surface;
+	hw.downloadh = fake_download;
+
+	err = vidframe_hw_download(&frame, &hw);
+	TEST_ERR(err);
+
+	ASSERT_EQ(VID_FMT_YUV420P, frame->fmt);
+	ASSERT_EQ(4, frame->size.w);
+	ASSERT_EQ(2, frame->size.h);
+	ASSERT_EQ(0x42, frame->data[0][0]);
+
+ out:
+	mem_deref(frame);
+
+	return err;
+}
+
+
+static int test_video_enc_threads(void)
+{
+	struct config *cfg = conf_config();
+	const uint32_t budget = cfg->video.enc_threads;
+	unsigned a, b = 0;
+	int err = 0;
+
+	cfg->video.enc_threads = 4;
+
+	a = videnc_threads_alloc(3);
+	ASSERT_EQ(3, a);
+
+	/* the budget is used up, but an encoder gets one thread */
+	b = videnc_threads_alloc(3);
+	ASSERT_EQ(1, b);
+
+	videnc_threads_free(b);
+	b = videnc_threads_alloc(3);
+	ASSERT_EQ(1, b);
+
+	videnc_threads_free(a);
+	a = 0;
+	videnc_threads_free(b);
+	b = videnc_threads_alloc(3);
+	ASSERT_EQ(3, b);
+
+ out:
+	videnc_threads_free(a);
+	videnc_threads_free(b);
+	cfg->video.enc_threads = budget;
+
+	return err;
+}
+
+
 int test_video(void)
 {
 	int err = 0;
@@ -28,6 +107,12 @@ int test_video(void)
 	ASSERT_EQ(1000000,    video_calc_timebase_timestamp(90000));
 	ASSERT_EQ(1000000000, video_calc_timebase_timestamp(90000000));
 
+	err = test_video_hw_download();
+	TEST_ERR(err);
+
+	err = test_video_enc_threads();
+	TEST_ERR(err);
+
  out:
 	return err;
 }
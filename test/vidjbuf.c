@@ -0,0 +1,180 @@
+/**
+ * @file test/vidjbuf.c  Video jitter buffer testcode
+ *
+ * Copyright (C) 2023 Alfred E. Heggestad, Christian Spielberger
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "../src/core.h"
+#include "test.h"
+
+
+struct nack_test {
+	unsigned n;
+	uint16_t pid;
+	uint16_t blp;
+};
+
+
+static void nack_handler(uint16_t pid, uint16_t blp, void *arg)
+{
+	struct nack_test *nt = arg;
+
+	++nt->n;
+	nt->pid = pid;
+	nt->blp = blp;
+}
+
+
+static int put(struct vidjbuf *vjb, struct mbuf *mb, uint16_t seq,
+	       uint32_t ts, bool marker)
+{
+	struct rtp_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ssrc = 0x1234;
+	hdr.seq  = seq;
+	hdr.ts   = ts;
+	hdr.m    = marker;
+
+	return vidjbuf_put(vjb, &hdr, mb);
+}
+
+
+static int get(struct vidjbuf *vjb, uint16_t *seqp, bool *lostp)
+{
+	struct rtp_header hdr;
+	struct mbuf *mb = NULL;
+	int err;
+
+	err = vidjbuf_get(vjb, &hdr, &mb, lostp);
+	if (err)
+		return err;
+
+	*seqp = hdr.seq;
+	mem_deref(mb);
+
+	return 0;
+}
+
+
+int test_vidjbuf(void)
+{
+	struct nack_test nt = {0, 0, 0};
+	struct vidjbuf_stat stat;
+	struct vidjbuf *vjb = NULL;
+	struct mbuf *mb;
+	uint16_t seq;
+	bool lost;
+	int err;
+
+	mb = mbuf_alloc(8);
+	if (!mb)
+		return ENOMEM;
+
+	err = mbuf_write_u32(mb, 0);
+	TEST_ERR(err);
+	mb->pos = 0;
+
+	err = vidjbuf_alloc(&vjb, 2, nack_handler, &nt);
+	TEST_ERR(err);
+
+	/* Empty */
+	err = get(vjb, &seq, &lost);
+	ASSERT_EQ(ENOENT, err);
+
+	/* First frame with a reordered start, held until a packet of the
+	 * next frame arrives */
+	err = put(vjb, mb, 2, 1000, false);
+	TEST_ERR(err);
+	err = put(vjb, mb, 3, 1000, true);
+	TEST_ERR(err);
+	err = put(vjb, mb, 3, 1000, true);
+	ASSERT_EQ(EALREADY, err);
+	err = get(vjb, &seq, &lost);
+	ASSERT_EQ(ENOENT, err);
+
+	err = put(vjb, mb, 1, 1000, false);
+	TEST_ERR(err);
+	err = get(vjb, &seq, &lost);
+	ASSERT_EQ(ENOENT, err);
+
+	err = put(vjb, mb, 4, 2000, false);
+	TEST_ERR(err);
+
+	for (uint16_t i = 1; i <= 3; i++) {
+		err = get(vjb, &seq, &lost);
+		TEST_ERR(err);
+		ASSERT_EQ(i, seq);
+		ASSERT_TRUE(!lost);
+	}
+	err = get(vjb, &seq, &lost);
+	ASSERT_EQ(ENOENT, err);
+	ASSERT_EQ(0, nt.n);
+
+	/* Missing packet is NACKed and recovered */
+	err = put(vjb, mb, 6, 2000, true);
+	TEST_ERR(err);
+	ASSERT_EQ(1, nt.n);
+	ASSERT_EQ(5, nt.pid);
+	ASSERT_EQ(0, nt.blp);
+	err = get(vjb, &seq, &lost);
+	ASSERT_EQ(ENOENT, err);
+
+	err = put(vjb, mb, 5, 2000, false);
+	TEST_ERR(err);
+
+	for (uint16_t i = 4; i <= 6; i++) {
+		err = get(vjb, &seq, &lost);
+		TEST_ERR(err);
+		ASSERT_EQ(i, seq);
+		ASSERT_TRUE(!lost);
+	}
+
+	/* Incomplete frame is given up after max_frames complete frames */
+	err = put(vjb, mb, 7, 3000, false);
+	TEST_ERR(err);
+	err = put(vjb, mb, 9, 3000, true);
+	TEST_ERR(err);
+	err = put(vjb, mb, 10, 4000, false);
+	TEST_ERR(err);
+	err = put(vjb, mb, 11, 4000, true);
+	TEST_ERR(err);
+	ASSERT_EQ(2, nt.n);
+	ASSERT_EQ(8, nt.pid);
+	err = get(vjb, &seq, &lost);
+	ASSERT_EQ(ENOENT, err);
+
+	err = put(vjb, mb, 12, 5000, true);
+	TEST_ERR(err);
+
+	err = get(vjb, &seq, &lost);
+	TEST_ERR(err);
+	ASSERT_EQ(10, seq);
+	ASSERT_TRUE(lost);
+
+	for (uint16_t i = 11; i <= 12; i++) {
+		err = get(vjb, &seq, &lost);
+		TEST_ERR(err);
+		ASSERT_EQ(i, seq);
+		ASSERT_TRUE(!lost);
+	}
+
+	/* Too late */
+	err = put(vjb, mb, 8, 3000, false);
+	ASSERT_EQ(ETIMEDOUT, err);
+
+	err = vidjbuf_stats(vjb, &stat);
+	TEST_ERR(err);
+	ASSERT_EQ(4, stat.n_frames);
+	ASSERT_EQ(1, stat.n_skipped);
+	ASSERT_EQ(1, stat.n_recovered);
+	ASSERT_EQ(1, stat.n_late);
+	ASSERT_EQ(1, stat.n_dups);
+
+ out:
+	mem_deref(vjb);
+	mem_deref(mb);
+	return err;
+}
@@ -0,0 +1,52 @@
+#!/usr/bin/gnuplot
+#
+# Use generate_plot.sh!
+#
+# Description of the plot
+# =======================
+# The plot is a time based diagram of the send-side bandwidth estimation.
+#
+# Upper plot:
+# - delay based estimate
+# - loss based estimate
+# - acknowledged bitrate
+# - target bitrate (minimum of delay and loss based estimate)
+#
+# Lower plot:
+# - modified trend of the delay variation
+# - adaptive threshold
+# - detected usage (0=normal, 1=overuse, 2=underuse)
+
+
+# Choose your preferred gnuplot terminal or use e.g. evince to view the
+# bwe.eps!
+
+#set terminal qt persist
+set terminal postscript eps size 15,10 enhanced color
+set output 'bwe.eps'
+#set terminal png size 1280,960
+#set output 'bwe.png'
+set datafile separator ","
+set key outside
+set xlabel "time/[ms]"
+
+set multiplot layout 2,1
+
+set ylabel "bitrate/[kbit/s]"
+plot \
+'bwe.dat' using 3:4 title 'delay' with lines lc "orange", \
+'bwe.dat' using 3:5 title 'loss' with lines lc "sea-green", \
+'bwe.dat' using 3:6 title 'acked' with lines lc "skyblue", \
+'bwe.dat' using 3:7 title 'target' with lines lw 2 lc "#FF0000"
+
+set ylabel "trend/threshold"
+set y2label "usage"
+set y2range [0:3]
+set y2tics 1
+plot \
+'bwe.dat' using 3:8 title 'trend' with lines lc "orange", \
+'bwe.dat' using 3:9 title 'threshold' with lines lc "sea-green", \
+'bwe.dat' using 3:(-$9) notitle with lines lc "sea-green", \
+'bwe.dat' using 3:10 axes x1y2 title 'usage' with steps lc "#A5A5A5"
+
+unset multiplot
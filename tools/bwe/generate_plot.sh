@@ -0,0 +1,21 @@
+#!/bin/bash
+
+if ! which jq; then
+    echo "Install jq"
+    exit 1
+fi
+
+if ! which gnuplot; then
+    echo "Install gnuplot"
+    exit 1
+fi
+
+if [ ! -f re_trace.json ]; then
+    echo "re_trace.json does not exist"
+    exit 1
+fi
+
+jqc='.traceEvents[] | select (.cat == "bwe" and .ph == "P") | .args.line'
+cat re_trace.json | jq -r "${jqc}" > bwe.dat
+
+./bwe.plot
@@ -0,0 +1,17 @@
+#!/bin/bash
+
+function enable_ratelimit() {
+    netif=$1
+    rate=$2
+    echo "ENABLE RATELIMIT $rate ..."
+    sudo tc qdisc add dev $netif root handle 1: tbf rate $rate burst 16kbit \
+        latency 400ms
+    sudo tc qdisc add dev $netif parent 1:1 handle 10: netem delay 20ms
+}
+
+
+function disable_ratelimit() {
+    netif=$1
+    echo "DISABLE RATELIMIT ..."
+    sudo tc qdisc del dev $netif root
+}
@@ -0,0 +1,36 @@
+#!/bin/bash
+
+if [ ! -f .env ]; then
+    echo ".env is missing. Copy and edit env-template!"
+    exit 1
+fi
+
+export `cat .env`
+
+echo "target: $target"
+echo "netif:  $netif"
+echo "rate:   $rate"
+
+source ./ratelimit.sh
+
+trap "disable_ratelimit $netif; killall -q baresip" EXIT
+
+baresip -v -f . > /tmp/bwe.log 2>&1 &
+sleep 1
+echo "/dial $target" | nc -N localhost 5555
+
+sleep 20
+
+enable_ratelimit $netif $rate
+
+sleep 30
+
+disable_ratelimit $netif
+
+sleep 30
+
+echo "/quit" | nc -N localhost 5555
+
+sleep 1
+
+./generate_plot.sh